@@ -40,11 +40,18 @@ AudioConversion::AudioConversion() :
     _convOutBufferIndex(0),
     _convOutFrames(0),
     _convOutBufferSizeInFrames(0),
-    _convOutBuffer(NULL)
+    _convOutBuffer(NULL),
+    _convOutBufferOwned(true),
+    _workingBufferFrames(0)
 {
     _audioConverter[ChannelCountSampleSpecItem] = new AudioRemapper(ChannelCountSampleSpecItem);
     _audioConverter[FormatSampleSpecItem] = new AudioReformatter(FormatSampleSpecItem);
     _audioConverter[RateSampleSpecItem] = new AudioResampler(RateSampleSpecItem);
+
+    for (uint32_t i = 0; i < NB_WORKING_BUFFERS; i++) {
+
+        _workingBuffers[i] = NULL;
+    }
 }
 
 AudioConversion::~AudioConversion()
@@ -55,7 +62,10 @@ AudioConversion::~AudioConversion()
         _audioConverter[i] = NULL;
     }
 
-    free(_convOutBuffer);
+    if (_convOutBufferOwned) {
+
+        free(_convOutBuffer);
+    }
     _convOutBuffer = NULL;
 }
 
@@ -65,9 +75,18 @@ status_t AudioConversion::configure(const SampleSpec &ssSrc, const SampleSpec &s
 
     emptyConversionChain();
 
-    free(_convOutBuffer);
+    if (_convOutBufferOwned) {
+
+        free(_convOutBuffer);
+    }
 
     _convOutBuffer = NULL;
+    _convOutBufferOwned = true;
+    for (uint32_t i = 0; i < NB_WORKING_BUFFERS; i++) {
+
+        _workingBuffers[i] = NULL;
+    }
+    _workingBufferFrames = 0;
     _convOutBufferIndex = 0;
     _convOutFrames = 0;
     _convOutBufferSizeInFrames = 0;
@@ -118,8 +137,19 @@ status_t AudioConversion::getConvertedBuffer(void *dst,
     if (_convOutBufferSizeInFrames < outFrames) {
 
         _convOutBufferSizeInFrames = outFrames + (MAX_RATE / MIN_RATE) * 2;
-        _convOutBuffer = static_cast<int16_t *>(realloc(_convOutBuffer,
-                                _ssDst.convertFramesToBytes(_convOutBufferSizeInFrames)));
+        if (_convOutBufferOwned) {
+
+            _convOutBuffer = static_cast<int16_t *>(realloc(_convOutBuffer,
+                                    _ssDst.convertFramesToBytes(_convOutBufferSizeInFrames)));
+        } else {
+
+            // Working buffer is too small, keep the pending frames in memory of our own
+            int16_t *convOutBuffer = static_cast<int16_t *>(malloc(
+                                    _ssDst.convertFramesToBytes(_convOutBufferSizeInFrames)));
+            memcpy(convOutBuffer, _convOutBuffer, _ssDst.convertFramesToBytes(_convOutFrames));
+            _convOutBuffer = convOutBuffer;
+            _convOutBufferOwned = true;
+        }
     }
 
     size_t framesRequested = outFrames;
@@ -234,6 +264,10 @@ status_t AudioConversion::convert(const void *src,
         return NO_ERROR;
     }
 
+    // Working buffers are sized for the intermediate sample specifications of the chain
+    bool useWorkingBuffers = (_workingBuffers[0] != NULL) && (inFrames <= _workingBufferFrames);
+    uint32_t workingBufferIndex = 1;
+
     AudioConverterListIterator it;
     for (it = _activeAudioConvList.begin(); it != _activeAudioConvList.end(); ++it) {
 
@@ -241,10 +275,15 @@ status_t AudioConversion::convert(const void *src,
         dstBuf = NULL;
         dstFrames = 0;
 
-        if (*dst && (pConv == _activeAudioConvList.back())) {
+        if (pConv == _activeAudioConvList.back()) {
 
             // Last converter must output within the provided buffer (if provided!!!)
-            dstBuf = *dst;
+            dstBuf = *dst != NULL ? *dst : (useWorkingBuffers ? _workingBuffers[0] : NULL);
+        } else if (useWorkingBuffers) {
+
+            // Converters work from one intermediate buffer to the other
+            dstBuf = _workingBuffers[workingBufferIndex];
+            workingBufferIndex = 3 - workingBufferIndex;
         }
         status = pConv->convert(srcBuf, &dstBuf, srcFrames, &dstFrames);
         if (status != NO_ERROR) {
@@ -260,6 +299,51 @@ status_t AudioConversion::convert(const void *src,
     return status;
 }
 
+size_t AudioConversion::getWorkingBufferSize(size_t frames) const
+{
+    // Intermediate sample specifications take each item either from the source or from the
+    // destination sample specification: bound them with the largest of both.
+    size_t dstFrames = AudioUtils::convertSrcToDstInFrames(frames, _ssSrc, _ssDst) +
+            (MAX_RATE / MIN_RATE) * 2;
+    size_t maxFrames = max(frames, dstFrames) + 1;
+    size_t maxChannels = max(_ssSrc.getChannelCount(), _ssDst.getChannelCount());
+    size_t maxSampleSize = max(audio_bytes_per_sample(_ssSrc.getFormat()),
+                               audio_bytes_per_sample(_ssDst.getFormat()));
+
+    return maxFrames * maxChannels * maxSampleSize;
+}
+
+void AudioConversion::setWorkingBuffers(void *const buffers[], size_t frames)
+{
+    LOG_ALWAYS_FATAL_IF(buffers == NULL);
+
+    for (uint32_t i = 0; i < NB_WORKING_BUFFERS; i++) {
+
+        LOG_ALWAYS_FATAL_IF(buffers[i] == NULL);
+        _workingBuffers[i] = buffers[i];
+    }
+    _workingBufferFrames = frames;
+
+    // Converted buffer is the first working buffer, pending frames are kept
+    size_t workingBufferSizeInFrames = _ssDst.convertBytesToFrames(getWorkingBufferSize(frames));
+    if (_convOutFrames > workingBufferSizeInFrames) {
+
+        LOGW("%s: %d pending frames, keeping the converted buffer", __FUNCTION__, _convOutFrames);
+        return;
+    }
+    if (_convOutBuffer != NULL) {
+
+        memcpy(_workingBuffers[0], _convOutBuffer, _ssDst.convertFramesToBytes(_convOutFrames));
+    }
+    if (_convOutBufferOwned) {
+
+        free(_convOutBuffer);
+    }
+    _convOutBuffer = static_cast<int16_t *>(_workingBuffers[0]);
+    _convOutBufferOwned = false;
+    _convOutBufferSizeInFrames = workingBufferSizeInFrames;
+}
+
 void AudioConversion::emptyConversionChain()
 {
     _activeAudioConvList.clear();
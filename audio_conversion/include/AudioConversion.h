@@ -93,6 +93,32 @@ public:
                                          const uint32_t outFrames,
                                          android::AudioBufferProvider *bufferProvider);
 
+    /**
+     * Get the size of each of the working buffers needed by the conversion chain.
+     * Must be called once the conversion chain is configured.
+     *
+     * @param[in] frames maximum number of frames in the source sample specification converted
+     *                   at once.
+     *
+     * @return size of a working buffer, in bytes.
+     */
+    size_t getWorkingBufferSize(size_t frames) const;
+
+    /**
+     * Provides the memory of the conversion chain, so that converting does not allocate.
+     * The buffers are owned by the caller and must remain valid until next configure call.
+     * Conversions of more frames than the buffers were sized for fall back on memory allocated
+     * by the conversion chain itself.
+     *
+     * @param[in] buffers NB_WORKING_BUFFERS buffers of getWorkingBufferSize(frames) bytes each.
+     * @param[in] frames maximum number of frames in the source sample specification the buffers
+     *                   were sized for.
+     */
+    void setWorkingBuffers(void *const buffers[], size_t frames);
+
+    /** Working buffers: the converted buffer, then two buffers between the converters. */
+    static const uint32_t NB_WORKING_BUFFERS = 3;
+
 private:
     AudioConversion(const AudioConversion &);
     AudioConversion &operator = (const AudioConversion &);
@@ -210,6 +236,13 @@ private:
     size_t _convOutFrames; /**< Number of converted Frames. */
     size_t _convOutBufferSizeInFrames; /**< Converted buffer size in Frames. */
     int16_t *_convOutBuffer; /**< Converted buffer. */
+    bool _convOutBufferOwned; /**< false if the converted buffer is a working buffer. */
+
+    /**
+     * Working buffers provided by the client, NULL if none.
+     */
+    void *_workingBuffers[NB_WORKING_BUFFERS];
+    size_t _workingBufferFrames; /**< in source sample specification. */
 
     /**
      * Buffer is acquired from the provider into ConvInBuffer.
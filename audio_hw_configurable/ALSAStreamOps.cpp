@@ -41,6 +41,7 @@
 #include "ALSAStreamOps.h"
 #include "AudioStreamRoute.h"
 #include <AudioConversion.h>
+#include "AudioVirtualClock.h"
 #include "AudioHardwareALSA.h"
 #include <AudioCommsAssert.hpp>
 #include "Property.h"
@@ -58,6 +59,10 @@ const uint32_t ALSAStreamOps::STR_FORMAT_LENGTH = 32;
 
 const uint32_t ALSAStreamOps::MAX_DEBUG_STREAM_SIZE = 998;
 
+const char* const ALSAStreamOps::LOCK_STREAM_MEMORY_PROP_NAME = "audiocomms.HAL.LockStreamMemory";
+
+const char* const ALSAStreamOps::STANDBY_DELAY_PROP_NAME = "audiocomms.HAL.OutputStandbyDelayMs";
+
 /**
  * Audio dump properties management (set with setprop)
  */
@@ -83,7 +88,12 @@ ALSAStreamOps::ALSAStreamOps(AudioHardwareALSA *parent, const char* pcLockTag) :
     mLatencyUs(0),
     mPowerLock(false),
     mPowerLockTag(pcLockTag),
-    mAudioConversion(new AudioConversion)
+    mAudioConversion(new AudioConversion),
+    mVirtualClock(new AudioVirtualClock),
+    mLockMemory(TProperty<bool>(LOCK_STREAM_MEMORY_PROP_NAME, false)),
+    mStandbyDelayMs(TProperty<int32_t>(STANDBY_DELAY_PROP_NAME, 0)),
+    mStandbyPending(false),
+    mStandbyDeadline(0)
 {
     mSampleSpec.setChannelCount(AudioHardwareALSA::DEFAULT_CHANNEL_COUNT);
     mSampleSpec.setSampleRate(AudioHardwareALSA::DEFAULT_SAMPLE_RATE);
@@ -94,6 +104,7 @@ ALSAStreamOps::~ALSAStreamOps()
 {
     AUDIOCOMMS_ASSERT(!isStarted(), "stream deleted while still active");
 
+    delete mVirtualClock;
     delete mAudioConversion;
     delete dumpAfterConv;
     delete dumpBeforeConv;
@@ -226,7 +237,11 @@ String8 ALSAStreamOps::getParameters(const String8& keys)
 
 size_t ALSAStreamOps::getBufferSize(uint32_t flags) const
 {
-    pcm_config pcmConf = mParent->getDefaultPcmConfig(isOut(), flags);
+    return getBufferSize(mParent->getDefaultPcmConfig(isOut(), flags));
+}
+
+size_t ALSAStreamOps::getBufferSize(const pcm_config &pcmConf) const
+{
     /**
      * Pcm config might not be in the same sample specification of the stream. So, need first
      * translate it into time domain, before switch back to frames and bytes.
@@ -249,7 +264,11 @@ uint32_t ALSAStreamOps::latency() const
 
 void ALSAStreamOps::updateLatency(uint32_t uiFlags)
 {
-    pcm_config pcmConf = mParent->getDefaultPcmConfig(isOut(), uiFlags);
+    updateLatency(mParent->getDefaultPcmConfig(isOut(), uiFlags));
+}
+
+void ALSAStreamOps::updateLatency(const pcm_config &pcmConf)
+{
     uint64_t latency = (uint64_t)AudioUtils::USEC_TO_SEC * pcmConf.period_count *
                                             pcmConf.period_size  / pcmConf.rate;
     LOG_ALWAYS_FATAL_IF(latency > numeric_limits<uint32_t>::max());
@@ -258,15 +277,92 @@ void ALSAStreamOps::updateLatency(uint32_t uiFlags)
 
 status_t ALSAStreamOps::setStandby(bool isSet)
 {
+    if (!isSet && resumeFromDelayedStandby()) {
+
+        // Restarted within the grace period: route and device are still held
+        mParent->resumeStream(this);
+        return OK;
+    }
     if (isStarted() == !isSet) {
 
         return OK;
     }
+    if (isSet && delayStandby()) {
+
+        mParent->delayStandby(this);
+        return OK;
+    }
     setStarted(!isSet);
 
     return isSet ? mParent->stopStream(this) : mParent->startStream(this);
 }
 
+bool ALSAStreamOps::delayStandby()
+{
+    if ((mStandbyDelayMs == 0) || !isOut()) {
+
+        return false;
+    }
+    AutoW lock(_streamLock);
+
+    // Only worth it if the stream holds a device that no other stream feeds
+    if (!isRouteAvailableL() || getCurrentRouteL()->isShared(isOut())) {
+
+        return false;
+    }
+    if (mStandbyPending) {
+
+        // Keep the first deadline
+        return true;
+    }
+    // Stop the device rather than let it underrun until the stream restarts
+    getCurrentRouteL()->flushPlayback(this);
+
+    mStandbyPending = true;
+    mStandbyDeadline = systemTime() + ms2ns(mStandbyDelayMs);
+    return true;
+}
+
+bool ALSAStreamOps::resumeFromDelayedStandby()
+{
+    AutoW lock(_streamLock);
+
+    if (!mStandbyPending) {
+
+        return false;
+    }
+    mStandbyPending = false;
+
+    // Route may have been lost within the grace period, the stream is still started anyway:
+    // like any started stream, it will be routed again on next routing.
+    return true;
+}
+
+bool ALSAStreamOps::applyDelayedStandby(nsecs_t now, nsecs_t &deadline)
+{
+    deadline = 0;
+    {
+        AutoW lock(_streamLock);
+
+        if (!mStandbyPending) {
+
+            return false;
+        }
+        if (now < mStandbyDeadline) {
+
+            deadline = mStandbyDeadline;
+            return false;
+        }
+        // Stopped in the same critical section: a restart seeing the standby no longer pending
+        // must see the stream stopped, and start it again
+        mStandbyPending = false;
+        mStandby = true;
+    }
+    initAudioDump();
+
+    return true;
+}
+
 bool ALSAStreamOps::isRouteAvailable() const
 {
     AutoR lock(_streamLock);
@@ -306,6 +402,21 @@ status_t ALSAStreamOps::attachRouteL()
         return err;
     }
 
+    // Stream buffers are carved from the arena, sized for the longest period the stream may
+    // be routed with, so that routing the stream again does not allocate.
+    uint32_t periodUs = mParent->getMaxPeriodUs(isOut(), getApplicabilityMaskL());
+    err = mArena.reserve(getArenaSizeL(periodUs), mLockMemory);
+    if (err != NO_ERROR) {
+
+        return err;
+    }
+    err = allocateArenaBuffersL(periodUs);
+    if (err != NO_ERROR) {
+
+        ALOGE("%s: could not allocate stream buffers (err=%d)", __FUNCTION__, err);
+        return err;
+    }
+
     // Open successful - Update current route
     mCurrentRoute = mNewRoute;
     mCurrentDevices = mNewDevices;
@@ -336,6 +447,48 @@ status_t ALSAStreamOps::configureAudioConversion(const SampleSpec &ssSrc, const
     return mAudioConversion->configure(ssSrc, ssDst);
 }
 
+size_t ALSAStreamOps::getConversionFramesL(uint32_t periodUs) const
+{
+    if (mSampleSpec == mHwSampleSpec) {
+
+        // No conversion chain, no conversion buffer
+        return 0;
+    }
+    return isOut() ? mSampleSpec.convertUsecToframes(periodUs) :
+                     mHwSampleSpec.convertUsecToframes(periodUs);
+}
+
+size_t ALSAStreamOps::getArenaSizeL(uint32_t periodUs) const
+{
+    size_t frames = getConversionFramesL(periodUs);
+    if (frames == 0) {
+
+        return 0;
+    }
+    return AudioConversion::NB_WORKING_BUFFERS *
+            AudioArena::getAlignedSize(mAudioConversion->getWorkingBufferSize(frames));
+}
+
+status_t ALSAStreamOps::allocateArenaBuffersL(uint32_t periodUs)
+{
+    size_t frames = getConversionFramesL(periodUs);
+    if (frames == 0) {
+
+        return NO_ERROR;
+    }
+    void* workingBuffers[AudioConversion::NB_WORKING_BUFFERS];
+    for (uint32_t i = 0; i < AudioConversion::NB_WORKING_BUFFERS; i++) {
+
+        workingBuffers[i] = mArena.allocate(mAudioConversion->getWorkingBufferSize(frames));
+        if (workingBuffers[i] == NULL) {
+
+            return NO_MEMORY;
+        }
+    }
+    mAudioConversion->setWorkingBuffers(workingBuffers, frames);
+    return NO_ERROR;
+}
+
 status_t ALSAStreamOps::getConvertedBuffer(void* dst, const uint32_t outFrames, AudioBufferProvider *pBufferProvider)
 {
     return mAudioConversion->getConvertedBuffer(dst, outFrames, pBufferProvider);
@@ -450,6 +603,16 @@ bool ALSAStreamOps::safeSleep(uint32_t sleepTimeUs)
     return nanosleep(&tim, &tim2) > 0;
 }
 
+void ALSAStreamOps::waitVirtualClock(size_t frames)
+{
+    mVirtualClock->wait(mSampleSpec.convertFramesToUsec(frames));
+}
+
+void ALSAStreamOps::resetVirtualClock()
+{
+    mVirtualClock->reset();
+}
+
 void ALSAStreamOps::printLPEfwDebugInfo() {
 
     ALOGE("^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^");
@@ -18,9 +18,12 @@
 #pragma once
 
 #include <media/AudioBufferProvider.h>
+#include <tinyalsa/asoundlib.h>
 #include <SampleSpec.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 #include "Utils.h"
+#include "AudioArena.h"
 
 /**
  * For debug purposes only, property-driven (dynamic)
@@ -36,6 +39,7 @@ namespace android_audio_legacy
 class AudioHardwareALSA;
 class CAudioStreamRoute;
 class AudioConversion;
+class AudioVirtualClock;
 struct acoustic_device_t;
 struct alsa_handle_t;
 
@@ -61,6 +65,16 @@ public:
      * @return size of a period in bytes.
      */
     size_t              getBufferSize(uint32_t flags = 0) const;
+
+    /**
+     * Get the buffer size matching the period of a pcm configuration, in stream sample
+     * specification.
+     *
+     * @param[in] pcmConf pcm configuration.
+     *
+     * @return size of a period in bytes.
+     */
+    size_t              getBufferSize(const pcm_config &pcmConf) const;
     inline int          format() const { return mSampleSpec.getFormat(); }
     inline uint32_t     channelCount() const { return mSampleSpec.getChannelCount(); }
     inline uint32_t     channels() const { return mSampleSpec.getChannelMask(); }
@@ -93,8 +107,26 @@ public:
 
     android::status_t   setStandby(bool bIsSet);
 
+    /**
+     * Applies the standby of the stream if requested and its grace period is elapsed.
+     * Called from route manager context, which reconsiders the routing if the stream is stopped.
+     *
+     * @param[in] now current time, a time beyond the grace period forces the standby.
+     * @param[out] deadline end of the grace period if still pending, 0 otherwise.
+     *
+     * @return true if the stream has been stopped, false otherwise.
+     */
+    bool                applyDelayedStandby(nsecs_t now, nsecs_t &deadline);
+
     virtual bool        isOut() const = 0;
 
+    /**
+     * Checks if starting the stream waits for its routing.
+     *
+     * @return true if the stream is started without waiting for its route, false otherwise.
+     */
+    virtual bool        isStartAsynchronous() const { return false; }
+
     /**
      * Set the route pointer to the new route.
      * No need to lock, newRoute is for exclusive access for route manager, from atomic context.
@@ -169,6 +201,13 @@ public:
      */
     virtual uint32_t    getApplicabilityMask() const = 0;
 
+    /**
+     * Applicability mask. Must be called with stream lock held.
+     *
+     * @return applicability Mask
+     */
+    virtual uint32_t    getApplicabilityMaskL() const = 0;
+
     /**
      * Get audio dump object before conversion for debug purposes
      *
@@ -206,11 +245,32 @@ protected:
      */
     virtual android::status_t detachRouteL();
 
+    /**
+     * Get the size of the stream buffers carved from the arena.
+     * Must be called with stream lock held, once the conversion chain is configured.
+     *
+     * @param[in] periodUs duration of the longest period of the routes of the stream.
+     *
+     * @return size in bytes, including the alignment of each buffer.
+     */
+    virtual size_t getArenaSizeL(uint32_t periodUs) const;
+
+    /**
+     * Carves the stream buffers from the arena.
+     * Must be called with stream lock held, once the arena is reserved.
+     *
+     * @param[in] periodUs duration of the longest period of the routes of the stream.
+     *
+     * @return OK if success, NO_MEMORY otherwise.
+     */
+    virtual android::status_t allocateArenaBuffersL(uint32_t periodUs);
+
     android::status_t applyAudioConversion(const void* src, void** dst, uint32_t inFrames, uint32_t* outFrames);
     android::status_t getConvertedBuffer(void* dst, const uint32_t outFrames, android::AudioBufferProvider* pBufferProvider);
 
     uint32_t            latency() const;
     void                updateLatency(uint32_t uiFlags = 0);
+    void                updateLatency(const pcm_config &pcmConf);
 
     /**
      * Checks if a stream is fully routed or not.
@@ -246,6 +306,20 @@ protected:
      */
     bool                safeSleep(uint32_t uiSleepTimeUs);
 
+    /**
+     * Paces the stream on its virtual clock when no audio device drives the timeline.
+     * Must be called from stream context, without stream lock held.
+     *
+     * @param[in] frames number of frames (in stream sample specification) to account for.
+     */
+    void                waitVirtualClock(size_t frames);
+
+    /**
+     * Drops the virtual clock timeline, the audio device driving the stream again.
+     * Must be called from stream context.
+     */
+    void                resetVirtualClock();
+
     /**
      * Prints debug information from LPE debug files
      *
@@ -300,7 +374,22 @@ protected:
      */
     mutable android::RWLock _streamLock;
 
+    /**
+     * Memory of the stream buffers (hardware, conversion, processing), allocated once for the
+     * longest period of the routes applicable to the stream.
+     */
+    AudioArena              mArena;
+
 private:
+    /**
+     * Get the number of frames converted at once by the conversion chain.
+     *
+     * @param[in] periodUs duration of the longest period of the routes of the stream.
+     *
+     * @return frames in the source sample specification of the conversion, 0 if no conversion.
+     */
+    size_t getConversionFramesL(uint32_t periodUs) const;
+
     // Configure the audio conversion chain
     android::status_t configureAudioConversion(const SampleSpec &ssSrc, const SampleSpec &ssDst);
 
@@ -323,6 +412,9 @@ private:
     // Audio Conversion utility class
     AudioConversion *mAudioConversion;
 
+    // Virtual clock pacing the stream while no route is available
+    AudioVirtualClock *mVirtualClock;
+
     static const uint32_t STR_FORMAT_LENGTH;
 
     static const uint32_t MAX_DEBUG_STREAM_SIZE;
@@ -339,6 +431,42 @@ private:
     static const std::string dumpAfterConvProps[CUtils::ENbDirections];
     /** maximum sleep time to be allowed by HAL, in microseconds. */
     static const uint32_t MAX_SLEEP_TIME = 1000000UL;
+
+    /** Property locking the stream buffers in memory. */
+    static const char* const LOCK_STREAM_MEMORY_PROP_NAME;
+
+    /** Property giving the standby grace period of output streams, in milliseconds. */
+    static const char* const STANDBY_DELAY_PROP_NAME;
+
+    /**
+     * Requests the standby of an output stream to be applied at the end of the grace period.
+     * The route and the device are kept, the device is stopped meanwhile.
+     *
+     * @return true if the standby is delayed, false if it must be applied now.
+     */
+    bool                delayStandby();
+
+    /**
+     * Cancels a standby still within its grace period.
+     *
+     * @return true if the stream was still holding its route, false otherwise.
+     */
+    bool                resumeFromDelayedStandby();
+
+    /** Stream buffers are locked in memory, so that audio threads do not page fault on them. */
+    bool                    mLockMemory;
+
+    /**
+     * Grace period of output standby, 0 if disabled. Streams restarting within the period
+     * find back their route and device without any routing.
+     */
+    uint32_t                mStandbyDelayMs;
+
+    /** Standby requested and not applied yet, stream is still seen as started meanwhile. */
+    bool                    mStandbyPending;
+    nsecs_t                 mStandbyDeadline;
+
+    friend class CAudioRoutingReplayer;
 };
 
 };        // namespace android
@@ -40,23 +40,40 @@ audio_hw_configurable_src_files :=  \
     audio_hw_hal.cpp \
     AudioHardwareALSA.cpp \
     AudioHardwareInterface.cpp \
+    AudioArena.cpp \
+    AudioRingBuffer.cpp \
     AudioStreamInALSA.cpp \
-    AudioStreamOutALSA.cpp
+    AudioStreamOutALSA.cpp \
+    AudioVirtualClock.cpp
 
 audio_hw_configurable_src_files +=  \
+    audio_route_manager/AudioApplicabilityTables.cpp \
+    audio_route_manager/AudioCaptureFanOut.cpp \
     audio_route_manager/AudioCompressedStreamRoute.cpp \
+    audio_route_manager/AudioEchoReference.cpp \
     audio_route_manager/AudioExternalRoute.cpp \
     audio_route_manager/AudioParameterHandler.cpp \
+    audio_route_manager/AudioPcmPool.cpp \
+    audio_route_manager/AudioPlatformDescription.cpp \
+    audio_route_manager/AudioPlatformHardware.cpp \
     $(AUDIO_PLATHW) \
+    audio_route_manager/AudioPlaybackMixer.cpp \
     audio_route_manager/AudioPlatformState.cpp \
     audio_route_manager/AudioPort.cpp \
     audio_route_manager/AudioPortGroup.cpp \
     audio_route_manager/AudioRoute.cpp \
     audio_route_manager/AudioRouteManager.cpp \
+    audio_route_manager/AudioRoutingRecorder.cpp \
+    audio_route_manager/AudioRoutingTracer.cpp \
+    audio_route_manager/AudioRoutingWorkers.cpp \
     audio_route_manager/AudioStreamRoute.cpp \
     audio_route_manager/VolumeKeys.cpp \
     audio_route_manager/AudioStreamRouteIaSspWorkaround.cpp
 
+# Replays the routing records against the stub backends, not shipped in audio.primary
+audio_hw_configurable_src_files_host := \
+    audio_route_manager/AudioRoutingReplayer.cpp
+
 audio_hw_configurable_includes_dir := \
     $(LOCAL_PATH)/audio_route_manager \
     $(TARGET_OUT_HEADERS)/libaudioresample \
@@ -81,22 +98,36 @@ audio_hw_configurable_includes_dir_target := \
 
 audio_hw_configurable_header_files :=  \
     ALSAStreamOps.h \
+    AudioArena.h \
     AudioDumpInterface.h \
     AudioHardwareALSA.h \
+    AudioRingBuffer.h \
+    AudioSpscQueue.h \
+    audio_route_manager/AudioApplicabilityTables.h \
+    audio_route_manager/AudioCaptureFanOut.h \
     audio_route_manager/AudioCompressedStreamRoute.h \
+    audio_route_manager/AudioEchoReference.h \
     audio_route_manager/AudioExternalRoute.h \
     audio_route_manager/AudioParameterHandler.h \
+    audio_route_manager/AudioPcmPool.h \
+    audio_route_manager/AudioPlatformDescription.h \
     audio_route_manager/AudioPlatformHardware.h \
     audio_route_manager/AudioPlatformState.h \
+    audio_route_manager/AudioPlaybackMixer.h \
     audio_route_manager/AudioPortGroup.h \
     audio_route_manager/AudioPort.h \
     audio_route_manager/AudioRoute.h \
     audio_route_manager/AudioRouteManager.h \
+    audio_route_manager/AudioRoutingRecorder.h \
+    audio_route_manager/AudioRoutingReplayer.h \
+    audio_route_manager/AudioRoutingTracer.h \
+    audio_route_manager/AudioRoutingWorkers.h \
     audio_route_manager/AudioStreamRoute.h \
     audio_route_manager/VolumeKeys.h \
     audio_route_manager/AudioStreamRouteIaSspWorkaround.h \
     AudioStreamInALSA.h \
-    AudioStreamOutALSA.h
+    AudioStreamOutALSA.h \
+    AudioVirtualClock.h
 
 audio_hw_configurable_header_copy_folder_unit_test := \
     audio_hw_configurable_unit_test
@@ -108,7 +139,8 @@ audio_hw_configurable_static_lib += \
     libaudio_comms_utilities
 
 audio_hw_configurable_static_lib_host += \
-    $(foreach lib, $(audio_hw_configurable_static_lib), $(lib)_host)
+    $(foreach lib, $(audio_hw_configurable_static_lib), $(lib)_host) \
+    libtinyalsa_fake_host
 
 audio_hw_configurable_static_lib_target += \
     $(audio_hw_configurable_static_lib) \
@@ -215,7 +247,8 @@ $( \
     $(eval LOCAL_COPY_HEADERS := $(audio_hw_configurable_header_files)) \
     $(eval LOCAL_C_INCLUDES := $(audio_hw_configurable_includes_dir_$(1))) \
     $(eval LOCAL_STATIC_LIBRARIES := $(audio_hw_configurable_static_lib_$(1))) \
-    $(eval LOCAL_SRC_FILES := $(audio_hw_configurable_src_files)) \
+    $(eval LOCAL_SRC_FILES := $(audio_hw_configurable_src_files) \
+                              $(audio_hw_configurable_src_files_$(1))) \
     $(eval LOCAL_CFLAGS := $(audio_hw_configurable_cflags)) \
     $(eval LOCAL_IMPORT_C_INCLUDE_DIRS_FROM_STATIC_LIBRARIES := $(audio_hw_configurable_include_dirs_from_static_libraries_$(1)))
     $(eval LOCAL_MODULE_TAGS := optional) \
@@ -271,6 +304,10 @@ include $(BUILD_STATIC_LIBRARY)
 
 endif #ifeq ($(audiocomms_test_target),true)
 
+#######################################################################
+# Host tests, last as they change LOCAL_PATH
+
+include $(LOCAL_PATH)/test/Android.mk
 
 endif #ifeq ($(BOARD_USES_AUDIO_HAL_CONFIGURABLE),true)
 endif #ifeq ($(BOARD_USES_ALSA_AUDIO),true)
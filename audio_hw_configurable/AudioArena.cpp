@@ -0,0 +1,136 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "AudioArena"
+
+#include "AudioArena.h"
+#include <utils/Log.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using android::status_t;
+using android::OK;
+using android::NO_MEMORY;
+
+namespace android_audio_legacy
+{
+
+AudioArena::AudioArena()
+    : _buffer(NULL),
+      _capacityBytes(0),
+      _usedBytes(0),
+      _isLocked(false),
+      _isLockRequested(false)
+{
+}
+
+AudioArena::~AudioArena()
+{
+    release();
+}
+
+status_t AudioArena::reserve(size_t bytes, bool lockMemory)
+{
+    reset();
+
+    if (bytes <= _capacityBytes) {
+
+        if (lockMemory != _isLockRequested) {
+
+            setLocked(lockMemory);
+        }
+        return OK;
+    }
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t capacityBytes = (bytes > _capacityBytes ? bytes : _capacityBytes);
+    capacityBytes = (capacityBytes + pageSize - 1) & ~(pageSize - 1);
+
+    release();
+
+    void *buffer;
+    if (posix_memalign(&buffer, pageSize, capacityBytes) != 0) {
+
+        ALOGE("%s(bytes=%zu): allocation failed", __FUNCTION__, capacityBytes);
+        return NO_MEMORY;
+    }
+    _buffer = static_cast<char *>(buffer);
+    _capacityBytes = capacityBytes;
+    setLocked(lockMemory);
+
+    ALOGD("%s: %zu bytes%s", __FUNCTION__, _capacityBytes, _isLocked ? ", locked" : "");
+    return OK;
+}
+
+void *AudioArena::allocate(size_t bytes)
+{
+    size_t alignedBytes = getAlignedSize(bytes);
+
+    if (alignedBytes > _capacityBytes - _usedBytes) {
+
+        ALOGE("%s(bytes=%zu): arena exhausted (%zu / %zu bytes used)", __FUNCTION__, bytes,
+              _usedBytes, _capacityBytes);
+        return NULL;
+    }
+    void *buffer = _buffer + _usedBytes;
+    _usedBytes += alignedBytes;
+
+    return buffer;
+}
+
+void AudioArena::setLocked(bool isLocked)
+{
+    _isLockRequested = isLocked;
+
+    if (isLocked == _isLocked) {
+
+        return;
+    }
+    if (!isLocked) {
+
+        munlock(_buffer, _capacityBytes);
+        _isLocked = false;
+        return;
+    }
+    // Touch the pages, then keep them resident
+    memset(_buffer, 0, _capacityBytes);
+    if (mlock(_buffer, _capacityBytes) == 0) {
+
+        _isLocked = true;
+    } else {
+
+        // Not retried before the block grows, as locking the same block would fail again
+        ALOGW("%s: could not lock %zu bytes (%s)", __FUNCTION__, _capacityBytes,
+              strerror(errno));
+    }
+}
+
+void AudioArena::release()
+{
+    if (_isLocked) {
+
+        munlock(_buffer, _capacityBytes);
+        _isLocked = false;
+    }
+    free(_buffer);
+    _buffer = NULL;
+    _capacityBytes = 0;
+    _usedBytes = 0;
+}
+
+}       // namespace android
@@ -0,0 +1,104 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils/Errors.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Single block of memory from which the audio buffers of a stream are carved.
+ *
+ * The block is page aligned and only grows, so that once sized for the largest route of the
+ * stream, routing the stream again does not allocate anymore. Buffers are carved on cache line
+ * boundaries and released all at once. The block may be locked in memory, so that the audio
+ * threads never page fault on it.
+ * Not thread safe: must be used with the stream lock held.
+ */
+class AudioArena
+{
+public:
+    AudioArena();
+    ~AudioArena();
+
+    /**
+     * Ensures the arena can hold a given number of bytes. Buffers carved before are released.
+     * A block large enough is kept, its memory being locked or unlocked in place. A block that
+     * could not be locked is not allocated again until a larger one is required.
+     *
+     * @param[in] bytes capacity required, including the alignment of the buffers.
+     * @param[in] lockMemory true to lock the memory of the arena.
+     *
+     * @return OK if success, NO_MEMORY otherwise.
+     */
+    android::status_t reserve(size_t bytes, bool lockMemory);
+
+    /**
+     * Carves a buffer from the arena.
+     *
+     * @param[in] bytes size of the buffer.
+     *
+     * @return cache line aligned buffer, NULL if the arena is exhausted.
+     */
+    void *allocate(size_t bytes);
+
+    /**
+     * Releases all the buffers carved from the arena.
+     */
+    void reset() { _usedBytes = 0; }
+
+    /**
+     * Get the space a buffer takes in the arena.
+     *
+     * @param[in] bytes size of the buffer.
+     *
+     * @return size of the buffer rounded up to the cache line size.
+     */
+    static size_t getAlignedSize(size_t bytes)
+    {
+        return (bytes + CACHE_LINE_SIZE - 1) & ~static_cast<size_t>(CACHE_LINE_SIZE - 1);
+    }
+
+private:
+    AudioArena(const AudioArena &);
+    AudioArena &operator=(const AudioArena &);
+
+    /**
+     * Locks or unlocks the memory of the block.
+     *
+     * @param[in] isLocked true to lock the memory, false to unlock it.
+     */
+    void setLocked(bool isLocked);
+
+    /**
+     * Frees the block, unlocking it if needed.
+     */
+    void release();
+
+    char *_buffer;
+    size_t _capacityBytes;
+    size_t _usedBytes;
+    bool _isLocked;
+    bool _isLockRequested; /**< last lock state requested, even if locking failed. */
+
+    static const uint32_t CACHE_LINE_SIZE = 64;
+};
+
+};        // namespace android
@@ -245,8 +245,9 @@ size_t AudioHardwareALSA::getInputBufferSize(uint32_t sampleRate, int format, in
     return (sampleRate / 25) * channelCount;
 }
 
-status_t AudioHardwareALSA::dump(int __UNUSED fd, const Vector<String16> __UNUSED &args)
+status_t AudioHardwareALSA::dump(int fd, const Vector<String16> __UNUSED &args)
 {
+    mRouteMgr->dump(fd);
     return NO_ERROR;
 }
 
@@ -277,6 +278,11 @@ const pcm_config& AudioHardwareALSA::getDefaultPcmConfig(bool bIsOut, uint32_t u
     return mRouteMgr->getDefaultPcmConfig(bIsOut, uiFlags);
 }
 
+uint32_t AudioHardwareALSA::getMaxPeriodUs(bool bIsOut, uint32_t uiMask) const
+{
+    return mRouteMgr->getMaxPeriodUs(bIsOut, uiMask);
+}
+
 status_t AudioHardwareALSA::startStream(ALSAStreamOps *stream)
 {
     AUDIOCOMMS_ASSERT(stream != NULL, "requesting to start NULL pointer stream");
@@ -289,16 +295,29 @@ status_t AudioHardwareALSA::stopStream(ALSAStreamOps *stream)
     return mRouteMgr->stopStream(stream);
 }
 
-void AudioHardwareALSA::resetEchoReference(struct echo_reference_itfe* reference)
+void AudioHardwareALSA::delayStandby(ALSAStreamOps *stream)
+{
+    AUDIOCOMMS_ASSERT(stream != NULL, "requesting to delay standby of NULL pointer stream");
+    mRouteMgr->delayStandby(stream);
+}
+
+void AudioHardwareALSA::resumeStream(ALSAStreamOps *stream)
+{
+    AUDIOCOMMS_ASSERT(stream != NULL, "requesting to resume NULL pointer stream");
+    mRouteMgr->resumeStream(stream);
+}
+
+void AudioHardwareALSA::resetEchoReference(CAudioEchoReference* reference, int32_t reader)
 {
-    mRouteMgr->resetEchoReference(reference);
+    mRouteMgr->resetEchoReference(reference, reader);
 }
 
-struct echo_reference_itfe* AudioHardwareALSA::getEchoReference(int format,
-                                                                uint32_t channel_count,
-                                                                uint32_t sampling_rate)
+CAudioEchoReference* AudioHardwareALSA::getEchoReference(int format,
+                                                         uint32_t channel_count,
+                                                         uint32_t sampling_rate,
+                                                         int32_t *reader)
 {
-    return mRouteMgr->getEchoReference(format, channel_count, sampling_rate);
+    return mRouteMgr->getEchoReference(format, channel_count, sampling_rate, reader);
 }
 
 
@@ -41,8 +41,6 @@ class CParameterMgrPlatformConnector;
 class ISelectionCriterionTypeInterface;
 class ISelectionCriterionInterface;
 
-struct echo_reference_itfe;
-
 namespace android_audio_legacy
 {
 
@@ -51,6 +49,7 @@ class AudioHardwareALSA;
 class CAudioRouteManager;
 class CAudioRoute;
 class CAudioStreamRoute;
+class CAudioEchoReference;
 class AudioResampler;
 class AudioConverter;
 class AudioConversion;
@@ -136,6 +135,20 @@ public:
 
     android::status_t stopStream(ALSAStreamOps *stream);
 
+    /**
+     * Informs the route manager that the standby of a stream is delayed by a grace period.
+     *
+     * @param[in] stream stream in standby.
+     */
+    void delayStandby(ALSAStreamOps *stream);
+
+    /**
+     * Informs the route manager that a stream restarted within the grace period of its standby.
+     *
+     * @param[in] stream stream restarted.
+     */
+    void resumeStream(ALSAStreamOps *stream);
+
 protected:
     virtual status_t    dump(int fd, const Vector<String16>& args);
 
@@ -144,37 +157,38 @@ protected:
      * the purpose of this function is
      * - to stop the processing (i.e. writing of playback frames as echo reference for
      * for AEC effect) in AudioSteamOutALSA
-     * - reset locally stored echo reference
+     * - release locally stored echo reference
      *
      * @param[in|out] reference: pointer to echo reference to reset
+     * @param[in] reader: reader of the reference released by the caller
      *
      * @return none
      */
-    void resetEchoReference(struct echo_reference_itfe* reference);
+    void resetEchoReference(CAudioEchoReference* reference, int32_t reader);
 
     /*
      * Echo reference provider.
      * the purpose of this function is
-     * - create echo_reference_itfe using input stream and output stream parameters
-     * - add echo_reference_itfs to AudioSteamOutALSA which will use it for providing
+     * - create echo reference using input stream and output stream parameters
+     * - add echo reference to AudioSteamOutALSA which will use it for providing
      *         playback frames as echo reference for AEC effect
      * - store locally the created reference
-     * - return created echo_reference_itfe to caller (i.e. AudioSteamInALSA)
-     * Note: created echo_reference_itfe is used as backlink between playback which
+     * - return created echo reference to caller (i.e. AudioSteamInALSA)
+     * Note: created echo reference is used as backlink between playback which
      *         provides reference of output data and record which applies AEC effect
      *
      * @param[in] format: input stream format
      * @param[in] channel_count: input stream channels count
      * @param[in] sampling_rate: input stream sampling rate
+     * @param[out] reader: reader of the reference registered for the caller
      *
-     * @return NULL is creation of echo_reference_itfe failed overwise,
-     *         pointer to created echo_reference_itfe
+     * @return NULL is creation of echo reference failed overwise,
+     *         pointer to created echo reference
      */
-    struct echo_reference_itfe* getEchoReference(int format,
-                                                 uint32_t channel_count,
-                                                 uint32_t sampling_rate);
-
-    struct echo_reference_itfe* mEchoReference;
+    CAudioEchoReference* getEchoReference(int format,
+                                          uint32_t channel_count,
+                                          uint32_t sampling_rate,
+                                          int32_t *reader);
 
     /**
      * Get the default pcm configuration.
@@ -190,10 +204,21 @@ protected:
      */
     const pcm_config& getDefaultPcmConfig(bool bIsOut, uint32_t uiFlags = 0) const;
 
+    /**
+     * Get the duration of the longest period of the routes applicable to a stream.
+     *
+     * @param[in] bIsOut direction of the stream.
+     * @param[in] uiMask applicability mask of the stream.
+     *
+     * @return duration in microseconds.
+     */
+    uint32_t getMaxPeriodUs(bool bIsOut, uint32_t uiMask) const;
+
     friend class AudioStreamOutALSA;
     friend class AudioStreamInALSA;
     friend class ALSAStreamOps;
     friend class CAudioRouteManager;
+    friend class CAudioRoutingReplayer;
     friend class AudioConverter;
 
 private:
@@ -0,0 +1,185 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "AudioRingBuffer"
+
+#include "AudioRingBuffer.h"
+#include <AudioCommsAssert.hpp>
+#include <utils/Log.h>
+#include <stdlib.h>
+#include <string.h>
+
+using android::status_t;
+using android::OK;
+using android::NO_MEMORY;
+
+namespace android_audio_legacy
+{
+
+AudioRingBuffer::AudioRingBuffer()
+    : _buffer(NULL),
+      _ownsBuffer(true),
+      _frameSize(0),
+      _capacityFrames(0),
+      _readIndex(0),
+      _writeIndex(0),
+      _availableFrames(0)
+{
+}
+
+AudioRingBuffer::~AudioRingBuffer()
+{
+    if (_ownsBuffer) {
+
+        free(_buffer);
+    }
+}
+
+status_t AudioRingBuffer::resize(size_t frames, size_t frameSize)
+{
+    AUDIOCOMMS_ASSERT((frames != 0) && (frameSize != 0), "invalid ring buffer size");
+
+    if ((frames == _capacityFrames) && (frameSize == _frameSize)) {
+
+        return OK;
+    }
+    char *buffer = static_cast<char *>(malloc(frames * frameSize));
+    if (buffer == NULL) {
+
+        ALOGE("%s(frames=%zu, frameSize=%zu): allocation failed", __FUNCTION__, frames, frameSize);
+        return NO_MEMORY;
+    }
+
+    // Keep pending frames (linearized at the beginning of the new ring) if possible
+    size_t pendingFrames = 0;
+    if (frameSize == _frameSize) {
+
+        pendingFrames = read(buffer, frames);
+    }
+    ALOGW_IF(_availableFrames != 0, "%s: %zu frames dropped", __FUNCTION__, _availableFrames);
+
+    if (_ownsBuffer) {
+
+        free(_buffer);
+    }
+    _buffer = buffer;
+    _ownsBuffer = true;
+    _frameSize = frameSize;
+    _capacityFrames = frames;
+    _readIndex = 0;
+    _writeIndex = pendingFrames % frames;
+    _availableFrames = pendingFrames;
+
+    ALOGD("%s: %zu frames of %zu bytes", __FUNCTION__, frames, frameSize);
+    return OK;
+}
+
+void AudioRingBuffer::attach(void *buffer, size_t frames, size_t frameSize)
+{
+    AUDIOCOMMS_ASSERT(buffer != NULL, "NULL ring buffer memory");
+    AUDIOCOMMS_ASSERT((frames != 0) && (frameSize != 0), "invalid ring buffer size");
+
+    ALOGW_IF(_availableFrames != 0, "%s: %zu frames dropped", __FUNCTION__, _availableFrames);
+
+    if (_ownsBuffer) {
+
+        free(_buffer);
+    }
+    _buffer = static_cast<char *>(buffer);
+    _ownsBuffer = false;
+    _frameSize = frameSize;
+    _capacityFrames = frames;
+    reset();
+}
+
+void *AudioRingBuffer::getWriteRegion(size_t *frames) const
+{
+    AUDIOCOMMS_ASSERT(frames != NULL, "NULL frames pointer");
+
+    size_t untilWrap = _capacityFrames - _writeIndex;
+    size_t freeFrames = getFreeFrames();
+    *frames = freeFrames < untilWrap ? freeFrames : untilWrap;
+
+    return _buffer + _writeIndex * _frameSize;
+}
+
+void AudioRingBuffer::commitWrite(size_t frames)
+{
+    AUDIOCOMMS_ASSERT(frames <= getFreeFrames(), "ring buffer overflow");
+
+    _writeIndex = (_writeIndex + frames) % _capacityFrames;
+    _availableFrames += frames;
+}
+
+void *AudioRingBuffer::getReadRegion(size_t *frames) const
+{
+    AUDIOCOMMS_ASSERT(frames != NULL, "NULL frames pointer");
+
+    size_t untilWrap = _capacityFrames - _readIndex;
+    *frames = _availableFrames < untilWrap ? _availableFrames : untilWrap;
+
+    return _buffer + _readIndex * _frameSize;
+}
+
+void AudioRingBuffer::commitRead(size_t frames)
+{
+    AUDIOCOMMS_ASSERT(frames <= _availableFrames, "ring buffer underflow");
+
+    _readIndex = (_readIndex + frames) % _capacityFrames;
+    _availableFrames -= frames;
+}
+
+size_t AudioRingBuffer::read(void *buffer, size_t frames)
+{
+    size_t copiedFrames = 0;
+
+    while ((copiedFrames < frames) && (_availableFrames != 0)) {
+
+        size_t regionFrames;
+        const void *region = getReadRegion(&regionFrames);
+        if (regionFrames > frames - copiedFrames) {
+
+            regionFrames = frames - copiedFrames;
+        }
+        memcpy(static_cast<char *>(buffer) + copiedFrames * _frameSize, region,
+               regionFrames * _frameSize);
+        commitRead(regionFrames);
+        copiedFrames += regionFrames;
+    }
+    return copiedFrames;
+}
+
+size_t AudioRingBuffer::write(const void *buffer, size_t frames)
+{
+    size_t copiedFrames = 0;
+
+    while ((copiedFrames < frames) && (getFreeFrames() != 0)) {
+
+        size_t regionFrames;
+        void *region = getWriteRegion(&regionFrames);
+        if (regionFrames > frames - copiedFrames) {
+
+            regionFrames = frames - copiedFrames;
+        }
+        memcpy(region, static_cast<const char *>(buffer) + copiedFrames * _frameSize,
+               regionFrames * _frameSize);
+        commitWrite(regionFrames);
+        copiedFrames += regionFrames;
+    }
+    return copiedFrames;
+}
+
+}       // namespace android
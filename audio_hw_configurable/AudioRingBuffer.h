@@ -0,0 +1,150 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <utils/Errors.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Fixed size ring buffer of audio frames.
+ *
+ * Producer and consumer work in place on contiguous regions of the ring (up to the wrap point),
+ * so that audio data is neither realigned nor staged in an intermediate buffer.
+ * Not thread safe: producer and consumer must be serialized by the caller.
+ */
+class AudioRingBuffer
+{
+public:
+    AudioRingBuffer();
+    ~AudioRingBuffer();
+
+    /**
+     * Sets the capacity of the ring. Pending frames are kept if the frame size does not change,
+     * dropped otherwise.
+     *
+     * @param[in] frames capacity of the ring, in frames.
+     * @param[in] frameSize size of a frame, in bytes.
+     *
+     * @return OK if success, NO_MEMORY otherwise.
+     */
+    android::status_t resize(size_t frames, size_t frameSize);
+
+    /**
+     * Uses memory provided by the caller as the ring. Pending frames are dropped.
+     * The memory must remain valid until the ring is resized, attached again or destroyed.
+     *
+     * @param[in] buffer memory of the ring, of at least frames * frameSize bytes.
+     * @param[in] frames capacity of the ring, in frames.
+     * @param[in] frameSize size of a frame, in bytes.
+     */
+    void attach(void *buffer, size_t frames, size_t frameSize);
+
+    /**
+     * Drops all pending frames.
+     */
+    void reset() { _readIndex = _writeIndex = _availableFrames = 0; }
+
+    /**
+     * Get the number of frames that can be consumed.
+     *
+     * @return available frames.
+     */
+    size_t getAvailableFrames() const { return _availableFrames; }
+
+    /**
+     * Get the number of frames that can be produced.
+     *
+     * @return free frames.
+     */
+    size_t getFreeFrames() const { return _capacityFrames - _availableFrames; }
+
+    /**
+     * Get the capacity of the ring.
+     *
+     * @return capacity, in frames.
+     */
+    size_t getCapacityFrames() const { return _capacityFrames; }
+
+    /**
+     * Get the contiguous region where frames can be produced.
+     *
+     * @param[out] frames number of frames that can be written contiguously.
+     *
+     * @return pointer on the write region.
+     */
+    void *getWriteRegion(size_t *frames) const;
+
+    /**
+     * Marks frames written in the write region as available.
+     *
+     * @param[in] frames number of frames produced.
+     */
+    void commitWrite(size_t frames);
+
+    /**
+     * Get the contiguous region where frames can be consumed.
+     *
+     * @param[out] frames number of frames that can be read contiguously.
+     *
+     * @return pointer on the read region.
+     */
+    void *getReadRegion(size_t *frames) const;
+
+    /**
+     * Releases frames consumed from the read region.
+     *
+     * @param[in] frames number of frames consumed.
+     */
+    void commitRead(size_t frames);
+
+    /**
+     * Copies frames out of the ring, handling the wrap point.
+     *
+     * @param[out] buffer destination of the frames.
+     * @param[in] frames maximum number of frames to copy.
+     *
+     * @return number of frames copied.
+     */
+    size_t read(void *buffer, size_t frames);
+
+    /**
+     * Copies frames into the ring, handling the wrap point.
+     *
+     * @param[in] buffer source of the frames.
+     * @param[in] frames maximum number of frames to copy.
+     *
+     * @return number of frames copied.
+     */
+    size_t write(const void *buffer, size_t frames);
+
+private:
+    AudioRingBuffer(const AudioRingBuffer &);
+    AudioRingBuffer &operator=(const AudioRingBuffer &);
+
+    char *_buffer;
+    bool _ownsBuffer; /**< false if the memory is provided by the caller. */
+    size_t _frameSize; /**< in bytes. */
+    size_t _capacityFrames;
+    size_t _readIndex; /**< in frames. */
+    size_t _writeIndex; /**< in frames. */
+    size_t _availableFrames;
+};
+
+};        // namespace android
@@ -0,0 +1,96 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <cutils/atomic.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Bounded lock-free queue between exactly one producer thread and one consumer thread.
+ *
+ * Indexes are free running: the producer only writes the write index, the consumer only
+ * writes the read index, each one publishing its progress with a release store.
+ * Neither side ever blocks, so that it can be used from audio threads.
+ *
+ * @tparam T type of the items, copied in and out of the queue.
+ * @tparam capacity number of items, must be a power of 2.
+ */
+template <typename T, uint32_t capacity>
+class AudioSpscQueue
+{
+public:
+    AudioSpscQueue()
+        : _readIndex(0),
+          _writeIndex(0)
+    {
+    }
+
+    /**
+     * Appends an item. Producer context only.
+     *
+     * @param[in] item to copy in the queue.
+     *
+     * @return true if queued, false if the queue is full.
+     */
+    bool push(const T &item)
+    {
+        uint32_t writeIndex = static_cast<uint32_t>(_writeIndex);
+        uint32_t readIndex = static_cast<uint32_t>(android_atomic_acquire_load(&_readIndex));
+
+        if (writeIndex - readIndex >= capacity) {
+
+            return false;
+        }
+        _items[writeIndex & (capacity - 1)] = item;
+        android_atomic_release_store(static_cast<int32_t>(writeIndex + 1), &_writeIndex);
+        return true;
+    }
+
+    /**
+     * Removes the oldest item. Consumer context only.
+     *
+     * @param[out] item copy of the oldest item.
+     *
+     * @return true if an item was dequeued, false if the queue is empty.
+     */
+    bool pop(T *item)
+    {
+        uint32_t readIndex = static_cast<uint32_t>(_readIndex);
+        uint32_t writeIndex = static_cast<uint32_t>(android_atomic_acquire_load(&_writeIndex));
+
+        if (readIndex == writeIndex) {
+
+            return false;
+        }
+        *item = _items[readIndex & (capacity - 1)];
+        android_atomic_release_store(static_cast<int32_t>(readIndex + 1), &_readIndex);
+        return true;
+    }
+
+private:
+    AudioSpscQueue(const AudioSpscQueue &);
+    AudioSpscQueue &operator=(const AudioSpscQueue &);
+
+    volatile int32_t _readIndex; /**< written by the consumer only. */
+    volatile int32_t _writeIndex; /**< written by the producer only. */
+    T _items[capacity];
+};
+
+};        // namespace android
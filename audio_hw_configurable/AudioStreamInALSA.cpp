@@ -20,12 +20,16 @@
 #include "AudioStreamInALSA.h"
 
 #include "AudioStreamRoute.h"
+#include "AudioEchoReference.h"
+#include "EventThread.h"
+#include "Property.h"
 #include <hardware_legacy/power.h>
 #include <media/AudioRecord.h>
 #include <AudioCommsAssert.hpp>
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <cutils/properties.h>
+#include <cutils/atomic.h>
 #include <algorithm>
 #include <errno.h>
 #include <stdarg.h>
@@ -44,6 +48,8 @@ using audio_comms::utilities::Mutex;
 namespace android_audio_legacy
 {
 
+const char *const AudioStreamInALSA::AEC_PIPELINED_PROP_NAME = "audiocomms.HAL.AecPipelined";
+
 AudioStreamInALSA::AudioStreamInALSA(AudioHardwareALSA *parent,
                                      AudioSystem::audio_in_acoustics audio_acoustics) :
     base(parent, "AudioInLock"),
@@ -51,19 +57,42 @@ AudioStreamInALSA::AudioStreamInALSA(AudioHardwareALSA *parent,
     mAcoustics(audio_acoustics),
     _inputSourceMask(0),
     mFramesIn(0),
-    mProcessingFramesIn(0),
-    mProcessingBuffer(NULL),
-    mProcessingBufferSizeInFrames(0),
-    mReferenceFramesIn(0),
-    mReferenceBuffer(NULL),
-    mReferenceBufferSizeInFrames(0),
     mPreprocessorsHandlerList(),
-    mHwBuffer(NULL)
+    mHwBuffer(NULL),
+    mEchoReferenceThread(NULL),
+    mProcessedPeriods(0),
+    mProcessingTime(0),
+    mMaxProcessingTime(0),
+    mStagingCopiedBytes(0),
+    mCaptureKeptBytes(0),
+    mReferenceKeptBytes(0)
 {
+    if (TProperty<bool>(AEC_PIPELINED_PROP_NAME, false)) {
+
+        // Reverse stream processing of AEC is moved off the capture critical path
+        mEchoReferenceThread = new CEventThread(this);
+        if (!mEchoReferenceThread->start()) {
+
+            ALOGE("%s: could not start echo reference worker, AEC not pipelined", __FUNCTION__);
+            delete mEchoReferenceThread;
+            mEchoReferenceThread = NULL;
+        }
+    }
 }
 
 AudioStreamInALSA::~AudioStreamInALSA()
 {
+    if (isAecPipelined()) {
+
+        // Worker does not take the stream lock, it can be stopped first
+        mEchoReferenceThread->stop();
+        delete mEchoReferenceThread;
+    }
+    Vector<AudioEffectHandle>::const_iterator it;
+    for (it = mPreprocessorsHandlerList.begin(); it != mPreprocessorsHandlerList.end(); ++it) {
+
+        delete it->mProcessLock;
+    }
     /**
      * Effects are managed by AudioFlinger in a different thread than Capture thread.
      * Deleting the input stream may happen while trying to remove / add an effect.
@@ -83,8 +112,8 @@ size_t AudioStreamInALSA::generateSilence(void *buffer, size_t bytes)
     memset(buffer, 0, bytes);
     // No HW will drive the timeline:
     //       we are here because of hardware error or missing route availability.
-    // Also, keep time sync by sleeping the equivalent amount of time.
-    usleep(mSampleSpec.convertFramesToUsec(mSampleSpec.convertBytesToFrames(bytes)));
+    // Also, keep time sync by waiting on the virtual clock.
+    waitVirtualClock(mSampleSpec.convertBytesToFrames(bytes));
     return bytes;
 }
 
@@ -118,7 +147,13 @@ ssize_t AudioStreamInALSA::readHwFrames(void *buffer, size_t frames)
     uint32_t retryCount = 0;
 
     do {
-        ret = pcm_read(mHandle, (char *)buffer, mHwSampleSpec.convertFramesToBytes(frames));
+        // Device is read through the route, which may share it with other input streams
+        uint32_t framesLost = 0;
+        ret = getCurrentRouteL()->readCapture(this, buffer, frames, &framesLost);
+        if (framesLost != 0) {
+
+            android_atomic_add(framesLost, &mFramesLost);
+        }
 
         ALOGV("%s %d %d", __FUNCTION__, ret, pcm_frames_to_bytes(mHandle, frames));
 
@@ -192,33 +227,57 @@ ssize_t AudioStreamInALSA::readFrames(void *buffer, size_t frames)
 }
 
 int AudioStreamInALSA::doProcessFrames(const void* buffer, ssize_t frames,
-                                           ssize_t* processed_frames,
-                                           ssize_t* processing_frames_in)
+                                           ssize_t* processed_frames)
 {
     int ret = 0;
 
     audio_buffer_t in_buf;
     audio_buffer_t out_buf;
 
-    while ((*processed_frames < frames) && (*processing_frames_in > 0) && (ret == 0)) {
+    while ((*processed_frames < frames) && (mProcessingRing.getAvailableFrames() > 0) &&
+           (ret == 0)) {
+
+        bool echoReferencePosted = false;
 
         Vector<AudioEffectHandle>::const_iterator it;
         for (it = mPreprocessorsHandlerList.begin(); it != mPreprocessorsHandlerList.end(); ++it) {
 
             if (it->mEchoReference != NULL) {
 
-                pushEchoReference(*processing_frames_in, it->mPreprocessor, it->mEchoReference);
+                if (isAecPipelined()) {
+
+                    // A single request covers all AEC preprocessors
+                    if (!echoReferencePosted) {
+
+                        postEchoReference(mProcessingRing.getAvailableFrames());
+                        echoReferencePosted = true;
+                    }
+                } else {
+
+                    struct echo_reference_buffer captureDelay;
+                    getCaptureDelay(&captureDelay);
+                    pushEchoReference(mProcessingRing.getAvailableFrames(), *it, &captureDelay);
+                }
             }
             // in_buf.frameCount and out_buf.frameCount indicate respectively
             // the maximum number of frames to be consumed and produced by process()
-            in_buf.frameCount = *processing_frames_in;
-            in_buf.s16 = (int16_t *)((char* )mProcessingBuffer +
-                                     mSampleSpec.convertFramesToBytes(*processed_frames));
+            // Input frames are processed in place, up to the wrap point of the ring.
+            size_t inFrames;
+            in_buf.s16 = static_cast<int16_t *>(mProcessingRing.getReadRegion(&inFrames));
+            in_buf.frameCount = inFrames;
             out_buf.frameCount = frames - *processed_frames;
             out_buf.s16 = (int16_t *)((char* )buffer +
                                       mSampleSpec.convertFramesToBytes(*processed_frames));
 
-            ret = (*(it->mPreprocessor))->process(it->mPreprocessor, &in_buf, &out_buf);
+            if (it->mProcessLock != NULL) {
+
+                // Echo reference worker may run process_reverse() on this effect meanwhile
+                Mutex::Locker locker(*it->mProcessLock);
+                ret = (*(it->mPreprocessor))->process(it->mPreprocessor, &in_buf, &out_buf);
+            } else {
+
+                ret = (*(it->mPreprocessor))->process(it->mPreprocessor, &in_buf, &out_buf);
+            }
             if (ret == 0)
             {
                 //Note: it is useless to recopy the output of effect processing as input
@@ -226,7 +285,7 @@ int AudioStreamInALSA::doProcessFrames(const void* buffer, ssize_t frames,
 
                 // process() has updated the number of frames consumed and produced in
                 // in_buf.frameCount and out_buf.frameCount respectively
-                *processing_frames_in -= in_buf.frameCount;
+                mProcessingRing.commitRead(in_buf.frameCount);
                 *processed_frames += out_buf.frameCount;
             }
         }
@@ -236,65 +295,60 @@ int AudioStreamInALSA::doProcessFrames(const void* buffer, ssize_t frames,
 
 ssize_t AudioStreamInALSA::processFrames(void* buffer, ssize_t frames)
 {
-    // first reload enough frames at the end of process input buffer
-    if (mProcessingFramesIn < frames) {
-
-        if (mProcessingBufferSizeInFrames < frames) {
+    if (mProcessingRing.getCapacityFrames() < getProcessingRingFrames(frames)) {
 
-            status_t ret = allocateProcessingMemory(frames);
-            if (ret != OK) {
+        status_t ret = allocateProcessingMemory(frames);
+        if (ret != OK) {
 
-                return ret;
-            }
+            return ret;
         }
+    }
+
+    // first reload enough frames in the processing ring, read in place in its free regions.
+    // Effects library works with 10 ms frames, remainder frames not consumed by the effect
+    // processor are kept in the ring for the next call, no realignment is needed.
+    while (mProcessingRing.getAvailableFrames() < static_cast<size_t>(frames)) {
+
+        size_t freeFrames;
+        void *pWriteRegion = mProcessingRing.getWriteRegion(&freeFrames);
+        size_t missingFrames = frames - mProcessingRing.getAvailableFrames();
 
-        ssize_t read_frames = readFrames((char* )mProcessingBuffer +
-                                            mSampleSpec.convertFramesToBytes(mProcessingFramesIn),
-                                         frames - mProcessingFramesIn);
+        ssize_t read_frames = readFrames(pWriteRegion, min(freeFrames, missingFrames));
         if (read_frames < 0) {
 
             return read_frames;
         }
         /* OK, we have to process all read frames */
-        mProcessingFramesIn += read_frames;
-        LOG_ALWAYS_FATAL_IF(mProcessingFramesIn < frames);
+        mProcessingRing.commitWrite(read_frames);
     }
 
     ssize_t processed_frames = 0;
-    ssize_t processing_frames_in = mProcessingFramesIn;
     int processingReturn = 0;
 
     // Then process the frames
-    processingReturn = doProcessFrames(buffer, frames, &processed_frames, &processing_frames_in);
+    nsecs_t processingStart = systemTime();
+    processingReturn = doProcessFrames(buffer, frames, &processed_frames);
+    nsecs_t processingTime = systemTime() - processingStart;
+    mProcessedPeriods++;
+    mProcessingTime += processingTime;
+    if (processingTime > mMaxProcessingTime) {
+
+        mMaxProcessingTime = processingTime;
+    }
     if (processingReturn != 0) {
 
         // Effects processing failed
         // at least, it is necessary to return the read HW frames
         ALOGD("%s: unable to apply any effect; returned value is %d", __FUNCTION__,
                                                                      processingReturn);
-        memcpy(buffer,
-               mProcessingBuffer,
-               mSampleSpec.convertFramesToBytes(mProcessingFramesIn));
-        processed_frames = mProcessingFramesIn;
-    } else {
-
-        // move remaining frames to the beginning of mProccesingBuffer because currently,
-        // the configuration imposes working with 160 frames and effects library works
-        // with 80 frames per cycle (10 ms), i.e. the processing of 160 read HW frames
-        // requests two calls to effects library (which are done by while loop. In future or
-        // if configuration changed, effects library processing could be not more multiple of
-        // HW read frames, so it is necessary to realign the buffer
-        if (processing_frames_in != 0) {
-
-            LOG_ALWAYS_FATAL_IF(processing_frames_in <= 0);
-            memmove(mProcessingBuffer,
-                    (char* )mProcessingBuffer +
-                    mSampleSpec.convertFramesToBytes(mProcessingFramesIn - processing_frames_in),
-                    mSampleSpec.convertFramesToBytes(processing_frames_in));
-        }
+        size_t copiedFrames = mProcessingRing.read(
+                    (char* )buffer + mSampleSpec.convertFramesToBytes(processed_frames),
+                    frames - processed_frames);
+        mStagingCopiedBytes += mSampleSpec.convertFramesToBytes(copiedFrames);
+        processed_frames += copiedFrames;
     }
-    // at the end, we keep remainder frames not cosumed by effect processor.
-    mProcessingFramesIn = processing_frames_in;
+    // Remainder frames not consumed by the effects stay in place until next call
+    mCaptureKeptBytes += mSampleSpec.convertFramesToBytes(mProcessingRing.getAvailableFrames());
 
     return processed_frames;
 }
@@ -303,16 +357,28 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
 {
     setStandby(false);
 
-    AutoR lock(_streamLock);
+    {
+        AutoR lock(_streamLock);
 
-    // Check if the audio route is available for this stream
-    if (!isRouteAvailableL()) {
+        // Check if the audio route is available for this stream
+        if (isRouteAvailableL()) {
 
-        ALOGW("%s(buffer=%p, bytes=%ld) No route available. Generating silence.",
-              __FUNCTION__, buffer, static_cast<long int>(bytes));
-        return generateSilence(buffer, bytes);
+            // The route is attached between two reads, hence the audio device takes over
+            // the timeline on a period boundary.
+            resetVirtualClock();
+            return readL(buffer, bytes);
+        }
     }
 
+    // Do not hold the stream lock while waiting: the route manager must be able to attach
+    // a route in the meantime.
+    ALOGW("%s(buffer=%p, bytes=%ld) No route available. Generating silence.",
+          __FUNCTION__, buffer, static_cast<long int>(bytes));
+    return generateSilence(buffer, bytes);
+}
+
+ssize_t AudioStreamInALSA::readL(void *buffer, ssize_t bytes)
+{
     LOG_ALWAYS_FATAL_IF(mHandle == NULL);
 
     ssize_t received_frames = -1;
@@ -341,8 +407,29 @@ ssize_t AudioStreamInALSA::read(void *buffer, ssize_t bytes)
     return mSampleSpec.convertFramesToBytes(received_frames);
 }
 
-status_t AudioStreamInALSA::dump(int __UNUSED fd, const Vector<String16> __UNUSED &args)
+status_t AudioStreamInALSA::dump(int fd, const Vector<String16> __UNUSED &args)
 {
+    String8 result;
+
+    result.appendFormat("Input stream %p (AEC %s):\n", this,
+                        isAecPipelined() ? "pipelined" : "inline");
+    result.appendFormat("  effects processing: %u periods, avg %lld us, max %lld us\n",
+                        mProcessedPeriods,
+                        static_cast<long long>(mProcessedPeriods ?
+                                               ns2us(mProcessingTime) / mProcessedPeriods : 0),
+                        static_cast<long long>(ns2us(mMaxProcessingTime)));
+    result.appendFormat("  staging per period: %llu bytes copied, %llu bytes with linear "
+                        "staging buffers\n",
+                        static_cast<unsigned long long>(mProcessedPeriods ?
+                                                        mStagingCopiedBytes /
+                                                        mProcessedPeriods : 0),
+                        static_cast<unsigned long long>(mProcessedPeriods ?
+                                                        (mStagingCopiedBytes +
+                                                         mCaptureKeptBytes +
+                                                         mReferenceKeptBytes) /
+                                                        mProcessedPeriods : 0));
+    ::write(fd, result.string(), result.size());
+
     return NO_ERROR;
 }
 
@@ -361,23 +448,13 @@ status_t AudioStreamInALSA::standby()
     return setStandby(true);
 }
 
-void AudioStreamInALSA::resetFramesLost()
-{
-    // setVoiceVolume and mixing during voice call cannot happen together
-    // need a lock; but deadlock may appear during simultaneous R or W
-    // so remove lock and the reset of mFramesLost which is never updated btw
-}
-
 unsigned int AudioStreamInALSA::getInputFramesLost() const
 {
-    unsigned int count = mFramesLost;   //set to 0 during construction
-
-    AudioStreamInALSA* mutable_this = const_cast<AudioStreamInALSA*>(this);
     // Requirement from AudioHardwareInterface.h:
     // Audio driver is expected to reset the value to 0 and restart counting upon
     // returning the current value by this function call.
-    mutable_this->resetFramesLost();
-    return count;
+    // Not locked: counter is updated by the capture thread, atomically swapped here.
+    return android_atomic_and(0, &mFramesLost);
 }
 
 status_t  AudioStreamInALSA::setParameters(const String8& keyValuePairs)
@@ -397,30 +474,57 @@ status_t  AudioStreamInALSA::setParameters(const String8& keyValuePairs)
     return ALSAStreamOps::setParameters(keyValuePairs);
 }
 
-status_t AudioStreamInALSA::allocateHwBuffer()
+size_t AudioStreamInALSA::getRoutedProcessingRingFramesL() const
 {
-    unsigned int bufferSize;
+    return getProcessingRingFrames(
+                mSampleSpec.convertBytesToFrames(getBufferSize(_inputSourceMask)));
+}
 
-    freeAllocatedBuffers();
+size_t AudioStreamInALSA::getArenaSizeL(uint32_t periodUs) const
+{
+    // Hardware buffer follows the ALSA ring buffer of the route
+    size_t hwBufferSize = pcm_frames_to_bytes(mHandle, pcm_get_buffer_size(mHandle));
+    size_t ringSize = mSampleSpec.convertFramesToBytes(getRoutedProcessingRingFramesL());
+
+    return base::getArenaSizeL(periodUs) +
+            AudioArena::getAlignedSize(hwBufferSize) + AudioArena::getAlignedSize(ringSize);
+}
+
+status_t AudioStreamInALSA::allocateArenaBuffersL(uint32_t periodUs)
+{
+    status_t status = base::allocateArenaBuffersL(periodUs);
+    if (status != NO_ERROR) {
+
+        return status;
+    }
 
-    bufferSize = pcm_get_buffer_size(mHandle);
+    mHwBufferSize = static_cast<size_t>(pcm_frames_to_bytes(mHandle,
+                                                            pcm_get_buffer_size(mHandle)));
+    mHwBuffer = static_cast<char *>(mArena.allocate(mHwBufferSize));
+    if (mHwBuffer == NULL) {
 
-    mHwBufferSize = static_cast<size_t>(pcm_frames_to_bytes(mHandle, bufferSize));
+        ALOGE("%s: cannot allocate mHwBuffer", __FUNCTION__);
+        return NO_MEMORY;
+    }
 
-    mHwBuffer = new char[mHwBufferSize];
-    if (!mHwBuffer) {
+    // Size the preprocessing rings once for the period of the route
+    size_t ringFrames = getRoutedProcessingRingFramesL();
+    void *ringBuffer = mArena.allocate(mSampleSpec.convertFramesToBytes(ringFrames));
+    if (ringBuffer == NULL) {
 
-        ALOGE("%s: cannot allocate resampler mHwbuffer", __FUNCTION__);
+        ALOGE("%s: cannot allocate processing ring", __FUNCTION__);
         return NO_MEMORY;
     }
+    mProcessingRing.attach(ringBuffer, ringFrames, mSampleSpec.getFrameSize());
 
     return NO_ERROR;
 }
 
 void AudioStreamInALSA::freeAllocatedBuffers()
 {
-     delete []mHwBuffer;
-     mHwBuffer = NULL;
+    // Memory belongs to the stream arena, kept to route the stream again
+    mHwBuffer = NULL;
+    mHwBufferSize = 0;
 }
 
 //
@@ -437,7 +541,7 @@ status_t AudioStreamInALSA::attachRouteL()
     // Checks if any effect requested to add them
     checkAndAddAudioEffects();
 
-    return allocateHwBuffer();
+    return NO_ERROR;
 }
 
 //
@@ -535,11 +639,15 @@ status_t AudioStreamInALSA::addAudioEffectL(effect_handle_t effect)
     //
     if (isAecEffect(&uuid)) {
 
-        struct echo_reference_itfe *stReference = NULL;
+        CAudioEchoReference *stReference = NULL;
+        int32_t reader = -1;
+        // Stream lock held: the route manager takes the input stream locks before its echo
+        // reference lock, and never the other way around
         stReference = mParent->getEchoReference(format(),
                                                channelCount(),
-                                               sampleRate());
-        return addSwAudioEffectL(effect, stReference);
+                                               sampleRate(),
+                                               &reader);
+        return addSwAudioEffectL(effect, stReference, reader);
     }
     return addSwAudioEffectL(effect);
 }
@@ -608,7 +716,8 @@ status_t AudioStreamInALSA::removeAudioEffectRequestL(effect_handle_t effect)
 }
 
 status_t AudioStreamInALSA::addSwAudioEffectL(effect_handle_t effect,
-                                               echo_reference_itfe *reference)
+                                               CAudioEchoReference *reference,
+                                               int32_t reader)
 {
     AUDIOCOMMS_ASSERT(effect != NULL, "effect handle is NULL");
 
@@ -621,13 +730,22 @@ status_t AudioStreamInALSA::addSwAudioEffectL(effect_handle_t effect,
 
         ALOGW("%s (effect=%p): it is useless to add again the same effect",
                                                                         __FUNCTION__, effect);
+        // Effect already reads the reference from its own reader
+        mParent->resetEchoReference(reference, reader);
         return NO_ERROR;
     }
 
-    status_t ret = mPreprocessorsHandlerList.add(AudioEffectHandle(effect, reference));
+    // Only AEC effects are called by the echo reference worker
+    Mutex *processLock = (reference != NULL) && isAecPipelined() ? new Mutex() : NULL;
+
+    Mutex::Locker locker(mEchoReferenceLock);
+    status_t ret = mPreprocessorsHandlerList.add(AudioEffectHandle(effect, reference, reader,
+                                                                   processLock));
     if (ret < 0) {
 
         ALOGE("%s (effect=%p): unable to add effect!", __FUNCTION__, effect);
+        delete processLock;
+        mParent->resetEchoReference(reference, reader);
         return ret;
     }
     ALOGD("%s (effect=%p): effect added. number of stored effects is %d", __FUNCTION__,
@@ -639,6 +757,9 @@ status_t AudioStreamInALSA::removeSwAudioEffectL(effect_handle_t effect)
 {
     AUDIOCOMMS_ASSERT(effect != NULL, "effect handle is NULL");
 
+    // Echo reference worker must be done with the effect before it is released
+    Mutex::Locker locker(mEchoReferenceLock);
+
     Vector<AudioEffectHandle>::iterator it;
     it = std::find_if(mPreprocessorsHandlerList.begin(), mPreprocessorsHandlerList.end(),
                       std::bind2nd( MatchEffect(), effect) );
@@ -648,11 +769,12 @@ status_t AudioStreamInALSA::removeSwAudioEffectL(effect_handle_t effect)
               __FUNCTION__, effect, mPreprocessorsHandlerList.size());
         if (it->mEchoReference != NULL) {
 
-            /* stop reading from echo reference */
-            it->mEchoReference->read(it->mEchoReference, NULL);
-            mParent->resetEchoReference(it->mEchoReference);
+            mParent->resetEchoReference(it->mEchoReference, it->mEchoReader);
             it->mEchoReference = NULL;
+            it->mEchoReader = -1;
         }
+        // Capture thread is not processing: the stream lock is held for writing
+        delete it->mProcessLock;
         mPreprocessorsHandlerList.erase(it);
         ALOGD("%s (effect=%p): number of effects after erase %d",
               __FUNCTION__, effect, mPreprocessorsHandlerList.size());
@@ -707,12 +829,12 @@ void AudioStreamInALSA::getCaptureDelay(struct echo_reference_buffer* buffer)
     // read frames available in audio HAL input buffer
     // add number of frames being read as we want the capture time of first sample
     // in current buffer.
-    buf_delay = mSampleSpec.convertFramesToUsec(mFramesIn + mProcessingFramesIn);
+    buf_delay = mSampleSpec.convertFramesToUsec(mFramesIn + mProcessingRing.getAvailableFrames());
 
     // add delay introduced by kernel
     kernel_delay = mHwSampleSpec.convertFramesToUsec(kernel_frames);
 
-    delay_ns = kernel_delay + buf_delay;
+    delay_ns = (kernel_delay + buf_delay) * 1000;
 
     buffer->time_stamp = tstamp;
     buffer->delay_ns   = delay_ns;
@@ -722,88 +844,158 @@ void AudioStreamInALSA::getCaptureDelay(struct echo_reference_buffer* buffer)
           kernel_delay, buf_delay, kernel_frames);
 }
 
-int32_t AudioStreamInALSA::updateEchoReference(ssize_t frames,
-                                               struct echo_reference_itfe* reference)
+status_t AudioStreamInALSA::pushEchoReference(ssize_t frames, const AudioEffectHandle &effect,
+                                              const struct echo_reference_buffer *captureDelay)
 {
-    struct echo_reference_buffer b;
-
-    LOG_ALWAYS_FATAL_IF(reference == NULL);
+    effect_handle_t preprocessor = effect.mPreprocessor;
+    CAudioEchoReference *reference = effect.mEchoReference;
+    int32_t reader = effect.mEchoReader;
+    LOG_ALWAYS_FATAL_IF(preprocessor == NULL || *preprocessor == NULL || reference == NULL);
 
-    b.delay_ns = 0;
+    /* align the echo reference on the capture time and update echo delay */
+    int32_t delay_us = reference->sync(reader, captureDelay) / 1000;
 
-    if (mReferenceFramesIn < frames) {
+    if ((*preprocessor)->process_reverse == NULL) {
 
-        if (mReferenceBufferSizeInFrames < frames) {
+        ALOGW(" %s(frames %ld): process_reverse is NULL", __FUNCTION__,
+              static_cast<long int>(frames));
+        return BAD_VALUE;
+    }
 
-            mReferenceBufferSizeInFrames = frames;
-            int16_t* pReferenceBuffer = (int16_t *)realloc(mReferenceBuffer,
-                                    mSampleSpec.convertFramesToBytes(mReferenceBufferSizeInFrames));
-            if (pReferenceBuffer == NULL) {
+    audio_buffer_t buf;
+    status_t processingReturn = OK;
 
-                ALOGE(" %s(frames=%ld): realloc failed", __FUNCTION__,
-                      static_cast<long int>(frames));
-                return NO_MEMORY;
-            }
-            mReferenceBuffer = pReferenceBuffer;
-        }
+    // Reference frames are processed in place in the echo reference ring, up to twice if they
+    // wrap around. Frames not consumed by process_reverse() remain in the ring for the next call.
+    ssize_t pushedFrames = 0;
+    while ((pushedFrames < frames) && (processingReturn == OK)) {
 
-        b.frame_count = frames - mReferenceFramesIn;
-        b.raw = (void *)((char* )mReferenceBuffer +
-                         mSampleSpec.convertFramesToBytes(mReferenceFramesIn));
+        uint32_t regionFrames;
+        buf.s16 = static_cast<int16_t *>(reference->getReadRegion(reader, &regionFrames));
+        buf.frameCount = min(static_cast<ssize_t>(regionFrames), frames - pushedFrames);
+        if (buf.frameCount == 0) {
 
-        getCaptureDelay(&b);
+            ALOGV("%s: NOT enough frames to read ref buffer", __FUNCTION__);
+            break;
+        }
+        size_t offeredFrames = buf.frameCount;
 
-        if (reference->read(reference, &b) == 0) {
+        if (effect.mProcessLock != NULL) {
 
-            mReferenceFramesIn += b.frame_count;
+            // Capture thread may run process() on this effect meanwhile, held per call so
+            // that it waits for one reverse processing at most
+            Mutex::Locker locker(*effect.mProcessLock);
+            processingReturn = (*preprocessor)->process_reverse(preprocessor, &buf, NULL);
         } else {
 
-            ALOGW("%s: NOT enough frames to read ref buffer", __FUNCTION__);
+            processingReturn = (*preprocessor)->process_reverse(preprocessor, &buf, NULL);
+        }
+        // Frames not consumed are offered again from the ring, where they stay
+        mReferenceKeptBytes +=
+                reference->getReadSampleSpec().convertFramesToBytes(offeredFrames - buf.frameCount);
+        if (buf.frameCount == 0) {
+
+            break;
         }
+        reference->commitRead(reader, buf.frameCount);
+        pushedFrames += buf.frameCount;
+    }
+    if (effect.mProcessLock != NULL) {
+
+        Mutex::Locker locker(*effect.mProcessLock);
+        setPreprocessorEchoDelay(preprocessor, delay_us);
+    } else {
+
+        setPreprocessorEchoDelay(preprocessor, delay_us);
     }
-    return b.delay_ns;
+    return processingReturn;
 }
 
-status_t AudioStreamInALSA::pushEchoReference(ssize_t frames, effect_handle_t preprocessor,
-                                              struct echo_reference_itfe* reference)
+void AudioStreamInALSA::postEchoReference(ssize_t frames)
 {
-    /* read frames from echo reference buffer and update echo delay
-     * mReferenceFramesIn is updated with frames available in mReferenceBuffer */
-    int32_t delay_us = updateEchoReference(frames, reference) / 1000;
+    // The capture time stamp must be sampled in the capture thread, the worker only
+    // receives a snapshot of it along with the number of frames.
+    struct echo_reference_buffer request;
+    getCaptureDelay(&request);
+    request.raw = NULL;
+    request.frame_count = frames;
+
+    if (!mEchoReferenceRequests.push(request)) {
+
+        // Worker is late by more than the queue depth: the reference it will read
+        // is resynchronized on the time stamp of the next request anyway.
+        ALOGW("%s: echo reference worker overrun, request dropped", __FUNCTION__);
+        return;
+    }
+    mEchoReferenceThread->trig();
+}
 
-    LOG_ALWAYS_FATAL_IF(preprocessor == NULL || *preprocessor == NULL || reference == NULL);
+void AudioStreamInALSA::processEchoReference(const struct echo_reference_buffer &request)
+{
+    Vector<AudioEffectHandle>::const_iterator it;
+    for (it = mPreprocessorsHandlerList.begin(); it != mPreprocessorsHandlerList.end(); ++it) {
 
-    if (mReferenceFramesIn < frames) {
+        if (it->mEchoReference != NULL) {
 
-        frames = mReferenceFramesIn;
+            pushEchoReference(request.frame_count, *it, &request);
+        }
     }
+}
 
-    if ((*preprocessor)->process_reverse == NULL) {
+//
+// Echo reference worker context
+//
+bool AudioStreamInALSA::onEvent(int __UNUSED iFd)
+{
+    return false;
+}
 
-        ALOGW(" %s(frames %ld): process_reverse is NULL", __FUNCTION__,
-              static_cast<long int>(frames));
-        return BAD_VALUE;
-    }
+//
+// Echo reference worker context
+//
+bool AudioStreamInALSA::onError(int __UNUSED iFd)
+{
+    return false;
+}
 
-    audio_buffer_t buf;
+//
+// Echo reference worker context
+//
+bool AudioStreamInALSA::onHangup(int __UNUSED iFd)
+{
+    return false;
+}
+
+//
+// Echo reference worker context
+//
+void AudioStreamInALSA::onAlarm()
+{
+}
 
-    buf.frameCount = mReferenceFramesIn;
-    buf.s16 = mReferenceBuffer;
+//
+// Echo reference worker context
+//
+void AudioStreamInALSA::onPollError()
+{
+}
 
-    status_t processingReturn = (*preprocessor)->process_reverse(preprocessor,
-                                                        &buf,
-                                                        NULL);
-    setPreprocessorEchoDelay(preprocessor, delay_us);
-    mReferenceFramesIn -= buf.frameCount;
+//
+// Echo reference worker context
+//
+bool AudioStreamInALSA::onProcess(uint16_t __UNUSED uiEvent)
+{
+    // Stream lock is not taken: the capture thread runs the forward processing in parallel.
+    // Effects list and reference ring are protected by the echo reference lock.
+    Mutex::Locker locker(mEchoReferenceLock);
 
-    if (mReferenceFramesIn > 0) {
+    // Drain all pending requests, a trig may cover several of them
+    struct echo_reference_buffer request;
+    while (mEchoReferenceRequests.pop(&request)) {
 
-        memcpy(mReferenceBuffer,
-               (char* )mReferenceBuffer + mSampleSpec.convertFramesToBytes(buf.frameCount),
-               mSampleSpec.convertFramesToBytes(mReferenceFramesIn));
+        processEchoReference(request);
     }
-
-    return processingReturn;
+    return false;
 }
 
 status_t AudioStreamInALSA::setPreprocessorParam(effect_handle_t handle, effect_param_t *param)
@@ -853,25 +1045,25 @@ status_t AudioStreamInALSA::setPreprocessorEchoDelay(effect_handle_t handle, int
     return setPreprocessorParam(handle, param);
 }
 
+size_t AudioStreamInALSA::getProcessingRingFrames(ssize_t frames) const
+{
+    return frames + mSampleSpec.convertUsecToframes(EFFECT_FRAME_DURATION_US);
+}
+
 status_t AudioStreamInALSA::allocateProcessingMemory(ssize_t frames)
 {
-    mProcessingBufferSizeInFrames = frames;
+    size_t ringFrames = getProcessingRingFrames(frames);
 
-    int16_t* pProcessingBuffer = (int16_t *)realloc(mProcessingBuffer,
-                                   mSampleSpec.convertFramesToBytes(mProcessingBufferSizeInFrames));
-    if (pProcessingBuffer == NULL) {
+    status_t ret = mProcessingRing.resize(ringFrames, mSampleSpec.getFrameSize());
+    if (ret != NO_ERROR) {
 
-        ALOGE(" %s(frames=%ld): realloc failed errno = %s!", __FUNCTION__,
-              static_cast<long int>(frames), strerror(errno));
-        return NO_MEMORY;
+        return ret;
     }
-    mProcessingBuffer = pProcessingBuffer;
-    ALOGD("%s(frames=%ld): mProcessingBuffer=%p size extended to %ld frames (i.e. %d bytes)",
+    ALOGD("%s(frames=%ld): processing ring of %zu frames (i.e. %zu bytes)",
           __FUNCTION__,
           static_cast<long int>(frames),
-          mProcessingBuffer,
-          static_cast<long int>(mProcessingBufferSizeInFrames),
-          mSampleSpec.convertFramesToBytes(mProcessingBufferSizeInFrames));
+          ringFrames,
+          mSampleSpec.convertFramesToBytes(ringFrames));
 
     return NO_ERROR;
 }
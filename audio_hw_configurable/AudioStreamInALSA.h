@@ -19,13 +19,20 @@
 
 #include "AudioHardwareALSA.h"
 #include "ALSAStreamOps.h"
+#include "AudioRingBuffer.h"
+#include "AudioSpscQueue.h"
+#include "EventListener.h"
 #include <media/AudioBufferProvider.h>
 #include <Mutex.hpp>
 
+class CEventThread;
+
 namespace android_audio_legacy
 {
+class CAudioEchoReference;
 
-class AudioStreamInALSA : public AudioStreamIn, public ALSAStreamOps,  public android::AudioBufferProvider
+class AudioStreamInALSA : public AudioStreamIn, public ALSAStreamOps,
+                          public android::AudioBufferProvider, private IEventListener
 {
     typedef std::list<effect_handle_t>::iterator AudioEffectsListIterator;
 
@@ -109,6 +116,10 @@ public:
     virtual android::status_t    attachRouteL();
     virtual android::status_t    detachRouteL();
 
+    // From ALSAStreamOps: hardware and processing buffers are carved from the stream arena
+    virtual size_t               getArenaSizeL(uint32_t periodUs) const;
+    virtual android::status_t    allocateArenaBuffersL(uint32_t periodUs);
+
     // From AudioBufferProvider
     virtual android::status_t getNextBuffer(android::AudioBufferProvider::Buffer* buffer, int64_t pts = kInvalidPTS);
     virtual void releaseBuffer(android::AudioBufferProvider::Buffer* buffer);
@@ -137,16 +148,27 @@ public:
         return _inputSourceMask;
     }
 
+    virtual uint32_t    getApplicabilityMaskL() const { return _inputSourceMask; }
+
 private:
     class AudioEffectHandle
     {
     public:
         effect_handle_t mPreprocessor;
-        struct echo_reference_itfe* mEchoReference;
+        CAudioEchoReference* mEchoReference;
+        int32_t mEchoReader; /**< reader of the echo reference, owned by the effect. */
+        /**
+         * Serializes process() and process_reverse() of an AEC effect in pipelined AEC mode,
+         * effects not being reentrant. NULL for the other effects, which are only called by
+         * the capture thread. Owned by the stream, shared by the copies of the handle.
+         */
+        audio_comms::utilities::Mutex* mProcessLock;
         AudioEffectHandle():
-            mPreprocessor(NULL), mEchoReference(NULL) {}
-        AudioEffectHandle(effect_handle_t effect, struct echo_reference_itfe* reference):
-            mPreprocessor(effect), mEchoReference(reference) {}
+            mPreprocessor(NULL), mEchoReference(NULL), mEchoReader(-1), mProcessLock(NULL) {}
+        AudioEffectHandle(effect_handle_t effect, CAudioEchoReference* reference,
+                          int32_t reader, audio_comms::utilities::Mutex* processLock):
+            mPreprocessor(effect), mEchoReference(reference), mEchoReader(reader),
+            mProcessLock(processLock) {}
         ~AudioEffectHandle() {}
     };
 
@@ -227,12 +249,15 @@ private:
      * It adds an audio effect on the input stream.
      *
      * @param[in] effect handle of the effect to add.
-     * @param[in] reference Echo Reference may be provided for AEC SW effect
+     * @param[in] reference Echo Reference may be provided for AEC SW effect, released if the
+     *                      effect is not added
+     * @param[in] reader reader of the Echo Reference
      *
      * @return status_t OK upon succes, error code otherwise.
      */
     status_t addSwAudioEffectL(effect_handle_t effect,
-                               struct echo_reference_itfe *reference = NULL);
+                               CAudioEchoReference *reference = NULL,
+                               int32_t reader = -1);
 
     /**
      * Removes a SW effect from the stream in locked context.
@@ -246,9 +271,19 @@ private:
 
     AudioStreamInALSA(const AudioStreamInALSA &);
     AudioStreamInALSA& operator = (const AudioStreamInALSA &);
-    void                resetFramesLost();
     size_t              generateSilence(void* buffer, size_t bytes);
 
+    /**
+     * Reads frames from the audio device and applies the pre processing if any.
+     * Must be called with stream lock held, route available.
+     *
+     * @param[out] buffer audio samples captured, in stream sample specification.
+     * @param[in] bytes size of the buffer, in bytes.
+     *
+     * @return number of bytes read if success, negative error code otherwise.
+     */
+    ssize_t             readL(void *buffer, ssize_t bytes);
+
     ssize_t             readHwFrames(void* buffer, size_t frames);
 
     ssize_t             readFrames(void* buffer, size_t frames);
@@ -257,18 +292,71 @@ private:
 
     android::status_t   allocateProcessingMemory(ssize_t frames);
 
-    inline android::status_t     allocateHwBuffer();
+    /**
+     * Get the number of frames of the processing ring sized upon routing.
+     *
+     * @return frames in the stream sample specification.
+     */
+    size_t              getRoutedProcessingRingFramesL() const;
 
     ssize_t             processFrames(void* buffer, ssize_t frames);
 
     int                 doProcessFrames(const void* buffer, ssize_t frames,
-                                               ssize_t* processed_frames,
-                                               ssize_t* processing_frames_in);
+                                               ssize_t* processed_frames);
 
-    status_t            pushEchoReference(ssize_t frames, effect_handle_t preprocessor,
-                                          struct echo_reference_itfe *reference);
+    /**
+     * Get the capacity of the processing ring for a given read size.
+     * Ring must hold a read request and the remainder of an effect frame.
+     *
+     * @param[in] frames number of frames requested by a read.
+     *
+     * @return capacity of the ring, in frames.
+     */
+    size_t              getProcessingRingFrames(ssize_t frames) const;
+
+    /**
+     * Feeds the far end reference to an AEC preprocessor and updates its echo delay.
+     * Reference frames are processed in place in the echo reference ring.
+     *
+     * @param[in] frames maximum number of reference frames to provide.
+     * @param[in] effect AEC preprocessor, with its echo reference and reader.
+     * @param[in] captureDelay capture time stamp and delay of the frames to process.
+     *
+     * @return OK if success, error code otherwise.
+     */
+    status_t            pushEchoReference(ssize_t frames, const AudioEffectHandle &effect,
+                                          const struct echo_reference_buffer *captureDelay);
 
-    int32_t             updateEchoReference(ssize_t frames, struct echo_reference_itfe *reference);
+    /**
+     * Queues the reference processing of the frames pending in the processing ring
+     * to the echo reference worker, and wakes it up.
+     * Capture thread context, pipelined AEC mode only.
+     *
+     * @param[in] frames number of frames the reference is requested for.
+     */
+    void                postEchoReference(ssize_t frames);
+
+    /**
+     * Runs the reverse stream processing of all AEC preprocessors.
+     *
+     * @param[in] request frames and capture delay of the reference to process.
+     */
+    void                processEchoReference(const struct echo_reference_buffer &request);
+
+    /**
+     * Checks if the reverse stream processing runs on the echo reference worker.
+     *
+     * @return true if pipelined AEC mode is enabled.
+     */
+    bool                isAecPipelined() const { return mEchoReferenceThread != NULL; }
+
+    // Inherited from IEventListener: echo reference worker events
+    virtual bool onEvent(int iFd);
+    virtual bool onError(int iFd);
+    virtual bool onHangup(int iFd);
+    virtual void onAlarm();
+    virtual void onPollError();
+    virtual bool onProcess(uint16_t uiEvent);
 
     status_t            setPreprocessorEchoDelay(effect_handle_t handle, int32_t delay_us);
 
@@ -279,7 +367,11 @@ private:
     status_t            checkAndAddAudioEffects();
     status_t            checkAndRemoveAudioEffects();
 
-    unsigned int        mFramesLost;
+    /**
+     * Frames lost by this stream when sharing the capture with other streams,
+     * reset when reported to the client.
+     */
+    mutable volatile int32_t mFramesLost;
     AudioSystem::audio_in_acoustics mAcoustics;
 
     /**
@@ -291,44 +383,59 @@ private:
     ssize_t mFramesIn;
 
     /**
-     * This variable represents the number of frames of in mProcessingBuffer.
-     */
-    ssize_t mProcessingFramesIn;
-
-    /**
-     * This variable is a dynamic buffer and contains raw data read from input device.
+     * Ring of raw data read from input device.
      * It is used as input buffer before application of SW accoustics effects.
      */
-    int16_t* mProcessingBuffer;
+    AudioRingBuffer mProcessingRing;
 
     /**
-     * This variable represents the size in frames of in mProcessingBuffer.
+     * It is vector which contains the handlers to accoustics effects.
      */
-    ssize_t mProcessingBufferSizeInFrames;
+    Vector <AudioEffectHandle> mPreprocessorsHandlerList;
+
+    char* mHwBuffer;
+    ssize_t mHwBufferSize;
 
     /**
-     * This variable represents the number of frames of in mReferenceBuffer.
+     * Worker running the reverse stream processing of AEC preprocessors,
+     * NULL if AEC is not pipelined.
      */
-    ssize_t mReferenceFramesIn;
+    CEventThread *mEchoReferenceThread;
+
+    /** Number of requests in flight to the echo reference worker. Must be a power of 2. */
+    static const uint32_t ECHO_REFERENCE_QUEUE_SIZE = 8;
 
     /**
-     * This variable is a dynamic buffer and contains the data used as reference for AEC and
-     * which are read from AudioEffectHandle::mEchoReference.
+     * Reference processing requests, from the capture thread to the echo reference worker.
+     * Only frame_count, time_stamp and delay_ns are meaningful.
      */
-    int16_t* mReferenceBuffer;
+    AudioSpscQueue<struct echo_reference_buffer, ECHO_REFERENCE_QUEUE_SIZE>
+    mEchoReferenceRequests;
 
     /**
-     * This variable represents the size in frames of in mReferenceBuffer.
+     * Serializes the echo reference worker against the updates of the effects list
+     * in pipelined AEC mode.
      */
-    ssize_t mReferenceBufferSizeInFrames;
+    audio_comms::utilities::Mutex mEchoReferenceLock;
+
+    /** Capture thread time spent in the effects, per period read. */
+    uint32_t            mProcessedPeriods;
+    nsecs_t             mProcessingTime;
+    nsecs_t             mMaxProcessingTime;
 
     /**
-     * It is vector which contains the handlers to accoustics effects.
+     * Bytes copied by the staging of the preprocessing, and bytes left in the capture and
+     * reference rings across effect calls, which linear staging buffers had to realign.
+     * Reference bytes are accounted from the context pushing the echo reference.
      */
-    Vector <AudioEffectHandle> mPreprocessorsHandlerList;
+    uint64_t            mStagingCopiedBytes;
+    uint64_t            mCaptureKeptBytes;
+    uint64_t            mReferenceKeptBytes;
 
-    char* mHwBuffer;
-    ssize_t mHwBufferSize;
+    static const char *const AEC_PIPELINED_PROP_NAME;
+
+    /** Duration of the frames processed by the effects library, in microseconds. */
+    static const uint32_t EFFECT_FRAME_DURATION_US = 10000;
 };
 
 };        // namespace android
@@ -29,7 +29,12 @@
 
 #include "AudioStreamOutALSA.h"
 #include "AudioStreamRoute.h"
+#include "AudioEchoReference.h"
+#include "Property.h"
 #include <AudioCommsAssert.hpp>
+#include <utils/String8.h>
+#include <unistd.h>
+#include <algorithm>
 
 #define base ALSAStreamOps
 
@@ -44,12 +49,27 @@ const uint32_t AudioStreamOutALSA::WAIT_BEFORE_RETRY_US = 10000; //10ms
  */
 const uint32_t AudioStreamOutALSA::USEC_PER_MSEC = 1000;
 
+const char* const AudioStreamOutALSA::ASYNC_START_PROP_NAME = "audiocomms.HAL.AsyncOutputStart";
+
+const uint32_t AudioStreamOutALSA::PREBUFFER_PERIODS = 4;
+
 AudioStreamOutALSA::AudioStreamOutALSA(AudioHardwareALSA *parent, audio_output_flags_t flags) :
     base(parent, "AudioOutLock"),
     mFrameCount(0),
     _flags(flags),
-    mEchoReference(NULL)
+    mEchoReference(NULL),
+    mLeftGain(1.0f),
+    mRightGain(1.0f),
+    mAsyncStart(TProperty<bool>(ASYNC_START_PROP_NAME, false)),
+    mRouteUnmuted(false),
+    mStartTime(0),
+    mFirstSampleWritten(true),
+    mLastTimeToFirstSample(0),
+    mMaxTimeToFirstSample(0),
+    mMaxWriteBlocking(0),
+    mPrebufferDroppedFrames(0)
 {
+    memset(&mPowerSavingPcmConfig, 0, sizeof(mPowerSavingPcmConfig));
 }
 
 AudioStreamOutALSA::~AudioStreamOutALSA()
@@ -61,8 +81,17 @@ uint32_t AudioStreamOutALSA::channels() const
     return ALSAStreamOps::channels();
 }
 
-status_t AudioStreamOutALSA::setVolume(float __UNUSED left, float __UNUSED right)
+status_t AudioStreamOutALSA::setVolume(float left, float right)
 {
+    AutoW lock(_streamLock);
+
+    mLeftGain = left;
+    mRightGain = right;
+
+    if (isRouteAvailableL()) {
+
+        getCurrentRouteL()->setPlaybackGain(this, mLeftGain, mRightGain);
+    }
     return NO_ERROR;
 }
 
@@ -70,25 +99,177 @@ size_t AudioStreamOutALSA::generateSilence(size_t bytes)
 {
     // No HW will drive the timeline:
     //       we are here because of hardware error or missing route availability.
-    // Also, keep time sync by sleeping the equivalent amount of time.
-    usleep(mSampleSpec.convertFramesToUsec(mSampleSpec.convertBytesToFrames(bytes)));
+    // Also, keep time sync by waiting on the virtual clock and keep the render position
+    // moving as if the frames were played.
+    size_t frames = mSampleSpec.convertBytesToFrames(bytes);
+    waitVirtualClock(frames);
+    mFrameCount += frames;
     return bytes;
 }
 
 ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
 {
+    nsecs_t writeStart = systemTime();
+
+    if (!isStarted()) {
+
+        AutoW lock(_streamLock);
+        mStartTime = writeStart;
+        mFirstSampleWritten = false;
+    }
     setStandby(false);
 
-    AutoR lock(_streamLock);
+    ssize_t ret = doWrite(buffer, bytes);
 
-    // Check if the audio route is available for this stream
-    if (!isRouteAvailableL()) {
+    nsecs_t writeBlocking = systemTime() - writeStart;
+    if (writeBlocking > mMaxWriteBlocking) {
+
+        mMaxWriteBlocking = writeBlocking;
+        ALOGV("%s: write blocked %lld us", __FUNCTION__,
+              static_cast<long long>(ns2us(writeBlocking)));
+    }
+    return ret;
+}
+
+ssize_t AudioStreamOutALSA::doWrite(const void *buffer, size_t bytes)
+{
+    {
+        AutoR lock(_streamLock);
+
+        // Check if the audio route is available for this stream
+        if (isRouteAvailableL() && isPrebufferReleasedL()) {
+
+            // Frames written while the asynchronous start was routed go first
+            flushPrebufferL();
 
-        ALOGW("%s(buffer=%p, bytes=%d) No route available. Generating silence.",
-            __FUNCTION__, buffer, bytes);
-        return generateSilence(bytes);
+            // The route is attached between two writes, hence the audio device takes over
+            // the timeline on a period boundary.
+            resetVirtualClock();
+            return writeL(buffer, bytes);
+        }
+        if (mAsyncStart && prebufferL(buffer, bytes)) {
+
+            // Played once routed
+            return bytes;
+        }
     }
 
+    if (mAsyncStart) {
+
+        // Routing lasts longer than the prebuffer: wait for it for the duration of the frames,
+        // without holding the stream lock
+        waitVirtualClock(mSampleSpec.convertBytesToFrames(bytes));
+
+        AutoR lock(_streamLock);
+        if (isRouteAvailableL()) {
+
+            // Routing not over yet: the prebuffer is played anyway rather than dropped
+            flushPrebufferL();
+            resetVirtualClock();
+            return writeL(buffer, bytes);
+        }
+        // Play time of the oldest prebuffered frames has passed meanwhile: they make room for
+        // the newest ones, so that the stream starts from the most recent frames once routed
+        size_t frames = mSampleSpec.convertBytesToFrames(bytes);
+        size_t droppedFrames = dropOldestPrebufferedFramesL(frames);
+        mFrameCount += droppedFrames;
+        mPrebufferDroppedFrames += droppedFrames;
+        if (prebufferL(buffer, bytes)) {
+
+            ALOGW("%s(buffer=%p, bytes=%zu) No route available, prebuffer full. %zu oldest "
+                  "frames dropped.", __FUNCTION__, buffer, bytes, droppedFrames);
+            return bytes;
+        }
+        ALOGW("%s(buffer=%p, bytes=%zu) No route available, larger than the prebuffer. "
+              "Dropping.", __FUNCTION__, buffer, bytes);
+        mFrameCount += frames;
+        mPrebufferDroppedFrames += frames;
+        return bytes;
+    }
+
+    // Do not hold the stream lock while waiting: the route manager must be able to attach
+    // a route in the meantime.
+    ALOGW("%s(buffer=%p, bytes=%zu) No route available. Generating silence.",
+        __FUNCTION__, buffer, bytes);
+    return generateSilence(bytes);
+}
+
+bool AudioStreamOutALSA::prebufferL(const void *buffer, size_t bytes)
+{
+    size_t frames = mSampleSpec.convertBytesToFrames(bytes);
+
+    if (mPrebufferRing.getCapacityFrames() == 0) {
+
+        // Sized upon first use, sample specification of the stream is known by then
+        size_t ringFrames = PREBUFFER_PERIODS * mSampleSpec.convertBytesToFrames(getBufferSizeL());
+        if (mPrebufferRing.resize(ringFrames, mSampleSpec.getFrameSize()) != NO_ERROR) {
+
+            return false;
+        }
+    }
+    if (mPrebufferRing.getFreeFrames() < frames) {
+
+        return false;
+    }
+    mPrebufferRing.write(buffer, frames);
+
+    return true;
+}
+
+size_t AudioStreamOutALSA::dropOldestPrebufferedFramesL(size_t frames)
+{
+    size_t freeFrames = mPrebufferRing.getFreeFrames();
+    if (freeFrames >= frames) {
+
+        return 0;
+    }
+    size_t droppedFrames = std::min(frames - freeFrames, mPrebufferRing.getAvailableFrames());
+
+    // Read regions are released without being read
+    size_t remainingFrames = droppedFrames;
+    while (remainingFrames != 0) {
+
+        size_t regionFrames;
+        mPrebufferRing.getReadRegion(&regionFrames);
+        regionFrames = std::min(regionFrames, remainingFrames);
+        mPrebufferRing.commitRead(regionFrames);
+        remainingFrames -= regionFrames;
+    }
+    return droppedFrames;
+}
+
+void AudioStreamOutALSA::flushPrebufferL()
+{
+    if (mPrebufferRing.getAvailableFrames() == 0) {
+
+        return;
+    }
+    ALOGD("%s: %zu frames prebuffered", __FUNCTION__, mPrebufferRing.getAvailableFrames());
+
+    // Written by periods, as the application does
+    size_t periodFrames = mSampleSpec.convertBytesToFrames(getBufferSizeL());
+
+    while (mPrebufferRing.getAvailableFrames() != 0) {
+
+        size_t frames;
+        const void *region = mPrebufferRing.getReadRegion(&frames);
+        if (frames > periodFrames) {
+
+            frames = periodFrames;
+        }
+        if (writeL(region, mSampleSpec.convertFramesToBytes(frames)) < 0) {
+
+            ALOGE("%s: %zu prebuffered frames dropped", __FUNCTION__,
+                  mPrebufferRing.getAvailableFrames());
+            break;
+        }
+        mPrebufferRing.commitRead(frames);
+    }
+    mPrebufferRing.reset();
+}
+
+ssize_t AudioStreamOutALSA::writeL(const void *buffer, size_t bytes)
+{
     AUDIOCOMMS_ASSERT(mHandle != NULL, "unexpected NULL handle on audio device");
 
     ssize_t srcFrames = mSampleSpec.convertBytesToFrames(bytes);
@@ -146,6 +327,8 @@ ssize_t AudioStreamOutALSA::write(const void *buffer, size_t bytes)
                                                  "after_conversion");
     }
 
+    mFrameCount += srcFrames;
+
     return mSampleSpec.convertFramesToBytes(AudioUtils::convertSrcToDstInFrames(ret,
                                                                                  mHwSampleSpec,
                                                                                  mSampleSpec));
@@ -157,7 +340,8 @@ ssize_t AudioStreamOutALSA::writeFrames(void* buffer, ssize_t frames)
     uint32_t retryCount = 0;
 
     do {
-        ret = pcm_write(mHandle, (char *)buffer, pcm_frames_to_bytes(mHandle, frames));
+        // Route may mix the frames with other streams before writing the device
+        ret = getCurrentRouteL()->writePlayback(this, buffer, frames);
 
         ALOGV("%s %d %d", __FUNCTION__, ret, pcm_frames_to_bytes(mHandle, frames));
 
@@ -183,11 +367,52 @@ ssize_t AudioStreamOutALSA::writeFrames(void* buffer, ssize_t frames)
         }
     } while (ret != 0);
 
+    if (!mFirstSampleWritten) {
+
+        mFirstSampleWritten = true;
+        mLastTimeToFirstSample = systemTime() - mStartTime;
+        if (mLastTimeToFirstSample > mMaxTimeToFirstSample) {
+
+            mMaxTimeToFirstSample = mLastTimeToFirstSample;
+        }
+        ALOGD("%s: first frames written %lld ms after stream start%s", __FUNCTION__,
+              static_cast<long long>(ns2ms(mLastTimeToFirstSample)),
+              mAsyncStart ? " (asynchronous)" : "");
+    }
+
     return frames;
 }
 
-status_t AudioStreamOutALSA::dump(int , const Vector<String16>& )
+void AudioStreamOutALSA::updateRouteLatencyL()
+{
+    const CAudioStreamRoute *route = getCurrentRouteL();
+
+    if (route->isPowerSavingConfigInUse(isOut())) {
+
+        mPowerSavingPcmConfig = route->getPcmConfig(isOut());
+        updateLatency(mPowerSavingPcmConfig);
+    } else {
+
+        mPowerSavingPcmConfig.period_size = 0;
+        updateLatency(_flags);
+    }
+}
+
+status_t AudioStreamOutALSA::dump(int fd, const Vector<String16>& )
 {
+    String8 result;
+
+    result.appendFormat("Output stream %p (flags=0x%x, %s start):\n", this, _flags,
+                        mAsyncStart ? "asynchronous" : "synchronous");
+    result.appendFormat("  time to first sample: last %lld ms, max %lld ms\n",
+                        static_cast<long long>(ns2ms(mLastTimeToFirstSample)),
+                        static_cast<long long>(ns2ms(mMaxTimeToFirstSample)));
+    result.appendFormat("  write blocking: max %lld ms\n",
+                        static_cast<long long>(ns2ms(mMaxWriteBlocking)));
+    result.appendFormat("  prebuffer: %u frames dropped while routing\n",
+                        mPrebufferDroppedFrames);
+    ::write(fd, result.string(), result.size());
+
     return NO_ERROR;
 }
 
@@ -222,15 +447,33 @@ status_t AudioStreamOutALSA::attachRouteL()
         uint32_t uiMsCount;
         for (uiMsCount = 0; uiMsCount < uiSilenceMs; uiMsCount++) {
 
-            pcm_write(mHandle,
-                          (const char*)pSilenceBuffer,
-                          uiBufferSize);
+            getCurrentRouteL()->writePlayback(this,
+                                              pSilenceBuffer,
+                                              mHwSampleSpec.convertBytesToFrames(uiBufferSize));
         }
     }
+    getCurrentRouteL()->setPlaybackGain(this, mLeftGain, mRightGain);
+    updateRouteLatencyL();
+
+    // Prebuffered frames are held until the route is unmuted, then written by the stream
+    mRouteUnmuted = false;
 
     return NO_ERROR;
 }
 
+//
+// Called from Route Manager Context
+//
+void AudioStreamOutALSA::onRouteUnmuted()
+{
+    AutoW lock(_streamLock);
+
+    if (isRouteAvailableL()) {
+
+        mRouteUnmuted = true;
+    }
+}
+
 
 status_t AudioStreamOutALSA::close()
 {
@@ -240,6 +483,12 @@ status_t AudioStreamOutALSA::close()
 status_t AudioStreamOutALSA::standby()
 {
     mFrameCount = 0;
+    {
+        AutoW lock(_streamLock);
+
+        // Frames not played yet are dropped
+        mPrebufferRing.reset();
+    }
 
     return setStandby(true);
 }
@@ -251,6 +500,16 @@ uint32_t AudioStreamOutALSA::latency() const
 
 size_t AudioStreamOutALSA::bufferSize() const
 {
+    AutoR lock(_streamLock);
+    return getBufferSizeL();
+}
+
+size_t AudioStreamOutALSA::getBufferSizeL() const
+{
+    if (mPowerSavingPcmConfig.period_size != 0) {
+
+        return getBufferSize(mPowerSavingPcmConfig);
+    }
     return getBufferSize(_flags);
 }
 
@@ -276,7 +535,8 @@ status_t AudioStreamOutALSA::flush()
 
     LOG_ALWAYS_FATAL_IF(mHandle == NULL);
 
-    status_t status = pcm_stop(mHandle);
+    // Only the frames of this stream are dropped if the route mixes other streams
+    status_t status = getCurrentRouteL()->flushPlayback(this);
     ALOGD("pcm stop status %d", status);
     return status;
 }
@@ -287,7 +547,13 @@ void AudioStreamOutALSA::setFlags(uint32_t uiFlags)
     AutoW lock(_streamLock);
     _flags = uiFlags;
 
-    updateLatency(uiFlags);
+    if (isRouteAvailableL()) {
+
+        updateRouteLatencyL();
+    } else {
+
+        updateLatency(uiFlags);
+    }
 }
 
 status_t  AudioStreamOutALSA::setParameters(const String8& keyValuePairs)
@@ -303,7 +569,7 @@ status_t  AudioStreamOutALSA::setParameters(const String8& keyValuePairs)
     return ALSAStreamOps::setParameters(keyValuePairs);
 }
 
-void AudioStreamOutALSA::addEchoReference(struct echo_reference_itfe* reference)
+void AudioStreamOutALSA::addEchoReference(CAudioEchoReference* reference)
 {
     ALOGD("%s(reference = %p): note mEchoReference = %p", __FUNCTION__, reference, mEchoReference);
 
@@ -314,13 +580,13 @@ void AudioStreamOutALSA::addEchoReference(struct echo_reference_itfe* reference)
     mEchoReference = reference;
 }
 
-void AudioStreamOutALSA::removeEchoReference(struct echo_reference_itfe* reference)
+void AudioStreamOutALSA::removeEchoReference(CAudioEchoReference* reference)
 {
     AutoW lock(_streamLock);
     removeEchoReferenceL(reference);
 }
 
-void AudioStreamOutALSA::removeEchoReferenceL(struct echo_reference_itfe* reference)
+void AudioStreamOutALSA::removeEchoReferenceL(CAudioEchoReference* reference)
 {
     if (reference == NULL) {
 
@@ -331,7 +597,6 @@ void AudioStreamOutALSA::removeEchoReferenceL(struct echo_reference_itfe* refere
     // Called from a WLocked context
     if (mEchoReference == reference) {
 
-        mEchoReference->write(mEchoReference, NULL);
         mEchoReference = NULL;
     }
 }
@@ -356,7 +621,7 @@ int AudioStreamOutALSA::getPlaybackDelay(ssize_t frames, struct echo_reference_b
      * Add the duration of current frame as we want the render time of the last
      * sample being written.
      */
-    buffer->delay_ns = mSampleSpec.convertFramesToUsec(kernel_frames + frames);
+    buffer->delay_ns = mSampleSpec.convertFramesToUsec(kernel_frames + frames) * 1000;
 
     ALOGV("%s: kernel_frames=%d buffer->time_stamp.tv_sec=%lu,"
           "buffer->time_stamp.tv_nsec =%lu buffer->delay_ns=%d",
@@ -373,11 +638,10 @@ void AudioStreamOutALSA::pushEchoReference(const void *buffer, ssize_t frames)
 {
     if (mEchoReference != NULL)
     {
+        // Period is written once in the reference ring, along with its render time
         struct echo_reference_buffer b;
-        b.raw = (void *)buffer;
-        b.frame_count = frames;
-        getPlaybackDelay(b.frame_count, &b);
-        mEchoReference->write(mEchoReference, &b);
+        getPlaybackDelay(frames, &b);
+        mEchoReference->write(buffer, frames, &b);
     }
 }
 
@@ -19,11 +19,14 @@
 
 #include "AudioHardwareALSA.h"
 #include "ALSAStreamOps.h"
+#include "AudioRingBuffer.h"
+#include <utils/Timers.h>
 
-struct echo_reference_itfe;
+struct echo_reference_buffer;
 
 namespace android_audio_legacy
 {
+class CAudioEchoReference;
 
 class AudioStreamOutALSA : public AudioStreamOut, public ALSAStreamOps
 {
@@ -75,25 +78,33 @@ public:
 
     virtual bool        isOut() const { return true; }
 
+    virtual bool        isStartAsynchronous() const { return mAsyncStart; }
+
     status_t            open(int mode);
     status_t            close();
 
     virtual status_t attachRouteL();
     virtual status_t detachRouteL();
 
+    /**
+     * Releases the prebuffered frames to the next write, once the route is unmuted.
+     * Called from route manager context at the end of the routing.
+     */
+    void                onRouteUnmuted();
+
     /**
      * Request to provide Echo Reference.
      *
      * @param[in] echo reference structure pointer.
      */
-    void                addEchoReference(struct echo_reference_itfe* reference);
+    void                addEchoReference(CAudioEchoReference* reference);
 
     /**
      * Cancel the request to provide Echo Reference.
      *
      * @param[in] echo reference structure pointer.
      */
-    void removeEchoReference(struct echo_reference_itfe* reference);
+    void removeEchoReference(CAudioEchoReference* reference);
 
     /**
      * Cancel the request to provide Echo Reference.
@@ -101,9 +112,9 @@ public:
      *
      * @param[in] echo reference structure pointer.
      */
-    void removeEchoReferenceL(struct echo_reference_itfe *reference);
+    void removeEchoReferenceL(CAudioEchoReference *reference);
 
-    struct echo_reference_itfe* getEchoReference() { return mEchoReference; }
+    CAudioEchoReference* getEchoReference() { return mEchoReference; }
 
     virtual status_t    flush();
 
@@ -128,28 +139,135 @@ public:
      */
     virtual uint32_t    getApplicabilityMask() const { return getFlags(); }
 
+    virtual uint32_t    getApplicabilityMaskL() const { return _flags; }
+
 private:
     AudioStreamOutALSA(const AudioStreamOutALSA&);
     AudioStreamOutALSA& operator = (const AudioStreamOutALSA&);
 
     size_t              generateSilence(size_t bytes);
 
+    /**
+     * Writes the buffer to the audio device if routed, prebuffers it while an asynchronous
+     * start is routed, generates silence otherwise.
+     *
+     * @param[in] buffer audio samples to play, in stream sample specification.
+     * @param[in] bytes size of the buffer, in bytes.
+     *
+     * @return number of bytes consumed if success, negative error code otherwise.
+     */
+    ssize_t             doWrite(const void *buffer, size_t bytes);
+
+    /**
+     * Queues the buffer until the stream is routed.
+     * Must be called with stream lock held, route not available.
+     *
+     * @param[in] buffer audio samples to play, in stream sample specification.
+     * @param[in] bytes size of the buffer, in bytes.
+     *
+     * @return true if queued, false if the prebuffer is full.
+     */
+    bool                prebufferL(const void *buffer, size_t bytes);
+
+    /**
+     * Makes room in the prebuffer, dropping the oldest prebuffered frames.
+     * Must be called with stream lock held, route not available.
+     *
+     * @param[in] frames number of frames to make room for.
+     *
+     * @return number of frames dropped.
+     */
+    size_t              dropOldestPrebufferedFramesL(size_t frames);
+
+    /**
+     * Writes the prebuffered frames to the audio device, from the thread writing the stream.
+     * Must be called with stream lock held, route available.
+     */
+    void                flushPrebufferL();
+
+    /**
+     * Checks if the frames written may go to the audio device, ie if no prebuffered frame is
+     * held until the route is unmuted.
+     * Must be called with stream lock held, route available.
+     */
+    bool                isPrebufferReleasedL() const
+    {
+        return mRouteUnmuted || (mPrebufferRing.getAvailableFrames() == 0);
+    }
+
+    /**
+     * Writes the buffer to the audio device.
+     * Must be called with stream lock held, route available.
+     *
+     * @param[in] buffer audio samples to play, in stream sample specification.
+     * @param[in] bytes size of the buffer, in bytes.
+     *
+     * @return number of bytes consumed if success, negative error code otherwise.
+     */
+    ssize_t             writeL(const void *buffer, size_t bytes);
+
     ssize_t             writeFrames(void* buffer, ssize_t frames);
 
+    /**
+     * Updates the latency and the buffer size from the configuration of the route, which may
+     * use power saving periods. Must be called with stream lock held, route available.
+     */
+    void                updateRouteLatencyL();
+
+    /**
+     * Get the size of a period. Must be called with stream lock held.
+     *
+     * @return size of a period of the route configuration in use, in bytes.
+     */
+    size_t              getBufferSizeL() const;
+
     uint32_t            mFrameCount;
 
     uint32_t            _flags;
 
+    /** Power saving configuration of the route, period_size is 0 if not in use. */
+    pcm_config          mPowerSavingPcmConfig;
+
     void                pushEchoReference(const void *buffer, ssize_t frames);
 
     int                 getPlaybackDelay(ssize_t frames, struct echo_reference_buffer * buffer);
 
-    struct echo_reference_itfe* mEchoReference;
+    CAudioEchoReference* mEchoReference;
+
+    /** Gains applied by the route when the stream is mixed with other streams. */
+    float               mLeftGain;
+    float               mRightGain;
+
+    /**
+     * Asynchronous start: the first writes do not wait for the routing, their frames are
+     * prebuffered and written to the audio device once the stream is routed.
+     */
+    bool                mAsyncStart;
+    AudioRingBuffer     mPrebufferRing;
+
+    /** Route unmuted since attached: prebuffered frames are not played muted before. */
+    bool                mRouteUnmuted;
+
+    /** Start metrics. */
+    nsecs_t             mStartTime;
+    bool                mFirstSampleWritten;
+    nsecs_t             mLastTimeToFirstSample; /**< from start to first frames written. */
+    nsecs_t             mMaxTimeToFirstSample;
+    nsecs_t             mMaxWriteBlocking; /**< longest time spent in write(). */
+    uint32_t            mPrebufferDroppedFrames; /**< too late to be played once routed. */
+
+    /** Property enabling the asynchronous start of output streams. */
+    static const char* const ASYNC_START_PROP_NAME;
+
+    /** Periods of playback prebuffered while the stream is routed. */
+    static const uint32_t PREBUFFER_PERIODS;
 
     static const uint32_t MAX_AGAIN_RETRY;
     static const uint32_t WAIT_TIME_MS;
     static const uint32_t WAIT_BEFORE_RETRY_US;
     static const uint32_t USEC_PER_MSEC;
+
+    friend class CAudioRoutingReplayer;
 };
 
 };        // namespace android
@@ -0,0 +1,115 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "AudioVirtualClock"
+
+#include "AudioVirtualClock.h"
+#include <utils/Log.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+namespace android_audio_legacy
+{
+
+const uint64_t AudioVirtualClock::NSEC_PER_SEC = 1000000000ULL;
+const uint64_t AudioVirtualClock::NSEC_PER_USEC = 1000ULL;
+
+AudioVirtualClock::AudioVirtualClock()
+    : _iTimerFd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)),
+      _bAnchored(false),
+      _ullDeadlineNs(0)
+{
+    if (_iTimerFd < 0) {
+
+        ALOGW("%s: timerfd not available (%s), falling back on clock_nanosleep",
+              __FUNCTION__, strerror(errno));
+    }
+}
+
+AudioVirtualClock::~AudioVirtualClock()
+{
+    if (_iTimerFd >= 0) {
+
+        close(_iTimerFd);
+    }
+}
+
+void AudioVirtualClock::wait(uint32_t uiDurationUs)
+{
+    uint64_t ullNowNs = now();
+
+    if (!_bAnchored) {
+
+        _ullDeadlineNs = ullNowNs;
+        _bAnchored = true;
+    }
+    _ullDeadlineNs += uiDurationUs * NSEC_PER_USEC;
+
+    if (_ullDeadlineNs <= ullNowNs) {
+
+        // More than a buffer late (client stalled): do not burst to catch up, restart the
+        // timeline from now instead.
+        ALOGV("%s: %llu ns late, resync", __FUNCTION__, ullNowNs - _ullDeadlineNs);
+        _ullDeadlineNs = ullNowNs;
+        return;
+    }
+    sleepUntil(_ullDeadlineNs);
+}
+
+void AudioVirtualClock::sleepUntil(uint64_t ullDeadlineNs)
+{
+    struct timespec deadline;
+    deadline.tv_sec = ullDeadlineNs / NSEC_PER_SEC;
+    deadline.tv_nsec = ullDeadlineNs % NSEC_PER_SEC;
+
+    if (_iTimerFd >= 0) {
+
+        struct itimerspec timerSpec;
+        memset(&timerSpec, 0, sizeof(timerSpec));
+        timerSpec.it_value = deadline;
+
+        if (timerfd_settime(_iTimerFd, TFD_TIMER_ABSTIME, &timerSpec, NULL) == 0) {
+
+            uint64_t ullExpirations;
+            ssize_t ret;
+            do {
+                ret = read(_iTimerFd, &ullExpirations, sizeof(ullExpirations));
+            } while ((ret < 0) && (errno == EINTR));
+
+            if (ret == sizeof(ullExpirations)) {
+
+                return;
+            }
+        }
+        ALOGE("%s: timerfd error (%s), falling back on clock_nanosleep",
+              __FUNCTION__, strerror(errno));
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+}
+
+uint64_t AudioVirtualClock::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+}       // namespace android
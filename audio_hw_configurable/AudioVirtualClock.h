@@ -0,0 +1,78 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Virtual clock pacing a stream when no audio device drives its timeline.
+ *
+ * Deadlines are absolute on CLOCK_MONOTONIC and advance by the duration of each buffer,
+ * so that wake up jitter does not accumulate over time. A timerfd is used when available,
+ * clock_nanosleep otherwise.
+ * Not thread safe: must only be used from the stream thread.
+ */
+class AudioVirtualClock
+{
+public:
+    AudioVirtualClock();
+    ~AudioVirtualClock();
+
+    /**
+     * Blocks until the virtual device has consumed (or produced) the given duration.
+     * First call after a reset anchors the timeline on the current time.
+     *
+     * @param[in] uiDurationUs duration of the buffer, in microseconds.
+     */
+    void wait(uint32_t uiDurationUs);
+
+    /**
+     * Drops the timeline.
+     * To be called when the stream is driven by the hardware again.
+     */
+    void reset() { _bAnchored = false; }
+
+private:
+    AudioVirtualClock(const AudioVirtualClock &);
+    AudioVirtualClock &operator=(const AudioVirtualClock &);
+
+    /**
+     * Sleeps until the absolute deadline.
+     *
+     * @param[in] ullDeadlineNs absolute deadline on CLOCK_MONOTONIC, in nanoseconds.
+     */
+    void sleepUntil(uint64_t ullDeadlineNs);
+
+    /**
+     * Get the current time.
+     *
+     * @return current time on CLOCK_MONOTONIC, in nanoseconds.
+     */
+    static uint64_t now();
+
+    int _iTimerFd; /**< timer file descriptor, negative if timerfd is not supported. */
+    bool _bAnchored; /**< true when the timeline has been started. */
+    uint64_t _ullDeadlineNs; /**< next absolute deadline, in nanoseconds. */
+
+    static const uint64_t NSEC_PER_SEC;
+    static const uint64_t NSEC_PER_USEC;
+};
+
+};        // namespace android
@@ -0,0 +1,83 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioApplicabilityTables.h"
+#include "AudioRoute.h"
+#include <string.h>
+
+namespace android_audio_legacy
+{
+
+CAudioApplicabilityTables::CAudioApplicabilityTables()
+{
+    reset();
+}
+
+void CAudioApplicabilityTables::reset()
+{
+    memset(_astTables, 0, sizeof(_astTables));
+}
+
+void CAudioApplicabilityTables::addRoute(const CAudioRoute *pRoute)
+{
+    uint32_t uiRouteId = pRoute->getRouteId();
+
+    for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+        for (uint32_t uiBit = 0; uiBit < NB_APPLICABILITY_BITS; uiBit++) {
+
+            uint32_t uiBitMask = (uint32_t)1 << uiBit;
+
+            if (pRoute->_applicabilityRules[uiDir].uiModes & uiBitMask) {
+
+                _astTables[uiDir].auiModeRoutes[uiBit] |= uiRouteId;
+            }
+            if (pRoute->_applicabilityRules[uiDir].uiDevices & uiBitMask) {
+
+                _astTables[uiDir].auiDeviceRoutes[uiBit] |= uiRouteId;
+            }
+            if (pRoute->_applicabilityRules[uiDir].uiMask & uiBitMask) {
+
+                _astTables[uiDir].auiMaskRoutes[uiBit] |= uiRouteId;
+            }
+        }
+    }
+}
+
+uint32_t CAudioApplicabilityTables::getRoutes(bool bIsOut, uint32_t uiDevices, int iMode) const
+{
+    if ((iMode < 0) || (static_cast<uint32_t>(iMode) >= NB_APPLICABILITY_BITS)) {
+
+        return 0;
+    }
+    return _astTables[bIsOut].auiModeRoutes[iMode] &
+            lookupRoutes(_astTables[bIsOut].auiDeviceRoutes, uiDevices);
+}
+
+uint32_t CAudioApplicabilityTables::lookupRoutes(const uint32_t auiBitRoutes[], uint32_t uiBits)
+{
+    uint32_t uiRoutes = 0;
+
+    while (uiBits != 0) {
+
+        uiRoutes |= auiBitRoutes[__builtin_ctz(uiBits)];
+        // Clear lowest bit set
+        uiBits &= uiBits - 1;
+    }
+    return uiRoutes;
+}
+
+}       // namespace android
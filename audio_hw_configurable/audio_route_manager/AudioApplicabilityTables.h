@@ -0,0 +1,98 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "Utils.h"
+
+namespace android_audio_legacy
+{
+
+class CAudioRoute;
+
+/**
+ * Static applicability rules of the routes (modes, devices, stream flags or input sources)
+ * compiled into lookup tables, so that the routes matching a routing request are found with a
+ * few bitwise operations instead of asking each route.
+ *
+ * For each direction, the tables hold the bitfield of the routes applicable in each mode, to
+ * each device and to each stream flag or input source.
+ */
+class CAudioApplicabilityTables
+{
+public:
+    /** Number of bits of the modes, devices and masks of the applicability rules. */
+    static const uint32_t NB_APPLICABILITY_BITS = 32;
+
+    CAudioApplicabilityTables();
+
+    /**
+     * Forgets the routes added.
+     */
+    void reset();
+
+    /**
+     * Adds the rules of a route to the tables.
+     *
+     * @param[in] pRoute route, its rules are not expected to change afterwards.
+     */
+    void addRoute(const CAudioRoute *pRoute);
+
+    /**
+     * Get the routes whose static applicability rules match the devices and mode of a routing.
+     *
+     * @param[in] bIsOut direction of the routing.
+     * @param[in] uiDevices devices of the routing.
+     * @param[in] iMode hardware mode of the routing.
+     *
+     * @return bitfield of the routes.
+     */
+    uint32_t getRoutes(bool bIsOut, uint32_t uiDevices, int iMode) const;
+
+    /**
+     * Get the routes applicable to a stream.
+     *
+     * @param[in] bIsOut direction of the stream.
+     * @param[in] uiMask output flags or input source of the stream.
+     *
+     * @return bitfield of the routes.
+     */
+    uint32_t getMaskRoutes(bool bIsOut, uint32_t uiMask) const
+    {
+        return lookupRoutes(_astTables[bIsOut].auiMaskRoutes, uiMask);
+    }
+
+private:
+    /**
+     * Get the routes applicable to any bit of a bitfield, from a lookup table.
+     *
+     * @param[in] auiBitRoutes lookup table, bitfield of the routes applicable to each bit.
+     * @param[in] uiBits bitfield to look up.
+     *
+     * @return bitfield of the routes.
+     */
+    static uint32_t lookupRoutes(const uint32_t auiBitRoutes[], uint32_t uiBits);
+
+    struct {
+
+        uint32_t auiModeRoutes[NB_APPLICABILITY_BITS];
+        uint32_t auiDeviceRoutes[NB_APPLICABILITY_BITS];
+        uint32_t auiMaskRoutes[NB_APPLICABILITY_BITS];
+    } _astTables[CUtils::ENbDirections];
+};
+
+};        // namespace android
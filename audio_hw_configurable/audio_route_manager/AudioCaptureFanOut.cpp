@@ -0,0 +1,182 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/CaptureFanOut"
+
+#include "AudioCaptureFanOut.h"
+#include <AudioCommsAssert.hpp>
+#include <utils/Log.h>
+#include <stdlib.h>
+#include <string.h>
+
+using android::status_t;
+using android::Mutex;
+using android::OK;
+using android::NO_MEMORY;
+
+namespace android_audio_legacy
+{
+
+const uint32_t CAudioCaptureFanOut::RING_PERIODS = 4;
+
+CAudioCaptureFanOut::CAudioCaptureFanOut()
+    : _pPcmDevice(NULL),
+      _pRing(NULL),
+      _uiPeriodFrames(0),
+      _uiRingFrames(0),
+      _szFrameSize(0),
+      _ullWriteIndex(0)
+{
+}
+
+CAudioCaptureFanOut::~CAudioCaptureFanOut()
+{
+    free(_pRing);
+}
+
+status_t CAudioCaptureFanOut::open(pcm *pPcmDevice, uint32_t uiPeriodFrames)
+{
+    AUDIOCOMMS_ASSERT(pPcmDevice != NULL, "NULL pcm device");
+    AUDIOCOMMS_ASSERT(uiPeriodFrames != 0, "invalid period size");
+
+    Mutex::Autolock lock(_lock);
+
+    uint32_t uiRingFrames = RING_PERIODS * uiPeriodFrames;
+    size_t szFrameSize = pcm_frames_to_bytes(pPcmDevice, 1);
+
+    if ((uiRingFrames * szFrameSize) != (_uiRingFrames * _szFrameSize)) {
+
+        free(_pRing);
+        _pRing = static_cast<char *>(malloc(uiRingFrames * szFrameSize));
+        if (_pRing == NULL) {
+
+            ALOGE("%s: could not allocate capture ring", __FUNCTION__);
+            _uiRingFrames = 0;
+            return NO_MEMORY;
+        }
+    }
+    _pPcmDevice = pPcmDevice;
+    _uiPeriodFrames = uiPeriodFrames;
+    _uiRingFrames = uiRingFrames;
+    _szFrameSize = szFrameSize;
+    _ullWriteIndex = 0;
+
+    return OK;
+}
+
+void CAudioCaptureFanOut::close()
+{
+    Mutex::Autolock lock(_lock);
+
+    ALOGW_IF(!_clientCursors.empty(), "%s: %zu clients still attached", __FUNCTION__,
+             _clientCursors.size());
+    _clientCursors.clear();
+    _pPcmDevice = NULL;
+}
+
+void CAudioCaptureFanOut::addClient(const void *pClient)
+{
+    Mutex::Autolock lock(_lock);
+
+    _clientCursors[pClient] = _ullWriteIndex;
+    ALOGD("%s(%p): %zu clients", __FUNCTION__, pClient, _clientCursors.size());
+}
+
+void CAudioCaptureFanOut::removeClient(const void *pClient)
+{
+    Mutex::Autolock lock(_lock);
+
+    _clientCursors.erase(pClient);
+    ALOGD("%s(%p): %zu clients", __FUNCTION__, pClient, _clientCursors.size());
+}
+
+int CAudioCaptureFanOut::read(const void *pClient, void *pBuffer, uint32_t uiFrames,
+                              uint32_t *puiFramesLost)
+{
+    AUDIOCOMMS_ASSERT(puiFramesLost != NULL, "NULL frames lost pointer");
+
+    Mutex::Autolock lock(_lock);
+
+    *puiFramesLost = 0;
+
+    ClientMapIterator it = _clientCursors.find(pClient);
+    AUDIOCOMMS_ASSERT(it != _clientCursors.end(), "unknown capture client");
+    uint64_t &ullCursor = it->second;
+
+    if ((_clientCursors.size() == 1) && (ullCursor == _ullWriteIndex)) {
+
+        // Alone and up to date: no need to go through the ring
+        return pcm_read(_pPcmDevice, pBuffer, pcm_frames_to_bytes(_pPcmDevice, uiFrames));
+    }
+
+    uint32_t uiCopiedFrames = 0;
+    while (uiCopiedFrames < uiFrames) {
+
+        uint64_t ullAvailableFrames = _ullWriteIndex - ullCursor;
+
+        if (ullAvailableFrames > _uiRingFrames) {
+
+            // Overwritten by the other clients
+            uint32_t uiLostFrames = ullAvailableFrames - _uiRingFrames;
+            *puiFramesLost += uiLostFrames;
+            ullCursor += uiLostFrames;
+            ullAvailableFrames = _uiRingFrames;
+        }
+        if (ullAvailableFrames == 0) {
+
+            int ret = fillPeriod();
+            if (ret != 0) {
+
+                return ret;
+            }
+            continue;
+        }
+        uint32_t uiOffset = ullCursor % _uiRingFrames;
+        uint32_t uiRegionFrames = _uiRingFrames - uiOffset;
+        if (uiRegionFrames > ullAvailableFrames) {
+
+            uiRegionFrames = ullAvailableFrames;
+        }
+        if (uiRegionFrames > uiFrames - uiCopiedFrames) {
+
+            uiRegionFrames = uiFrames - uiCopiedFrames;
+        }
+        memcpy(static_cast<char *>(pBuffer) + uiCopiedFrames * _szFrameSize,
+               _pRing + uiOffset * _szFrameSize,
+               uiRegionFrames * _szFrameSize);
+        ullCursor += uiRegionFrames;
+        uiCopiedFrames += uiRegionFrames;
+    }
+    ALOGW_IF(*puiFramesLost != 0, "%s(%p): %d frames lost", __FUNCTION__, pClient,
+             *puiFramesLost);
+    return 0;
+}
+
+int CAudioCaptureFanOut::fillPeriod()
+{
+    // Write index only moves by periods, so that a period never wraps around the ring
+    uint32_t uiOffset = _ullWriteIndex % _uiRingFrames;
+
+    int ret = pcm_read(_pPcmDevice, _pRing + uiOffset * _szFrameSize,
+                       _uiPeriodFrames * _szFrameSize);
+    if (ret == 0) {
+
+        _ullWriteIndex += _uiPeriodFrames;
+    }
+    return ret;
+}
+
+}       // namespace android
@@ -0,0 +1,114 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <tinyalsa/asoundlib.h>
+#include <utils/Errors.h>
+#include <utils/threads.h>
+#include <map>
+#include <stdint.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Fans out the capture of an input pcm device to several input streams.
+ *
+ * The device is read once, period by period, into a ring of hardware frames. Each client
+ * consumes the ring from its own cursor, then applies its own conversion chain. A client that
+ * lags by more than the ring loses the oldest frames, which is accounted to this client only.
+ * While a single client is attached and has no pending frames, it reads the device directly
+ * into its own buffer, so that the ring costs nothing in the usual case.
+ */
+class CAudioCaptureFanOut
+{
+public:
+    CAudioCaptureFanOut();
+    ~CAudioCaptureFanOut();
+
+    /**
+     * Starts sharing a device. Called by the route upon opening of the input device.
+     *
+     * @param[in] pPcmDevice opened input device.
+     * @param[in] uiPeriodFrames period size of the device, in frames.
+     *
+     * @return OK if success, NO_MEMORY otherwise.
+     */
+    android::status_t open(pcm *pPcmDevice, uint32_t uiPeriodFrames);
+
+    /**
+     * Stops sharing the device. Called by the route before closing the input device.
+     */
+    void close();
+
+    /**
+     * Registers a client. Its cursor starts at the most recent frame.
+     *
+     * @param[in] pClient client identifier.
+     */
+    void addClient(const void *pClient);
+
+    /**
+     * Unregisters a client.
+     *
+     * @param[in] pClient client identifier.
+     */
+    void removeClient(const void *pClient);
+
+    /**
+     * Reads frames for a client. Blocks until all frames are available.
+     *
+     * @param[in] pClient client identifier.
+     * @param[out] pBuffer destination of the frames, in hardware sample specification.
+     * @param[in] uiFrames number of frames to read.
+     * @param[out] puiFramesLost frames lost by the client since its previous read.
+     *
+     * @return 0 if success, pcm_read error code otherwise.
+     */
+    int read(const void *pClient, void *pBuffer, uint32_t uiFrames, uint32_t *puiFramesLost);
+
+private:
+    CAudioCaptureFanOut(const CAudioCaptureFanOut &);
+    CAudioCaptureFanOut &operator=(const CAudioCaptureFanOut &);
+
+    /**
+     * Reads a period of the device in the ring. Must be called with the lock held.
+     *
+     * @return 0 if success, pcm_read error code otherwise.
+     */
+    int fillPeriod();
+
+    typedef std::map<const void *, uint64_t>::iterator ClientMapIterator;
+
+    /** Client cursors, free running indexes in frames. */
+    std::map<const void *, uint64_t> _clientCursors;
+
+    pcm *_pPcmDevice;
+    char *_pRing;
+    uint32_t _uiPeriodFrames;
+    uint32_t _uiRingFrames; /**< multiple of the period size. */
+    size_t _szFrameSize;
+    uint64_t _ullWriteIndex; /**< free running, in frames. */
+
+    /** Serializes the clients, so that the device is read by one client at a time. */
+    android::Mutex _lock;
+
+    /** Periods of capture kept for the clients lagging behind. */
+    static const uint32_t RING_PERIODS;
+};
+
+};        // namespace android
@@ -0,0 +1,326 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/EchoReference"
+
+#include "AudioEchoReference.h"
+#include <AudioConversion.h>
+#include <AudioCommsAssert.hpp>
+#include <audio_utils/echo_reference.h>
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+#include <stdlib.h>
+#include <string.h>
+
+using android::status_t;
+using android::OK;
+using android::NO_MEMORY;
+
+namespace android_audio_legacy
+{
+
+const uint32_t CAudioEchoReference::RING_DURATION_MS = 500;
+const int64_t CAudioEchoReference::MAX_ECHO_DELAY_NS = 250000000LL;
+const int64_t CAudioEchoReference::NSEC_PER_SEC = 1000000000LL;
+
+CAudioEchoReference::CAudioEchoReference(const SampleSpec &readSampleSpec,
+                                         const SampleSpec &writeSampleSpec)
+    : _readSampleSpec(readSampleSpec),
+      _writeSampleSpec(writeSampleSpec),
+      _pAudioConversion(NULL),
+      _pRing(NULL),
+      _uiRingFrames(0),
+      _szFrameSize(readSampleSpec.getFrameSize()),
+      _iWriteIndex(0),
+      _iAnchorSequence(0)
+{
+    for (uint32_t i = 0; i < MAX_READERS; i++) {
+
+        _astReaders[i].iUsed = 0;
+        _astReaders[i].iReadIndex = 0;
+    }
+    _stAnchor.uiFrameIndex = 0;
+    _stAnchor.llRenderTimeNs = 0;
+}
+
+CAudioEchoReference::~CAudioEchoReference()
+{
+    delete _pAudioConversion;
+    free(_pRing);
+}
+
+status_t CAudioEchoReference::init()
+{
+    if (_readSampleSpec != _writeSampleSpec) {
+
+        _pAudioConversion = new AudioConversion;
+        status_t status = _pAudioConversion->configure(_writeSampleSpec, _readSampleSpec);
+        if (status != OK) {
+
+            ALOGE("%s: could not configure reference conversion", __FUNCTION__);
+            return status;
+        }
+    }
+
+    // Power of 2 capacity, so that free running indexes can wrap
+    uint32_t uiMinFrames = _readSampleSpec.convertUsecToframes(RING_DURATION_MS * 1000);
+    for (_uiRingFrames = 1; _uiRingFrames < uiMinFrames; _uiRingFrames <<= 1) {
+    }
+
+    _pRing = static_cast<char *>(malloc(_uiRingFrames * _szFrameSize));
+    if (_pRing == NULL) {
+
+        ALOGE("%s: could not allocate reference ring", __FUNCTION__);
+        return NO_MEMORY;
+    }
+    ALOGD("%s: ring of %d frames, %s", __FUNCTION__, _uiRingFrames,
+          _pAudioConversion != NULL ? "with conversion" : "no conversion");
+    return OK;
+}
+
+int32_t CAudioEchoReference::addReader()
+{
+    for (uint32_t i = 0; i < MAX_READERS; i++) {
+
+        if (_astReaders[i].iUsed == 0) {
+
+            // Starts from the next frame written, cursor is set before the writer sees it
+            _astReaders[i].iReadIndex = android_atomic_acquire_load(&_iWriteIndex);
+            android_atomic_release_store(1, &_astReaders[i].iUsed);
+            return i;
+        }
+    }
+    ALOGE("%s: %d readers already", __FUNCTION__, MAX_READERS);
+    return -1;
+}
+
+void CAudioEchoReference::removeReader(int32_t iReader)
+{
+    AUDIOCOMMS_ASSERT(iReader >= 0 && static_cast<uint32_t>(iReader) < MAX_READERS,
+                      "invalid reader");
+    android_atomic_release_store(0, &_astReaders[iReader].iUsed);
+}
+
+uint32_t CAudioEchoReference::getNbReaders() const
+{
+    uint32_t uiNbReaders = 0;
+
+    for (uint32_t i = 0; i < MAX_READERS; i++) {
+
+        uiNbReaders += _astReaders[i].iUsed;
+    }
+    return uiNbReaders;
+}
+
+//
+// Playback thread context
+//
+void CAudioEchoReference::write(const void *pBuffer, uint32_t uiFrames,
+                                const struct echo_reference_buffer *pPlaybackDelay)
+{
+    AUDIOCOMMS_ASSERT(pPlaybackDelay != NULL, "NULL playback delay");
+
+    const void *pFrames = pBuffer;
+    uint32_t uiRingFrames = uiFrames;
+
+    if (_pAudioConversion != NULL) {
+
+        void *pConverted = NULL;
+        if (_pAudioConversion->convert(pBuffer, &pConverted, uiFrames, &uiRingFrames) != OK) {
+
+            ALOGE("%s: reference conversion failed", __FUNCTION__);
+            return;
+        }
+        pFrames = pConverted;
+    }
+
+    if (!copyToRing(pFrames, uiRingFrames)) {
+
+        // Capture side is not consuming the reference (or is late by more than the ring):
+        // it will realign on the render time of the following buffers.
+        ALOGV("%s: ring full, %d frames dropped", __FUNCTION__, uiRingFrames);
+        return;
+    }
+
+    // Publish the render time of the last frame written
+    SAnchor anchor;
+    anchor.uiFrameIndex = static_cast<uint32_t>(_iWriteIndex) - 1;
+    anchor.llRenderTimeNs = getTimeNs(pPlaybackDelay);
+    publishAnchor(anchor);
+}
+
+bool CAudioEchoReference::copyToRing(const void *pBuffer, uint32_t uiFrames)
+{
+    uint32_t uiWriteIndex = static_cast<uint32_t>(_iWriteIndex);
+
+    if (uiFrames > _uiRingFrames - getMaxPendingFrames(uiWriteIndex)) {
+
+        return false;
+    }
+
+    uint32_t uiCopiedFrames = 0;
+    while (uiCopiedFrames < uiFrames) {
+
+        uint32_t uiOffset = (uiWriteIndex + uiCopiedFrames) & (_uiRingFrames - 1);
+        uint32_t uiRegionFrames = _uiRingFrames - uiOffset;
+        if (uiRegionFrames > uiFrames - uiCopiedFrames) {
+
+            uiRegionFrames = uiFrames - uiCopiedFrames;
+        }
+        memcpy(_pRing + uiOffset * _szFrameSize,
+               static_cast<const char *>(pBuffer) + uiCopiedFrames * _szFrameSize,
+               uiRegionFrames * _szFrameSize);
+        uiCopiedFrames += uiRegionFrames;
+    }
+    android_atomic_release_store(static_cast<int32_t>(uiWriteIndex + uiFrames), &_iWriteIndex);
+    return true;
+}
+
+uint32_t CAudioEchoReference::getMaxPendingFrames(uint32_t uiWriteIndex) const
+{
+    uint32_t uiMaxPendingFrames = 0;
+
+    for (uint32_t i = 0; i < MAX_READERS; i++) {
+
+        if (android_atomic_acquire_load(&_astReaders[i].iUsed) == 0) {
+
+            continue;
+        }
+        uint32_t uiReadIndex =
+                static_cast<uint32_t>(android_atomic_acquire_load(&_astReaders[i].iReadIndex));
+        uint32_t uiPendingFrames = uiWriteIndex - uiReadIndex;
+
+        // Reader added meanwhile starts at or after the write index
+        if ((uiPendingFrames <= _uiRingFrames) && (uiPendingFrames > uiMaxPendingFrames)) {
+
+            uiMaxPendingFrames = uiPendingFrames;
+        }
+    }
+    return uiMaxPendingFrames;
+}
+
+void CAudioEchoReference::publishAnchor(const SAnchor &stAnchor)
+{
+    // Sequence lock: odd while written, readers retry on a change
+    int32_t iSequence = _iAnchorSequence;
+
+    android_atomic_release_store(iSequence + 1, &_iAnchorSequence);
+    android_memory_barrier();
+    _stAnchor = stAnchor;
+    android_atomic_release_store(iSequence + 2, &_iAnchorSequence);
+}
+
+//
+// Reader context
+//
+bool CAudioEchoReference::getAnchor(SAnchor *pstAnchor) const
+{
+    int32_t iSequence;
+    do {
+        iSequence = android_atomic_acquire_load(&_iAnchorSequence);
+        if (iSequence == 0) {
+
+            return false;
+        }
+        *pstAnchor = _stAnchor;
+        android_memory_barrier();
+    } while ((iSequence & 1) || (android_atomic_acquire_load(&_iAnchorSequence) != iSequence));
+
+    return true;
+}
+
+//
+// Reader context
+//
+int32_t CAudioEchoReference::sync(int32_t iReader,
+                                  const struct echo_reference_buffer *pCaptureDelay)
+{
+    AUDIOCOMMS_ASSERT(pCaptureDelay != NULL, "NULL capture delay");
+
+    SAnchor anchor;
+    if (!getAnchor(&anchor)) {
+
+        // Nothing rendered yet
+        return 0;
+    }
+
+    // Capture time of the first frame to process
+    int64_t llCaptureTimeNs = pCaptureDelay->time_stamp.tv_sec * NSEC_PER_SEC +
+            pCaptureDelay->time_stamp.tv_nsec - pCaptureDelay->delay_ns;
+
+    uint32_t uiReadIndex = static_cast<uint32_t>(_astReaders[iReader].iReadIndex);
+    int64_t llEchoDelayNs = llCaptureTimeNs - getRenderTimeNs(anchor, uiReadIndex);
+
+    if (llEchoDelayNs > MAX_ECHO_DELAY_NS) {
+
+        // Skip the frames rendered before the capture time
+        uint32_t uiWriteIndex = static_cast<uint32_t>(android_atomic_acquire_load(&_iWriteIndex));
+        uint32_t uiSkippedFrames = _readSampleSpec.convertUsecToframes(llEchoDelayNs / 1000);
+        if (uiSkippedFrames > uiWriteIndex - uiReadIndex) {
+
+            uiSkippedFrames = uiWriteIndex - uiReadIndex;
+        }
+        ALOGD("%s: echo delay of %lld ns, %d reference frames skipped", __FUNCTION__,
+              static_cast<long long>(llEchoDelayNs), uiSkippedFrames);
+        commitRead(iReader, uiSkippedFrames);
+        llEchoDelayNs = llCaptureTimeNs - getRenderTimeNs(anchor, uiReadIndex + uiSkippedFrames);
+    }
+    // Reference rendered after the capture time cannot be echoed: reference is ahead, which
+    // is recovered by the capture side consuming it.
+    return llEchoDelayNs < 0 ? 0 : static_cast<int32_t>(llEchoDelayNs);
+}
+
+void *CAudioEchoReference::getReadRegion(int32_t iReader, uint32_t *puiFrames) const
+{
+    AUDIOCOMMS_ASSERT(puiFrames != NULL, "NULL frames pointer");
+
+    uint32_t uiReadIndex = static_cast<uint32_t>(_astReaders[iReader].iReadIndex);
+    uint32_t uiWriteIndex = static_cast<uint32_t>(android_atomic_acquire_load(&_iWriteIndex));
+    uint32_t uiOffset = uiReadIndex & (_uiRingFrames - 1);
+    uint32_t uiAvailableFrames = uiWriteIndex - uiReadIndex;
+
+    *puiFrames = uiAvailableFrames < _uiRingFrames - uiOffset ?
+                uiAvailableFrames : _uiRingFrames - uiOffset;
+
+    return _pRing + uiOffset * _szFrameSize;
+}
+
+void CAudioEchoReference::commitRead(int32_t iReader, uint32_t uiFrames)
+{
+    uint32_t uiReadIndex = static_cast<uint32_t>(_astReaders[iReader].iReadIndex);
+    AUDIOCOMMS_ASSERT(uiFrames <= static_cast<uint32_t>(android_atomic_acquire_load(&_iWriteIndex)) -
+                      uiReadIndex, "reference ring underflow");
+
+    android_atomic_release_store(static_cast<int32_t>(uiReadIndex + uiFrames),
+                                 &_astReaders[iReader].iReadIndex);
+}
+
+int64_t CAudioEchoReference::getRenderTimeNs(const SAnchor &stAnchor, uint32_t uiFrameIndex) const
+{
+    // Signed distance, frame may be before or after the anchor
+    int32_t iFrames = static_cast<int32_t>(uiFrameIndex - stAnchor.uiFrameIndex);
+
+    return stAnchor.llRenderTimeNs +
+            iFrames * NSEC_PER_SEC / static_cast<int64_t>(_readSampleSpec.getSampleRate());
+}
+
+int64_t CAudioEchoReference::getTimeNs(const struct echo_reference_buffer *pDelay)
+{
+    return pDelay->time_stamp.tv_sec * NSEC_PER_SEC + pDelay->time_stamp.tv_nsec +
+            pDelay->delay_ns;
+}
+
+}       // namespace android
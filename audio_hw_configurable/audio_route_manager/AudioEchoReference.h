@@ -0,0 +1,229 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <SampleSpec.h>
+#include <utils/Errors.h>
+#include <stdint.h>
+
+struct echo_reference_buffer;
+
+namespace android_audio_legacy
+{
+class AudioConversion;
+
+/**
+ * Echo reference channel between the playback stream providing the far end signal and the
+ * AEC effects of the capture streams.
+ *
+ * Frames are stored once, in the capture sample specification, in a single producer ring read
+ * by several consumers: the playback thread writes each period and publishes its render time
+ * stamp, each AEC effect processes the reference in place in the ring from its own read cursor,
+ * aligned on its capture time stamp. The ring only drops playback frames once full for the
+ * slowest reader. Conversion (hence resampling) is only done when playback and capture sample
+ * specifications differ. None of the two sides ever blocks.
+ */
+class CAudioEchoReference
+{
+public:
+    /**
+     * @param[in] readSampleSpec sample specification of the capture stream.
+     * @param[in] writeSampleSpec sample specification of the playback stream.
+     */
+    CAudioEchoReference(const SampleSpec &readSampleSpec, const SampleSpec &writeSampleSpec);
+    ~CAudioEchoReference();
+
+    /**
+     * Allocates the ring and configures the conversion if any.
+     *
+     * @return OK if success, error code otherwise.
+     */
+    android::status_t init();
+
+    const SampleSpec &getReadSampleSpec() const { return _readSampleSpec; }
+
+    /**
+     * Registers a consumer of the reference, reading from the next frame written.
+     * Serialized with removeReader() by the caller.
+     *
+     * @return reader identifier, -1 if there are MAX_READERS readers already.
+     */
+    int32_t addReader();
+
+    /**
+     * Unregisters a consumer of the reference. The reader must not be used anymore.
+     *
+     * @param[in] iReader reader identifier.
+     */
+    void removeReader(int32_t iReader);
+
+    /**
+     * @return number of readers registered.
+     */
+    uint32_t getNbReaders() const;
+
+    /**
+     * Appends a playback buffer to the reference. Playback thread context.
+     * The buffer is dropped if the capture side does not consume the reference.
+     *
+     * @param[in] pBuffer playback frames, in playback sample specification.
+     * @param[in] uiFrames number of playback frames.
+     * @param[in] pPlaybackDelay time stamp and delay (in ns) until the last frame is rendered.
+     */
+    void write(const void *pBuffer, uint32_t uiFrames,
+               const struct echo_reference_buffer *pPlaybackDelay);
+
+    /**
+     * Aligns the reference on the capture time. Reader context.
+     * Reference frames rendered too long before the capture time are skipped.
+     *
+     * @param[in] iReader reader identifier.
+     * @param[in] pCaptureDelay time stamp and delay (in ns) since the first frame to process
+     *                          was captured.
+     *
+     * @return echo delay, i.e. delay between render of the next reference frame and its
+     *         capture, in ns.
+     */
+    int32_t sync(int32_t iReader, const struct echo_reference_buffer *pCaptureDelay);
+
+    /**
+     * Get the contiguous region of reference frames that can be consumed. Reader context.
+     *
+     * @param[in] iReader reader identifier.
+     * @param[out] puiFrames number of frames that can be read contiguously.
+     *
+     * @return pointer on the read region, in capture sample specification.
+     */
+    void *getReadRegion(int32_t iReader, uint32_t *puiFrames) const;
+
+    /**
+     * Releases frames consumed from the read region. Reader context.
+     *
+     * @param[in] iReader reader identifier.
+     * @param[in] uiFrames number of frames consumed.
+     */
+    void commitRead(int32_t iReader, uint32_t uiFrames);
+
+    /** Maximum number of AEC effects reading the reference. */
+    static const uint32_t MAX_READERS = 4;
+
+private:
+    CAudioEchoReference(const CAudioEchoReference &);
+    CAudioEchoReference &operator=(const CAudioEchoReference &);
+
+    /**
+     * Render time of a frame of the ring, as published by the playback side.
+     */
+    struct SAnchor
+    {
+        uint32_t uiFrameIndex; /**< free running index of the frame in the ring. */
+        int64_t llRenderTimeNs; /**< render time of the frame. */
+    };
+
+    /**
+     * Read cursor of a consumer.
+     */
+    struct SReader
+    {
+        volatile int32_t iUsed; /**< written with the readers serialized by the caller. */
+        volatile int32_t iReadIndex; /**< free running, written by the reader only. */
+    };
+
+    /**
+     * Copies frames in the ring, handling the wrap point. Playback thread context.
+     *
+     * @param[in] pBuffer frames in capture sample specification.
+     * @param[in] uiFrames number of frames to copy.
+     *
+     * @return true if copied, false if the ring is full.
+     */
+    bool copyToRing(const void *pBuffer, uint32_t uiFrames);
+
+    /**
+     * Get the number of frames the slowest reader has not consumed yet. Playback thread context.
+     *
+     * @param[in] uiWriteIndex write index of the ring.
+     *
+     * @return number of frames, 0 if there is no reader.
+     */
+    uint32_t getMaxPendingFrames(uint32_t uiWriteIndex) const;
+
+    /**
+     * Publishes the render time of the last frame written. Playback thread context.
+     *
+     * @param[in] stAnchor anchor to publish.
+     */
+    void publishAnchor(const SAnchor &stAnchor);
+
+    /**
+     * Get the last anchor published by the playback side, retried until not torn by a
+     * concurrent publication. Reader context.
+     *
+     * @param[out] pstAnchor last anchor.
+     *
+     * @return true if an anchor was ever published, false otherwise.
+     */
+    bool getAnchor(SAnchor *pstAnchor) const;
+
+    /**
+     * Get the render time of a frame of the ring from an anchor.
+     *
+     * @param[in] stAnchor anchor.
+     * @param[in] uiFrameIndex free running index of the frame.
+     *
+     * @return render time of the frame, in ns.
+     */
+    int64_t getRenderTimeNs(const SAnchor &stAnchor, uint32_t uiFrameIndex) const;
+
+    /**
+     * Converts a time stamp and a delay into an absolute time.
+     *
+     * @param[in] pDelay time stamp and delay in ns.
+     *
+     * @return time stamp plus delay, in ns.
+     */
+    static int64_t getTimeNs(const struct echo_reference_buffer *pDelay);
+
+    SampleSpec _readSampleSpec;
+    SampleSpec _writeSampleSpec;
+
+    /** Conversion from playback to capture sample specification, NULL if not needed. */
+    AudioConversion *_pAudioConversion;
+
+    char *_pRing;
+    uint32_t _uiRingFrames; /**< power of 2. */
+    size_t _szFrameSize; /**< capture frame size, in bytes. */
+
+    volatile int32_t _iWriteIndex; /**< free running, written by the playback side only. */
+
+    SReader _astReaders[MAX_READERS];
+
+    /** Last anchor published by the playback side, only the most recent one is relevant. */
+    SAnchor _stAnchor;
+    /** Odd while the anchor is written, 0 until the first anchor is published. */
+    volatile int32_t _iAnchorSequence;
+
+    /** Minimum duration of reference kept in the ring. */
+    static const uint32_t RING_DURATION_MS;
+
+    /** Reference is realigned on the capture time if the echo delay exceeds this value. */
+    static const int64_t MAX_ECHO_DELAY_NS;
+
+    static const int64_t NSEC_PER_SEC;
+};
+
+};        // namespace android
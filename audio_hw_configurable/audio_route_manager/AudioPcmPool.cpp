@@ -0,0 +1,227 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/PcmPool"
+
+#include "AudioPcmPool.h"
+#include <utils/Log.h>
+
+using android::Mutex;
+using android::String8;
+
+namespace android_audio_legacy
+{
+
+CAudioPcmPool::CAudioPcmPool(uint32_t uiMaxHandles, uint32_t uiRetentionMs)
+    : _uiMaxHandles(uiMaxHandles),
+      _retentionTime(ms2ns(uiRetentionMs))
+{
+    _stMetrics.uiHits = 0;
+    _stMetrics.uiMisses = 0;
+    _stMetrics.uiEvicted = 0;
+    _stMetrics.uiExpired = 0;
+    _stMetrics.warmOpenTime = 0;
+    _stMetrics.coldOpenTime = 0;
+}
+
+CAudioPcmPool::~CAudioPcmPool()
+{
+    closeAll();
+}
+
+pcm *CAudioPcmPool::acquire(int iCard, int iDevice, bool bIsOut, const pcm_config &stConfig)
+{
+    pcm *pPcmDevice = NULL;
+    pcm *pEvictedPcmDevice = NULL;
+    {
+        Mutex::Autolock lock(_lock);
+
+        HandleListIterator it;
+        for (it = _handles.begin(); it != _handles.end(); ++it) {
+
+            if (isSameDevice(*it, iCard, iDevice, bIsOut)) {
+
+                // A device is opened only once: the handle is either reused or closed
+                if (isSameConfig(it->stConfig, stConfig)) {
+
+                    pPcmDevice = it->pPcmDevice;
+                } else {
+
+                    pEvictedPcmDevice = it->pPcmDevice;
+                    _stMetrics.uiEvicted++;
+                }
+                _handles.erase(it);
+                break;
+            }
+        }
+        if (pPcmDevice != NULL) {
+
+            _stMetrics.uiHits++;
+        } else {
+
+            _stMetrics.uiMisses++;
+        }
+    }
+    if (pEvictedPcmDevice != NULL) {
+
+        ALOGD("%s: closing warm handle of (%d,%d) opened with another config", __FUNCTION__,
+              iCard, iDevice);
+        pcm_close(pEvictedPcmDevice);
+    }
+    return pPcmDevice;
+}
+
+bool CAudioPcmPool::release(int iCard, int iDevice, bool bIsOut, const pcm_config &stConfig,
+                            pcm *pPcmDevice)
+{
+    if (_uiMaxHandles == 0) {
+
+        pcm_close(pPcmDevice);
+        return false;
+    }
+    if (pcm_stop(pPcmDevice) != 0) {
+
+        ALOGW("%s: could not stop (%d,%d): %s, closing it", __FUNCTION__, iCard, iDevice,
+              pcm_get_error(pPcmDevice));
+        pcm_close(pPcmDevice);
+        return false;
+    }
+
+    SHandle stHandle;
+    stHandle.iCard = iCard;
+    stHandle.iDevice = iDevice;
+    stHandle.bIsOut = bIsOut;
+    stHandle.stConfig = stConfig;
+    stHandle.pPcmDevice = pPcmDevice;
+    stHandle.releaseTime = systemTime();
+
+    pcm *pEvictedPcmDevice = NULL;
+    {
+        Mutex::Autolock lock(_lock);
+
+        if (_handles.size() >= _uiMaxHandles) {
+
+            // Evict the oldest handle
+            pEvictedPcmDevice = _handles.front().pPcmDevice;
+            _handles.pop_front();
+            _stMetrics.uiEvicted++;
+        }
+        _handles.push_back(stHandle);
+    }
+    if (pEvictedPcmDevice != NULL) {
+
+        pcm_close(pEvictedPcmDevice);
+    }
+    ALOGV("%s: (%d,%d) kept warm", __FUNCTION__, iCard, iDevice);
+    return true;
+}
+
+nsecs_t CAudioPcmPool::closeExpired(nsecs_t now)
+{
+    std::list<SHandle> expiredHandles;
+    nsecs_t nextDeadline = 0;
+    {
+        Mutex::Autolock lock(_lock);
+
+        // Handles are sorted by release time
+        while (!_handles.empty() && (_handles.front().releaseTime + _retentionTime <= now)) {
+
+            expiredHandles.splice(expiredHandles.end(), _handles, _handles.begin());
+            _stMetrics.uiExpired++;
+        }
+        if (!_handles.empty()) {
+
+            nextDeadline = _handles.front().releaseTime + _retentionTime;
+        }
+    }
+    HandleListIterator it;
+    for (it = expiredHandles.begin(); it != expiredHandles.end(); ++it) {
+
+        ALOGD("%s: closing warm handle of (%d,%d)", __FUNCTION__, it->iCard, it->iDevice);
+        pcm_close(it->pPcmDevice);
+    }
+    return nextDeadline;
+}
+
+void CAudioPcmPool::closeAll()
+{
+    std::list<SHandle> handles;
+    {
+        Mutex::Autolock lock(_lock);
+
+        handles.swap(_handles);
+    }
+    HandleListIterator it;
+    for (it = handles.begin(); it != handles.end(); ++it) {
+
+        pcm_close(it->pPcmDevice);
+    }
+}
+
+bool CAudioPcmPool::isEmpty() const
+{
+    Mutex::Autolock lock(_lock);
+
+    return _handles.empty();
+}
+
+void CAudioPcmPool::recordOpenTime(bool bIsWarm, nsecs_t duration)
+{
+    Mutex::Autolock lock(_lock);
+
+    if (bIsWarm) {
+
+        _stMetrics.warmOpenTime += duration;
+    } else {
+
+        _stMetrics.coldOpenTime += duration;
+    }
+}
+
+void CAudioPcmPool::dump(String8 &result) const
+{
+    Mutex::Autolock lock(_lock);
+
+    result.appendFormat("  pcm pool: %zu/%d warm handles, retention %lld ms\n", _handles.size(),
+                        _uiMaxHandles, static_cast<long long>(ns2ms(_retentionTime)));
+    result.appendFormat("    %d warm opens (avg %lld us), %d cold opens (avg %lld us), "
+                        "%d evicted, %d expired\n",
+                        _stMetrics.uiHits,
+                        static_cast<long long>(_stMetrics.uiHits ?
+                                               ns2us(_stMetrics.warmOpenTime) / _stMetrics.uiHits :
+                                               0),
+                        _stMetrics.uiMisses,
+                        static_cast<long long>(_stMetrics.uiMisses ?
+                                               ns2us(_stMetrics.coldOpenTime) /
+                                               _stMetrics.uiMisses : 0),
+                        _stMetrics.uiEvicted,
+                        _stMetrics.uiExpired);
+}
+
+bool CAudioPcmPool::isSameConfig(const pcm_config &stLeft, const pcm_config &stRight)
+{
+    return (stLeft.channels == stRight.channels) &&
+           (stLeft.rate == stRight.rate) &&
+           (stLeft.period_size == stRight.period_size) &&
+           (stLeft.period_count == stRight.period_count) &&
+           (stLeft.format == stRight.format) &&
+           (stLeft.start_threshold == stRight.start_threshold) &&
+           (stLeft.stop_threshold == stRight.stop_threshold) &&
+           (stLeft.silence_threshold == stRight.silence_threshold) &&
+           (stLeft.avail_min == stRight.avail_min);
+}
+
+}       // namespace android
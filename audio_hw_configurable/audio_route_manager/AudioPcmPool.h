@@ -0,0 +1,156 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <tinyalsa/asoundlib.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <list>
+#include <stdint.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Keeps the pcm devices closed by the routes open for a while, so that a route enabled again
+ * soon after with the same pcm configuration skips the opening of the device.
+ *
+ * A warm handle is stopped when released, hence prepared again by the route taking it back. It
+ * is kept at most a retention time, and the oldest handle is evicted when the pool is full.
+ * As a device cannot be opened twice, a warm handle is closed when its device is requested
+ * with another configuration.
+ * The pool also measures the time spent opening the devices, warm or not.
+ * Thread safe: routes are opened and closed concurrently by the routing workers.
+ */
+class CAudioPcmPool
+{
+public:
+    /**
+     * @param[in] uiMaxHandles maximum number of warm handles, 0 to close the devices at once.
+     * @param[in] uiRetentionMs maximum time a warm handle is kept.
+     */
+    CAudioPcmPool(uint32_t uiMaxHandles, uint32_t uiRetentionMs);
+    ~CAudioPcmPool();
+
+    /**
+     * Takes a warm handle matching a device and configuration.
+     *
+     * @param[in] iCard index of the sound card.
+     * @param[in] iDevice pcm device identifier.
+     * @param[in] bIsOut direction of the device.
+     * @param[in] stConfig configuration requested.
+     *
+     * @return warm handle, in stopped state, NULL if none: the device must be opened.
+     */
+    pcm *acquire(int iCard, int iDevice, bool bIsOut, const pcm_config &stConfig);
+
+    /**
+     * Stops a device and keeps it as a warm handle, or closes it if the pool is disabled.
+     *
+     * @param[in] iCard index of the sound card.
+     * @param[in] iDevice pcm device identifier.
+     * @param[in] bIsOut direction of the device.
+     * @param[in] stConfig configuration the device was opened with.
+     * @param[in] pPcmDevice opened device.
+     *
+     * @return true if kept as a warm handle, false if closed.
+     */
+    bool release(int iCard, int iDevice, bool bIsOut, const pcm_config &stConfig,
+                 pcm *pPcmDevice);
+
+    /**
+     * Closes the warm handles kept longer than the retention time.
+     *
+     * @param[in] now current time.
+     *
+     * @return time at which the next warm handle expires, 0 if none.
+     */
+    nsecs_t closeExpired(nsecs_t now);
+
+    /**
+     * Closes all warm handles, for instance when the devices were lost.
+     */
+    void closeAll();
+
+    /**
+     * Checks if warm handles are kept.
+     *
+     * @return true if there is no warm handle.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Records the time spent opening a device, prepare included.
+     *
+     * @param[in] bIsWarm true if a warm handle was used.
+     * @param[in] duration time spent.
+     */
+    void recordOpenTime(bool bIsWarm, nsecs_t duration);
+
+    /**
+     * Appends the state and metrics of the pool to a dump.
+     *
+     * @param[out] result dump.
+     */
+    void dump(android::String8 &result) const;
+
+private:
+    CAudioPcmPool(const CAudioPcmPool &);
+    CAudioPcmPool &operator=(const CAudioPcmPool &);
+
+    struct SHandle
+    {
+        int iCard;
+        int iDevice;
+        bool bIsOut;
+        pcm_config stConfig;
+        pcm *pPcmDevice;
+        nsecs_t releaseTime;
+    };
+
+    typedef std::list<SHandle>::iterator HandleListIterator;
+
+    static bool isSameDevice(const SHandle &stHandle, int iCard, int iDevice, bool bIsOut)
+    {
+        return (stHandle.iCard == iCard) && (stHandle.iDevice == iDevice) &&
+               (stHandle.bIsOut == bIsOut);
+    }
+
+    static bool isSameConfig(const pcm_config &stLeft, const pcm_config &stRight);
+
+    /** Warm handles, from the oldest to the most recently released. */
+    std::list<SHandle> _handles;
+
+    uint32_t _uiMaxHandles;
+    nsecs_t _retentionTime;
+
+    struct {
+
+        uint32_t uiHits; /**< devices opened from a warm handle. */
+        uint32_t uiMisses; /**< devices opened. */
+        uint32_t uiEvicted; /**< warm handles closed to make room or for another config. */
+        uint32_t uiExpired; /**< warm handles closed after the retention time. */
+        nsecs_t warmOpenTime; /**< cumulated time spent taking back warm handles. */
+        nsecs_t coldOpenTime; /**< cumulated time spent opening the devices. */
+    } _stMetrics;
+
+    /** Protects the handles and the metrics. */
+    mutable android::Mutex _lock;
+};
+
+};        // namespace android
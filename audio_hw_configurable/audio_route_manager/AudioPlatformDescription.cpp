@@ -0,0 +1,367 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/PlatformDescription"
+
+#include "AudioPlatformDescription.h"
+#include "AudioRoute.h"
+#include "SampleSpec.h"
+#include <utils/Log.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using android::status_t;
+using android::OK;
+using android::BAD_VALUE;
+using android::NAME_NOT_FOUND;
+using android::NO_MEMORY;
+using std::string;
+
+namespace android_audio_legacy
+{
+
+// "APDS"
+const uint32_t CAudioPlatformDescription::IMAGE_MAGIC = 0x53445041;
+
+const uint32_t CAudioPlatformDescription::IMAGE_VERSION = 1;
+
+CAudioPlatformDescription::CAudioPlatformDescription()
+    : _pstImage(NULL),
+      _bMapped(false)
+{
+}
+
+CAudioPlatformDescription::~CAudioPlatformDescription()
+{
+    release();
+}
+
+CAudioPlatformDescription::SImage *CAudioPlatformDescription::createImage()
+{
+    SImage *pstImage = new SImage;
+
+    memset(pstImage, 0, sizeof(*pstImage));
+    pstImage->uiMagic = IMAGE_MAGIC;
+    pstImage->uiVersion = IMAGE_VERSION;
+    pstImage->uiSize = sizeof(*pstImage);
+    return pstImage;
+}
+
+status_t CAudioPlatformDescription::indexNames(SImage &stImage)
+{
+    for (uint32_t uiNameIndex = 0; uiNameIndex < ENbNameIndexes; uiNameIndex++) {
+
+        NameIndex eNameIndex = static_cast<NameIndex>(uiNameIndex);
+        uint8_t *aucSlots = stImage.aaucNameIndexes[eNameIndex];
+        uint32_t uiNbNames = getNbNames(stImage, eNameIndex);
+
+        memset(aucSlots, 0, NAME_INDEX_SIZE);
+        if (uiNbNames > NAME_INDEX_SIZE / 2) {
+
+            ALOGE("%s: %d names, %d max", __FUNCTION__, uiNbNames, NAME_INDEX_SIZE / 2);
+            return BAD_VALUE;
+        }
+        for (uint32_t uiIndex = 0; uiIndex < uiNbNames; uiIndex++) {
+
+            const char *pcName = getName(stImage, eNameIndex, uiIndex);
+            if (findName(stImage, eNameIndex, pcName) >= 0) {
+
+                ALOGE("%s: %s declared twice", __FUNCTION__, pcName);
+                return BAD_VALUE;
+            }
+            // Linear probing, the table being at most half full
+            uint32_t uiSlot = hashName(pcName) & (NAME_INDEX_SIZE - 1);
+            while (aucSlots[uiSlot] != 0) {
+
+                uiSlot = (uiSlot + 1) & (NAME_INDEX_SIZE - 1);
+            }
+            aucSlots[uiSlot] = uiIndex + 1;
+        }
+    }
+    return OK;
+}
+
+bool CAudioPlatformDescription::copyName(char *pcDest, const char *pcName)
+{
+    if (strlen(pcName) >= MAX_NAME_LENGTH) {
+
+        ALOGE("%s: %s longer than %d characters", __FUNCTION__, pcName, MAX_NAME_LENGTH - 1);
+        return false;
+    }
+    strcpy(pcDest, pcName);
+    return true;
+}
+
+int32_t CAudioPlatformDescription::findName(const SImage &stImage, NameIndex eNameIndex,
+                                            const char *pcName)
+{
+    const uint8_t *aucSlots = stImage.aaucNameIndexes[eNameIndex];
+    uint32_t uiSlot = hashName(pcName) & (NAME_INDEX_SIZE - 1);
+
+    // Bounded by the table size in case of a table without any empty slot
+    for (uint32_t uiProbe = 0; uiProbe < NAME_INDEX_SIZE; uiProbe++) {
+
+        uint32_t uiEntry = aucSlots[uiSlot];
+        if (uiEntry == 0) {
+
+            break;
+        }
+        if (strcmp(getName(stImage, eNameIndex, uiEntry - 1), pcName) == 0) {
+
+            return uiEntry - 1;
+        }
+        uiSlot = (uiSlot + 1) & (NAME_INDEX_SIZE - 1);
+    }
+    return -1;
+}
+
+status_t CAudioPlatformDescription::adopt(SImage *pstImage)
+{
+    if (!check(*pstImage)) {
+
+        delete pstImage;
+        return BAD_VALUE;
+    }
+    release();
+    _pstImage = pstImage;
+    _bMapped = false;
+    return OK;
+}
+
+status_t CAudioPlatformDescription::map(const string &strPath)
+{
+    int fd = open(strPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+
+        ALOGE("%s: could not open %s: %s", __FUNCTION__, strPath.c_str(), strerror(errno));
+        return NAME_NOT_FOUND;
+    }
+    struct stat stStat;
+    if ((fstat(fd, &stStat) != 0) || (stStat.st_size != sizeof(SImage))) {
+
+        ALOGE("%s: %s is not a platform description of this layout", __FUNCTION__,
+              strPath.c_str());
+        close(fd);
+        return BAD_VALUE;
+    }
+    void *pMapping = mmap(NULL, sizeof(SImage), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping holds its own reference on the file
+    close(fd);
+    if (pMapping == MAP_FAILED) {
+
+        ALOGE("%s: could not map %s: %s", __FUNCTION__, strPath.c_str(), strerror(errno));
+        return NO_MEMORY;
+    }
+    const SImage *pstImage = static_cast<const SImage *>(pMapping);
+    if (!check(*pstImage)) {
+
+        ALOGE("%s: %s is inconsistent", __FUNCTION__, strPath.c_str());
+        munmap(pMapping, sizeof(SImage));
+        return BAD_VALUE;
+    }
+    release();
+    _pstImage = pstImage;
+    _bMapped = true;
+    return OK;
+}
+
+status_t CAudioPlatformDescription::exportImage(const string &strPath) const
+{
+    if (!isLoaded()) {
+
+        return NAME_NOT_FOUND;
+    }
+    FILE *pFile = fopen(strPath.c_str(), "wb");
+    if (pFile == NULL) {
+
+        ALOGE("%s: could not open %s: %s", __FUNCTION__, strPath.c_str(), strerror(errno));
+        return NAME_NOT_FOUND;
+    }
+    bool bWritten = fwrite(_pstImage, sizeof(*_pstImage), 1, pFile) == 1;
+    if ((fclose(pFile) != 0) || !bWritten) {
+
+        ALOGE("%s: could not write %s", __FUNCTION__, strPath.c_str());
+        unlink(strPath.c_str());
+        return BAD_VALUE;
+    }
+    return OK;
+}
+
+bool CAudioPlatformDescription::check(const SImage &stImage)
+{
+    if ((stImage.uiMagic != IMAGE_MAGIC) || (stImage.uiVersion != IMAGE_VERSION) ||
+            (stImage.uiSize != sizeof(stImage))) {
+
+        ALOGE("%s: not a platform description of this version and layout", __FUNCTION__);
+        return false;
+    }
+    if ((stImage.uiNbPorts > MAX_PORTS) || (stImage.uiNbPortGroups > MAX_PORT_GROUPS) ||
+            (stImage.uiNbRoutes > MAX_ROUTES)) {
+
+        ALOGE("%s: too many ports, port groups or routes", __FUNCTION__);
+        return false;
+    }
+    for (uint32_t uiNameIndex = 0; uiNameIndex < ENbNameIndexes; uiNameIndex++) {
+
+        NameIndex eNameIndex = static_cast<NameIndex>(uiNameIndex);
+        uint32_t uiNbNames = getNbNames(stImage, eNameIndex);
+
+        for (uint32_t uiSlot = 0; uiSlot < NAME_INDEX_SIZE; uiSlot++) {
+
+            if (stImage.aaucNameIndexes[eNameIndex][uiSlot] > uiNbNames) {
+
+                ALOGE("%s: name index out of range", __FUNCTION__);
+                return false;
+            }
+        }
+        for (uint32_t uiIndex = 0; uiIndex < uiNbNames; uiIndex++) {
+
+            if (memchr(getName(stImage, eNameIndex, uiIndex), '\0', MAX_NAME_LENGTH) == NULL) {
+
+                ALOGE("%s: name %d not terminated", __FUNCTION__, uiIndex);
+                return false;
+            }
+        }
+        // Names compared while probing are all terminated from here
+        for (uint32_t uiIndex = 0; uiIndex < uiNbNames; uiIndex++) {
+
+            const char *pcName = getName(stImage, eNameIndex, uiIndex);
+            if (findName(stImage, eNameIndex, pcName) != static_cast<int32_t>(uiIndex)) {
+
+                ALOGE("%s: %s not indexed", __FUNCTION__, pcName);
+                return false;
+            }
+        }
+    }
+    uint32_t uiPortMask = getIdMask(stImage.uiNbPorts);
+    for (uint32_t uiPortGroup = 0; uiPortGroup < stImage.uiNbPortGroups; uiPortGroup++) {
+
+        if (stImage.auiPortGroups[uiPortGroup] & ~uiPortMask) {
+
+            ALOGE("%s: port group %d uses unknown ports", __FUNCTION__, uiPortGroup);
+            return false;
+        }
+    }
+    for (uint32_t uiRoute = 0; uiRoute < stImage.uiNbRoutes; uiRoute++) {
+
+        const SRoute &stRoute = stImage.astRoutes[uiRoute];
+
+        // A route connects at most two ports, as the route manager requires
+        if ((stRoute.uiType >= CAudioRoute::ENbRouteType) ||
+                (stRoute.uiPortsUsed & ~uiPortMask) ||
+                (__builtin_popcount(stRoute.uiPortsUsed) > 2) ||
+                (stRoute.uiSlaveRoutes & ~getIdMask(stImage.uiNbRoutes)) ||
+                (memchr(stRoute.acCardName, '\0', MAX_NAME_LENGTH) == NULL)) {
+
+            ALOGE("%s: route %s is inconsistent", __FUNCTION__, stRoute.acName);
+            return false;
+        }
+        for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+            // Routes divide by the rate and the period of their configuration
+            if (!checkPcmConfig(stRoute.astPcmConfig[uiDir], true)) {
+
+                ALOGE("%s: route %s has an invalid pcm configuration", __FUNCTION__,
+                      stRoute.acName);
+                return false;
+            }
+            for (uint32_t uiChannel = 0; uiChannel < MAX_CHANNELS; uiChannel++) {
+
+                int32_t iPolicy = stRoute.aiChannelsPolicy[uiDir][uiChannel];
+                if ((iPolicy < 0) || (iPolicy >= SampleSpec::NbChannelsPolicy)) {
+
+                    ALOGE("%s: route %s has an unknown channel policy", __FUNCTION__,
+                          stRoute.acName);
+                    return false;
+                }
+            }
+        }
+    }
+    for (uint32_t uiConfig = 0; uiConfig < ENbDefaultPcmConfigs; uiConfig++) {
+
+        // Platforms without deep buffer or fast routes leave their configuration empty
+        bool bIsOptional = (uiConfig == EDeepMediaPlayback) || (uiConfig == EFastMediaPlayback);
+        if (!checkPcmConfig(stImage.astDefaultPcmConfigs[uiConfig], bIsOptional)) {
+
+            ALOGE("%s: default pcm configuration %d is invalid", __FUNCTION__, uiConfig);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CAudioPlatformDescription::checkPcmConfig(const pcm_config &stConfig, bool bIsOptional)
+{
+    if (bIsOptional && (stConfig.channels == 0) && (stConfig.rate == 0) &&
+            (stConfig.period_size == 0) && (stConfig.period_count == 0)) {
+
+        return true;
+    }
+    return (stConfig.channels != 0) && (stConfig.channels <= MAX_CHANNELS) &&
+            (stConfig.rate != 0) && (stConfig.period_size != 0) && (stConfig.period_count != 0);
+}
+
+const char *CAudioPlatformDescription::getName(const SImage &stImage, NameIndex eNameIndex,
+                                               uint32_t uiIndex)
+{
+    return eNameIndex == EPortNames ?
+                stImage.aacPortNames[uiIndex] : stImage.astRoutes[uiIndex].acName;
+}
+
+uint32_t CAudioPlatformDescription::getNbNames(const SImage &stImage, NameIndex eNameIndex)
+{
+    return eNameIndex == EPortNames ? stImage.uiNbPorts : stImage.uiNbRoutes;
+}
+
+uint32_t CAudioPlatformDescription::hashName(const char *pcName)
+{
+    uint32_t uiHash = 2166136261u;
+
+    while (*pcName != '\0') {
+
+        uiHash ^= static_cast<uint8_t>(*pcName++);
+        uiHash *= 16777619u;
+    }
+    return uiHash;
+}
+
+uint32_t CAudioPlatformDescription::getIdMask(uint32_t uiNbIds)
+{
+    return uiNbIds >= 32 ? ~0u : ((uint32_t)1 << uiNbIds) - 1;
+}
+
+void CAudioPlatformDescription::release()
+{
+    if (_pstImage == NULL) {
+
+        return;
+    }
+    if (_bMapped) {
+
+        munmap(const_cast<SImage *>(_pstImage), sizeof(*_pstImage));
+    } else {
+
+        delete _pstImage;
+    }
+    _pstImage = NULL;
+}
+
+}       // namespace android
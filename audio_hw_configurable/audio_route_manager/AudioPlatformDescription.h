@@ -0,0 +1,192 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <tinyalsa/asoundlib.h>
+#include <utils/Errors.h>
+#include <string>
+#include <stdint.h>
+#include "Utils.h"
+
+namespace android_audio_legacy
+{
+
+/**
+ * Compact binary description of the platform topology: ports, port groups, routes and default
+ * pcm configurations, with hashed indexes of the port and route names.
+ *
+ * The description is a single image of fixed size, either built at startup from the tables
+ * compiled in the platform file, or mapped read only from a file exported from such tables, so
+ * that the topology of a board can be changed without a new HAL binary. Lists of ports and of
+ * slave routes are resolved into bit fields when the image is built, and need no parsing when
+ * it is loaded. The image holds fixed width fields only, in the byte order of the target: the
+ * host converter exports it for the x86 targets from a build server, and its header checks the
+ * layout.
+ */
+class CAudioPlatformDescription
+{
+public:
+    static const uint32_t MAX_PORTS = 32;
+    static const uint32_t MAX_PORT_GROUPS = 32;
+    static const uint32_t MAX_ROUTES = 32;
+    static const uint32_t MAX_CHANNELS = 32;
+    /** Including the terminating null character. */
+    static const uint32_t MAX_NAME_LENGTH = 32;
+    /** Slots of a name index, power of 2 twice the max number of names for short probes. */
+    static const uint32_t NAME_INDEX_SIZE = 64;
+
+    enum NameIndex {
+
+        EPortNames,
+        ERouteNames,
+
+        ENbNameIndexes
+    };
+
+    enum DefaultPcmConfig {
+
+        EMediaPlayback,
+        EMediaCapture,
+        EDeepMediaPlayback,
+        EFastMediaPlayback,
+
+        ENbDefaultPcmConfigs
+    };
+
+    struct SRoute
+    {
+        char acName[MAX_NAME_LENGTH];
+        uint32_t uiType;                /**< CAudioRoute::RouteType. */
+        uint32_t uiPortsUsed;           /**< bit field of port ids. */
+        uint32_t auiApplicableDevices[CUtils::ENbDirections];
+        uint32_t auiApplicableMask[CUtils::ENbDirections];
+        uint32_t auiApplicableModes[CUtils::ENbDirections];
+        char acCardName[MAX_NAME_LENGTH];
+        int32_t aiDeviceId[CUtils::ENbDirections];
+        pcm_config astPcmConfig[CUtils::ENbDirections];
+        int32_t aiChannelsPolicy[CUtils::ENbDirections][MAX_CHANNELS]; /**< SampleSpec policies. */
+        uint32_t uiSlaveRoutes;         /**< bit field of route ids. */
+    };
+
+    struct SImage
+    {
+        uint32_t uiMagic;
+        uint32_t uiVersion;
+        uint32_t uiSize;                /**< size of the image, changes with the layout. */
+        uint32_t uiNbPorts;
+        uint32_t uiNbPortGroups;
+        uint32_t uiNbRoutes;
+        char aacPortNames[MAX_PORTS][MAX_NAME_LENGTH];
+        uint32_t auiPortGroups[MAX_PORT_GROUPS]; /**< bit field of port ids per group. */
+        SRoute astRoutes[MAX_ROUTES];
+        pcm_config astDefaultPcmConfigs[ENbDefaultPcmConfigs];
+        /** Open addressing hash tables of the names: slots hold index + 1, 0 if empty. */
+        uint8_t aaucNameIndexes[ENbNameIndexes][NAME_INDEX_SIZE];
+    };
+
+    static const uint32_t IMAGE_MAGIC;
+    static const uint32_t IMAGE_VERSION;
+
+    CAudioPlatformDescription();
+    ~CAudioPlatformDescription();
+
+    /**
+     * Allocates an empty image, with its header filled, for the caller to fill and adopt.
+     */
+    static SImage *createImage();
+
+    /**
+     * Fills the name indexes of an image from its port and route names.
+     *
+     * @return OK if indexed, BAD_VALUE on duplicated names or too many of them.
+     */
+    static android::status_t indexNames(SImage &stImage);
+
+    /**
+     * Copies a name into an image.
+     *
+     * @return false if the name is too long.
+     */
+    static bool copyName(char *pcDest, const char *pcName);
+
+    /**
+     * Looks a name up through the indexes of an image.
+     *
+     * @return index of the port or route, -1 if not found.
+     */
+    static int32_t findName(const SImage &stImage, NameIndex eNameIndex, const char *pcName);
+
+    /**
+     * Takes ownership of an image built by the caller, once checked.
+     *
+     * @return OK if the image is consistent, BAD_VALUE otherwise, the image being deleted.
+     */
+    android::status_t adopt(SImage *pstImage);
+
+    /**
+     * Maps an image exported to a file, once checked.
+     *
+     * @return OK if mapped, error code otherwise.
+     */
+    android::status_t map(const std::string &strPath);
+
+    /**
+     * Writes the image to a file, to be mapped later on.
+     *
+     * @return OK if written, error code otherwise.
+     */
+    android::status_t exportImage(const std::string &strPath) const;
+
+    bool isLoaded() const { return _pstImage != NULL; }
+
+    const SImage &getImage() const { return *_pstImage; }
+
+private:
+    CAudioPlatformDescription(const CAudioPlatformDescription &);
+    CAudioPlatformDescription &operator=(const CAudioPlatformDescription &);
+
+    /**
+     * Checks the header, the counts, the names and their indexes, the bit fields, the pcm
+     * configurations and the channel policies of an image, so that a corrupted or stale file
+     * cannot crash the route manager.
+     */
+    static bool check(const SImage &stImage);
+
+    /**
+     * Checks that a pcm configuration has channels, a rate and periods.
+     *
+     * @param[in] stConfig configuration to check.
+     * @param[in] bIsOptional true if the configuration may also be left empty, not applicable.
+     */
+    static bool checkPcmConfig(const pcm_config &stConfig, bool bIsOptional);
+
+    static const char *getName(const SImage &stImage, NameIndex eNameIndex, uint32_t uiIndex);
+
+    static uint32_t getNbNames(const SImage &stImage, NameIndex eNameIndex);
+
+    /** FNV-1a hash of a name. */
+    static uint32_t hashName(const char *pcName);
+
+    static uint32_t getIdMask(uint32_t uiNbIds);
+
+    void release();
+
+    const SImage *_pstImage;
+    bool _bMapped;
+};
+
+};        // namespace android
@@ -0,0 +1,240 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/PlatformHardware"
+
+#include "AudioPlatformHardware.h"
+#include "Tokenizer.h"
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+
+using android::status_t;
+using android::OK;
+using android::BAD_VALUE;
+using android::Mutex;
+using std::string;
+
+namespace android_audio_legacy
+{
+
+CAudioPlatformDescription* CAudioPlatformHardware::_pDescription = NULL;
+
+volatile int32_t CAudioPlatformHardware::_iDescriptionLoaded = 0;
+
+string CAudioPlatformHardware::_strDescriptionPath;
+
+nsecs_t CAudioPlatformHardware::_descriptionLoadTime = 0;
+
+Mutex CAudioPlatformHardware::_descriptionLock;
+
+CAudioRoute* CAudioPlatformHardware::createGenericAudioRoute(uint32_t uiRouteIndex,
+                                                            CAudioPlatformState* pPlatformState)
+{
+    switch (getRouteType(uiRouteIndex)) {
+    case CAudioRoute::EStreamRoute:
+        return new CAudioStreamRoute(uiRouteIndex, pPlatformState);
+
+    case CAudioRoute::ECompressedStreamRoute:
+        return new CAudioCompressedStreamRoute(uiRouteIndex, pPlatformState);
+
+    case CAudioRoute::EExternalRoute:
+        return new CAudioExternalRoute(uiRouteIndex, pPlatformState);
+
+    default:
+        ALOGE("%s: wrong route type for route index=%d", __FUNCTION__, uiRouteIndex);
+        return NULL;
+    }
+}
+
+status_t CAudioPlatformHardware::loadDescription(const string& strPath)
+{
+    Mutex::Autolock lock(_descriptionLock);
+
+    if (_pDescription != NULL) {
+
+        // Routes and ports keep the indexes of the description loaded first
+        return OK;
+    }
+    nsecs_t startTime = systemTime();
+    CAudioPlatformDescription* pDescription = new CAudioPlatformDescription();
+    status_t status = OK;
+
+    if (!strPath.empty()) {
+
+        status = pDescription->map(strPath);
+        if (status == OK) {
+
+            _strDescriptionPath = strPath;
+        } else {
+
+            ALOGE("%s: could not load %s, using the compiled tables", __FUNCTION__,
+                  strPath.c_str());
+        }
+    }
+    if (!pDescription->isLoaded()) {
+
+        CAudioPlatformDescription::SImage* pstImage = buildCompiledImage();
+
+        // The compiled tables are the last resort of the platform
+        LOG_ALWAYS_FATAL_IF(pstImage == NULL || pDescription->adopt(pstImage) != OK);
+    }
+    _descriptionLoadTime = systemTime() - startTime;
+    _pDescription = pDescription;
+    // Streams opened concurrently get the description without the lock
+    android_atomic_release_store(1, &_iDescriptionLoaded);
+    return status;
+}
+
+status_t CAudioPlatformHardware::exportDescription(const string& strPath)
+{
+    nsecs_t startTime = systemTime();
+    CAudioPlatformDescription::SImage* pstImage = buildCompiledImage();
+    CAudioPlatformDescription description;
+
+    if ((pstImage == NULL) || (description.adopt(pstImage) != OK)) {
+
+        return BAD_VALUE;
+    }
+    ALOGI("%s: compiled tables converted in %lld us", __FUNCTION__,
+          static_cast<long long>(ns2us(systemTime() - startTime)));
+    return description.exportImage(strPath);
+}
+
+const CAudioPlatformDescription::SImage& CAudioPlatformHardware::getDescription()
+{
+    if (!android_atomic_acquire_load(&_iDescriptionLoaded)) {
+
+        // Loaded once, under the lock, by the first caller
+        loadDescription("");
+    }
+    return _pDescription->getImage();
+}
+
+CAudioPlatformDescription::SImage* CAudioPlatformHardware::buildCompiledImage()
+{
+    if ((_uiNbPorts > CAudioPlatformDescription::MAX_PORTS) ||
+            (_uiNbPortGroups > CAudioPlatformDescription::MAX_PORT_GROUPS) ||
+            (_uiNbRoutes > CAudioPlatformDescription::MAX_ROUTES)) {
+
+        ALOGE("%s: too many ports, port groups or routes", __FUNCTION__);
+        return NULL;
+    }
+    CAudioPlatformDescription::SImage* pstImage = CAudioPlatformDescription::createImage();
+    bool bNamesCopied = true;
+    uint32_t i;
+
+    pstImage->uiNbPorts = _uiNbPorts;
+    pstImage->uiNbPortGroups = _uiNbPortGroups;
+    pstImage->uiNbRoutes = _uiNbRoutes;
+
+    for (i = 0; i < _uiNbPorts; i++) {
+
+        bNamesCopied &= CAudioPlatformDescription::copyName(pstImage->aacPortNames[i],
+                                                            _acPorts[i]);
+    }
+    for (i = 0; i < _uiNbRoutes; i++) {
+
+        const s_route_t& stCompiledRoute = _astAudioRoutes[i];
+        CAudioPlatformDescription::SRoute& stRoute = pstImage->astRoutes[i];
+
+        bNamesCopied &= CAudioPlatformDescription::copyName(stRoute.acName,
+                                                            stCompiledRoute.pcRouteName.c_str());
+        // Only stream routes open a card, the others leave it not applicable
+        if (stCompiledRoute.pcCardName != NULL) {
+
+            bNamesCopied &= CAudioPlatformDescription::copyName(stRoute.acCardName,
+                                                                stCompiledRoute.pcCardName);
+        }
+        stRoute.uiType = stCompiledRoute.uiRouteType;
+
+        for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+            stRoute.auiApplicableDevices[uiDir] = stCompiledRoute.auiApplicableDevices[uiDir];
+            stRoute.auiApplicableMask[uiDir] = stCompiledRoute.uiApplicableMask[uiDir];
+            stRoute.auiApplicableModes[uiDir] = stCompiledRoute.uiApplicableModes[uiDir];
+            stRoute.aiDeviceId[uiDir] = stCompiledRoute.aiDeviceId[uiDir];
+            stRoute.astPcmConfig[uiDir] = stCompiledRoute.astPcmConfig[uiDir];
+
+            for (uint32_t uiChannel = 0; uiChannel < MAX_CHANNELS; uiChannel++) {
+
+                stRoute.aiChannelsPolicy[uiDir][uiChannel] =
+                        stCompiledRoute.aChannelsPolicy[uiDir][uiChannel];
+            }
+        }
+    }
+    if (!bNamesCopied || (CAudioPlatformDescription::indexNames(*pstImage) != OK)) {
+
+        delete pstImage;
+        return NULL;
+    }
+
+    // Lists are resolved once the names are indexed
+    for (i = 0; i < _uiNbPortGroups; i++) {
+
+        pstImage->auiPortGroups[i] = resolveNames(*pstImage,
+                                                  CAudioPlatformDescription::EPortNames,
+                                                  _acPortGroups[i]);
+    }
+    for (i = 0; i < _uiNbRoutes; i++) {
+
+        pstImage->astRoutes[i].uiPortsUsed =
+                resolveNames(*pstImage, CAudioPlatformDescription::EPortNames,
+                             _astAudioRoutes[i].pcPortsUsed);
+        pstImage->astRoutes[i].uiSlaveRoutes =
+                resolveNames(*pstImage, CAudioPlatformDescription::ERouteNames,
+                             _astAudioRoutes[i].pcSlaveRoutes);
+    }
+
+    pstImage->astDefaultPcmConfigs[CAudioPlatformDescription::EMediaPlayback] =
+            pcm_config_media_playback;
+    pstImage->astDefaultPcmConfigs[CAudioPlatformDescription::EMediaCapture] =
+            pcm_config_media_capture;
+    pstImage->astDefaultPcmConfigs[CAudioPlatformDescription::EDeepMediaPlayback] =
+            pcm_config_deep_media_playback;
+    pstImage->astDefaultPcmConfigs[CAudioPlatformDescription::EFastMediaPlayback] =
+            pcm_config_fast_media_playback;
+
+    return pstImage;
+}
+
+uint32_t CAudioPlatformHardware::resolveNames(const CAudioPlatformDescription::SImage& stImage,
+                                              CAudioPlatformDescription::NameIndex eNameIndex,
+                                              const char* pcNames)
+{
+    if (pcNames == NULL) {
+
+        return 0;
+    }
+    Tokenizer tokenizer(pcNames, ",");
+    std::vector<std::string> astrItems = tokenizer.split();
+    uint32_t uiIds = 0;
+
+    for (uint32_t i = 0; i < astrItems.size(); i++) {
+
+        int32_t iIndex = CAudioPlatformDescription::findName(stImage, eNameIndex,
+                                                             astrItems[i].c_str());
+        if (iIndex < 0) {
+
+            // Unknown names were always ignored
+            ALOGW("%s: unknown name %s in %s", __FUNCTION__, astrItems[i].c_str(), pcNames);
+            continue;
+        }
+        uiIds |= (uint32_t)1 << iIndex;
+    }
+    return uiIds;
+}
+
+}       // namespace android
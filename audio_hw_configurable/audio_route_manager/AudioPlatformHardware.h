@@ -24,7 +24,9 @@
 #include "AudioExternalRoute.h"
 #include "AudioRoute.h"
 #include "AudioRouteManager.h"
-#include "Tokenizer.h"
+#include "AudioPlatformDescription.h"
+#include <utils/threads.h>
+#include <utils/Timers.h>
 
 namespace android_audio_legacy
 {
@@ -84,17 +86,51 @@ public:
 
     static CAudioRoute* createAudioRoute(uint32_t uiRouteIndex, CAudioPlatformState* pPlatformState);
 
-    static uint32_t getNbPorts() { return _uiNbPorts; }
+    /**
+     * Creates a route with the generic behavior of its type, for the routes of a loaded
+     * description that the platform file does not know.
+     */
+    static CAudioRoute* createGenericAudioRoute(uint32_t uiRouteIndex,
+                                                CAudioPlatformState* pPlatformState);
+
+    /**
+     * Loads the platform description, once for the process: mapped from a file exported by
+     * exportDescription, or built from the compiled tables if no file is given or if the file
+     * cannot be used.
+     *
+     * @param[in] strPath file to map, empty to use the compiled tables.
+     *
+     * @return OK if the description requested is loaded, error code if it fell back on the
+     *         compiled tables.
+     */
+    static android::status_t loadDescription(const std::string& strPath);
+
+    /**
+     * Converts the compiled tables into a description file, to be loaded instead of them.
+     *
+     * @param[in] strPath file to write.
+     *
+     * @return OK if exported, error code otherwise.
+     */
+    static android::status_t exportDescription(const std::string& strPath);
+
+    /** File the description was mapped from, empty for the compiled tables. */
+    static const std::string& getDescriptionPath() { return _strDescriptionPath; }
+
+    /** Time spent loading the description. */
+    static nsecs_t getDescriptionLoadTime() { return _descriptionLoadTime; }
 
-    static uint32_t getNbPortGroups() { return _uiNbPortGroups; }
+    static uint32_t getNbPorts() { return getDescription().uiNbPorts; }
 
-    static uint32_t getNbRoutes() { return _uiNbRoutes; }
+    static uint32_t getNbPortGroups() { return getDescription().uiNbPortGroups; }
+
+    static uint32_t getNbRoutes() { return getDescription().uiNbRoutes; }
 
     //
     // Port helpers
     //
     static const char* getPortName(int uiPortIndex) {
-        return _acPorts[uiPortIndex];
+        return getDescription().aacPortNames[uiPortIndex];
     }
 
     static uint32_t getPortId(uint32_t uiPortIndex) { return (uint32_t)1 << uiPortIndex; }
@@ -103,108 +139,60 @@ public:
     // Port group helpers
     //
     static uint32_t getPortsUsedByPortGroup(uint32_t uiPortGroupIndex) {
-
-        std::string srtPorts(_acPortGroups[uiPortGroupIndex]);
-        uint32_t uiPorts = 0;
-        Tokenizer tokenizer(srtPorts, ",");
-        std::vector<std::string> astrItems = tokenizer.split();
-
-        uint32_t i;
-        for (i = 0; i < astrItems.size(); i++) {
-
-            uiPorts |= getPortIdByName(astrItems[i]);
-        }
-        LOGD("%s Ports name=%s", __FUNCTION__, srtPorts.c_str());
-        return uiPorts;
+        return getDescription().auiPortGroups[uiPortGroupIndex];
     }
 
     //
     // Route helpers
     //
     static std::string getRouteName(int iRouteIndex) {
-        return _astAudioRoutes[iRouteIndex].pcRouteName;
+        return getRoute(iRouteIndex).acName;
     }
     static uint32_t getRouteId(int iRouteIndex) {
         return (uint32_t)1 << iRouteIndex;
     }
     static uint32_t getRouteType(int iRouteIndex) {
-        return _astAudioRoutes[iRouteIndex].uiRouteType;
+        return getRoute(iRouteIndex).uiType;
     }
     static uint32_t getPortsUsedByRoute(int iRouteIndex) {
-
-        std::string srtPorts(_astAudioRoutes[iRouteIndex].pcPortsUsed);
-        uint32_t uiPorts = 0;
-        Tokenizer tokenizer(srtPorts, ",");
-        std::vector<std::string> astrItems = tokenizer.split();
-
-        uint32_t i;
-        for (i = 0; i < astrItems.size(); i++) {
-
-            uiPorts |= getPortIdByName(astrItems[i].c_str());
-        }
-        LOGD("%s Ports name=%s", __FUNCTION__, srtPorts.c_str());
-        return uiPorts;
+        return getRoute(iRouteIndex).uiPortsUsed;
     }
     static uint32_t getRouteApplicableDevices(int iRouteIndex, bool bIsOut) {
-        return _astAudioRoutes[iRouteIndex].auiApplicableDevices[bIsOut];
+        return getRoute(iRouteIndex).auiApplicableDevices[bIsOut];
     }
     static uint32_t getRouteApplicableMask(int iRouteIndex, bool bIsOut) {
-        return _astAudioRoutes[iRouteIndex].uiApplicableMask[bIsOut];
+        return getRoute(iRouteIndex).auiApplicableMask[bIsOut];
     }
     static uint32_t getRouteApplicableModes(int iRouteIndex, bool bIsOut) {
-        return _astAudioRoutes[iRouteIndex].uiApplicableModes[bIsOut];
+        return getRoute(iRouteIndex).auiApplicableModes[bIsOut];
     }
     static const char* getRouteCardName(int iRouteIndex) {
-        return _astAudioRoutes[iRouteIndex].pcCardName;
+        return getRoute(iRouteIndex).acCardName;
     }
     static int32_t getRouteDeviceId(int iRouteIndex, bool bIsOut) {
-        return _astAudioRoutes[iRouteIndex].aiDeviceId[bIsOut];
+        return getRoute(iRouteIndex).aiDeviceId[bIsOut];
     }
     static const pcm_config& getRoutePcmConfig(int iRouteIndex, bool bIsOut) {
-        return _astAudioRoutes[iRouteIndex].astPcmConfig[bIsOut];
+        return getRoute(iRouteIndex).astPcmConfig[bIsOut];
     }
     static uint32_t getSlaveRoutes(int iRouteIndex) {
-
-        std::string srtSlaveRoutes(_astAudioRoutes[iRouteIndex].pcSlaveRoutes);
-        uint32_t uiSlaves = 0;
-        Tokenizer tokenizer(srtSlaveRoutes, ",");
-        std::vector<std::string> astrItems = tokenizer.split();
-
-        uint32_t i;
-        for (i = 0; i < astrItems.size(); i++) {
-
-            uiSlaves |= getRouteIdByName(astrItems[i]);
-        }
-        LOGD("%s acSlaveRoutes=%s", __FUNCTION__, srtSlaveRoutes.c_str());
-        return uiSlaves;
+        return getRoute(iRouteIndex).uiSlaveRoutes;
     }
 
     static uint32_t getRouteIdByName(const std::string& strRouteName) {
 
-        uint32_t index;
-        for (index = 0; index < getNbRoutes(); index++) {
-
-            std::string strRouteAtIndexName(_astAudioRoutes[index].pcRouteName);
-            if (strRouteName == strRouteAtIndexName) {
-
-                return 1 << index;
-            }
-        }
-        return 0;
+        int32_t iIndex = CAudioPlatformDescription::findName(getDescription(),
+                                                             CAudioPlatformDescription::ERouteNames,
+                                                             strRouteName.c_str());
+        return iIndex < 0 ? 0 : getRouteId(iIndex);
     }
 
     static uint32_t getPortIdByName(const std::string& strPortName) {
 
-        uint32_t index;
-        for (index = 0; index < getNbPorts(); index++) {
-
-            std::string strPortAtIndexName(_acPorts[index]);
-            if (strPortName == strPortAtIndexName) {
-
-                return 1 << index;
-            }
-        }
-        return 0;
+        int32_t iIndex = CAudioPlatformDescription::findName(getDescription(),
+                                                             CAudioPlatformDescription::EPortNames,
+                                                             strPortName.c_str());
+        return iIndex < 0 ? 0 : getPortId(iIndex);
     }
 
     // Property name indicating time to write silence before first write
@@ -213,11 +201,14 @@ public:
     static const vector<SampleSpec::ChannelsPolicy> getChannelsPolicy(int iRouteIndex,
                                                                       bool bIsOut) {
 
-        std::vector<SampleSpec::ChannelsPolicy> channelsPolicyVector(
-                    _astAudioRoutes[iRouteIndex].aChannelsPolicy[bIsOut],
-                    _astAudioRoutes[iRouteIndex].aChannelsPolicy[bIsOut] +
-                            getRoutePcmConfig(iRouteIndex, bIsOut).channels);
+        const int32_t* aiChannelsPolicy = getRoute(iRouteIndex).aiChannelsPolicy[bIsOut];
+        std::vector<SampleSpec::ChannelsPolicy> channelsPolicyVector;
+
+        for (uint32_t i = 0; i < getRoutePcmConfig(iRouteIndex, bIsOut).channels; i++) {
 
+            channelsPolicyVector.push_back(
+                        static_cast<SampleSpec::ChannelsPolicy>(aiChannelsPolicy[i]));
+        }
         return channelsPolicyVector;
     }
 
@@ -229,20 +220,68 @@ public:
      *
      * @param[in] bIsOut direction of the stream requesting the configuration
      * @param[in] uiFlags only valid for output stream, depends on flag, might use different
-     *                    buffering model.
+     *                    buffering model. Fast flag falls back on the primary buffering model
+     *                    if the platform does not provide any low latency configuration.
      *
      * @return reference of default pcm_config
      */
     static const pcm_config& getDefaultPcmConfig(bool bIsOut, uint32_t uiFlags)
     {
-        bool bIsDeepFlag = uiFlags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER;
-        return bIsOut ?
-                    (bIsDeepFlag ?
-                         pcm_config_deep_media_playback : pcm_config_media_playback) :
-                    pcm_config_media_capture;
+        const pcm_config* astDefaultPcmConfigs = getDescription().astDefaultPcmConfigs;
+
+        if (!bIsOut) {
+
+            return astDefaultPcmConfigs[CAudioPlatformDescription::EMediaCapture];
+        }
+        // Platforms without deep buffer route leave its configuration empty
+        if ((uiFlags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER) &&
+                (astDefaultPcmConfigs[CAudioPlatformDescription::EDeepMediaPlayback].period_size != 0)) {
+
+            return astDefaultPcmConfigs[CAudioPlatformDescription::EDeepMediaPlayback];
+        }
+        // The primary output may carry the fast flag, it keeps the primary configuration
+        if (((uiFlags & (AUDIO_OUTPUT_FLAG_FAST | AUDIO_OUTPUT_FLAG_PRIMARY)) ==
+                AUDIO_OUTPUT_FLAG_FAST) &&
+                (astDefaultPcmConfigs[CAudioPlatformDescription::EFastMediaPlayback].period_size != 0)) {
+
+            return astDefaultPcmConfigs[CAudioPlatformDescription::EFastMediaPlayback];
+        }
+        return astDefaultPcmConfigs[CAudioPlatformDescription::EMediaPlayback];
     }
 
 private:
+    /**
+     * Gets the description loaded, loading the compiled tables if accessed before the route
+     * manager loaded it.
+     */
+    static const CAudioPlatformDescription::SImage& getDescription();
+
+    static const CAudioPlatformDescription::SRoute& getRoute(int iRouteIndex) {
+        return getDescription().astRoutes[iRouteIndex];
+    }
+
+    /**
+     * Converts the compiled tables into a description image: names are indexed, lists of ports
+     * and of slave routes resolved into bit fields.
+     *
+     * @return image built, NULL if the tables do not fit in an image.
+     */
+    static CAudioPlatformDescription::SImage* buildCompiledImage();
+
+    /**
+     * Resolves a comma separated list of names into a bit field of ids.
+     */
+    static uint32_t resolveNames(const CAudioPlatformDescription::SImage& stImage,
+                                 CAudioPlatformDescription::NameIndex eNameIndex,
+                                 const char* pcNames);
+
+    static CAudioPlatformDescription* _pDescription;
+    /** Set once the description is loaded, read without the lock before _pDescription. */
+    static volatile int32_t _iDescriptionLoaded;
+    static std::string _strDescriptionPath;
+    static nsecs_t _descriptionLoadTime;
+    static android::Mutex _descriptionLock;
+
     static const uint32_t MAX_CHANNELS = 32;
 
     struct s_route_t {
@@ -290,5 +329,7 @@ private:
     static const pcm_config pcm_config_media_capture;
 
     static const pcm_config pcm_config_deep_media_playback;
+
+    static const pcm_config pcm_config_fast_media_playback;
 };
 };        // namespace android
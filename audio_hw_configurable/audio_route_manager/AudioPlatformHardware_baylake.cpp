@@ -21,6 +21,7 @@
 
 #define DEEP_PLAYBACK_PERIOD_TIME_MS    ((int)96)
 #define PLAYBACK_PERIOD_TIME_MS         ((int)24)
+#define FAST_PLAYBACK_PERIOD_TIME_MS    ((int)4)
 #define VOICE_PERIOD_TIME_MS            ((int)20)
 
 #define LONG_PERIOD_FACTOR              ((int)2)
@@ -28,18 +29,21 @@
 
 #define NB_RING_BUFFER                  ((int)4)
 #define NB_RING_BUFFER_DEEP             ((int)2)
+#define NB_RING_BUFFER_FAST             ((int)2)
 
 #define SAMPLE_RATE_8000                ((int)8000)
 #define SAMPLE_RATE_48000               ((int)48000)
 
 #define DEEP_PLAYBACK_48000_PERIOD_SIZE ((int)DEEP_PLAYBACK_PERIOD_TIME_MS * SAMPLE_RATE_48000 / SEC_PER_MSEC) //(96 * 2 * 48000 / USEC_PER_SEC)
 #define PLAYBACK_48000_PERIOD_SIZE      ((int)PLAYBACK_PERIOD_TIME_MS * SAMPLE_RATE_48000 / SEC_PER_MSEC)
+#define FAST_PLAYBACK_48000_PERIOD_SIZE ((int)FAST_PLAYBACK_PERIOD_TIME_MS * SAMPLE_RATE_48000 / SEC_PER_MSEC)
 #define CAPTURE_48000_PERIOD_SIZE       ((int)VOICE_PERIOD_TIME_MS * SAMPLE_RATE_48000 / SEC_PER_MSEC)
 #define VOICE_48000_PERIOD_SIZE         ((int)VOICE_PERIOD_TIME_MS * SAMPLE_RATE_48000 / SEC_PER_MSEC)
 
 static const char* MEDIA_CARD_NAME = "baytrailaudio";
 #define DEEP_MEDIA_PLAYBACK_DEVICE_ID   ((int)0)
 #define MEDIA_PLAYBACK_DEVICE_ID        ((int)0)
+#define FAST_MEDIA_PLAYBACK_DEVICE_ID   ((int)0)
 #define MEDIA_CAPTURE_DEVICE_ID         ((int)0)
 
 using namespace std;
@@ -62,6 +66,20 @@ const pcm_config CAudioPlatformHardware::pcm_config_deep_media_playback = {
    avail_min         : DEEP_PLAYBACK_48000_PERIOD_SIZE,
 };
 
+// Low latency playback starts as soon as the first period is written,
+// not waiting for the ring buffer to be full.
+const pcm_config CAudioPlatformHardware::pcm_config_fast_media_playback = {
+   channels          : 2,
+   rate              : SAMPLE_RATE_48000,
+   period_size       : FAST_PLAYBACK_48000_PERIOD_SIZE,
+   period_count      : NB_RING_BUFFER_FAST,
+   format            : PCM_FORMAT_S16_LE,
+   start_threshold   : FAST_PLAYBACK_48000_PERIOD_SIZE,
+   stop_threshold    : FAST_PLAYBACK_48000_PERIOD_SIZE * NB_RING_BUFFER_FAST,
+   silence_threshold : 0,
+   avail_min         : FAST_PLAYBACK_48000_PERIOD_SIZE,
+};
+
 const pcm_config CAudioPlatformHardware::pcm_config_media_playback = {
    channels          : 2,
    rate              : SAMPLE_RATE_48000,
@@ -147,6 +165,40 @@ const CAudioPlatformHardware::s_route_t CAudioPlatformHardware::_astAudioRoutes[
         },
         ""
     },
+    // Fast route must be declared after Media: routes are assigned in declaration order, and the
+    // primary output may also carry the fast flag
+    {
+        "FastMedia",
+        CAudioRoute::EStreamRoute,
+        "",
+        {
+            NOT_APPLICABLE,
+            DEVICE_OUT_MM_ALL
+        },
+        {
+            NOT_APPLICABLE,
+            AUDIO_OUTPUT_FLAG_FAST
+        },
+        {
+            NOT_APPLICABLE,
+            (1 << AudioSystem::MODE_NORMAL) | (1 << AudioSystem::MODE_RINGTONE) |
+            (1 << AudioSystem::MODE_IN_COMMUNICATION)
+        },
+        MEDIA_CARD_NAME,
+        {
+            NOT_APPLICABLE,
+            FAST_MEDIA_PLAYBACK_DEVICE_ID
+        },
+        {
+            pcm_config_not_applicable,
+            CAudioPlatformHardware::pcm_config_fast_media_playback
+        },
+        {
+            { SampleSpec::Copy, SampleSpec::Copy },
+            { SampleSpec::Copy, SampleSpec::Copy }
+        },
+        ""
+    },
     {
         "DeepMedia",
         CAudioRoute::EStreamRoute,
@@ -248,7 +300,7 @@ const CAudioPlatformHardware::s_route_t CAudioPlatformHardware::_astAudioRoutes[
             channel_policy_not_applicable,
             channel_policy_not_applicable
         },
-        "CompressedMedia,Media,DeepMedia"
+        "CompressedMedia,Media,FastMedia,DeepMedia"
     }
 };
 
@@ -301,7 +353,11 @@ CAudioRoute* CAudioPlatformHardware::createAudioRoute(uint32_t uiRouteIndex, CAu
 
     const string strName = getRouteName(uiRouteIndex);
 
-    if (strName == "Media") {
+    if (strName == "FastMedia") {
+
+        return new CAudioStreamRoute(uiRouteIndex, pPlatformState);
+
+    } else if (strName == "Media") {
 
         return new CAudioStreamRoute(uiRouteIndex, pPlatformState);
 
@@ -47,6 +47,8 @@ namespace android_audio_legacy
 // first frame.
 const pcm_config CAudioPlatformHardware::pcm_config_deep_media_playback = pcm_config_not_applicable;
 
+const pcm_config CAudioPlatformHardware::pcm_config_fast_media_playback = pcm_config_not_applicable;
+
 const pcm_config CAudioPlatformHardware::pcm_config_media_playback = {
    channels          : 2,
    rate              : SAMPLE_RATE_48000,
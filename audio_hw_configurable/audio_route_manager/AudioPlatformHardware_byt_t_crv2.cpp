@@ -67,6 +67,8 @@ const pcm_config CAudioPlatformHardware::pcm_config_deep_media_playback = {
     avail_min         : DEEP_PLAYBACK_48000_PERIOD_SIZE,
 };
 
+const pcm_config CAudioPlatformHardware::pcm_config_fast_media_playback = pcm_config_not_applicable;
+
 const pcm_config CAudioPlatformHardware::pcm_config_media_playback = {
     channels          : 2,
     rate              : SAMPLE_RATE_48000,
@@ -52,19 +52,24 @@ CAudioPlatformState::CAudioPlatformState(CAudioRouteManager* pAudioRouteManager)
     _bypassedNonLinearPp(false),
     _bypassedLinearPp(false),
     _uiPlatformEventChanged(false),
+    _uiReadEvents(0),
+    _uiReadTrackingDepth(0),
     _pAudioRouteManager(pAudioRouteManager)
 {
     _uiDevices[EInput] = 0;
     _uiDevices[EOutput] = 0;
+
+    LOG_ALWAYS_FATAL_IF(pthread_key_create(&_readTrackingKey, NULL) != 0);
 }
 
 CAudioPlatformState::~CAudioPlatformState()
 {
-
+    pthread_key_delete(_readTrackingKey);
 }
 
 bool CAudioPlatformState::hasPlatformStateChanged(int iEvents) const
 {
+    recordRead(iEvents);
     return (_uiPlatformEventChanged & iEvents) != 0;
 }
 
@@ -131,6 +136,7 @@ void CAudioPlatformState::setModemAudioAvailable(bool bIsAudioAvailable)
 //
 bool CAudioPlatformState::isSharedI2SBusAvailable() const
 {
+    recordRead(ESharedI2SStateChange);
     return !isModemEmbedded() || (isModemAlive() && _bIsSharedI2SGlitchSafe);
 }
 
@@ -259,6 +265,7 @@ void CAudioPlatformState::setFmState(bool bIsFmOn)
 
 CAudioBand::Type CAudioPlatformState::getBandType() const
 {
+    recordRead(EBandTypeChange);
     return getHwMode() == AudioSystem::MODE_IN_COMMUNICATION ? _eVoipBandType : _eCsvBandType ;
 }
 
@@ -410,6 +417,35 @@ void CAudioPlatformState::clearPlatformStateEvents()
     _uiPlatformEventChanged = 0;
 }
 
+uint32_t CAudioPlatformState::startReadTracking()
+{
+    uint32_t uiOuterReadEvents = 0;
+
+    if (_uiReadTrackingDepth++ == 0) {
+
+        pthread_setspecific(_readTrackingKey, &_uiReadEvents);
+    } else {
+
+        uiOuterReadEvents = _uiReadEvents;
+    }
+    _uiReadEvents = 0;
+    return uiOuterReadEvents;
+}
+
+uint32_t CAudioPlatformState::stopReadTracking(uint32_t uiOuterReadEvents)
+{
+    uint32_t uiReadEvents = _uiReadEvents;
+
+    // States read by a nested tracking are read by the outer one as well
+    _uiReadEvents = uiOuterReadEvents | uiReadEvents;
+
+    if (--_uiReadTrackingDepth == 0) {
+
+        pthread_setspecific(_readTrackingKey, NULL);
+    }
+    return uiReadEvents;
+}
+
 
 void CAudioPlatformState::setDirectStreamEvent(uint32_t uiFlags)
 {
@@ -15,6 +15,7 @@
  */
 #pragma once
 #include "AudioBand.h"
+#include <pthread.h>
 
 #define ADD_EVENT(eventName) E##eventName = 1 << eventName
 
@@ -103,13 +104,17 @@ public:
     virtual           ~CAudioPlatformState();
 
     // Get the modem status
-    bool isModemAlive() const { return _bModemAlive; }
+    bool isModemAlive() const { recordRead(EModemStateChange); return _bModemAlive; }
 
     // Set the modem status
     void setModemAlive(bool bIsAlive);
 
     // Get the modem audio call status
-    bool isModemAudioAvailable() const { return _bModemAudioAvailable; }
+    bool isModemAudioAvailable() const
+    {
+        recordRead(EModemAudioStatusChange);
+        return _bModemAudioAvailable;
+    }
 
     // Set the modem Audio available
     void setModemAudioAvailable(bool bIsAudioAvailable);
@@ -127,22 +132,22 @@ public:
     void setMode(int iMode);
 
     // Get telephony mode
-    int getMode() const { return _iAndroidMode; }
+    int getMode() const { recordRead(EAndroidModeChange); return _iAndroidMode; }
 
     // Get the HW mode
-    int getHwMode() const { return _iHwMode; }
+    int getHwMode() const { recordRead(EHwModeChange); return _iHwMode; }
 
     // Set TTY mode
     void setTtyDirection(int iTtyDirection);
 
     // Get TTY mode
-    int getTtyDirection() const { return _iTtyDirection; }
+    int getTtyDirection() const { recordRead(ETtyDirectionChange); return _iTtyDirection; }
 
     // Set HAC mode
     void setHacMode(bool bEnabled);
 
     // Get HAC Mode
-    bool isHacEnabled() const { return _bIsHacModeEnabled; }
+    bool isHacEnabled() const { recordRead(EHacModeChange); return _bIsHacModeEnabled; }
 
     /**
      * Set the BT headset NREC.
@@ -152,7 +157,11 @@ public:
     void setBtHeadsetNrEc(bool bIsAcousticSupportedOnBT);
 
     // Get BT NREC
-    bool isBtHeadsetNrEcEnabled() const { return _bBtHeadsetNrEcEnabled; }
+    bool isBtHeadsetNrEcEnabled() const
+    {
+        recordRead(EBtHeadsetNrEcChange);
+        return _bBtHeadsetNrEcEnabled;
+    }
 
     /**
      * Set the BT headset negociated Band Type.
@@ -168,13 +177,17 @@ public:
      *
      * @return Negociated band type of the BT headset (default: ENarrow)
      */
-    CAudioBand::Type getBtHeadsetBandType() const { return _eBtHeadsetBandType; }
+    CAudioBand::Type getBtHeadsetBandType() const
+    {
+        recordRead(EBtHeadsetBandTypeChange);
+        return _eBtHeadsetBandType;
+    }
 
     // Set BT Enabled flag
     void setBtEnabled(bool bIsBtEnabled);
 
     // Get BT Enabled flag
-    bool isBtEnabled() const { return _bIsBtEnabled; }
+    bool isBtEnabled() const { recordRead(EBtEnableChange); return _bIsBtEnabled; }
 
     /**
      * Set SCO resource requested flag
@@ -188,18 +201,30 @@ public:
      *
      * @return true if SCO resource is requested.
      */
-    bool isScoResourceRequested() const { return mScoResourceRequested; }
-
-    bool hasDirectStreams() const { return (_uiDirectStreamsRefCount != 0); }
+    bool isScoResourceRequested() const
+    {
+        recordRead(EScoRscReqStateChange);
+        return mScoResourceRequested;
+    }
+
+    bool hasDirectStreams() const
+    {
+        recordRead(EStreamEvent);
+        return (_uiDirectStreamsRefCount != 0);
+    }
 
     // Get devices
-    uint32_t getDevices(bool bIsOut) const { return _uiDevices[bIsOut]; }
+    uint32_t getDevices(bool bIsOut) const
+    {
+        recordRead(bIsOut ? EOutputDevicesChange : EInputDevicesChange);
+        return _uiDevices[bIsOut];
+    }
 
     // Set devices
     void setDevices(uint32_t devices, bool bIsOut);
 
     // Get input source
-    uint32_t getInputSource() const { return _uiInputSource; }
+    uint32_t getInputSource() const { recordRead(EInputSourceChange); return _uiInputSource; }
 
     /**
      * Set input source mask
@@ -220,7 +245,11 @@ public:
      *
      * @return true if the context awareness feature is enabled
      */
-    bool isContextAwarenessEnabled() const { return _bIsContextAwarenessEnabled; }
+    bool isContextAwarenessEnabled() const
+    {
+        recordRead(EContextAwarenessStateChange);
+        return _bIsContextAwarenessEnabled;
+    }
 
     /**
      * Set "Always Listening" status
@@ -234,7 +263,11 @@ public:
      *
      * @return true if the "always listening" feature is enabled
      */
-    bool isAlwaysListeningEnabled() const { return _isAlwaysListeningEnabled; }
+    bool isAlwaysListeningEnabled() const
+    {
+        recordRead(EAlwaysListeningStateChange);
+        return _isAlwaysListeningEnabled;
+    }
 
     /**
      * Set "Bypass Non linear mode" status
@@ -255,21 +288,29 @@ public:
      *
      * @return true if the non linear post processing is disabled
      */
-    bool bypassedNonLinearPp() const { return _bypassedNonLinearPp; }
+    bool bypassedNonLinearPp() const
+    {
+        recordRead(EBypassNonLinearPpStateChange);
+        return _bypassedNonLinearPp;
+    }
 
     /**
      * Get "Bypass Linear status" status
      *
      * @return true if the linear post processing is disabled
      */
-    bool bypassedLinearPp() const { return _bypassedLinearPp; }
+    bool bypassedLinearPp() const
+    {
+        recordRead(EBypassLinearPpStateChange);
+        return _bypassedLinearPp;
+    }
 
     /**
      * Get FM State.
      *
      * @return true if FM module is powered on by FM stack.
      */
-    inline bool isFmStateOn() const { return _bFmIsOn; }
+    inline bool isFmStateOn() const { recordRead(EFmStateChange); return _bFmIsOn; }
 
     void setFmState(bool bIsFmOn);
 
@@ -295,7 +336,7 @@ public:
 
     void setScreenState(bool _bScreenOn);
 
-    bool isScreenOn() { return _bScreenOn; }
+    bool isScreenOn() const { recordRead(EScreenStateChange); return _bScreenOn; }
 
     void setPlatformStateEvent(int iEvent);
 
@@ -303,6 +344,25 @@ public:
 
     bool hasPlatformStateChanged(int iEvents = EAllEvents) const;
 
+    /**
+     * Starts tracking the platform state read through the getters. Each getter records the
+     * event notifying a change of the state it returns. Trackings may be nested.
+     * Only the reads of the calling thread are recorded: routing workers and streams may read
+     * the platform state meanwhile. Trackings are serialized by the routing lock.
+     *
+     * @return events read before the tracking started, to give back to stopReadTracking.
+     */
+    uint32_t startReadTracking();
+
+    /**
+     * Stops tracking the platform state read through the getters.
+     *
+     * @param[in] uiOuterReadEvents events returned by the matching startReadTracking.
+     *
+     * @return events of the states read since the matching startReadTracking.
+     */
+    uint32_t stopReadTracking(uint32_t uiOuterReadEvents);
+
     // update the HW mode
     void updateHwMode();
 
@@ -320,9 +380,19 @@ public:
      *
      * @return true if the state of mic mute feature is set to true, false otherwise.
      */
-    bool getMicMute() const { return _micMute; }
+    bool getMicMute() const { recordRead(EMicMuteChange); return _micMute; }
 
 private:
+    // Record the events of the states read through a getter, if the thread tracks its reads
+    void recordRead(int iEvents) const
+    {
+        uint32_t* puiReadEvents = static_cast<uint32_t*>(pthread_getspecific(_readTrackingKey));
+        if (puiReadEvents != NULL) {
+
+            *puiReadEvents |= iEvents;
+        }
+    }
+
     // Check if the Hw mode has changed
     bool checkHwMode();
 
@@ -401,6 +471,15 @@ private:
 
     uint32_t _uiPlatformEventChanged;
 
+    // Events of the states read since the last startReadTracking, by the tracking thread
+    uint32_t _uiReadEvents;
+
+    // Nested trackings of the tracking thread
+    uint32_t _uiReadTrackingDepth;
+
+    // Points to _uiReadEvents in the tracking thread, NULL in the others
+    pthread_key_t _readTrackingKey;
+
     uint32_t _uiPlatformComponentsState;
 
     CAudioRouteManager* _pAudioRouteManager;
@@ -0,0 +1,533 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/PlaybackMixer"
+
+#include "AudioPlaybackMixer.h"
+#include <AudioCommsAssert.hpp>
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using android::status_t;
+using android::Mutex;
+using android::OK;
+using android::BAD_VALUE;
+using android::NO_MEMORY;
+
+namespace android_audio_legacy
+{
+
+const uint32_t CAudioPlaybackMixer::RING_PERIODS = 4;
+// A writer playing consumes the rings each period, even if blocked for a period on the device
+const uint32_t CAudioPlaybackMixer::WRITER_TIMEOUT_PERIODS = 2;
+const float CAudioPlaybackMixer::UNITY_GAIN = 1.0f;
+
+CAudioPlaybackMixer::CAudioPlaybackMixer()
+    : _pPcmDevice(NULL),
+      _eFormat(PCM_FORMAT_S16_LE),
+      _uiChannels(0),
+      _uiPeriodUs(0),
+      _uiRingFrames(0),
+      _szFrameSize(0),
+      _pMixBuffer(NULL),
+      _uiMixFrames(0),
+      _uiWriterMixes(0)
+{
+}
+
+CAudioPlaybackMixer::~CAudioPlaybackMixer()
+{
+    ClientMapIterator it;
+    for (it = _clients.begin(); it != _clients.end(); ++it) {
+
+        free(it->second->pRing);
+        delete it->second;
+    }
+    free(_pMixBuffer);
+}
+
+bool CAudioPlaybackMixer::isMixable(const pcm_config &stConfig)
+{
+    // 32 bits samples are 24 bits samples over 32 bits for the HAL
+    return (stConfig.format == PCM_FORMAT_S16_LE) || (stConfig.format == PCM_FORMAT_S32_LE);
+}
+
+status_t CAudioPlaybackMixer::open(pcm *pPcmDevice, const pcm_config &stConfig)
+{
+    AUDIOCOMMS_ASSERT(pPcmDevice != NULL, "NULL pcm device");
+    AUDIOCOMMS_ASSERT(stConfig.period_size != 0, "invalid period size");
+
+    if (!isMixable(stConfig)) {
+
+        ALOGE("%s: format %d cannot be mixed", __FUNCTION__, stConfig.format);
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock lock(_lock);
+
+    AUDIOCOMMS_ASSERT(_clients.empty(), "clients attached before opening");
+
+    size_t szFrameSize = pcm_frames_to_bytes(pPcmDevice, 1);
+
+    if ((stConfig.period_size * szFrameSize) != (_uiMixFrames * _szFrameSize)) {
+
+        free(_pMixBuffer);
+        _pMixBuffer = static_cast<char *>(malloc(stConfig.period_size * szFrameSize));
+        if (_pMixBuffer == NULL) {
+
+            ALOGE("%s: could not allocate mix buffer", __FUNCTION__);
+            _uiMixFrames = 0;
+            return NO_MEMORY;
+        }
+    }
+    _pPcmDevice = pPcmDevice;
+    _eFormat = stConfig.format;
+    _uiChannels = stConfig.channels;
+    _uiPeriodUs = static_cast<uint64_t>(stConfig.period_size) * 1000000 / stConfig.rate;
+    _uiMixFrames = stConfig.period_size;
+    _szFrameSize = szFrameSize;
+
+    // Power of 2 capacity, so that free running indexes can wrap
+    for (_uiRingFrames = 1; _uiRingFrames < RING_PERIODS * stConfig.period_size;
+         _uiRingFrames <<= 1) {
+    }
+    return OK;
+}
+
+void CAudioPlaybackMixer::close()
+{
+    Mutex::Autolock lock(_lock);
+
+    ALOGW_IF(!_clients.empty(), "%s: %zu clients still attached", __FUNCTION__, _clients.size());
+    _pPcmDevice = NULL;
+}
+
+status_t CAudioPlaybackMixer::addClient(const void *pClient, bool bIsWriter)
+{
+    Mutex::Autolock lock(_lock);
+
+    AUDIOCOMMS_ASSERT(_clients.find(pClient) == _clients.end(), "client already attached");
+
+    SClient *pNewClient = new SClient;
+    pNewClient->bIsWriter = bIsWriter;
+    pNewClient->afGains[0] = UNITY_GAIN;
+    pNewClient->afGains[1] = UNITY_GAIN;
+    pNewClient->iReadIndex = 0;
+    pNewClient->iWriteIndex = 0;
+    pNewClient->pRing = NULL;
+
+    // The writer mixes its frames directly
+    if (!bIsWriter) {
+
+        pNewClient->pRing = static_cast<char *>(malloc(_uiRingFrames * _szFrameSize));
+        if (pNewClient->pRing == NULL) {
+
+            ALOGE("%s: could not allocate ring of client %p", __FUNCTION__, pClient);
+            delete pNewClient;
+            return NO_MEMORY;
+        }
+    }
+    _clients[pClient] = pNewClient;
+
+    ALOGD("%s(%p%s): %zu clients", __FUNCTION__, pClient, bIsWriter ? ", writer" : "",
+          _clients.size());
+    return OK;
+}
+
+void CAudioPlaybackMixer::removeClient(const void *pClient)
+{
+    Mutex::Autolock lock(_lock);
+
+    ClientMapIterator it = _clients.find(pClient);
+    if (it == _clients.end()) {
+
+        return;
+    }
+    free(it->second->pRing);
+    delete it->second;
+    _clients.erase(it);
+
+    // Client may have been waiting for room
+    _ringConsumed.broadcast();
+
+    ALOGD("%s(%p): %zu clients", __FUNCTION__, pClient, _clients.size());
+}
+
+void CAudioPlaybackMixer::setClientGain(const void *pClient, float fLeftGain, float fRightGain)
+{
+    Mutex::Autolock lock(_lock);
+
+    SClient *pMixerClient = getClientL(pClient);
+    if (pMixerClient == NULL) {
+
+        return;
+    }
+    fLeftGain = fLeftGain < 0 ? 0 : (fLeftGain > UNITY_GAIN ? UNITY_GAIN : fLeftGain);
+    fRightGain = fRightGain < 0 ? 0 : (fRightGain > UNITY_GAIN ? UNITY_GAIN : fRightGain);
+
+    // Samples alternate between left and right channels only with an even number of channels
+    if ((_uiChannels % 2) != 0) {
+
+        fLeftGain = fRightGain = fLeftGain > fRightGain ? fLeftGain : fRightGain;
+    }
+    pMixerClient->afGains[0] = fLeftGain;
+    pMixerClient->afGains[1] = fRightGain;
+}
+
+int CAudioPlaybackMixer::write(const void *pClient, const void *pBuffer, uint32_t uiFrames)
+{
+    SClient *pMixerClient;
+    bool bIsAlone;
+    {
+        Mutex::Autolock lock(_lock);
+
+        pMixerClient = getClientL(pClient);
+        AUDIOCOMMS_ASSERT(pMixerClient != NULL, "unknown playback client");
+
+        bIsAlone = pMixerClient->bIsWriter && (_clients.size() == 1) &&
+                isUnityGain(pMixerClient->afGains);
+    }
+    if (bIsAlone) {
+
+        // No need to go through the mix buffer. A client joining meanwhile is mixed from the
+        // next write on, but may drain the rings in between.
+        Mutex::Autolock writeLock(_writeLock);
+        {
+            Mutex::Autolock lock(_lock);
+
+            _uiWriterMixes++;
+        }
+        return pcm_write(_pPcmDevice, pBuffer, uiFrames * _szFrameSize);
+    }
+    // Client can only be removed from the route manager, with the stream lock held, ie not
+    // while it is writing.
+    if (pMixerClient->bIsWriter) {
+
+        return mixAndWrite(pMixerClient, pBuffer, uiFrames);
+    }
+    return queue(pMixerClient, pBuffer, uiFrames);
+}
+
+int CAudioPlaybackMixer::flush(const void *pClient)
+{
+    Mutex::Autolock lock(_lock);
+
+    SClient *pMixerClient = getClientL(pClient);
+    AUDIOCOMMS_ASSERT(pMixerClient != NULL, "unknown playback client");
+
+    if (pMixerClient->bIsWriter) {
+
+        // Device holds the frames of the other clients too, which keep playing
+        return _clients.size() == 1 ? pcm_stop(_pPcmDevice) : 0;
+    }
+    // Only the reader index may be moved by the writer context, which is serialized by the lock
+    android_atomic_release_store(android_atomic_acquire_load(&pMixerClient->iWriteIndex),
+                                 &pMixerClient->iReadIndex);
+    return 0;
+}
+
+int CAudioPlaybackMixer::mixAndWrite(const SClient *pWriter, const void *pBuffer,
+                                     uint32_t uiFrames)
+{
+    uint32_t uiWrittenFrames = 0;
+    while (uiWrittenFrames < uiFrames) {
+
+        uint32_t uiMixFrames = uiFrames - uiWrittenFrames;
+        if (uiMixFrames > _uiMixFrames) {
+
+            uiMixFrames = _uiMixFrames;
+        }
+        Mutex::Autolock writeLock(_writeLock);
+        {
+            Mutex::Autolock lock(_lock);
+
+            const char *pWriterFrames = static_cast<const char *>(pBuffer) +
+                    uiWrittenFrames * _szFrameSize;
+
+            if (isUnityGain(pWriter->afGains)) {
+
+                memcpy(_pMixBuffer, pWriterFrames, uiMixFrames * _szFrameSize);
+            } else {
+
+                memset(_pMixBuffer, 0, uiMixFrames * _szFrameSize);
+                if (_eFormat == PCM_FORMAT_S16_LE) {
+
+                    mixS16(reinterpret_cast<int16_t *>(_pMixBuffer),
+                           reinterpret_cast<const int16_t *>(pWriterFrames),
+                           uiMixFrames * _uiChannels, pWriter->afGains);
+                } else {
+
+                    mixS24over32(reinterpret_cast<uint32_t *>(_pMixBuffer),
+                                 reinterpret_cast<const uint32_t *>(pWriterFrames),
+                                 uiMixFrames * _uiChannels, pWriter->afGains);
+                }
+            }
+            mixClientsL(uiMixFrames);
+            _uiWriterMixes++;
+        }
+        // Mix buffer and device are serialized by the write lock, the clients may queue
+        int ret = pcm_write(_pPcmDevice, _pMixBuffer, uiMixFrames * _szFrameSize);
+        if (ret != 0) {
+
+            return ret;
+        }
+        uiWrittenFrames += uiMixFrames;
+    }
+    return 0;
+}
+
+int CAudioPlaybackMixer::drain(const SClient *pClient, uint32_t uiWriterMixes)
+{
+    Mutex::Autolock writeLock(_writeLock);
+    {
+        Mutex::Autolock lock(_lock);
+
+        // Writer back, or ring drained by another client meanwhile
+        uint32_t uiQueuedFrames = static_cast<uint32_t>(pClient->iWriteIndex) -
+                static_cast<uint32_t>(pClient->iReadIndex);
+        if ((_uiWriterMixes != uiWriterMixes) || (uiQueuedFrames < _uiRingFrames)) {
+
+            return 0;
+        }
+        memset(_pMixBuffer, 0, _uiMixFrames * _szFrameSize);
+        mixClientsL(_uiMixFrames);
+    }
+    ALOGV("%s: writer not consuming, %d frames drained", __FUNCTION__, _uiMixFrames);
+    return pcm_write(_pPcmDevice, _pMixBuffer, _uiMixFrames * _szFrameSize);
+}
+
+void CAudioPlaybackMixer::mixClientsL(uint32_t uiFrames)
+{
+    ClientMapIterator it;
+    for (it = _clients.begin(); it != _clients.end(); ++it) {
+
+        if (!it->second->bIsWriter) {
+
+            mixClient(it->second, uiFrames);
+        }
+    }
+    _ringConsumed.broadcast();
+}
+
+void CAudioPlaybackMixer::mixClient(SClient *pClient, uint32_t uiFrames)
+{
+    uint32_t uiReadIndex = static_cast<uint32_t>(pClient->iReadIndex);
+    uint32_t uiWriteIndex = static_cast<uint32_t>(android_atomic_acquire_load(&pClient->iWriteIndex));
+    uint32_t uiAvailableFrames = uiWriteIndex - uiReadIndex;
+
+    // Client late to queue its frames: the missing frames are mixed as silence
+    ALOGV_IF(uiAvailableFrames < uiFrames, "%s: client underrun, %d frames missing",
+             __FUNCTION__, uiFrames - uiAvailableFrames);
+    if (uiFrames > uiAvailableFrames) {
+
+        uiFrames = uiAvailableFrames;
+    }
+
+    uint32_t uiMixedFrames = 0;
+    while (uiMixedFrames < uiFrames) {
+
+        uint32_t uiOffset = (uiReadIndex + uiMixedFrames) & (_uiRingFrames - 1);
+        uint32_t uiRegionFrames = _uiRingFrames - uiOffset;
+        if (uiRegionFrames > uiFrames - uiMixedFrames) {
+
+            uiRegionFrames = uiFrames - uiMixedFrames;
+        }
+        const char *pRegion = pClient->pRing + uiOffset * _szFrameSize;
+        char *pMix = _pMixBuffer + uiMixedFrames * _szFrameSize;
+
+        if (_eFormat == PCM_FORMAT_S16_LE) {
+
+            mixS16(reinterpret_cast<int16_t *>(pMix), reinterpret_cast<const int16_t *>(pRegion),
+                   uiRegionFrames * _uiChannels, pClient->afGains);
+        } else {
+
+            mixS24over32(reinterpret_cast<uint32_t *>(pMix),
+                         reinterpret_cast<const uint32_t *>(pRegion),
+                         uiRegionFrames * _uiChannels, pClient->afGains);
+        }
+        uiMixedFrames += uiRegionFrames;
+    }
+    android_atomic_release_store(static_cast<int32_t>(uiReadIndex + uiFrames),
+                                 &pClient->iReadIndex);
+}
+
+int CAudioPlaybackMixer::queue(SClient *pClient, const void *pBuffer, uint32_t uiFrames)
+{
+    uint32_t uiQueuedFrames = 0;
+    while (uiQueuedFrames < uiFrames) {
+
+        uint32_t uiWriteIndex = static_cast<uint32_t>(pClient->iWriteIndex);
+        uint32_t uiReadIndex = static_cast<uint32_t>(android_atomic_acquire_load(&pClient->iReadIndex));
+        uint32_t uiFreeFrames = _uiRingFrames - (uiWriteIndex - uiReadIndex);
+
+        if (uiFreeFrames == 0) {
+
+            uint32_t uiWriterMixes;
+            {
+                Mutex::Autolock lock(_lock);
+
+                // Read index is only moved with the lock held, the signal cannot be missed
+                if ((static_cast<uint32_t>(pClient->iReadIndex) != uiReadIndex) ||
+                        (_ringConsumed.waitRelative(_lock, WRITER_TIMEOUT_PERIODS *
+                                                    _uiPeriodUs * 1000LL) == OK)) {
+
+                    continue;
+                }
+                uiWriterMixes = _uiWriterMixes;
+            }
+            // No writer is consuming the rings, the client drains them itself
+            int ret = drain(pClient, uiWriterMixes);
+            if (ret != 0) {
+
+                ALOGW("%s: drain failed, %d frames dropped", __FUNCTION__,
+                      uiFrames - uiQueuedFrames);
+                return ret;
+            }
+            continue;
+        }
+
+        uint32_t uiOffset = uiWriteIndex & (_uiRingFrames - 1);
+        uint32_t uiRegionFrames = _uiRingFrames - uiOffset;
+        if (uiRegionFrames > uiFreeFrames) {
+
+            uiRegionFrames = uiFreeFrames;
+        }
+        if (uiRegionFrames > uiFrames - uiQueuedFrames) {
+
+            uiRegionFrames = uiFrames - uiQueuedFrames;
+        }
+        memcpy(pClient->pRing + uiOffset * _szFrameSize,
+               static_cast<const char *>(pBuffer) + uiQueuedFrames * _szFrameSize,
+               uiRegionFrames * _szFrameSize);
+        android_atomic_release_store(static_cast<int32_t>(uiWriteIndex + uiRegionFrames),
+                                     &pClient->iWriteIndex);
+        uiQueuedFrames += uiRegionFrames;
+    }
+    return 0;
+}
+
+CAudioPlaybackMixer::SClient *CAudioPlaybackMixer::getClientL(const void *pClient) const
+{
+    ClientMapConstIterator it = _clients.find(pClient);
+
+    return it != _clients.end() ? it->second : NULL;
+}
+
+void CAudioPlaybackMixer::mixS16(int16_t *pMix, const int16_t *pSrc, uint32_t uiSamples,
+                                 const float afGains[2])
+{
+    // Q15 gains, unity gain is kept exact as it cannot be represented on 16 bits
+    static const int32_t MAX_S16 = std::numeric_limits<int16_t>::max();
+    static const int32_t MIN_S16 = std::numeric_limits<int16_t>::min();
+    int32_t aiGains[2];
+    uint32_t i = 0;
+
+    aiGains[0] = static_cast<int32_t>(afGains[0] * (1 << 15) + 0.5f);
+    aiGains[1] = static_cast<int32_t>(afGains[1] * (1 << 15) + 0.5f);
+    bool bUnity = (aiGains[0] >= (1 << 15)) && (aiGains[1] >= (1 << 15));
+    for (uint32_t uiGain = 0; uiGain < 2; uiGain++) {
+
+        // Channel at unity with the other one attenuated is scaled 1 LSB below unity
+        aiGains[uiGain] = bUnity ? 1 << 15 : (aiGains[uiGain] > MAX_S16 ? MAX_S16 :
+                                                                          aiGains[uiGain]);
+    }
+
+#ifdef __SSE2__
+    if (bUnity) {
+
+        for (; i + 8 <= uiSamples; i += 8) {
+
+            __m128i mix = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pMix + i));
+            __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pMix + i), _mm_adds_epi16(mix, src));
+        }
+    } else {
+
+        const __m128i gain = _mm_set_epi16(aiGains[1], aiGains[0], aiGains[1], aiGains[0],
+                                           aiGains[1], aiGains[0], aiGains[1], aiGains[0]);
+        const __m128i rounding = _mm_set1_epi32(1 << 14);
+        for (; i + 8 <= uiSamples; i += 8) {
+
+            __m128i mix = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pMix + i));
+            __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + i));
+
+            // 32 bits products, rounded back to Q0 then packed with saturation
+            __m128i productLow = _mm_mullo_epi16(src, gain);
+            __m128i productHigh = _mm_mulhi_epi16(src, gain);
+            __m128i scaled0 = _mm_srai_epi32(
+                        _mm_add_epi32(_mm_unpacklo_epi16(productLow, productHigh), rounding), 15);
+            __m128i scaled1 = _mm_srai_epi32(
+                        _mm_add_epi32(_mm_unpackhi_epi16(productLow, productHigh), rounding), 15);
+            __m128i scaled = _mm_packs_epi32(scaled0, scaled1);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pMix + i), _mm_adds_epi16(mix, scaled));
+        }
+    }
+#endif
+    for (; i < uiSamples; i++) {
+
+        int32_t iSample = pMix[i] + ((pSrc[i] * aiGains[i & 1] + (1 << 14)) >> 15);
+        pMix[i] = iSample > MAX_S16 ? MAX_S16 : (iSample < MIN_S16 ? MIN_S16 : iSample);
+    }
+}
+
+void CAudioPlaybackMixer::mixS24over32(uint32_t *pMix, const uint32_t *pSrc, uint32_t uiSamples,
+                                       const float afGains[2])
+{
+    // 24 bits samples are exactly represented in single precision
+    static const float MAX_S24 = 8388607.0f;
+    static const float MIN_S24 = -8388608.0f;
+    static const uint32_t S24_MASK = 0x00FFFFFF;
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    const __m128 gain = _mm_set_ps(afGains[1], afGains[0], afGains[1], afGains[0]);
+    const __m128 maxSample = _mm_set1_ps(MAX_S24);
+    const __m128 minSample = _mm_set1_ps(MIN_S24);
+    const __m128i mask = _mm_set1_epi32(S24_MASK);
+    for (; i + 4 <= uiSamples; i += 4) {
+
+        // Sign extension of the 24 bits samples
+        __m128i mix = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pMix + i));
+        __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + i));
+        mix = _mm_srai_epi32(_mm_slli_epi32(mix, 8), 8);
+        src = _mm_srai_epi32(_mm_slli_epi32(src, 8), 8);
+
+        __m128 sum = _mm_add_ps(_mm_cvtepi32_ps(mix), _mm_mul_ps(_mm_cvtepi32_ps(src), gain));
+        sum = _mm_min_ps(_mm_max_ps(sum, minSample), maxSample);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pMix + i),
+                         _mm_and_si128(_mm_cvtps_epi32(sum), mask));
+    }
+#endif
+    for (; i < uiSamples; i++) {
+
+        int32_t iMix = static_cast<int32_t>(pMix[i] << 8) >> 8;
+        int32_t iSrc = static_cast<int32_t>(pSrc[i] << 8) >> 8;
+        float fSum = iMix + iSrc * afGains[i & 1];
+        fSum = fSum > MAX_S24 ? MAX_S24 : (fSum < MIN_S24 ? MIN_S24 : fSum);
+        pMix[i] = static_cast<uint32_t>(static_cast<int32_t>(fSum + (fSum < 0 ? -0.5f : 0.5f))) &
+                S24_MASK;
+    }
+}
+
+}       // namespace android
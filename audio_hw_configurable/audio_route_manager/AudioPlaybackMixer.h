@@ -0,0 +1,254 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <tinyalsa/asoundlib.h>
+#include <utils/Errors.h>
+#include <utils/threads.h>
+#include <map>
+#include <stdint.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Mixes several output streams into the output pcm device of a route.
+ *
+ * The stream owning the route is the single writer of the device: it mixes its own frames with
+ * the frames queued by the other streams, then writes the mix, so that the device keeps being
+ * driven by one thread and one timeline. Each other stream queues its frames, already converted
+ * in the route sample specification, in its own single producer single consumer ring. A stream
+ * late to fill its ring is mixed as silence, a stream finding its ring full waits for the writer
+ * to consume it. If the writer does not consume the rings, paused or in standby, the stream
+ * finding its ring full mixes the rings and writes the device itself, so that the other streams
+ * keep playing. While the writer is alone, it writes its frames directly to the device.
+ * Saturating mix of S16 and S24 over 32 bits samples, with a left and right gain per stream.
+ */
+class CAudioPlaybackMixer
+{
+public:
+    CAudioPlaybackMixer();
+    ~CAudioPlaybackMixer();
+
+    /**
+     * Starts mixing on a device. Called by the route upon opening of the output device.
+     *
+     * @param[in] pPcmDevice opened output device.
+     * @param[in] stConfig configuration of the device.
+     *
+     * @return OK if success, BAD_VALUE if the format cannot be mixed, NO_MEMORY otherwise.
+     */
+    android::status_t open(pcm *pPcmDevice, const pcm_config &stConfig);
+
+    /**
+     * Stops mixing. Called by the route before closing the output device.
+     */
+    void close();
+
+    /**
+     * Registers a client.
+     *
+     * @param[in] pClient client identifier.
+     * @param[in] bIsWriter true for the stream owning the route, which writes the device.
+     *
+     * @return OK if success, NO_MEMORY otherwise.
+     */
+    android::status_t addClient(const void *pClient, bool bIsWriter);
+
+    /**
+     * Unregisters a client. Frames it queued and not mixed yet are dropped.
+     *
+     * @param[in] pClient client identifier.
+     */
+    void removeClient(const void *pClient);
+
+    /**
+     * Sets the gains applied to the frames of a client. With an even number of channels, the
+     * channels of even rank take the left gain and the others the right gain. With an odd number
+     * of channels, the loudest gain applies to all of them.
+     *
+     * @param[in] pClient client identifier.
+     * @param[in] fLeftGain linear gain of the left channels, from 0 (mute) to 1 (unity).
+     * @param[in] fRightGain linear gain of the right channels, from 0 (mute) to 1 (unity).
+     */
+    void setClientGain(const void *pClient, float fLeftGain, float fRightGain);
+
+    /**
+     * Writes frames for a client: mixed and written to the device for the writer, queued for the
+     * other clients.
+     *
+     * @param[in] pClient client identifier.
+     * @param[in] pBuffer frames, in route sample specification.
+     * @param[in] uiFrames number of frames to write.
+     *
+     * @return 0 if success, pcm_write error code otherwise.
+     */
+    int write(const void *pClient, const void *pBuffer, uint32_t uiFrames);
+
+    /**
+     * Drops the frames of a client: stops the device for the writer while it is alone, drops the
+     * queued frames otherwise. Frames of the writer already mixed with the frames of the other
+     * clients stay in the device.
+     *
+     * @param[in] pClient client identifier.
+     *
+     * @return 0 if success, pcm_stop error code otherwise.
+     */
+    int flush(const void *pClient);
+
+    /**
+     * Checks if a pcm configuration can be mixed.
+     *
+     * @param[in] stConfig pcm configuration.
+     *
+     * @return true if the format is supported by the mixer.
+     */
+    static bool isMixable(const pcm_config &stConfig);
+
+private:
+    CAudioPlaybackMixer(const CAudioPlaybackMixer &);
+    CAudioPlaybackMixer &operator=(const CAudioPlaybackMixer &);
+
+    /**
+     * Frames queued by a client, in route sample specification.
+     */
+    struct SClient
+    {
+        bool bIsWriter;
+        float afGains[2]; /**< linear gains of the samples of even and odd rank. */
+        char *pRing;
+        volatile int32_t iReadIndex; /**< free running, moved with the lock held only. */
+        volatile int32_t iWriteIndex; /**< free running, written by the client only. */
+    };
+
+    typedef std::map<const void *, SClient *>::iterator ClientMapIterator;
+    typedef std::map<const void *, SClient *>::const_iterator ClientMapConstIterator;
+
+    /**
+     * Mixes the frames of the writer with the frames queued by the other clients and writes the
+     * mix on the device.
+     *
+     * @param[in] pWriter writer client.
+     * @param[in] pBuffer frames of the writer.
+     * @param[in] uiFrames number of frames to write.
+     *
+     * @return 0 if success, pcm_write error code otherwise.
+     */
+    int mixAndWrite(const SClient *pWriter, const void *pBuffer, uint32_t uiFrames);
+
+    /**
+     * Mixes a period of the frames queued by the clients other than the writer and writes the
+     * mix on the device, on behalf of a writer not consuming the rings.
+     *
+     * @param[in] pClient client finding its ring full.
+     * @param[in] uiWriterMixes mixes of the writer when the client gave up waiting for it.
+     *
+     * @return 0 if success, pcm_write error code otherwise.
+     */
+    int drain(const SClient *pClient, uint32_t uiWriterMixes);
+
+    /**
+     * Mixes the frames queued by the clients other than the writer in the mix buffer, then
+     * wakes up the clients waiting for room. Must be called with the lock held.
+     *
+     * @param[in] uiFrames maximum number of frames to mix.
+     */
+    void mixClientsL(uint32_t uiFrames);
+
+    /**
+     * Mixes the frames queued by a client in the mix buffer, handling the wrap point.
+     * Must be called with the lock held.
+     *
+     * @param[in] pClient client to consume.
+     * @param[in] uiFrames maximum number of frames to mix.
+     */
+    void mixClient(SClient *pClient, uint32_t uiFrames);
+
+    /**
+     * Queues frames of a client, waiting for the writer to make room if needed, or draining the
+     * rings if the writer does not.
+     *
+     * @param[in] pClient client producing.
+     * @param[in] pBuffer frames to queue.
+     * @param[in] uiFrames number of frames to queue.
+     *
+     * @return 0 if success, pcm_write error code otherwise.
+     */
+    int queue(SClient *pClient, const void *pBuffer, uint32_t uiFrames);
+
+    /**
+     * Get a client from its identifier. Must be called with the lock held.
+     *
+     * @param[in] pClient client identifier.
+     *
+     * @return client, NULL if unknown.
+     */
+    SClient *getClientL(const void *pClient) const;
+
+    /**
+     * Adds samples into the mix, with gain and saturation.
+     *
+     * @param[in,out] pMix mix buffer.
+     * @param[in] pSrc samples to add.
+     * @param[in] uiSamples number of samples.
+     * @param[in] afGains linear gains applied to the samples added of even and odd rank.
+     */
+    static void mixS16(int16_t *pMix, const int16_t *pSrc, uint32_t uiSamples,
+                       const float afGains[2]);
+    static void mixS24over32(uint32_t *pMix, const uint32_t *pSrc, uint32_t uiSamples,
+                             const float afGains[2]);
+
+    static bool isUnityGain(const float afGains[2])
+    {
+        return (afGains[0] == UNITY_GAIN) && (afGains[1] == UNITY_GAIN);
+    }
+
+    std::map<const void *, SClient *> _clients;
+
+    pcm *_pPcmDevice;
+    pcm_format _eFormat;
+    uint32_t _uiChannels;
+    uint32_t _uiPeriodUs; /**< duration of a period, maximum wait of a client. */
+    uint32_t _uiRingFrames; /**< per client, power of 2. */
+    size_t _szFrameSize;
+
+    /** Mix of a period, used by the thread writing the device. */
+    char *_pMixBuffer;
+    uint32_t _uiMixFrames;
+
+    /** Mixes of the writer, so that a client draining the rings steps back once it is back. */
+    uint32_t _uiWriterMixes;
+
+    /** Protects the client map. */
+    android::Mutex _lock;
+
+    /** Serializes the use of the mix buffer and the writes of the device, taken before _lock. */
+    android::Mutex _writeLock;
+
+    /** Signaled each time the rings are consumed. */
+    android::Condition _ringConsumed;
+
+    /** Periods a client waits for the writer to consume its ring before draining it. */
+    static const uint32_t WRITER_TIMEOUT_PERIODS;
+
+    /** Periods of playback a client may queue ahead of the writer. */
+    static const uint32_t RING_PERIODS;
+
+    static const float UNITY_GAIN;
+};
+
+};        // namespace android
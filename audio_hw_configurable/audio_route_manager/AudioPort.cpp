@@ -31,6 +31,7 @@ CAudioPort::CAudioPort(uint32_t uiPortIndex) :
     _uiPortId(CAudioPlatformHardware::getPortId(uiPortIndex)),
     _portGroupList(0),
     _pRouteAttached(0),
+    _uiUserRoutes(0),
     _bBlocked(false),
     _bUsed(false)
 {
@@ -115,6 +116,18 @@ void CAudioPort::setUsed(CAudioRoute *pRoute)
     }
 }
 
+uint32_t CAudioPort::getMutualExclusivePorts() const
+{
+    uint32_t uiPorts = 0;
+    PortGroupListConstIterator it;
+
+    for (it = _portGroupList.begin(); it != _portGroupList.end(); ++it) {
+
+        uiPorts |= (*it)->getPortsMask();
+    }
+    return uiPorts & ~_uiPortId;
+}
+
 // This function add the route to this list of routes
 // that use this port
 void CAudioPort::addRouteToPortUsers(CAudioRoute* pRoute)
@@ -122,6 +135,7 @@ void CAudioPort::addRouteToPortUsers(CAudioRoute* pRoute)
     assert(pRoute);
 
     mRouteList.push_back(pRoute);
+    _uiUserRoutes |= pRoute->getRouteId();
 
     ALOGV("%s: added %s route to %s port users", __FUNCTION__, pRoute->getName().c_str(), getName().c_str());
 }
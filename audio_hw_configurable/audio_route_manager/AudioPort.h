@@ -37,9 +37,11 @@ public:
     virtual           ~CAudioPort();
 
     // From PortGroup
+    // Only used to validate the mutual exclusions compiled by the route manager
     void setBlocked(bool bBlocked);
 
     // From Route: this port is now used
+    // Only used to validate the mutual exclusions compiled by the route manager
     void setUsed(CAudioRoute* pRoute);
 
     void resetAvailability();
@@ -54,6 +56,12 @@ public:
     // From Group Port
     void addGroupToPort(CAudioPortGroup* portGroup);
 
+    // Bitfield of the routes that use this port
+    uint32_t getUserRoutes() const { return _uiUserRoutes; }
+
+    // Bitfield of the ports condemned when this port is used, ie the other ports of its groups
+    uint32_t getMutualExclusivePorts() const;
+
 private:
     CAudioPort(const CAudioPort &);
     CAudioPort& operator = (const CAudioPort &);
@@ -70,6 +78,8 @@ private:
 
     std::list<CAudioRoute*> mRouteList;
 
+    uint32_t _uiUserRoutes;
+
     bool _bBlocked;
     bool _bUsed;
 };
@@ -26,7 +26,8 @@ namespace android_audio_legacy
 {
 
 CAudioPortGroup::CAudioPortGroup() :
-    mPortList(0)
+    mPortList(0),
+    mPortsMask(0)
 {
 
 }
@@ -44,6 +45,7 @@ void CAudioPortGroup::addPortToGroup(CAudioPort* port)
     }
 
     mPortList.push_back(port);
+    mPortsMask |= port->getPortId();
 
     // Give the pointer on Group port back to the port
     port->addGroupToPort(this);
@@ -18,6 +18,7 @@
 
 #include <string>
 #include <list>
+#include <stdint.h>
 
 #include "AudioPortGroup.h"
 
@@ -41,11 +42,16 @@ public:
     // Condamns all the other port from this group
     void condemnMutualExclusivePort(const CAudioPort *port);
 
+    // Bitfield of the ports of this group
+    uint32_t getPortsMask() const { return mPortsMask; }
+
 private:
 
     // List of Ports that belongs to this PortGroup
     // All these port are mutual exlusive
     std::list<CAudioPort*> mPortList;
+
+    uint32_t mPortsMask;
 };
 
 };        // namespace android
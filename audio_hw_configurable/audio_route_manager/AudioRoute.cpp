@@ -31,6 +31,7 @@ namespace android_audio_legacy
 CAudioRoute::CAudioRoute(uint32_t uiRouteIndex, CAudioPlatformState* pPlatformState) :
     _strName(CAudioPlatformHardware::getRouteName(uiRouteIndex)),
     _uiRouteId(CAudioPlatformHardware::getRouteId(uiRouteIndex)),
+    _uiPorts(0),
     _uiSlaveRoutes(CAudioPlatformHardware::getSlaveRoutes(uiRouteIndex)),
     _pPlatformState(pPlatformState)
 {
@@ -61,6 +62,7 @@ void CAudioRoute::addPort(CAudioPort* pPort)
 
         ALOGV("%s: %d to route %s", __FUNCTION__, pPort->getPortId(), getName().c_str());
         pPort->addRouteToPortUsers(this);
+        _uiPorts |= pPort->getPortId();
         if (!_pPort[EPortSource]) {
 
             _pPort[EPortSource]= pPort;
@@ -140,17 +142,8 @@ void CAudioRoute::setUsed(bool bIsOut)
 
     ALOGV("%s: route %s is now in use in %s", __FUNCTION__, getName().c_str(), bIsOut? "PLAYBACK" : "CAPTURE");
 
+    // The route manager propagates the in use attribute to the ports used by this route
     _stUsed[bIsOut].bAfterRouting = true;
-
-    // Propagate the in use attribute to the ports
-    // used by this route
-    for (int i = 0; i < ENbPorts ; i++) {
-
-        if (_pPort[i]) {
-
-            _pPort[i]->setUsed(this);
-        }
-    }
 }
 
 void CAudioRoute::setNeedRerouting(bool needRerouting, bool isOut)
@@ -98,10 +98,33 @@ public:
      */
     virtual void unroute(bool isOut, bool isPostDisable);
 
+    /**
+     * Opens the devices of the route, called during enable routing stage before route(), with the
+     * same arguments. May block, and may run concurrently with the opening of other routes.
+     *
+     * @param[in] isOut direction of the audio route
+     * @param[in] isPreEnable flag is true if called before setting the audio path, false after.
+     *
+     * @return OK if successfull operation, error code otherwise.
+     */
+    virtual status_t openDevices(bool __UNUSED isOut, bool __UNUSED isPreEnable) { return OK; }
+
+    /**
+     * Closes the devices of the route, called during disable routing stage after unroute(), with
+     * the same arguments. May block, and may run concurrently with the closing of other routes.
+     *
+     * @param[in] isOut direction of the audio route
+     * @param[in] isPostDisable flag is true if called after reseting the audio path, false before.
+     */
+    virtual void closeDevices(bool __UNUSED isOut, bool __UNUSED isPostDisable) { }
+
     virtual void configure(bool __UNUSED bIsOut) { return ; }
 
     uint32_t getRouteId() const { return _uiRouteId; }
 
+    // Bitfield of the ports used by this route
+    uint32_t getPortsMask() const { return _uiPorts; }
+
     // Filters the unroute/route
     // Returns true if a route is currently used, will be used
     // after reconsiderRouting but needs to be reconfigured
@@ -157,6 +180,8 @@ private:
 
     uint32_t _uiRouteId;
 
+    uint32_t _uiPorts;
+
 protected:
     struct {
 
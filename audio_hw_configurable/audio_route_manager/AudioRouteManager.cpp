@@ -16,14 +16,23 @@
 
 #define LOG_TAG "RouteManager"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 #include <cutils/bitops.h>
+#include <cutils/atomic.h>
+#include <string.h>
 #include <string>
+#include <algorithm>
+#include <limits>
 
 #include <AudioHardwareALSA.h>
 #include <ALSAStreamOps.h>
 #include <AudioStreamInALSA.h>
 #include <AudioStreamOutALSA.h>
 #include "EventThread.h"
+#include "AudioRoutingWorkers.h"
+#include "AudioPcmPool.h"
+#include "AudioRoutingTracer.h"
+#include "AudioRoutingRecorder.h"
 #include "AudioRouteManager.h"
 #include "AudioRoute.h"
 #include "AudioStreamRoute.h"
@@ -38,6 +47,7 @@
 
 #include "AudioPlatformHardware.h"
 #include "AudioParameterHandler.h"
+#include "AudioEchoReference.h"
 #include "AudioCommsAssert.hpp"
 
 #include <fcntl.h>
@@ -47,14 +57,72 @@ using namespace android;
 using namespace std;
 using audio_comms::utilities::BitField;
 
-typedef RWLock::AutoRLock AutoR;
-typedef RWLock::AutoWLock AutoW;
 
 namespace android_audio_legacy
 {
 
 const char* const CAudioRouteManager::ROUTING_LOCKED_PROP_NAME = "AudioComms.HAL.isLocked";
 
+const char* const CAudioRouteManager::INCREMENTAL_ROUTING_PROP_NAME =
+        "audiocomms.HAL.IncrementalRouting";
+
+const char* const CAudioRouteManager::INCREMENTAL_ROUTING_CHECK_PROP_NAME =
+        "audiocomms.HAL.IncrementalRoutingCheck";
+
+const char* const CAudioRouteManager::ROUTING_WORKERS_PROP_NAME = "audiocomms.HAL.RoutingWorkers";
+
+// Calling thread takes part in the work: 3 devices opened or closed at once
+const int32_t CAudioRouteManager::ROUTING_WORKERS_DEFAULT_VALUE = 2;
+
+const char* const CAudioRouteManager::WARM_PCM_HANDLES_PROP_NAME = "audiocomms.HAL.WarmPcmHandles";
+
+const char* const CAudioRouteManager::WARM_PCM_RETENTION_PROP_NAME =
+        "audiocomms.HAL.WarmPcmRetentionMs";
+
+// Devices are closed at once by default
+const int32_t CAudioRouteManager::WARM_PCM_HANDLES_DEFAULT_VALUE = 0;
+
+const int32_t CAudioRouteManager::WARM_PCM_RETENTION_DEFAULT_VALUE_MS = 2000;
+
+const char* const CAudioRouteManager::ROUTING_TRACE_EVENTS_PROP_NAME =
+        "audiocomms.HAL.RoutingTraceEvents";
+
+// Disabled, 1024 events keep about the last 30 routings
+const int32_t CAudioRouteManager::ROUTING_TRACE_EVENTS_DEFAULT_VALUE = 0;
+
+const char* const CAudioRouteManager::ROUTING_TRACE_KEY = "routing-trace";
+
+const char* const CAudioRouteManager::ROUTING_RECORD_FILE_PROP_NAME =
+        "audiocomms.HAL.RoutingRecordFile";
+
+const char* const CAudioRouteManager::PLATFORM_DESCRIPTION_PROP_NAME =
+        "audiocomms.HAL.PlatformDescription";
+
+const char* const CAudioRouteManager::PLATFORM_DESCRIPTION_EXPORT_PROP_NAME =
+        "audiocomms.HAL.PlatformDescriptionExport";
+
+const char* const CAudioRouteManager::DEFERRED_STARTUP_PROP_NAME =
+        "audiocomms.HAL.DeferredStartup";
+
+const char* const CAudioRouteManager::STARTUP_PHASE_NAMES[ENbStartupPhases] = {
+
+    "ModemStartup",
+    "PfwStartup"
+};
+
+const char* const CAudioRouteManager::ROUTING_STAGE_NAMES[ENbRoutingStages] = {
+
+    "mute",
+    "disable",
+    "configure",
+    "enable",
+    "unmute"
+};
+
+const char* const CAudioRouteManager::TRACE_STAGE = "stage";
+const char* const CAudioRouteManager::TRACE_ROUTE = "route";
+const char* const CAudioRouteManager::TRACE_PFW = "pfw";
+
 // Defines the name of the Android property describing the name of the PFW configuration file
 const char* const CAudioRouteManager::PFW_CONF_FILE_NAME_PROP_NAME = "AudioComms.PFW.ConfPath";
 
@@ -72,6 +140,10 @@ const int CAudioRouteManager::UEVENT_MSG_MAX_LEN = 1024;
 
 const int CAudioRouteManager::SOCKET_BUFFER_DEFAULT_SIZE = 64 * 1024;
 
+const uint32_t CAudioRouteManager::SST_RECOVERY_TIMEOUT_MS = 3000;
+
+const uint32_t CAudioRouteManager::SST_RECOVERY_POLL_PERIOD_MS = 100;
+
 /// PFW related definitions
 // Logger
 class CParameterMgrPlatformConnectorLogger : public CParameterMgrPlatformConnector::ILogger
@@ -327,8 +399,35 @@ CAudioRouteManager::CAudioRouteManager(AudioHardwareALSA *pParent) :
     _pModemAudioManagerInterface(NULL),
     _pPlatformState(new CAudioPlatformState(this)),
     _pEventThread(new CEventThread(this)),
+    _pRoutingTracer(new CAudioRoutingTracer(TProperty<int32_t>(ROUTING_TRACE_EVENTS_PROP_NAME,
+                                                               ROUTING_TRACE_EVENTS_DEFAULT_VALUE))),
+    _pRoutingWorkers(new CAudioRoutingWorkers(TProperty<int32_t>(ROUTING_WORKERS_PROP_NAME,
+                                                                 ROUTING_WORKERS_DEFAULT_VALUE),
+                                              _pRoutingTracer)),
+    _pPcmPool(new CAudioPcmPool(TProperty<int32_t>(WARM_PCM_HANDLES_PROP_NAME,
+                                                   WARM_PCM_HANDLES_DEFAULT_VALUE),
+                                TProperty<int32_t>(WARM_PCM_RETENTION_PROP_NAME,
+                                                   WARM_PCM_RETENTION_DEFAULT_VALUE_MS))),
+    _pRoutingRecorder(new CAudioRoutingRecorder(TProperty<string>(ROUTING_RECORD_FILE_PROP_NAME,
+                                                                  ""))),
+    _platformCreationTime(0),
+    _creationTime(systemTime()),
+    _bDeferredStartup(TProperty<bool>(DEFERRED_STARTUP_PROP_NAME, true)),
+    _bStartupFailed(false),
+    _bRoutingReady(false),
     _bIsStarted(false),
     _bRoutingLocked(TProperty<bool>(ROUTING_LOCKED_PROP_NAME, true)),
+    _uiUsedPorts(0),
+    _uiBlockedRoutes(0),
+    _bIncrementalRouting(TProperty<bool>(INCREMENTAL_ROUTING_PROP_NAME, false)),
+    _bIncrementalRoutingCheck(TProperty<bool>(INCREMENTAL_ROUTING_CHECK_PROP_NAME, false)),
+    _bRoutingEvaluationRequired(true),
+    _uiRoutingDependencies(0),
+    _uiLastRoutingEvents(0),
+    _bRoutingPending(false),
+    _bSstRecoveryPending(false),
+    _sstRecoveryStartTime(0),
+    _bSstAudioPending(false),
     _pParent(pParent),
     _pAudioParameterHandler(new CAudioParameterHandler()),
     _pEchoReference(NULL)
@@ -342,6 +441,29 @@ CAudioRouteManager::CAudioRouteManager(AudioHardwareALSA *pParent) :
     _stRoutes[CUtils::EInput].uiPrevEnabled = 0;
     _stRoutes[CUtils::EOutput].uiPrevEnabled = 0;
 
+    _stRoutes[CUtils::EInput].uiStaticallyApplicable = 0;
+    _stRoutes[CUtils::EOutput].uiStaticallyApplicable = 0;
+
+    memset(_apRoutes, 0, sizeof(_apRoutes));
+    memset(_auiPortBlockedRoutes, 0, sizeof(_auiPortBlockedRoutes));
+
+    _stStandbyMetrics.iDelayed = 0;
+    _stStandbyMetrics.iResumed = 0;
+    _stStandbyMetrics.iApplied = 0;
+
+    memset(&_stRoutingLockContention, 0, sizeof(_stRoutingLockContention));
+    memset(&_stVolumeLockContention, 0, sizeof(_stVolumeLockContention));
+
+    memset(_auiEventRoutes, 0, sizeof(_auiEventRoutes));
+
+    _stIncrementalRoutingMetrics.iEvaluated = 0;
+    _stIncrementalRoutingMetrics.iSkipped = 0;
+    _stIncrementalRoutingMetrics.iMismatches = 0;
+
+    memset(&_stRoutingMetrics, 0, sizeof(_stRoutingMetrics));
+    memset(&_stStartupMetrics, 0, sizeof(_stStartupMetrics));
+    memset(&_stSstRecoveryMetrics, 0, sizeof(_stSstRecoveryMetrics));
+
     // Try to connect a ModemAudioManager Interface
     NInterfaceProvider::IInterfaceProvider* pMAMGRInterfaceProvider = getInterfaceProvider(TProperty<string>(MODEM_LIB_PROP_NAME).getValue().c_str());
     if (pMAMGRInterfaceProvider == NULL) {
@@ -402,8 +524,9 @@ CAudioRouteManager::CAudioRouteManager(AudioHardwareALSA *pParent) :
     }
 
     // Platform embeds a modem if we found a modem interface
-    _pPlatformState->setModemEmbedded(pMAMGRInterfaceProvider != NULL);
-    if (_pPlatformState->isModemEmbedded()) {
+    _bModemEmbedded = pMAMGRInterfaceProvider != NULL;
+    _pPlatformState->setModemEmbedded(_bModemEmbedded);
+    if (_bModemEmbedded) {
 
         ALOGD("%s: platform embeds a Modem chip", __FUNCTION__);
     } else {
@@ -414,7 +537,15 @@ CAudioRouteManager::CAudioRouteManager(AudioHardwareALSA *pParent) :
 
 CAudioRouteManager::~CAudioRouteManager()
 {
-    AutoW lock(_lock);
+    // Startup phases still running use the route manager, and take the routing lock
+    for (uint32_t uiPhase = 0; uiPhase < ENbStartupPhases; uiPhase++) {
+
+        if (_aStartupThreads[uiPhase] != 0) {
+
+            _aStartupThreads[uiPhase]->requestExitAndWait();
+        }
+    }
+    AutoRoutingLock lock(this);
 
     if (_pModemAudioManagerInterface != NULL) {
 
@@ -428,6 +559,8 @@ CAudioRouteManager::~CAudioRouteManager()
         _pEventThread->stop();
     }
     delete _pEventThread;
+    delete _pRoutingWorkers;
+    delete _pRoutingTracer;
 
     RouteListIterator it;
     // Delete all routes
@@ -435,9 +568,12 @@ CAudioRouteManager::~CAudioRouteManager()
 
         delete *it;
     }
+    // Close the devices kept warm
+    delete _pPcmPool;
+    delete _pRoutingRecorder;
 
-    // Remove Voice Call Volume Parameter Handle
-    delete _pVoiceVolumeParamHandle;
+    // Remove parameter handles, including Voice Call Volume one, before the connector
+    clearParameterHandles();
     // Unset logger
     _pParameterMgrPlatformConnector->setLogger(NULL);
     // Remove logger
@@ -455,39 +591,115 @@ void CAudioRouteManager::initRouting()
     muteRoutes(CUtils::EInput);
     muteRoutes(CUtils::EOutput);
     _apSelectedCriteria[ESelectedRoutingStage]->setCriterionState(EConfigure|EPath|EFlow);
-    _pParameterMgrPlatformConnector->applyConfigurations();
+    applyConfigurations();
 }
 
 status_t CAudioRouteManager::start()
 {
-    AutoW lock(_lock);
+    {
+        AutoRoutingLock lock(this);
+
+        assert(!_bIsStarted);
+
+        _bIsStarted = true;
+
+        uevent_init();
+
+        // Start Event thread
+        _pEventThread->start();
+    }
+    // Critical phase done: streams can be opened, platform and criteria were created with us
+    android_atomic_release_store(ns2us(systemTime() - _creationTime),
+                                 &_stStartupMetrics.iCriticalPhaseUs);
+    ALOGI("%s: critical phase done %d us after creation%s", __FUNCTION__,
+          _stStartupMetrics.iCriticalPhaseUs,
+          _bDeferredStartup ? ", starting in the background" : "");
+
+    for (uint32_t uiPhase = 0; uiPhase < ENbStartupPhases; uiPhase++) {
+
+        StartupPhase ePhase = static_cast<StartupPhase>(uiPhase);
+        if (_bDeferredStartup) {
+
+            _aStartupThreads[uiPhase] = new CStartupThread(this, ePhase);
+            if (_aStartupThreads[uiPhase]->run(STARTUP_PHASE_NAMES[uiPhase],
+                                               android::PRIORITY_AUDIO) == OK) {
+
+                continue;
+            }
+            ALOGE("%s: could not start %s thread, run in sequence", __FUNCTION__,
+                  STARTUP_PHASE_NAMES[uiPhase]);
+            _aStartupThreads[uiPhase].clear();
+        }
+        runStartupPhase(ePhase);
+    }
+    return _bStartupFailed ? NO_INIT : NO_ERROR;
+}
 
-    assert(!_bIsStarted);
+bool CAudioRouteManager::CStartupThread::threadLoop()
+{
+    _pRouteManager->runStartupPhase(_ePhase);
 
-    _bIsStarted = true;
+    // Run once
+    return false;
+}
 
-    uevent_init();
+void CAudioRouteManager::runStartupPhase(StartupPhase ePhase)
+{
+    nsecs_t startTime = systemTime();
 
-    // Start Event thread
-    _pEventThread->start();
+    switch (ePhase) {
+    case EModemPhase:
+        startModemAudioManager();
+        ALOGD_IF(isModemLess(), "%s: Note that this platform is MODEM-LESS", __FUNCTION__);
+        break;
 
-    // Start Modem Audio Manager
-    startModemAudioManager();
+    case EParameterFrameworkPhase:
+        startParameterFramework();
+        break;
 
-    ALOGD_IF(isModemLess(), "%s: Note that this platform is MODEM-LESS", __FUNCTION__);
+    default:
+        ALOGE("%s: unknown phase %d", __FUNCTION__, ePhase);
+        return;
+    }
+    android_atomic_release_store(ns2us(systemTime() - startTime),
+                                 &_stStartupMetrics.aiPhaseUs[ePhase]);
+    ALOGI("%s: %s done in %d us", __FUNCTION__, STARTUP_PHASE_NAMES[ePhase],
+          _stStartupMetrics.aiPhaseUs[ePhase]);
+}
 
-    // Start PFW
+void CAudioRouteManager::startParameterFramework()
+{
+    // Started without the routing lock, streams being opened and started meanwhile. No
+    // criterion is written until _bRoutingReady is set under the lock below: routing passes
+    // and recoveries leave them untouched until then.
     std::string strError;
     if (!_pParameterMgrPlatformConnector->start(strError)) {
 
         ALOGE("parameter-framework start error: %s", strError.c_str());
+        ALOGE("%s: NO ROUTING AVAILABLE", __FUNCTION__);
+        {
+            AutoRoutingLock lock(this);
+
+            // No client waits for a routing pass from now on, release the ones queued
+            _bStartupFailed = true;
+            _clientWaitSemaphoreList.sync();
+        }
         _pEventThread->stop();
-        return NO_INIT;
+        return;
     }
+    AutoRoutingLock lock(this);
+
+    _bRoutingReady = true;
     initRouting();
     ALOGI("parameter-framework successfully started!");
 
-    return NO_ERROR;
+    if (_bRoutingPending) {
+
+        // One pass serves the routing requests queued meanwhile
+        ALOGD("%s: {+++ RECONSIDER ROUTING +++} for %d requests queued during startup",
+              __FUNCTION__, android_atomic_acquire_load(&_stStartupMetrics.iQueuedRequests));
+        _pEventThread->trig(EUpdateRouting);
+    }
 }
 
 void CAudioRouteManager::uevent_init()
@@ -504,27 +716,45 @@ void CAudioRouteManager::uevent_init()
 //
 // Must be called from WLocked context
 //
-void CAudioRouteManager::reconsiderRouting(bool bIsSynchronous)
+status_t CAudioRouteManager::reconsiderRouting(bool bIsSynchronous)
 {
     ALOGD("%s", __FUNCTION__);
 
     assert(_bStarted && !_pEventThread->inThreadContext());
 
-    if (!bIsSynchronous) {
+    if (_bStartupFailed) {
+
+        ALOGE("%s: no routing available, parameter framework failed to start", __FUNCTION__);
+        return NO_INIT;
+    }
+
+    android_atomic_inc(&_stRoutingMetrics.iRequests);
+    if (!_bRoutingReady) {
+
+        android_atomic_inc(&_stStartupMetrics.iQueuedRequests);
+    }
+
+    if (_bRoutingPending) {
+
+        // Next routing pass is not run yet and will consider this request as well
+        android_atomic_inc(&_stRoutingMetrics.iCoalesced);
+        ALOGD("%s: coalesced with pending routing", __FUNCTION__);
+    } else {
+
+        _bRoutingPending = true;
 
         // Trigs the processing of the list
         _pEventThread->trig(EUpdateRouting);
-    } else {
+    }
 
-        // Synchronization semaphore
+    if (bIsSynchronous) {
+
+        // Synchronization semaphore, released by the next routing pass
         CSyncSemaphore syncSemaphore;
 
         // Push sync semaphore
         _clientWaitSemaphoreList.add(&syncSemaphore);
 
-        // Trig the processing of the list
-        _pEventThread->trig(EUpdateRouting);
-
         // Unlock to allow for sem wait
         _lock.unlock();
 
@@ -536,6 +766,7 @@ void CAudioRouteManager::reconsiderRouting(bool bIsSynchronous)
     }
 
     ALOGD("%s: DONE", __FUNCTION__);
+    return NO_ERROR;
 }
 
 //
@@ -546,11 +777,55 @@ void CAudioRouteManager::reconsiderRouting(bool bIsSynchronous)
 //
 void CAudioRouteManager::doReconsiderRouting()
 {
-    // Reset availability of all route (All routes to be available)
-    resetAvailability();
+    if (!_bRoutingReady || _bSstRecoveryPending) {
+
+        // Queued until the parameter framework is started or the sound cards are back from an
+        // SST recovery
+        _bRoutingPending = true;
+        if (_bSstRecoveryPending) {
+
+            // Streams started meanwhile generate silence until the pass ending the recovery
+            _clientWaitSemaphoreList.sync();
+        }
+        return;
+    }
+    // This pass serves all the requests received so far
+    _bRoutingPending = false;
+    android_atomic_inc(&_stRoutingMetrics.iPasses);
+
+    bool bRoutesWillChange = false;
+    bool bEvaluationSkippable = (_bIncrementalRouting || _bIncrementalRoutingCheck) &&
+            isRoutingEvaluationSkippable();
+
+    if (!bEvaluationSkippable || _bIncrementalRoutingCheck) {
+
+        // Reset availability of all route (All routes to be available)
+        resetAvailability();
+
+        // Parse all streams and affect route to it according to applicability of the route
+        bRoutesWillChange = prepareRouting();
+        android_atomic_inc(&_stIncrementalRoutingMetrics.iEvaluated);
 
-    // Parse all streams and affect route to it according to applicability of the route
-    bool bRoutesWillChange = prepareRouting();
+        if (bEvaluationSkippable && bRoutesWillChange) {
+
+            android_atomic_inc(&_stIncrementalRoutingMetrics.iMismatches);
+            ALOGE("%s: routing evaluation skippable on events 0x%X changed the routes"
+                  " (routing dependencies 0x%X)", __FUNCTION__, _uiLastRoutingEvents,
+                  _uiRoutingDependencies);
+        }
+        // Routes opened or closed: their state differs from the one they were evaluated with
+        _bRoutingEvaluationRequired = bRoutesWillChange;
+    } else {
+
+        // Same result as an evaluation finding the routes unchanged
+        _stRoutes[CUtils::EOutput].uiPrevEnabled = _stRoutes[CUtils::EOutput].uiEnabled;
+        _stRoutes[CUtils::EOutput].uiNeedReconfig = 0;
+        _stRoutes[CUtils::EInput].uiPrevEnabled = _stRoutes[CUtils::EInput].uiEnabled;
+        _stRoutes[CUtils::EInput].uiNeedReconfig = 0;
+        android_atomic_inc(&_stIncrementalRoutingMetrics.iSkipped);
+        ALOGV("%s: routing evaluation skipped on events 0x%X", __FUNCTION__,
+              _uiLastRoutingEvents);
+    }
 
     ALOGD("%s: %s",__FUNCTION__,
           bRoutesWillChange? "      Platform State:" : "      Platform Changes:");
@@ -685,7 +960,28 @@ void CAudioRouteManager::doReconsiderRouting()
         ALOGD("%s:          -Route that need reconfiguration in Output = %s", __FUNCTION__,
               _apCriteriaTypeInterface[ERouteCriteriaType]->getFormattedState(_stRoutes[CUtils::EOutput].uiNeedReconfig).c_str());
 
+        android_atomic_inc(&_stRoutingMetrics.iExecuted);
         executeRouting();
+
+        if ((_stRoutes[CUtils::EOutput].uiEnabled || _stRoutes[CUtils::EInput].uiEnabled) &&
+                (_stStartupMetrics.iFirstAudioMs == 0)) {
+
+            // 0 stands for no route enabled yet
+            android_atomic_release_store(std::max<int32_t>(ns2ms(systemTime() - _creationTime),
+                                                           1),
+                                         &_stStartupMetrics.iFirstAudioMs);
+            ALOGI("%s: boot to first audio: %d ms", __FUNCTION__,
+                  _stStartupMetrics.iFirstAudioMs);
+        }
+        if (_bSstAudioPending &&
+                (_stRoutes[CUtils::EOutput].uiEnabled || _stRoutes[CUtils::EInput].uiEnabled)) {
+
+            _bSstAudioPending = false;
+            android_atomic_release_store(ns2ms(systemTime() - _sstRecoveryStartTime),
+                                         &_stSstRecoveryMetrics.iAudioBackMs);
+            ALOGI("%s: audio back %d ms after SST recovery event", __FUNCTION__,
+                  _stSstRecoveryMetrics.iAudioBackMs);
+        }
     }
 
     // Clear Platform State flag
@@ -699,20 +995,46 @@ void CAudioRouteManager::doReconsiderRouting()
 
 bool CAudioRouteManager::isStarted() const
 {
-    return _pParameterMgrPlatformConnector && _pParameterMgrPlatformConnector->isStarted();
+    // Started as soon as the critical phase is done, the parameter framework being started in
+    // the background
+    return _bIsStarted && !_bStartupFailed;
 }
 
 void CAudioRouteManager::executeRouting()
 {
+    // Wall time of each stage is accounted in the routing metrics, and detailed by the routing
+    // trace if enabled
+    CAudioRoutingTracer::CScope trace(*_pRoutingTracer, TRACE_STAGE, "routing");
+    nsecs_t stageStartTime = systemTime();
+
     executeMuteStage();
+    stageStartTime = recordRoutingStageTime(EMuteStageIndex, stageStartTime);
 
     executeDisableStage();
+    stageStartTime = recordRoutingStageTime(EDisableStageIndex, stageStartTime);
 
     executeConfigureStage();
+    stageStartTime = recordRoutingStageTime(EConfigureStageIndex, stageStartTime);
 
     executeEnableStage();
+    stageStartTime = recordRoutingStageTime(EEnableStageIndex, stageStartTime);
 
     executeUnmuteStage();
+    recordRoutingStageTime(EUnmuteStageIndex, stageStartTime);
+}
+
+nsecs_t CAudioRouteManager::recordRoutingStageTime(RoutingStageIndex eStage, nsecs_t startTime)
+{
+    nsecs_t now = systemTime();
+    int32_t iStageUs = ns2us(now - startTime);
+
+    // Single writer, the routing lock being held
+    _stRoutingMetrics.aiStageTotalUs[eStage] += iStageUs;
+    if (iStageUs > _stRoutingMetrics.aiStageMaxUs[eStage]) {
+
+        _stRoutingMetrics.aiStageMaxUs[eStage] = iStageUs;
+    }
+    return now;
 }
 
 //
@@ -720,7 +1042,10 @@ void CAudioRouteManager::executeRouting()
 //
 status_t CAudioRouteManager::setStreamParameters(ALSAStreamOps* pStream, const String8 &keyValuePairs, int iMode)
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
+
+    _pRoutingRecorder->record(CAudioRoutingRecorder::ESetStreamParameters, pStream, iMode, 0,
+                              keyValuePairs.string());
 
     AudioParameter param = AudioParameter(keyValuePairs);
     status_t status;
@@ -817,35 +1142,190 @@ status_t CAudioRouteManager::setStreamParameters(ALSAStreamOps* pStream, const S
 //
 // From ALSA Stream In / Out via ALSAStreamOps
 //
-status_t CAudioRouteManager::startStream(bool bIsStreamOut)
+status_t CAudioRouteManager::startStream(const ALSAStreamOps* pStream)
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
+
+    bool bIsSynchronous = !pStream->isStartAsynchronous();
+    _pRoutingRecorder->record(CAudioRoutingRecorder::EStartStream, pStream);
 
-    ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to %s stream start event",
+    ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to %s stream start event%s",
           __FUNCTION__,
-          bIsStreamOut ? "output" : "input");
+          pStream->isOut() ? "output" : "input",
+          bIsSynchronous ? "" : " (asynchronous)");
     //
-    // SYNCHRONOUS RECONSIDERATION of the routing in case of stream start
+    // SYNCHRONOUS RECONSIDERATION of the routing in case of stream start, unless the stream
+    // prebuffers its frames until routed
     //
-    reconsiderRouting();
-    return NO_ERROR;
+    return reconsiderRouting(bIsSynchronous);
 }
 
 //
 // From ALSA Stream In / Out via ALSAStreamOps
 //
-status_t CAudioRouteManager::stopStream(bool bIsStreamOut)
+status_t CAudioRouteManager::stopStream(const ALSAStreamOps* pStream)
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
+
+    _pRoutingRecorder->record(CAudioRoutingRecorder::EStopStream, pStream);
 
     ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to %s stream stop event",
           __FUNCTION__,
-          bIsStreamOut ? "output" : "input");
+          pStream->isOut() ? "output" : "input");
     //
     // SYNCHRONOUS RECONSIDERATION of the routing in case of stream stop
     //
-    reconsiderRouting();
-    return NO_ERROR;
+    return reconsiderRouting();
+}
+
+//
+// From ALSA Stream In / Out via ALSAStreamOps
+//
+void CAudioRouteManager::delayStandby(const ALSAStreamOps* pStream)
+{
+    _pRoutingRecorder->record(CAudioRoutingRecorder::EDelayStandby, pStream);
+
+    ALOGD("%s: %s stream standby delayed", __FUNCTION__, pStream->isOut() ? "output" : "input");
+    android_atomic_inc(&_stStandbyMetrics.iDelayed);
+
+    // Alarm is armed from worker thread context
+    _pEventThread->trig(EUpdateDelayedStandby);
+}
+
+//
+// From ALSA Stream In / Out via ALSAStreamOps
+//
+void CAudioRouteManager::resumeStream(const ALSAStreamOps* pStream)
+{
+    _pRoutingRecorder->record(CAudioRoutingRecorder::EResumeStream, pStream);
+
+    ALOGD("%s: %s stream restarted within standby grace period, no rerouting", __FUNCTION__,
+          pStream->isOut() ? "output" : "input");
+    android_atomic_inc(&_stStandbyMetrics.iResumed);
+}
+
+CAudioRouteManager::AutoRoutingLock::AutoRoutingLock(CAudioRouteManager* pRouteManager)
+    : _lock(pRouteManager->_lock)
+{
+    nsecs_t waitTime = 0;
+    if (_lock.tryWriteLock() != NO_ERROR) {
+
+        nsecs_t startTime = systemTime();
+        _lock.writeLock();
+        waitTime = systemTime() - startTime;
+    }
+    recordLockWait(pRouteManager->_stRoutingLockContention, waitTime);
+}
+
+CAudioRouteManager::AutoRoutingLock::~AutoRoutingLock()
+{
+    _lock.unlock();
+}
+
+CAudioRouteManager::AutoVolumeLock::AutoVolumeLock(CAudioRouteManager* pRouteManager)
+    : _lock(pRouteManager->_volumeLock)
+{
+    nsecs_t waitTime = 0;
+    if (_lock.tryLock() != NO_ERROR) {
+
+        nsecs_t startTime = systemTime();
+        _lock.lock();
+        waitTime = systemTime() - startTime;
+    }
+    recordLockWait(pRouteManager->_stVolumeLockContention, waitTime);
+}
+
+CAudioRouteManager::AutoVolumeLock::~AutoVolumeLock()
+{
+    _lock.unlock();
+}
+
+//
+// Lock held context
+//
+void CAudioRouteManager::recordLockWait(SLockContention& stContention, nsecs_t waitTime)
+{
+    stContention.iAcquisitions++;
+    if (waitTime == 0) {
+
+        return;
+    }
+    int32_t iWaitUs = ns2us(waitTime);
+    stContention.iContended++;
+    stContention.iTotalWaitUs += iWaitUs;
+    if (iWaitUs > stContention.iMaxWaitUs) {
+
+        stContention.iMaxWaitUs = iWaitUs;
+    }
+}
+
+void CAudioRouteManager::dumpLockContention(String8& result, const char* pcName,
+                                            const SLockContention& stContention)
+{
+    result.appendFormat("  %s lock: %d acquisitions, %d contended, waited %d us (max %d us)\n",
+                        pcName,
+                        android_atomic_acquire_load(&stContention.iAcquisitions),
+                        android_atomic_acquire_load(&stContention.iContended),
+                        android_atomic_acquire_load(&stContention.iTotalWaitUs),
+                        android_atomic_acquire_load(&stContention.iMaxWaitUs));
+}
+
+void CAudioRouteManager::dump(int fd) const
+{
+    String8 result;
+
+    result.appendFormat("Route manager:\n");
+    result.appendFormat("  delayed standby: %d delayed, %d resumed (reroutings avoided), "
+                        "%d applied\n",
+                        android_atomic_acquire_load(&_stStandbyMetrics.iDelayed),
+                        android_atomic_acquire_load(&_stStandbyMetrics.iResumed),
+                        android_atomic_acquire_load(&_stStandbyMetrics.iApplied));
+    result.appendFormat("  routing: %d requests, %d coalesced, %d passes, %d executed\n",
+                        android_atomic_acquire_load(&_stRoutingMetrics.iRequests),
+                        android_atomic_acquire_load(&_stRoutingMetrics.iCoalesced),
+                        android_atomic_acquire_load(&_stRoutingMetrics.iPasses),
+                        android_atomic_acquire_load(&_stRoutingMetrics.iExecuted));
+    for (uint32_t uiStage = 0; uiStage < ENbRoutingStages; uiStage++) {
+
+        result.appendFormat("    %s stage: %d us (max %d us)\n", ROUTING_STAGE_NAMES[uiStage],
+                            android_atomic_acquire_load(&_stRoutingMetrics.aiStageTotalUs[uiStage]),
+                            android_atomic_acquire_load(&_stRoutingMetrics.aiStageMaxUs[uiStage]));
+    }
+    result.appendFormat("  incremental routing%s%s: %d evaluations, %d skipped, "
+                        "%d mismatches\n",
+                        _bIncrementalRouting ? "" : " (disabled)",
+                        _bIncrementalRoutingCheck ? " (checked)" : "",
+                        android_atomic_acquire_load(&_stIncrementalRoutingMetrics.iEvaluated),
+                        android_atomic_acquire_load(&_stIncrementalRoutingMetrics.iSkipped),
+                        android_atomic_acquire_load(&_stIncrementalRoutingMetrics.iMismatches));
+    const string& strDescriptionPath = CAudioPlatformHardware::getDescriptionPath();
+    result.appendFormat("  platform: description from %s loaded in %lld us, "
+                        "created in %lld us\n",
+                        strDescriptionPath.empty() ? "compiled tables" :
+                                                     strDescriptionPath.c_str(),
+                        static_cast<long long>(
+                            ns2us(CAudioPlatformHardware::getDescriptionLoadTime())),
+                        static_cast<long long>(ns2us(_platformCreationTime)));
+    result.appendFormat("  startup%s: critical phase %d us, modem %d us, parameter framework"
+                        " %d us, %d routing requests queued, first audio %d ms\n",
+                        _bDeferredStartup ? " (deferred)" : "",
+                        android_atomic_acquire_load(&_stStartupMetrics.iCriticalPhaseUs),
+                        android_atomic_acquire_load(&_stStartupMetrics.aiPhaseUs[EModemPhase]),
+                        android_atomic_acquire_load(
+                            &_stStartupMetrics.aiPhaseUs[EParameterFrameworkPhase]),
+                        android_atomic_acquire_load(&_stStartupMetrics.iQueuedRequests),
+                        android_atomic_acquire_load(&_stStartupMetrics.iFirstAudioMs));
+    result.appendFormat("  sst recovery: %d recoveries, last one cards back in %d ms, "
+                        "audio back in %d ms\n",
+                        android_atomic_acquire_load(&_stSstRecoveryMetrics.iRecoveries),
+                        android_atomic_acquire_load(&_stSstRecoveryMetrics.iCardsBackMs),
+                        android_atomic_acquire_load(&_stSstRecoveryMetrics.iAudioBackMs));
+    _pPcmPool->dump(result);
+    dumpLockContention(result, "routing", _stRoutingLockContention);
+    dumpLockContention(result, "voice volume", _stVolumeLockContention);
+    result.appendFormat("  routing trace %s, from %s key\n",
+                        _pRoutingTracer->isEnabled() ? "enabled" : "disabled", ROUTING_TRACE_KEY);
+    write(fd, result.string(), result.size());
 }
 
 //
@@ -853,7 +1333,10 @@ status_t CAudioRouteManager::stopStream(bool bIsStreamOut)
 //
 status_t CAudioRouteManager::setParameters(const String8& keyValuePairs)
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
+
+    _pRoutingRecorder->record(CAudioRoutingRecorder::ESetParameters, NULL, 0, 0,
+                              keyValuePairs.string());
 
     AudioParameter param = AudioParameter(keyValuePairs);
     status_t status;
@@ -897,6 +1380,17 @@ String8 CAudioRouteManager::getParameters(const String8& keyValuePairs)
 {
     ALOGV("%s: key value pair %s", __FUNCTION__, keyValuePairs.string());
 
+    //
+    // Search routing trace request
+    //
+    if (keyValuePairs.find(String8(ROUTING_TRACE_KEY)) >= 0) {
+
+        String8 result(ROUTING_TRACE_KEY);
+        result.append("=");
+        _pRoutingTracer->exportJson(result);
+        return result;
+    }
+
     //
     // Search FM state parameter
     //
@@ -1153,7 +1647,7 @@ void CAudioRouteManager::doSetHacParameters(AudioParameter &param)
 
 void CAudioRouteManager::setMicMute(bool state)
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
     _pPlatformState->setMicMute(state);
     doReconsiderRouting();
 }
@@ -1265,6 +1759,13 @@ void CAudioRouteManager::setOutputFlags(AudioStreamOutALSA* pStreamOut, uint32_t
     pStreamOut->setFlags(uiFlags);
 
     ALOGD("%s: output flags = 0x%X (Prev Flags=0x%X)", __FUNCTION__, uiFlags, uiPreviousFlags);
+
+    // Flags select the stream route (fast, primary, deep buffer...): an active stream
+    // must be rerouted if they changed.
+    if ((uiFlags != uiPreviousFlags) && pStreamOut->isStarted()) {
+
+        _pPlatformState->setPlatformStateEvent(CAudioPlatformState::EStreamEvent);
+    }
 }
 
 void CAudioRouteManager::createsRoutes()
@@ -1273,6 +1774,11 @@ void CAudioRouteManager::createsRoutes()
 
         CAudioRoute* pRoute = CAudioPlatformHardware::createAudioRoute(i, _pPlatformState);
 
+        if (!pRoute) {
+
+            // Route of a loaded description unknown to the platform file
+            pRoute = CAudioPlatformHardware::createGenericAudioRoute(i, _pPlatformState);
+        }
         if (!pRoute) {
 
             ALOGE("%s: could not find routeIndex %d", __FUNCTION__, i);
@@ -1281,6 +1787,12 @@ void CAudioRouteManager::createsRoutes()
         ALOGV("%s: add %s (Index=%d) to route manager", __FUNCTION__, pRoute->getName().c_str(), i);
 
         _routeList.push_back(pRoute);
+        _apRoutes[i] = pRoute;
+
+        if (pRoute->getRouteType() == CAudioRoute::EStreamRoute) {
+
+            static_cast<CAudioStreamRoute*>(pRoute)->setPcmPool(_pPcmPool);
+        }
 
         // Add ports to the route
         uint32_t uiPortsUsed = CAudioPlatformHardware::getPortsUsedByRoute(i);
@@ -1298,15 +1810,101 @@ void CAudioRouteManager::createsRoutes()
             }
         }
     }
+    compileApplicabilityTables();
+    compileMutualExclusions();
+}
+
+void CAudioRouteManager::compileApplicabilityTables()
+{
+    _applicabilityTables.reset();
+
+    RouteListConstIterator it;
+    for (it = _routeList.begin(); it != _routeList.end(); ++it) {
+
+        _applicabilityTables.addRoute(*it);
+    }
+}
+
+void CAudioRouteManager::compileMutualExclusions()
+{
+    memset(_auiPortBlockedRoutes, 0, sizeof(_auiPortBlockedRoutes));
+
+    PortListIterator it;
+    for (it = _portList.begin(); it != _portList.end(); ++it) {
+
+        CAudioPort* pPort = *it;
+        uint32_t uiPortIndex = __builtin_ctz(pPort->getPortId());
+        uint32_t uiExclusivePorts = pPort->getMutualExclusivePorts();
+
+        PortListIterator itExclusive;
+        for (itExclusive = _portList.begin(); itExclusive != _portList.end(); ++itExclusive) {
+
+            if (uiExclusivePorts & (*itExclusive)->getPortId()) {
+
+                _auiPortBlockedRoutes[uiPortIndex] |= (*itExclusive)->getUserRoutes();
+            }
+        }
+
+        // Check against the resolution walking the port groups
+        resetAvailability();
+        pPort->setUsed(NULL);
+
+        uint32_t uiBlockedRoutes = 0;
+        RouteListConstIterator itRoute;
+        for (itRoute = _routeList.begin(); itRoute != _routeList.end(); ++itRoute) {
+
+            if ((*itRoute)->isBlocked()) {
+
+                uiBlockedRoutes |= (*itRoute)->getRouteId();
+            }
+        }
+        if (uiBlockedRoutes != _auiPortBlockedRoutes[uiPortIndex]) {
+
+            ALOGE("%s: port %s blocks routes 0x%X, compiled as 0x%X", __FUNCTION__,
+                  pPort->getName().c_str(), uiBlockedRoutes, _auiPortBlockedRoutes[uiPortIndex]);
+            _auiPortBlockedRoutes[uiPortIndex] = uiBlockedRoutes;
+        }
+
+        PortListIterator itReset;
+        for (itReset = _portList.begin(); itReset != _portList.end(); ++itReset) {
+
+            (*itReset)->resetAvailability();
+        }
+    }
+    resetAvailability();
+}
+
+void CAudioRouteManager::useRoutePorts(const CAudioRoute* pRoute)
+{
+    uint32_t uiNewPorts = pRoute->getPortsMask() & ~_uiUsedPorts;
+    uint32_t uiBlockedRoutes = 0;
+
+    _uiUsedPorts |= uiNewPorts;
+    while (uiNewPorts != 0) {
+
+        uiBlockedRoutes |= _auiPortBlockedRoutes[__builtin_ctz(uiNewPorts)];
+        // Clear lowest bit set
+        uiNewPorts &= uiNewPorts - 1;
+    }
+
+    uiBlockedRoutes &= ~_uiBlockedRoutes;
+    _uiBlockedRoutes |= uiBlockedRoutes;
+    while (uiBlockedRoutes != 0) {
 
+        _apRoutes[__builtin_ctz(uiBlockedRoutes)]->setBlocked();
+        uiBlockedRoutes &= uiBlockedRoutes - 1;
+    }
 }
 
 void CAudioRouteManager::createAudioHardwarePlatform()
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
 
     ALOGV("%s", __FUNCTION__);
 
+    nsecs_t startTime = systemTime();
+    CAudioPlatformHardware::loadDescription(TProperty<string>(PLATFORM_DESCRIPTION_PROP_NAME, ""));
+
     for (uint32_t i = 0; i < CAudioPlatformHardware::getNbPorts(); i++) {
 
         addPort(i);
@@ -1318,6 +1916,22 @@ void CAudioRouteManager::createAudioHardwarePlatform()
     }
 
     createsRoutes();
+    _platformCreationTime = systemTime() - startTime;
+
+    const string& strDescriptionPath = CAudioPlatformHardware::getDescriptionPath();
+    ALOGI("%s: platform description from %s loaded in %lld us, platform created in %lld us",
+          __FUNCTION__,
+          strDescriptionPath.empty() ? "compiled tables" : strDescriptionPath.c_str(),
+          static_cast<long long>(ns2us(CAudioPlatformHardware::getDescriptionLoadTime())),
+          static_cast<long long>(ns2us(_platformCreationTime)));
+
+    // Converting the compiled tables also times them, to compare with a loaded file
+    string strExportPath = TProperty<string>(PLATFORM_DESCRIPTION_EXPORT_PROP_NAME, "");
+    if (!strExportPath.empty() &&
+            (CAudioPlatformHardware::exportDescription(strExportPath) == OK)) {
+
+        ALOGI("%s: compiled tables exported into %s", __FUNCTION__, strExportPath.c_str());
+    }
 }
 
 
@@ -1377,14 +1991,8 @@ void CAudioRouteManager::resetAvailability()
     }
 
     // Reset Port availability
-    PortListIterator itport;
-
-    // Find the applicable route for this route request
-    for (itport = _portList.begin(); itport != _portList.end(); ++itport) {
-
-        CAudioPort* aPort = *itport;
-        aPort->resetAvailability();
-    }
+    _uiUsedPorts = 0;
+    _uiBlockedRoutes = 0;
 }
 
 //
@@ -1392,13 +2000,25 @@ void CAudioRouteManager::resetAvailability()
 //
 void CAudioRouteManager::addStream(ALSAStreamOps* pStream)
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
 
     bool bIsOut = pStream->isOut();
 
     ALOGV("%s: add %s stream to route manager", __FUNCTION__, bIsOut ? "output" : "input");
 
+    if (_pRoutingRecorder->isEnabled()) {
+
+        AudioParameter sampleSpec;
+        sampleSpec.addInt(String8(AudioParameter::keyFormat), pStream->format());
+        sampleSpec.addInt(String8(AudioParameter::keyChannels), pStream->channels());
+        sampleSpec.addInt(String8(AudioParameter::keySamplingRate), pStream->sampleRate());
+        _pRoutingRecorder->record(CAudioRoutingRecorder::EAddStream, pStream,
+                                  bIsOut ? pStream->getApplicabilityMask() : 0, bIsOut,
+                                  sampleSpec.toString().string());
+    }
+
     // Add Stream Out to the list
+    Mutex::Autolock streamsLock(_streamsListLock);
     _streamsList[bIsOut].push_back(pStream);
 }
 
@@ -1407,14 +2027,25 @@ void CAudioRouteManager::addStream(ALSAStreamOps* pStream)
 //
 void CAudioRouteManager::removeStream(ALSAStreamOps* pStream)
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
 
     ALOGV("%s", __FUNCTION__);
 
+    _pRoutingRecorder->record(CAudioRoutingRecorder::ERemoveStream, pStream);
+
     ALSAStreamOpsListIterator it;
 
     bool isOut = pStream->isOut();
 
+    // Stream closed within the grace period of its standby: release its route now
+    nsecs_t deadline;
+    if (pStream->applyDelayedStandby(numeric_limits<nsecs_t>::max(), deadline)) {
+
+        android_atomic_inc(&_stStandbyMetrics.iApplied);
+        ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to stream removal", __FUNCTION__);
+        reconsiderRouting();
+    }
+
     for (it = _streamsList[isOut].begin(); it != _streamsList[isOut].end(); ++it) {
 
         ALSAStreamOps* pOps = *it;
@@ -1422,6 +2053,7 @@ void CAudioRouteManager::removeStream(ALSAStreamOps* pStream)
         if (pOps == pStream) {
 
             // Remove element
+            Mutex::Autolock streamsLock(_streamsListLock);
             _streamsList[isOut].erase(it);
 
             // Done
@@ -1437,6 +2069,10 @@ bool CAudioRouteManager::prepareRouting()
 {
     ALOGV("\t\t %s", __FUNCTION__);
 
+    // Dependencies are recorded again while evaluating the routes
+    memset(_auiEventRoutes, 0, sizeof(_auiEventRoutes));
+    _uiRoutingDependencies = 0;
+
     // Return true if any changes observed routes (input or output direction)
     return prepareRouting(CUtils::EOutput) | prepareRouting(CUtils::EInput);
 }
@@ -1466,6 +2102,14 @@ bool CAudioRouteManager::prepareRouting(bool bIsOut)
     // Reset Need reconfiguration Routes
     _stRoutes[bIsOut].uiNeedReconfig = 0;
 
+    // Platform devices and mode are the same for all the routes, and so are the dependencies of
+    // the routes on them through the prefilter
+    uint32_t uiOuterReadEvents = _pPlatformState->startReadTracking();
+    _stRoutes[bIsOut].uiStaticallyApplicable =
+            _applicabilityTables.getRoutes(bIsOut, _pPlatformState->getDevices(bIsOut),
+                                           _pPlatformState->getHwMode());
+    uint32_t uiPrefilterReadEvents = _pPlatformState->stopReadTracking(uiOuterReadEvents);
+
     // Go through the list of routes
     RouteListIterator it;
 
@@ -1474,9 +2118,15 @@ bool CAudioRouteManager::prepareRouting(bool bIsOut)
 
         CAudioRoute *pRoute =  *it;
 
+        uiOuterReadEvents = _pPlatformState->startReadTracking();
+
         prepareRoute(pRoute, bIsOut);
 
+        recordRouteDependencies(pRoute, _pPlatformState->stopReadTracking(uiOuterReadEvents) |
+                                uiPrefilterReadEvents);
     }
+    // Dedicated routes have been served first, remaining streams may share a route
+    prepareSharedStreamRoutes(bIsOut);
     return (_stRoutes[bIsOut].uiPrevEnabled != _stRoutes[bIsOut].uiEnabled) || (_stRoutes[bIsOut].uiNeedReconfig != 0);
 }
 
@@ -1529,6 +2179,7 @@ void CAudioRouteManager::prepareRoute(CAudioRoute* pRoute, bool bIsOut)
             // Route is not condemned -> its port are now busy by this ext route
             // It will automatically condemn all mutual exclusive ports used by this route
             pRoute->setUsed(bIsOut);
+            useRoutePorts(pRoute);
             // Add route to enabled route bit field
             _stRoutes[bIsOut].uiEnabled |= pRoute->getRouteId();
         }
@@ -1546,6 +2197,7 @@ void CAudioRouteManager::prepareRoute(CAudioRoute* pRoute, bool bIsOut)
             pStreamRoute->setStream(pStreamOps);
 
             pRoute->setUsed(bIsOut);
+            useRoutePorts(pRoute);
 
             // Add route to enabled route bit field
             _stRoutes[bIsOut].uiEnabled |= pRoute->getRouteId();
@@ -1561,37 +2213,181 @@ void CAudioRouteManager::prepareRoute(CAudioRoute* pRoute, bool bIsOut)
     }
 }
 
-ALSAStreamOps* CAudioRouteManager::findApplicableStreamForRoute(bool bIsOut, const CAudioRoute *pRoute)
+void CAudioRouteManager::prepareSharedStreamRoutes(bool bIsOut)
 {
-    if (pRoute->getRouteType() != CAudioRoute::EStreamRoute) {
-
-        return NULL;
-    }
-
     ALSAStreamOpsListIterator it;
 
     for (it = _streamsList[bIsOut].begin(); it != _streamsList[bIsOut].end(); ++it) {
 
         ALSAStreamOps* pOps = *it;
-        assert(isOut == pOps->isOut());
 
-        // Check stream state - only evaluates streams that are started
-        if (pOps->isStarted() && !pOps->isRouteAssignedToStream()) {
+        if (!pOps->isStarted() || pOps->isRouteAssignedToStream()) {
 
-            // Check if the route is applicable
-            // Applicability will also check if this route is already busy or not.
+            continue;
+        }
+        RouteListIterator routeIt;
+        for (routeIt = _routeList.begin(); routeIt != _routeList.end(); ++routeIt) {
 
-            // Applicability mask depends on the direction of the stream
-            //  -Output stream: output Flags
-            //  -Input stream: input source
-            uint32_t uiApplicabilityMask = pOps->getApplicabilityMask();
+            CAudioRoute* pRoute = *routeIt;
+            if (pRoute->getRouteType() != CAudioRoute::EStreamRoute) {
 
-            if (pRoute->isApplicable(_pPlatformState->getDevices(bIsOut),
-                                     _pPlatformState->getHwMode(),
-                                     bIsOut,
-                                     uiApplicabilityMask)) {
+                continue;
+            }
+            CAudioStreamRoute* pStreamRoute = static_cast<CAudioStreamRoute*>(pRoute);
+            if (pStreamRoute->isSharable(pOps->getApplicabilityMask(), bIsOut)) {
 
-                ALOGV("%s: route %s is applicable", __FUNCTION__, pRoute->getName().c_str());
+                pStreamRoute->addSharedStream(pOps);
+                break;
+            }
+        }
+    }
+
+    // Set of shared streams is part of the reconfiguration criteria of the stream routes,
+    // which is only known now.
+    RouteListIterator routeIt;
+    for (routeIt = _routeList.begin(); routeIt != _routeList.end(); ++routeIt) {
+
+        CAudioRoute* pRoute = *routeIt;
+        if (pRoute->getRouteType() != CAudioRoute::EStreamRoute) {
+
+            continue;
+        }
+        uint32_t uiOuterReadEvents = _pPlatformState->startReadTracking();
+
+        if (pRoute->needReconfiguration(bIsOut)) {
+
+            _stRoutes[bIsOut].uiNeedReconfig |= pRoute->getRouteId();
+        } else {
+
+            _stRoutes[bIsOut].uiNeedReconfig &= ~pRoute->getRouteId();
+        }
+        recordRouteDependencies(pRoute, _pPlatformState->stopReadTracking(uiOuterReadEvents));
+    }
+}
+
+bool CAudioRouteManager::isRoutingEvaluationSkippable()
+{
+    // Flags of the events read by the last evaluation are cleared since then: changed as well
+    uint32_t uiChangedEvents = _uiLastRoutingEvents;
+    _uiLastRoutingEvents = 0;
+    for (uint32_t uiEvent = 0; uiEvent < CAudioPlatformState::NbEvents; uiEvent++) {
+
+        if (_pPlatformState->hasPlatformStateChanged(1 << uiEvent)) {
+
+            _uiLastRoutingEvents |= 1 << uiEvent;
+        }
+    }
+    uiChangedEvents |= _uiLastRoutingEvents;
+
+    _newStreamSignature.clear();
+    for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+        ALSAStreamOpsListIterator it;
+        for (it = _streamsList[uiDir].begin(); it != _streamsList[uiDir].end(); ++it) {
+
+            ALSAStreamOps* pOps = *it;
+            SStreamSignature stSignature;
+
+            stSignature.pStream = pOps;
+            stSignature.bStarted = pOps->isStarted();
+            stSignature.uiApplicabilityMask = pOps->getApplicabilityMask();
+            stSignature.uiDevices = pOps->getNewDevices();
+            _newStreamSignature.push_back(stSignature);
+        }
+    }
+    bool bStreamsChanged = (_newStreamSignature != _streamSignature);
+    _streamSignature.swap(_newStreamSignature);
+
+    if (_bRoutingEvaluationRequired || bStreamsChanged) {
+
+        return false;
+    }
+    uint32_t uiImpactedRoutes = getRoutesDependingOn(uiChangedEvents);
+    if (uiImpactedRoutes != 0) {
+
+        ALOGV("%s: events 0x%X impact routes %s", __FUNCTION__, uiChangedEvents,
+              _apCriteriaTypeInterface[ERouteCriteriaType]->getFormattedState(
+                  uiImpactedRoutes).c_str());
+        return false;
+    }
+    return true;
+}
+
+void CAudioRouteManager::recordRouteDependencies(const CAudioRoute* pRoute, uint32_t uiReadEvents)
+{
+    _uiRoutingDependencies |= uiReadEvents;
+
+    for (uint32_t uiEvent = 0; uiEvent < CAudioPlatformState::NbEvents; uiEvent++) {
+
+        if (uiReadEvents & (1 << uiEvent)) {
+
+            _auiEventRoutes[uiEvent] |= pRoute->getRouteId();
+        }
+    }
+}
+
+uint32_t CAudioRouteManager::getRoutesDependingOn(uint32_t uiEvents) const
+{
+    uint32_t uiRoutes = 0;
+
+    if ((uiEvents & _uiRoutingDependencies) == 0) {
+
+        return 0;
+    }
+    for (uint32_t uiEvent = 0; uiEvent < CAudioPlatformState::NbEvents; uiEvent++) {
+
+        if (uiEvents & (1 << uiEvent)) {
+
+            uiRoutes |= _auiEventRoutes[uiEvent];
+        }
+    }
+    return uiRoutes;
+}
+
+ALSAStreamOps* CAudioRouteManager::findApplicableStreamForRoute(bool bIsOut, const CAudioRoute *pRoute)
+{
+    if (pRoute->getRouteType() != CAudioRoute::EStreamRoute) {
+
+        return NULL;
+    }
+
+    // Stream routes specialization only restricts the static rules: no need to go further if
+    // they do not match
+    uint32_t uiRouteId = pRoute->getRouteId();
+    if ((_stRoutes[bIsOut].uiStaticallyApplicable & uiRouteId) == 0) {
+
+        return NULL;
+    }
+
+    ALSAStreamOpsListIterator it;
+
+    for (it = _streamsList[bIsOut].begin(); it != _streamsList[bIsOut].end(); ++it) {
+
+        ALSAStreamOps* pOps = *it;
+        assert(isOut == pOps->isOut());
+
+        // Check stream state - only evaluates streams that are started
+        if (pOps->isStarted() && !pOps->isRouteAssignedToStream()) {
+
+            // Check if the route is applicable
+            // Applicability will also check if this route is already busy or not.
+
+            // Applicability mask depends on the direction of the stream
+            //  -Output stream: output Flags
+            //  -Input stream: input source
+            uint32_t uiApplicabilityMask = pOps->getApplicabilityMask();
+
+            if ((_applicabilityTables.getMaskRoutes(bIsOut, uiApplicabilityMask) &
+                 uiRouteId) == 0) {
+
+                continue;
+            }
+            if (pRoute->isApplicable(_pPlatformState->getDevices(bIsOut),
+                                     _pPlatformState->getHwMode(),
+                                     bIsOut,
+                                     uiApplicabilityMask)) {
+
+                ALOGV("%s: route %s is applicable", __FUNCTION__, pRoute->getName().c_str());
 
                 // Got it! Bailing out
                 return pOps;
@@ -1604,6 +2400,7 @@ ALSAStreamOps* CAudioRouteManager::findApplicableStreamForRoute(bool bIsOut, con
 void CAudioRouteManager::executeMuteStage()
 {
     ALOGD("%s: --------------- Routing Stage = Mute ---------------", __FUNCTION__);
+    CAudioRoutingTracer::CScope trace(*_pRoutingTracer, TRACE_STAGE, "mute");
 
     _apSelectedCriteria[ESelectedRoutingStage]->setCriterionState(EFlow);
 
@@ -1614,7 +2411,7 @@ void CAudioRouteManager::executeMuteStage()
     muteRoutes(CUtils::EInput);
     muteRoutes(CUtils::EOutput);
 
-    _pParameterMgrPlatformConnector->applyConfigurations();
+    applyConfigurations();
 }
 
 void CAudioRouteManager::muteRoutes(bool bIsOut)
@@ -1649,16 +2446,26 @@ void CAudioRouteManager::muteRoutes(bool bIsOut)
 void CAudioRouteManager::executeUnmuteStage()
 {
     ALOGD("%s: --------------- Routing Stage = Unmute ---------------", __FUNCTION__);
+    CAudioRoutingTracer::CScope trace(*_pRoutingTracer, TRACE_STAGE, "unmute");
 
     // Warn PFW
     _apSelectedCriteria[ESelectedRoutingStage]->setCriterionState(EConfigure|EPath|EFlow);
 
-    _pParameterMgrPlatformConnector->applyConfigurations();
+    applyConfigurations();
+
+    // Output streams write their prebuffered frames from now on
+    ALSAStreamOpsListIterator it;
+    for (it = _streamsList[CUtils::EOutput].begin(); it != _streamsList[CUtils::EOutput].end();
+         ++it) {
+
+        static_cast<AudioStreamOutALSA*>(*it)->onRouteUnmuted();
+    }
 }
 
 void CAudioRouteManager::executeConfigureStage()
 {
     ALOGD("%s: --------------- Routing Stage = Configure ---------------", __FUNCTION__);
+    CAudioRoutingTracer::CScope trace(*_pRoutingTracer, TRACE_STAGE, "configure");
 
     // Warn PFW
     _apSelectedCriteria[ESelectedRoutingStage]->setCriterionState(EConfigure);
@@ -1667,6 +2474,8 @@ void CAudioRouteManager::executeConfigureStage()
     configureRoutes(CUtils::EInput);
 
     // Change here the devices, the mode, ... all the criteria required for the routing
+    nsecs_t criteriaBeginTime = _pRoutingTracer->begin();
+
     _apSelectedCriteria[ESelectedMode]->setCriterionState(
                 _pPlatformState->getHwMode());
 
@@ -1697,7 +2506,9 @@ void CAudioRouteManager::executeConfigureStage()
     _apSelectedCriteria[ESelectedMicMute]->setCriterionState(
                 _pPlatformState->getMicMute());
 
-    _pParameterMgrPlatformConnector->applyConfigurations();
+    _pRoutingTracer->record(TRACE_PFW, "setCriterionState", criteriaBeginTime);
+
+    applyConfigurations();
 }
 
 void CAudioRouteManager::configureRoutes(bool bIsOut)
@@ -1712,6 +2523,9 @@ void CAudioRouteManager::configureRoutes(bool bIsOut)
 
         if (!route->needRerouting(bIsOut) &&
             ( route->getRouteId() & _stRoutes[bIsOut].uiNeedReconfig)) {
+
+            CAudioRoutingTracer::CScope trace(*_pRoutingTracer, TRACE_ROUTE, "configure",
+                                              route->getName().c_str(), bIsOut);
             route->configure(bIsOut);
         }
     }
@@ -1731,6 +2545,7 @@ void CAudioRouteManager::configureRoutes(bool bIsOut)
 void CAudioRouteManager::executeDisableStage()
 {
     ALOGD("%s: --------------- Routing Stage = Disable ---------------", __FUNCTION__);
+    CAudioRoutingTracer::CScope trace(*_pRoutingTracer, TRACE_STAGE, "disable");
 
     _apSelectedCriteria[ESelectedRoutingStage]->setCriterionState(EPath);
 
@@ -1743,10 +2558,21 @@ void CAudioRouteManager::executeDisableStage()
     doDisableRoutes(CUtils::EInput);
     doDisableRoutes(CUtils::EOutput);
 
-    _pParameterMgrPlatformConnector->applyConfigurations();
+    // Close the devices of both directions at once, before the path is reset
+    _pRoutingWorkers->run();
+
+    applyConfigurations();
 
     doPostDisableRoutes<CUtils::EInput>();
     doPostDisableRoutes<CUtils::EOutput>();
+
+    _pRoutingWorkers->run();
+
+    if (!_pPcmPool->isEmpty()) {
+
+        // Devices kept warm: alarm closing them is armed from worker thread context
+        _pEventThread->trig(EUpdateDelayedStandby);
+    }
 }
 
 void CAudioRouteManager::prepareDisableRoutes(bool bIsOut)
@@ -1787,9 +2613,15 @@ void CAudioRouteManager::doDisableRoutes(bool isOut, bool isPostDisable)
         // Disable Routes that were opened before reconsidering the routing
         // and will be closed after.
         //
-        if ((route->currentlyUsed(isOut) && !route->willBeUsed(isOut)) ||
-                route->needRerouting(isOut)) {
+        if (isRouteToDisable(route, isOut)) {
+
+            nsecs_t beginTime = _pRoutingTracer->begin();
             route->unroute(isOut, isPostDisable);
+            _pRoutingTracer->record(TRACE_ROUTE, isPostDisable ? "postUnroute" : "unroute",
+                                    beginTime, route->getName().c_str(), isOut);
+
+            // Closing of the devices is deferred to the routing workers
+            _pRoutingWorkers->queueClose(route, isOut, isPostDisable);
         }
     }
 }
@@ -1797,20 +2629,44 @@ void CAudioRouteManager::doDisableRoutes(bool isOut, bool isPostDisable)
 void CAudioRouteManager::executeEnableStage()
 {
     ALOGD("%s: --------------- Routing Stage = Enable ---------------", __FUNCTION__);
+    CAudioRoutingTracer::CScope trace(*_pRoutingTracer, TRACE_STAGE, "enable");
 
     // Warn PFW
     _apSelectedCriteria[ESelectedRoutingStage]->setCriterionState(EPath|EConfigure);
 
+    openRouteDevices(true);
+
     doPreEnableRoutes<CUtils::EOutput>();
     doPreEnableRoutes<CUtils::EInput>();
 
-    _pParameterMgrPlatformConnector->applyConfigurations();
+    applyConfigurations();
+
+    openRouteDevices(false);
 
     // Connect all streams that need to be connected (starting from output streams)
     doEnableRoutes(CUtils::EOutput);
     doEnableRoutes(CUtils::EInput);
 }
 
+void CAudioRouteManager::openRouteDevices(bool isPreEnable)
+{
+    RouteListIterator it;
+
+    for (it = _routeList.begin(); it != _routeList.end(); ++it) {
+
+        CAudioRoute* route = *it;
+
+        for (int iDir = 0; iDir < CUtils::ENbDirections; iDir++) {
+
+            if (isRouteToEnable(route, iDir)) {
+
+                _pRoutingWorkers->queueOpen(route, iDir, isPreEnable);
+            }
+        }
+    }
+    _pRoutingWorkers->run();
+}
+
 void CAudioRouteManager::doEnableRoutes(bool isOut, bool isPreEnable)
 {
     ALOGV("%s for %s:", __FUNCTION__,
@@ -1832,10 +2688,13 @@ void CAudioRouteManager::doEnableRoutes(bool isOut, bool isPreEnable)
         CAudioRoute* route = *it;
 
         // If the route is external and was set busy -> it needs to be routed
-        if ((!route->currentlyUsed(isOut) && route->willBeUsed(isOut)) ||
-                route->needRerouting(isOut)) {
+        if (isRouteToEnable(route, isOut)) {
 
-            if (route->route(isOut, isPreEnable) != NO_ERROR) {
+            nsecs_t beginTime = _pRoutingTracer->begin();
+            status_t err = route->route(isOut, isPreEnable);
+            _pRoutingTracer->record(TRACE_ROUTE, isPreEnable ? "preRoute" : "route", beginTime,
+                                    route->getName().c_str(), isOut);
+            if (err != NO_ERROR) {
                 // Just logging
                 ALOGE("\t error while routing %s", route->getName().c_str());
             }
@@ -1843,6 +2702,18 @@ void CAudioRouteManager::doEnableRoutes(bool isOut, bool isPreEnable)
     }
 }
 
+void CAudioRouteManager::applyConfigurations()
+{
+    if (!_bRoutingReady) {
+
+        // Criteria set meanwhile are applied by the initial routing
+        return;
+    }
+    CAudioRoutingTracer::CScope trace(*_pRoutingTracer, TRACE_PFW, "applyConfigurations");
+
+    _pParameterMgrPlatformConnector->applyConfigurations();
+}
+
 CAudioRoute* CAudioRouteManager::findRouteById(uint32_t uiRouteId)
 {
     CAudioRoute* pFoundRoute =  NULL;
@@ -1885,8 +2756,12 @@ void CAudioRouteManager::startModemAudioManager()
 
         return;
     }
-    // Starts the ModemAudioManager
-    if(!_pModemAudioManagerInterface->start()) {
+    // Starts the ModemAudioManager, without the routing lock as it waits for the modem
+    bool bStarted = _pModemAudioManagerInterface->start();
+
+    AutoRoutingLock lock(this);
+
+    if (!bStarted) {
 
         ALOGW("%s: could not start ModemAudioManager.", __FUNCTION__);
         _pModemAudioManagerInterface->setModemAudioManagerObserver(NULL);
@@ -1902,6 +2777,12 @@ void CAudioRouteManager::startModemAudioManager()
     _pPlatformState->setBandType(_pModemAudioManagerInterface->getAudioBand(), AudioSystem::MODE_IN_CALL);
 
     ALOGD("%s: success", __FUNCTION__);
+
+    if (_bRoutingReady) {
+
+        // Parameter framework started first: streams were routed without the modem status
+        reconsiderRouting(false);
+    }
 }
 
 //
@@ -1959,8 +2840,10 @@ bool CAudioRouteManager::onEvent(int iFd)
         while (cp < msg + n) {
             if (!strcmp(cp, "EVENT_TYPE=SST_RECOVERY")) {
                 LOGE("Encountered SST driver event : %s", cp);
-                //Restart Mediaserver to complete LPE recovery
-                AUDIOCOMMS_ASSERT(false, "Restarting MediaServer due to SST_RECOVERY event");
+                _pRoutingRecorder->record(CAudioRoutingRecorder::ESstRecovery);
+                // Recover the audio path without restarting the media server
+                AutoRoutingLock lock(this);
+                doRecoverFromSstReset();
                 break;
             }
            cp += strlen(cp) + 1;
@@ -1969,6 +2852,136 @@ bool CAudioRouteManager::onEvent(int iFd)
     return true;
 }
 
+//
+// From any context but worker thread one
+//
+void CAudioRouteManager::recoverFromSstReset()
+{
+    AutoRoutingLock lock(this);
+
+    // Served by the routing pass ending the recovery
+    _bRoutingPending = true;
+    _pEventThread->trig(ERecoverFromSstReset);
+}
+
+//
+// Worker thread context, WLocked
+// Recovery of the audio path after a reset of the LPE firmware
+//
+void CAudioRouteManager::doRecoverFromSstReset()
+{
+    ALOGD("%s: {+++ RECOVERY +++} unrouting all routes", __FUNCTION__);
+
+    android_atomic_inc(&_stSstRecoveryMetrics.iRecoveries);
+    _sstRecoveryStartTime = systemTime();
+    // Time to audio is measured up to the pass enabling routes again, if any was in use
+    _bSstAudioPending = _bSstAudioPending ||
+            _stRoutes[CUtils::EOutput].uiEnabled || _stRoutes[CUtils::EInput].uiEnabled;
+
+    // Nothing is routed while the parameter framework starts, which reads the criteria
+    if (_bRoutingReady) {
+
+        // Warn PFW: the routes in use are muted, then their paths disabled once their devices
+        // closed
+        _apSelectedCriteria[ESelectedRoutingStage]->setCriterionState(EFlow);
+        for (uint32_t uiDirection = 0; uiDirection < CUtils::ENbDirections; uiDirection++) {
+
+            selectedClosingRoutes(uiDirection)->setCriterionState(
+                        _stRoutes[uiDirection].uiEnabled);
+            selectedOpenedRoutes(uiDirection)->setCriterionState(0);
+        }
+        applyConfigurations();
+    }
+
+    // Detach the streams (they generate silence until rerouted) and close the pcm devices
+    unrouteAllRoutes(CUtils::EInput);
+    unrouteAllRoutes(CUtils::EOutput);
+
+    if (_bRoutingReady) {
+
+        _apSelectedCriteria[ESelectedRoutingStage]->setCriterionState(EPath);
+        applyConfigurations();
+    }
+
+    // Devices kept warm were lost with the firmware
+    _pPcmPool->closeAll();
+
+    // Sound cards are polled from the alarm, without holding the lock meanwhile
+    _bSstRecoveryPending = true;
+    _bRoutingPending = true;
+    if (!checkSstRecovery(systemTime())) {
+
+        // Streams waiting for a routing pass generate silence until the cards are back
+        _clientWaitSemaphoreList.sync();
+        _pEventThread->setAlarmMs(SST_RECOVERY_POLL_PERIOD_MS);
+        return;
+    }
+    ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to SST recovery", __FUNCTION__);
+    doReconsiderRouting();
+}
+
+//
+// Worker thread context, WLocked
+//
+bool CAudioRouteManager::checkSstRecovery(nsecs_t now)
+{
+    bool bCardsAvailable = areSoundCardsAvailable();
+
+    if (!bCardsAvailable && (now - _sstRecoveryStartTime < ms2ns(SST_RECOVERY_TIMEOUT_MS))) {
+
+        return false;
+    }
+    // Routing is reconsidered anyway on timeout, streams whose route failed to open keep on
+    // generating silence until next routing
+    ALOGE_IF(!bCardsAvailable, "%s: sound cards still not available after %d ms",
+             __FUNCTION__, SST_RECOVERY_TIMEOUT_MS);
+    ALOGI_IF(bCardsAvailable, "%s: sound cards back %lld ms after SST recovery event",
+             __FUNCTION__, static_cast<long long>(ns2ms(now - _sstRecoveryStartTime)));
+    android_atomic_release_store(ns2ms(now - _sstRecoveryStartTime),
+                                 &_stSstRecoveryMetrics.iCardsBackMs);
+
+    _bSstRecoveryPending = false;
+    return true;
+}
+
+void CAudioRouteManager::unrouteAllRoutes(bool bIsOut)
+{
+    RouteListIterator it;
+
+    for (it = _routeList.begin(); it != _routeList.end(); ++it) {
+
+        CAudioRoute *route = *it;
+
+        if (route->currentlyUsed(bIsOut)) {
+
+            route->unroute(bIsOut, false);
+            route->closeDevices(bIsOut, false);
+            route->unroute(bIsOut, true);
+            route->closeDevices(bIsOut, true);
+        }
+    }
+    // All routes are closed: next routing will enable again the routes from scratch
+    _stRoutes[bIsOut].uiEnabled = 0;
+    _bRoutingEvaluationRequired = true;
+}
+
+bool CAudioRouteManager::areSoundCardsAvailable() const
+{
+    RouteListConstIterator it;
+
+    for (it = _routeList.begin(); it != _routeList.end(); ++it) {
+
+        const CAudioRoute *route = *it;
+
+        if (route->getRouteType() == CAudioRoute::EStreamRoute &&
+                !static_cast<const CAudioStreamRoute *>(route)->isCardAvailable()) {
+
+            return false;
+        }
+    }
+    return true;
+}
+
 //
 // Worker thread context
 //
@@ -1990,7 +3003,65 @@ bool CAudioRouteManager::onHangup(int __UNUSED iFd)
 //
 void CAudioRouteManager::onAlarm()
 {
-    ALOGD("%s", __FUNCTION__);
+    AutoRoutingLock lock(this);
+
+    // Recovery state first, the alarm being armed upon it
+    bool bSstRecovered = _bSstRecoveryPending && checkSstRecovery(systemTime());
+
+    if (!applyDelayedStandby() && !bSstRecovered) {
+
+        return;
+    }
+    ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to %s", __FUNCTION__,
+          bSstRecovered ? "SST recovery" : "delayed standby");
+    doReconsiderRouting();
+}
+
+//
+// Worker thread context, WLocked
+//
+bool CAudioRouteManager::applyDelayedStandby()
+{
+    nsecs_t now = systemTime();
+    nsecs_t nextDeadline = numeric_limits<nsecs_t>::max();
+    bool bStreamStopped = false;
+
+    nsecs_t poolDeadline = _pPcmPool->closeExpired(now);
+    if (poolDeadline != 0) {
+
+        nextDeadline = poolDeadline;
+    }
+
+    for (uint32_t uiDirection = 0; uiDirection < CUtils::ENbDirections; uiDirection++) {
+
+        ALSAStreamOpsListIterator it;
+        for (it = _streamsList[uiDirection].begin(); it != _streamsList[uiDirection].end(); ++it) {
+
+            nsecs_t deadline;
+            if ((*it)->applyDelayedStandby(now, deadline)) {
+
+                android_atomic_inc(&_stStandbyMetrics.iApplied);
+                bStreamStopped = true;
+            } else if ((deadline != 0) && (deadline < nextDeadline)) {
+
+                nextDeadline = deadline;
+            }
+        }
+    }
+    if (_bSstRecoveryPending) {
+
+        // Sound cards polled until back
+        nextDeadline = std::min(nextDeadline, now + ms2ns(SST_RECOVERY_POLL_PERIOD_MS));
+    }
+    if (nextDeadline != numeric_limits<nsecs_t>::max()) {
+
+        // Round up, not to wake up before the deadline
+        _pEventThread->setAlarmMs(ns2ms(nextDeadline - now + ms2ns(1) - 1));
+    } else {
+
+        _pEventThread->cancelAlarm();
+    }
+    return bStreamStopped;
 }
 
 //
@@ -2006,36 +3077,48 @@ void CAudioRouteManager::onPollError()
 //
 bool CAudioRouteManager::onProcess(uint16_t __UNUSED uiEvent)
 {
-    AutoW lock(_lock);
+    AutoRoutingLock lock(this);
 
     switch(uiEvent) {
     case EUpdateModemAudioBand:
 
         ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to Modem Band change", __FUNCTION__);
-        // Update the platform state
-        _pPlatformState->setBandType(_pModemAudioManagerInterface->getAudioBand(), AudioSystem::MODE_IN_CALL);
+        applyModemStatus(uiEvent, _pModemAudioManagerInterface->getAudioBand());
         break;
 
     case EUpdateModemState:
         ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to Modem State change", __FUNCTION__);
-        // Update the platform state
-        _pPlatformState->setModemAlive(_pModemAudioManagerInterface->isModemAlive());
-        // Force Parameters synchronization to reduce cold latency
-        if (_pModemAudioManagerInterface->isModemAlive()) {
-            _pParameterMgrPlatformConnector->applyConfigurations();
-        }
+        applyModemStatus(uiEvent, _pModemAudioManagerInterface->isModemAlive());
         break;
 
     case EUpdateModemAudioStatus:
         ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to Modem Audio Status change", __FUNCTION__);
-        // Update the platform state
-        _pPlatformState->setModemAudioAvailable(_pModemAudioManagerInterface->isModemAudioAvailable());
+        applyModemStatus(uiEvent, _pModemAudioManagerInterface->isModemAudioAvailable());
         break;
 
     case EUpdateRouting:
+        if (!_bRoutingPending) {
+
+            // Requests already served by a routing pass run since they were received
+            return false;
+        }
         // Nothing to update before call of doReconsiderRouting()
         break;
 
+    case EUpdateDelayedStandby:
+        if (!applyDelayedStandby()) {
+
+            // Only the alarm to arm, routing is unchanged
+            return false;
+        }
+        ALOGD("%s: {+++ RECONSIDER ROUTING +++} due to delayed standby", __FUNCTION__);
+        break;
+
+    case ERecoverFromSstReset:
+        // Reconsiders the routing once the sound cards are back
+        doRecoverFromSstReset();
+        return false;
+
     default:
         ALOGE("%s: Unhandled event.", __FUNCTION__);
         break;
@@ -2045,6 +3128,38 @@ bool CAudioRouteManager::onProcess(uint16_t __UNUSED uiEvent)
     return false;
 }
 
+//
+// Worker thread context, or replay context
+//
+void CAudioRouteManager::applyModemStatus(uint16_t uiEvent, int32_t iStatus)
+{
+    _pRoutingRecorder->record(CAudioRoutingRecorder::EModemStatus, NULL, uiEvent, iStatus);
+
+    // Update the platform state
+    switch(uiEvent) {
+    case EUpdateModemAudioBand:
+        _pPlatformState->setBandType(static_cast<CAudioBand::Type>(iStatus),
+                                     AudioSystem::MODE_IN_CALL);
+        break;
+
+    case EUpdateModemState:
+        _pPlatformState->setModemAlive(iStatus);
+        // Force Parameters synchronization to reduce cold latency
+        if (iStatus) {
+            applyConfigurations();
+        }
+        break;
+
+    case EUpdateModemAudioStatus:
+        _pPlatformState->setModemAudioAvailable(iStatus);
+        break;
+
+    default:
+        ALOGE("%s: not a modem event.", __FUNCTION__);
+        break;
+    }
+}
+
 // Used to fill types for PFW
 ISelectionCriterionTypeInterface* CAudioRouteManager::createAndFillSelectionCriterionType(CriteriaType eCriteriaType) const
 {
@@ -2071,6 +3186,39 @@ ISelectionCriterionTypeInterface* CAudioRouteManager::createAndFillSelectionCrit
     return pSelectionCriterionType;
 }
 
+CParameterHandle* CAudioRouteManager::getParameterHandle(const string& strParameterPath,
+                                                         string& strError) const
+{
+    Mutex::Autolock lock(_parameterHandlesLock);
+
+    ParameterHandleMapConstIterator it = _parameterHandles.find(strParameterPath);
+    if (it != _parameterHandles.end()) {
+
+        return it->second;
+    }
+    // Resolve the path once, handle is kept until the connector is deleted
+    CParameterHandle* pParameterHandle =
+            _pParameterMgrPlatformConnector->createParameterHandle(strParameterPath, strError);
+    if (pParameterHandle != NULL) {
+
+        _parameterHandles[strParameterPath] = pParameterHandle;
+    }
+    return pParameterHandle;
+}
+
+void CAudioRouteManager::clearParameterHandles()
+{
+    Mutex::Autolock lock(_parameterHandlesLock);
+
+    ParameterHandleMapConstIterator it;
+    for (it = _parameterHandles.begin(); it != _parameterHandles.end(); ++it) {
+
+        delete it->second;
+    }
+    _parameterHandles.clear();
+    _pVoiceVolumeParamHandle = NULL;
+}
+
 uint32_t CAudioRouteManager::getIntegerParameterValue(const string& strParameterPath, uint32_t uiDefaultValue) const
 {
     ALOGV("%s in", __FUNCTION__);
@@ -2082,7 +3230,7 @@ uint32_t CAudioRouteManager::getIntegerParameterValue(const string& strParameter
 
     string strError;
     // Get handle
-    CParameterHandle* pParameterHandle = _pParameterMgrPlatformConnector->createParameterHandle(strParameterPath, strError);
+    CParameterHandle* pParameterHandle = getParameterHandle(strParameterPath, strError);
 
     if (!pParameterHandle) {
 
@@ -2103,15 +3251,9 @@ uint32_t CAudioRouteManager::getIntegerParameterValue(const string& strParameter
 
         ALOGV("%s returning %d", __FUNCTION__, uiDefaultValue);
 
-        // Remove handle
-        delete pParameterHandle;
-
         return uiDefaultValue;
     }
 
-    // Remove handle
-    delete pParameterHandle;
-
     ALOGV("%s: %s is %d", __FUNCTION__, strParameterPath.c_str(), uiValue);
 
     return uiValue;
@@ -2129,8 +3271,7 @@ status_t CAudioRouteManager::getStringParameterValue(const string& strParameterP
 
     string strError;
     // Get handle
-    CParameterHandle* pParameterHandle =
-            _pParameterMgrPlatformConnector->createParameterHandle(strParameterPath, strError);
+    CParameterHandle* pParameterHandle = getParameterHandle(strParameterPath, strError);
 
     if (!pParameterHandle) {
 
@@ -2149,9 +3290,6 @@ status_t CAudioRouteManager::getStringParameterValue(const string& strParameterP
         ret = BAD_VALUE;
     }
 
-    // Remove handle
-    delete pParameterHandle;
-
     ALOGV_IF(!ret, "%s: %s is %s", __FUNCTION__, strParameterPath.c_str(), strValue.c_str());
 
     return ret;
@@ -2168,7 +3306,7 @@ status_t CAudioRouteManager::setIntegerParameterValue(const string& strParameter
 
     string strError;
     // Get handle
-    CParameterHandle* pParameterHandle = _pParameterMgrPlatformConnector->createParameterHandle(strParameterPath, strError);
+    CParameterHandle* pParameterHandle = getParameterHandle(strParameterPath, strError);
 
     if (!pParameterHandle) {
 
@@ -2183,15 +3321,9 @@ status_t CAudioRouteManager::setIntegerParameterValue(const string& strParameter
 
         ALOGE("%s: Unable to set value: %s, from parameter path: %s", __FUNCTION__, strError.c_str(), strParameterPath.c_str());
 
-        // Remove handle
-        delete pParameterHandle;
-
         return NAME_NOT_FOUND;
     }
 
-    // Remove handle
-    delete pParameterHandle;
-
     ALOGV("%s: %s set to %d", __FUNCTION__, strParameterPath.c_str(), uiValue);
 
     return NO_ERROR;
@@ -2208,7 +3340,7 @@ status_t CAudioRouteManager::setIntegerArrayParameterValue(const string& strPara
 
     string strError;
     // Get handle
-    CParameterHandle* pParameterHandle = _pParameterMgrPlatformConnector->createParameterHandle(strParameterPath, strError);
+    CParameterHandle* pParameterHandle = getParameterHandle(strParameterPath, strError);
 
     if (!pParameterHandle) {
 
@@ -2222,15 +3354,9 @@ status_t CAudioRouteManager::setIntegerArrayParameterValue(const string& strPara
 
         ALOGE("Unable to set value: %s, from parameter path: %s", strError.c_str(), strParameterPath.c_str());
 
-        // Remove handle
-        delete pParameterHandle;
-
         return INVALID_OPERATION;
     }
 
-    // Remove handle
-    delete pParameterHandle;
-
     return NO_ERROR;
 }
 
@@ -2248,8 +3374,7 @@ CParameterHandle* CAudioRouteManager::getDynamicParameterHandle(const string& st
     ALOGD("%s  Platform specific parameter path=%s", __FUNCTION__, strParameter.c_str());
 
     string strError;
-    CParameterHandle* pHandle = _pParameterMgrPlatformConnector->createParameterHandle(strParameter,
-                                                                                       strError);
+    CParameterHandle* pHandle = getParameterHandle(strParameter, strError);
     if (!pHandle) {
 
         ALOGE("%s: Unable to get parameter handle for %s: '%s'",
@@ -2271,11 +3396,11 @@ CParameterHandle* CAudioRouteManager::getVoiceVolumeHandle()
 
 status_t CAudioRouteManager::setVoiceVolume(float gain)
 {
-    // Protect here concurrent access to Parameter Framework
-    AutoR lock(_lock);
+    // Parameter Framework protects its accesses, no need to wait for a routing pass
+    AutoVolumeLock lock(this);
     string strError;
 
-    if (!_pPlatformState->isModemEmbedded()) {
+    if (!_bModemEmbedded) {
 
         ALOGD("%s: platform does NOT embed a Modem chip", __FUNCTION__);
         return NO_ERROR;
@@ -2306,45 +3431,70 @@ status_t CAudioRouteManager::setVoiceVolume(float gain)
     return OK;
 }
 
-void CAudioRouteManager::resetEchoReference(struct echo_reference_itfe* reference)
+void CAudioRouteManager::resetEchoReference(CAudioEchoReference* reference, int32_t iReader)
 {
-    AutoW lock(_lock);
-    ALOGD(" %s(reference=%p)", __FUNCTION__, reference);
+    Mutex::Autolock lock(_echoReferenceLock);
+
+    ALOGD(" %s(reference=%p, reader=%d)", __FUNCTION__, reference, iReader);
     if (reference == NULL || _pEchoReference != reference) {
 
         /* Nothing to do */
         return ;
     }
+    reference->removeReader(iReader);
+    if (reference->getNbReaders() != 0) {
+
+        // Still read by other AEC effects
+        return;
+    }
 
     // First try to find the stream out which that used to provide this echo reference
+    Mutex::Autolock streamsLock(_streamsListLock);
     ALSAStreamOpsListIterator it;
 
     for (it = _streamsList[CUtils::EOutput].begin(); it != _streamsList[CUtils::EOutput].end(); ++it) {
 
         AudioStreamOutALSA* pOut = static_cast<AudioStreamOutALSA*>(*it);
-        struct echo_reference_itfe* pReference = pOut->getEchoReference();
+        CAudioEchoReference* pReference = pOut->getEchoReference();
         if (pReference != NULL && pReference == reference) {
 
+            // Once removed, the output does not access the reference anymore
             pOut->removeEchoReference(reference);
-            release_echo_reference(_pEchoReference);
+            delete _pEchoReference;
             _pEchoReference = NULL;
             // Only one output is expected to provide the reference
             return ;
         }
     }
     ALOGE("%s: nothing to do, reference not found!", __FUNCTION__);
-    release_echo_reference(_pEchoReference);
+    delete _pEchoReference;
     _pEchoReference = NULL;
 }
 
-struct echo_reference_itfe* CAudioRouteManager::getEchoReference(int format,
-                                                                 uint32_t channel_count,
-                                                                 uint32_t sampling_rate)
+CAudioEchoReference* CAudioRouteManager::getEchoReference(int format,
+                                                          uint32_t channel_count,
+                                                          uint32_t sampling_rate,
+                                                          int32_t *piReader)
 {
-    AutoW lock(_lock);
+    Mutex::Autolock lock(_echoReferenceLock);
 
     ALOGD("%s ()", __FUNCTION__);
-    resetEchoReference(_pEchoReference);
+    SampleSpec readSampleSpec(channel_count, format, sampling_rate);
+
+    if (_pEchoReference != NULL) {
+
+        // Created once, then shared by the AEC effects until the last one resets it
+        if (_pEchoReference->getReadSampleSpec() != readSampleSpec) {
+
+            ALOGE("%s: reference already provided in another sample specification",
+                  __FUNCTION__);
+            return NULL;
+        }
+        *piReader = _pEchoReference->addReader();
+        return *piReader >= 0 ? _pEchoReference : NULL;
+    }
+
+    Mutex::Autolock streamsLock(_streamsListLock);
 
     if (_streamsList[CUtils::EOutput].empty()) {
 
@@ -2363,23 +3513,23 @@ struct echo_reference_itfe* CAudioRouteManager::getEchoReference(int format,
 
             ALOGD("%s: format=%d channels=%d samplerate=%d", __FUNCTION__,
                                 pOps->format(), pOps->channelCount(), pOps->sampleRate());
-            int iWriteFormat = pOps->format();
-            uint32_t uiWriteChannelCount = pOps->channelCount();
-            uint32_t uiWriteSampleRate = sampling_rate;
-
-            if (create_echo_reference((audio_format_t)format,
-                                      channel_count,
-                                      sampling_rate,
-                                      (audio_format_t)iWriteFormat,
-                                      uiWriteChannelCount,
-                                      uiWriteSampleRate,
-                                      &_pEchoReference) < 0) {
+            SampleSpec writeSampleSpec(pOps->channelCount(), pOps->format(), pOps->sampleRate());
+
+            _pEchoReference = new CAudioEchoReference(readSampleSpec, writeSampleSpec);
+            if (_pEchoReference->init() != OK) {
 
                 ALOGE("%s: Could not create echo reference", __FUNCTION__);
+                delete _pEchoReference;
+                _pEchoReference = NULL;
                 return NULL;
             }
+            // Reader registered before the output writes the reference
+            *piReader = _pEchoReference->addReader();
             AudioStreamOutALSA* pOut = static_cast<AudioStreamOutALSA*>(pOps);
             pOut->addEchoReference(_pEchoReference);
+
+            // Only one output is expected to provide the reference
+            break;
         }
 
     }
@@ -2392,4 +3542,27 @@ const pcm_config& CAudioRouteManager::getDefaultPcmConfig(bool bIsOut, uint32_t
     return CAudioPlatformHardware::getDefaultPcmConfig(bIsOut, uiFlags);
 }
 
+uint32_t CAudioRouteManager::getMaxPeriodUs(bool bIsOut, uint32_t uiMask) const
+{
+    uint32_t uiMaxPeriodUs = 0;
+
+    // Route list is only built upon construction, no need to lock
+    list<CAudioRoute*>::const_iterator it;
+    for (it = _routeList.begin(); it != _routeList.end(); ++it) {
+
+        const CAudioRoute* pRoute = *it;
+        if (pRoute->getRouteType() != CAudioRoute::EStreamRoute) {
+
+            continue;
+        }
+        uint32_t uiPeriodUs =
+                static_cast<const CAudioStreamRoute*>(pRoute)->getMaxPeriodUs(bIsOut, uiMask);
+        if (uiPeriodUs > uiMaxPeriodUs) {
+
+            uiMaxPeriodUs = uiPeriodUs;
+        }
+    }
+    return uiMaxPeriodUs;
+}
+
 }       // namespace android
@@ -17,12 +17,14 @@
 #pragma once
 
 #include <list>
+#include <map>
 #include <vector>
 #include <utils/threads.h>
 #include <hardware_legacy/AudioHardwareBase.h>
 #include <tinyalsa/asoundlib.h>
 #include <BitField.hpp>
 
+#include "AudioApplicabilityTables.h"
 #include "AudioRoute.h"
 #include "SyncSemaphoreList.h"
 #include "Utils.h"
@@ -39,7 +41,7 @@ class CParameterHandle;
 class ISelectionCriterionTypeInterface;
 class ISelectionCriterionInterface;
 struct IModemAudioManagerInterface;
-struct echo_reference_itfe;
+class CAudioEchoReference;
 
 namespace android_audio_legacy
 {
@@ -58,6 +60,10 @@ class CAudioPort;
 class CAudioStreamRoute;
 class CAudioParameterHandler;
 class CAudioPlatformState;
+class CAudioRoutingWorkers;
+class CAudioPcmPool;
+class CAudioRoutingTracer;
+class CAudioRoutingRecorder;
 
 class CAudioRouteManager : private IModemAudioManagerObserver, public IEventListener
 {
@@ -82,7 +88,9 @@ class CAudioRouteManager : private IModemAudioManagerObserver, public IEventList
         EUpdateModemAudioBand,
         EUpdateModemState,
         EUpdateModemAudioStatus,
-        EUpdateRouting
+        EUpdateRouting,
+        EUpdateDelayedStandby,
+        ERecoverFromSstReset
     };
 
     /*
@@ -126,9 +134,39 @@ public:
 
     status_t setStreamParameters(android_audio_legacy::ALSAStreamOps* pStream, const String8 &keyValuePairsSET, int iMode);
 
-    status_t startStream(bool bIsStreamOut);
+    /**
+     * Reconsiders the routing upon stream start.
+     * Returns without waiting for the routing to complete if the stream starts asynchronously.
+     *
+     * @param[in] pStream stream started.
+     *
+     * @return OK.
+     */
+    status_t startStream(const ALSAStreamOps* pStream);
 
-    status_t stopStream(bool bIsStreamOut);
+    status_t stopStream(const ALSAStreamOps* pStream);
+
+    /**
+     * Schedules the standby of a stream at the end of its grace period.
+     * The stream is still considered as started until then, so that it keeps its route.
+     *
+     * @param[in] pStream stream put in standby.
+     */
+    void delayStandby(const ALSAStreamOps* pStream);
+
+    /**
+     * Accounts a stream restarted within the grace period of its standby, i.e. without routing.
+     *
+     * @param[in] pStream stream restarted.
+     */
+    void resumeStream(const ALSAStreamOps* pStream);
+
+    /**
+     * Dumps the route manager metrics.
+     *
+     * @param[in] fd file descriptor to write to.
+     */
+    void dump(int fd) const;
 
     status_t setParameters(const String8& keyValuePairs);
     String8 getParameters(const String8& keyValuePairs);
@@ -145,7 +183,15 @@ public:
     // Remove a stream from route manager
     void removeStream(ALSAStreamOps* pStream);
 
-    // Start route manager service
+    /**
+     * Starts the route manager service.
+     * Only the critical phase, needed to open streams, is run synchronously when the startup is
+     * deferred: the parameter framework and the modem audio manager are started by background
+     * threads, the routing of the streams started meanwhile being queued until the parameter
+     * framework is started.
+     *
+     * @return NO_ERROR if started or starting, NO_INIT if the parameter framework failed to start.
+     */
     status_t start();
 
    /**
@@ -154,6 +200,9 @@ public:
     */
     void initRouting();
 
+    /**
+     * @return true once started, unless the parameter framework failed to start.
+     */
     bool isStarted() const;
 
     /**
@@ -171,33 +220,40 @@ public:
     /**
      * Reset the Echo Reference.
      * The purpose of this function is
-     * - to stop the processing (i.e. writing of playback frames as echo reference for
-     * for AEC effect) in AudioSteamOutALSA
-     * - reset locally stored echo reference
+     * - to release the reader of the caller
+     * - once the last reader is released, to stop the processing (i.e. writing of playback
+     * frames as echo reference for AEC effect) in AudioSteamOutALSA and to release locally
+     * stored echo reference
      * @param[in] reference: pointer to echo reference to reset
+     * @param[in] iReader: reader of the reference released by the caller
      */
-    void resetEchoReference(struct echo_reference_itfe* reference);
+    void resetEchoReference(CAudioEchoReference* reference, int32_t iReader);
 
     /**
      * Get an Echo Reference for AEC.
      * The purpose of this function is
-     *     - create echo_reference_itfe using input stream and output stream parameters
-     *     - add echo_reference_itfs to AudioSteamOutALSA which will use it for
+     *     - create echo reference using input stream and output stream parameters, unless
+     *         a reference of the same input sample specification is already provided, which
+     *         is then shared: each AEC effect reads it from its own reader
+     *     - add echo reference to AudioSteamOutALSA which will use it for
      *         providing playback frames as echo reference for AEC effect
      *     - store locally the created reference
-     *     - return created echo_reference_itfe to caller (i.e. AudioSteamInALSA)
-     * Note: created echo_reference_itfe is used as backlink between playback which
-     *         provides reference of output data and record which applies AEC effect
+     *     - return created echo reference to caller (i.e. AudioSteamInALSA)
+     * Note: created echo reference is used as backlink between playback which
+     *         provides reference of output data and record which applies AEC effect.
+     *         Reference is resampled only if input and output rates differ.
      * @param[in] format: input stream format
      * @param[in] channel_count: input stream channels count
      * @param[in] sampling_rate: input stream sampling rate
+     * @param[out] piReader: reader of the reference registered for the caller
      *
-     * @return NULL is creation of echo_reference_itfe failed overwise,
-     *         pointer to created echo_reference_itfe
+     * @return NULL is creation of echo reference failed overwise,
+     *         pointer to created echo reference
      */
-    struct echo_reference_itfe* getEchoReference(int format,
-                                                 uint32_t channel_count,
-                                                 uint32_t sampling_rate);
+    CAudioEchoReference* getEchoReference(int format,
+                                          uint32_t channel_count,
+                                          uint32_t sampling_rate,
+                                          int32_t *piReader);
 
     /**
      * Get the default pcm configuration.
@@ -213,6 +269,18 @@ public:
      */
     const pcm_config& getDefaultPcmConfig(bool bIsOut, uint32_t uiFlags = 0) const;
 
+    /**
+     * Get the duration of the longest period of the stream routes applicable to a stream.
+     * Streams size their buffers once with it, so that rerouting them does not allocate.
+     *
+     * @param[in] bIsOut direction of the stream.
+     * @param[in] uiMask applicability mask of the stream (flags for output, input source
+     *                   for input).
+     *
+     * @return duration in microseconds.
+     */
+    uint32_t getMaxPeriodUs(bool bIsOut, uint32_t uiMask) const;
+
     /**  Socket Id enumerator**/
     enum UeventSocketDesc {
         FdFromSstDriver,
@@ -239,7 +307,15 @@ private:
 
     void setOutputFlags(AudioStreamOutALSA* pStreamOut, uint32_t uiFlags);
 
-    void reconsiderRouting(bool bIsSynchronous = true);
+    /**
+     * Requests a routing pass, run from the worker thread.
+     *
+     * @param[in] bIsSynchronous true to wait for the pass, the routing lock being released
+     *                           meanwhile.
+     *
+     * @return NO_ERROR if requested, NO_INIT if the parameter framework failed to start.
+     */
+    status_t reconsiderRouting(bool bIsSynchronous = true);
 
     /**
      * Open uevent socket and listen to it
@@ -254,6 +330,15 @@ private:
     bool prepareRouting(bool bIsOut);
     void prepareRoute(CAudioRoute* pRoute, bool bIsOut);
 
+    /**
+     * Virtually connects the started streams that did not find any route to a stream route
+     * already used by another stream of the same direction, if applicable, so that input streams
+     * share its capture and output streams are mixed in its playback.
+     *
+     * @param[in] bIsOut direction of the streams.
+     */
+    void prepareSharedStreamRoutes(bool bIsOut);
+
     // Route stage dispatcher
     void executeRouting();
 
@@ -281,10 +366,40 @@ private:
      */
     void prepareDisableRoutes(bool bIsOut);
 
+    /**
+     * Checks if a route was opened before reconsidering the routing and will be closed after,
+     * or needs to be closed and opened again.
+     *
+     * @param[in] pRoute route to check.
+     * @param[in] bIsOut direction of the route.
+     *
+     * @return true if the route must be disabled.
+     */
+    static bool isRouteToDisable(const CAudioRoute* pRoute, bool bIsOut)
+    {
+        return (pRoute->currentlyUsed(bIsOut) && !pRoute->willBeUsed(bIsOut)) ||
+                pRoute->needRerouting(bIsOut);
+    }
+
+    /**
+     * Checks if a route was not opened before reconsidering the routing and will be opened after,
+     * or needs to be closed and opened again.
+     *
+     * @param[in] pRoute route to check.
+     * @param[in] bIsOut direction of the route.
+     *
+     * @return true if the route must be enabled.
+     */
+    static bool isRouteToEnable(const CAudioRoute* pRoute, bool bIsOut)
+    {
+        return (!pRoute->currentlyUsed(bIsOut) && pRoute->willBeUsed(bIsOut)) ||
+                pRoute->needRerouting(bIsOut);
+    }
+
     /**
      * Performs the disabling of the route.
      * It only concerns the action that needs to be done on routes themselves, ie detaching
-     * streams, closing alsa devices.
+     * streams. Closing of the alsa devices is queued to the routing workers.
      *
      * @param[in] isOut direction of the routes to disable.
      * @param[in] isPostDisable if set, it indicates that the disable happens after unrouting.
@@ -309,6 +424,17 @@ private:
     // Enable the routes
     void executeEnableStage();
 
+    // Applies the PFW configurations, traced
+    void applyConfigurations();
+
+    /**
+     * Opens the alsa devices of the routes to enable, in both directions, concurrently.
+     * Returns once all devices are opened, so that routes are enabled with their devices.
+     *
+     * @param[in] isPreEnable if set, it indicates that the devices are opened before routing.
+     */
+    void openRouteDevices(bool isPreEnable);
+
     /**
      * Performs the enabling of the routes.
      * It only concerns the action that needs to be done on routes themselves, ie attaching
@@ -334,6 +460,22 @@ private:
         doEnableRoutes(isOut, true);
     }
 
+    /**
+     * Get a handle on a parameter. Handles are cached by path, so that a path is resolved by
+     * the parameter framework only once. They are deleted with the connector.
+     *
+     * @param[in] strParameterPath path of the parameter.
+     * @param[out] strError error reported by the parameter framework.
+     *
+     * @return handle on the parameter, NULL pointer if error. Must not be deleted.
+     */
+    CParameterHandle* getParameterHandle(const string& strParameterPath, string& strError) const;
+
+    /**
+     * Deletes the cached parameter handles. Must be called before deleting the connector.
+     */
+    void clearParameterHandles();
+
     // unsigned integer parameter value retrieval
     uint32_t getIntegerParameterValue(const string& strParameterPath, uint32_t uiDefaultValue) const;
 
@@ -385,9 +527,123 @@ private:
     // Reset availability of all routes
     void resetAvailability();
 
+    /**
+     * Checks if a routing evaluation can be skipped, ie if it would find the routes unchanged.
+     * It is the case if the last evaluation did not change the routes, if the streams to route
+     * did not change since then and if none of the platform states read by the routes during
+     * this evaluation changed.
+     * Takes the signature of the streams for the next check.
+     *
+     * @return true if the routing evaluation can be skipped.
+     */
+    bool isRoutingEvaluationSkippable();
+
+    /**
+     * Records the platform state events a route depends on, ie the events of the states it read
+     * while evaluated.
+     *
+     * @param[in] pRoute route evaluated.
+     * @param[in] uiReadEvents events of the states read by the route.
+     */
+    void recordRouteDependencies(const CAudioRoute* pRoute, uint32_t uiReadEvents);
+
+    /**
+     * Get the routes depending on platform state events.
+     *
+     * @param[in] uiEvents platform state events.
+     *
+     * @return bitfield of the routes which read the state of any of the events at last evaluation.
+     */
+    uint32_t getRoutesDependingOn(uint32_t uiEvents) const;
+
     // Start the AT Manager
     void startModemAudioManager();
 
+    /**
+     * Starts the parameter framework and routes the streams started meanwhile.
+     */
+    void startParameterFramework();
+
+    /**
+     * Background phases of the startup, independent from each other.
+     * Run in this order when the startup is not deferred.
+     */
+    enum StartupPhase {
+
+        EModemPhase,
+        EParameterFrameworkPhase,
+
+        ENbStartupPhases
+    };
+
+    /**
+     * Runs a startup phase and accounts its duration. Called without the routing lock.
+     */
+    void runStartupPhase(StartupPhase ePhase);
+
+    static const char* const STARTUP_PHASE_NAMES[ENbStartupPhases];
+
+    /**
+     * Thread running a startup phase once.
+     */
+    class CStartupThread : public android::Thread
+    {
+    public:
+        CStartupThread(CAudioRouteManager* pRouteManager, StartupPhase ePhase)
+            : android::Thread(false),
+              _pRouteManager(pRouteManager),
+              _ePhase(ePhase)
+        {
+        }
+
+    private:
+        virtual bool threadLoop();
+
+        CAudioRouteManager* _pRouteManager;
+        StartupPhase _ePhase;
+    };
+
+    /**
+     * Requests the recovery of the audio path after a reset of the LPE firmware, as the
+     * SST_RECOVERY uevent does. Not to be called from worker thread context.
+     */
+    void recoverFromSstReset();
+
+    /**
+     * Recovers the audio path after a reset of the LPE firmware (SST_RECOVERY uevent).
+     * All opened routes are unrouted: the streams are detached, so that they keep on generating
+     * silence, the pcm devices are closed and the paths disabled. The sound cards are then
+     * polled from the alarm, routing passes being held until they are registered again: the
+     * clients requesting a synchronous pass meanwhile do not wait for it.
+     * Called from worker thread context, WLocked.
+     */
+    void doRecoverFromSstReset();
+
+    /**
+     * Ends the SST recovery once the sound cards are registered again or the timeout elapsed.
+     * Called from worker thread context, WLocked.
+     *
+     * @param[in] now current time.
+     *
+     * @return true if the recovery ended, the routing having to be reconsidered.
+     */
+    bool checkSstRecovery(nsecs_t now);
+
+    /**
+     * Unroutes all the routes currently in use, whatever the platform state.
+     * It detaches the streams and closes the pcm devices of these routes.
+     *
+     * @param[in] bIsOut direction of the routes to unroute.
+     */
+    void unrouteAllRoutes(bool bIsOut);
+
+    /**
+     * Checks the sound cards used by the stream routes are registered.
+     *
+     * @return true if all the cards are available.
+     */
+    bool areSoundCardsAvailable() const;
+
     bool isAecEffect(const effect_uuid_t *uuid);
     status_t getAudioEffectUuidFromHandle(effect_handle_t effect, effect_uuid_t* uuid);
     status_t doAddAudioEffect(AudioStreamInALSA* pStream, effect_handle_t effect);
@@ -406,6 +662,24 @@ private:
     virtual void onPollError();
     virtual bool onProcess(uint16_t uiEvent);
 
+    /**
+     * Updates the platform state with a modem status.
+     * Called from worker thread context with the routing lock held.
+     *
+     * @param[in] uiEvent modem event: band, state or audio status change.
+     * @param[in] iStatus status read from the modem audio manager.
+     */
+    void applyModemStatus(uint16_t uiEvent, int32_t iStatus);
+
+    /**
+     * Applies the standby of the streams whose grace period is elapsed, closes the devices kept
+     * warm longer than their retention time, and arms the alarm for the next deadline.
+     * Must be called from worker thread, WLocked context.
+     *
+     * @return true if at least one stream was stopped, i.e. if routing must be reconsidered.
+     */
+    bool applyDelayedStandby();
+
     /**
      * Do parameters pop & set.
      * Pop all parameters provided in the key/value and set those which are handled.
@@ -526,6 +800,28 @@ private:
 
     void createsRoutes();
 
+    /**
+     * Compiles the static applicability rules of the routes (modes, devices, stream flags or
+     * input sources) into lookup tables, so that the routes matching a routing request are
+     * found with a few bitwise operations.
+     */
+    void compileApplicabilityTables();
+
+    /**
+     * Compiles the mutual exclusions of the ports, declared by the port groups, into the
+     * bitfield of the routes blocked by the use of each port. Each bitfield is checked against
+     * the resolution walking the ports, port groups and routes.
+     */
+    void compileMutualExclusions();
+
+    /**
+     * Marks the ports of a route as used, and blocks the routes using a port mutually exclusive
+     * with them.
+     *
+     * @param[in] pRoute route now used.
+     */
+    void useRoutePorts(const CAudioRoute* pRoute);
+
     void createAudioHardwarePlatform();
 
     // Used to fill types for PFW
@@ -542,6 +838,36 @@ private:
     static const char* const PFW_CONF_FILE_NAME_PROP_NAME;
     static const char* const gPfwConfFileDefaultName;
     static const char* const ROUTING_LOCKED_PROP_NAME;
+    static const char* const INCREMENTAL_ROUTING_PROP_NAME;
+    static const char* const INCREMENTAL_ROUTING_CHECK_PROP_NAME;
+    static const char* const ROUTING_WORKERS_PROP_NAME;
+    static const int32_t ROUTING_WORKERS_DEFAULT_VALUE;
+    static const char* const WARM_PCM_HANDLES_PROP_NAME;
+    static const char* const WARM_PCM_RETENTION_PROP_NAME;
+    static const int32_t WARM_PCM_HANDLES_DEFAULT_VALUE;
+    static const int32_t WARM_PCM_RETENTION_DEFAULT_VALUE_MS;
+    static const char* const ROUTING_TRACE_EVENTS_PROP_NAME;
+    static const int32_t ROUTING_TRACE_EVENTS_DEFAULT_VALUE;
+
+    // Parameter key returning the routing trace
+    static const char* const ROUTING_TRACE_KEY;
+
+    // File the route manager inputs are recorded into, none if empty
+    static const char* const ROUTING_RECORD_FILE_PROP_NAME;
+
+    // Platform description file loaded instead of the compiled tables, none if empty
+    static const char* const PLATFORM_DESCRIPTION_PROP_NAME;
+
+    // File the compiled tables are converted into at startup, none if empty
+    static const char* const PLATFORM_DESCRIPTION_EXPORT_PROP_NAME;
+
+    // Run the parameter framework and modem audio manager startups in the background
+    static const char* const DEFERRED_STARTUP_PROP_NAME;
+
+    // Categories of the routing trace events
+    static const char* const TRACE_STAGE;
+    static const char* const TRACE_ROUTE;
+    static const char* const TRACE_PFW;
 
     static const char* const gapcLineInToHeadsetLineVolume;
     static const char* const gapcLineInToSpeakerLineVolume;
@@ -553,14 +879,25 @@ private:
 
     bool _bBluetoothHFPSupported;
 
+    // Set upon construction, so that the voice volume reads it without the routing lock
+    bool _bModemEmbedded;
+
     // The connector
     CParameterMgrPlatformConnector* _pParameterMgrPlatformConnector;
     // Logger
     CParameterMgrPlatformConnectorLogger* _pParameterMgrPlatformConnectorLogger;
 
-    // Voice volume Parameter handle
+    // Voice volume Parameter handle, owned by the parameter handle cache
     CParameterHandle* _pVoiceVolumeParamHandle;
 
+    typedef map<string, CParameterHandle*>::const_iterator ParameterHandleMapConstIterator;
+
+    // Parameter handles, by path
+    mutable map<string, CParameterHandle*> _parameterHandles;
+
+    // Protects the parameter handle cache, parameters may be accessed with the lock shared
+    mutable Mutex _parameterHandlesLock;
+
     // Mode type
     static const SSelectionCriterionTypeValuePair MODE_VALUE_PAIRS[];
     // Band type
@@ -668,6 +1005,45 @@ private:
     // Worker Thread
     CEventThread* _pEventThread;
 
+    // Tracer of the routing stages, route actions and PFW calls
+    CAudioRoutingTracer* _pRoutingTracer;
+
+    // Routing workers, opening and closing the alsa devices of a routing stage concurrently
+    CAudioRoutingWorkers* _pRoutingWorkers;
+
+    // Pool keeping the alsa devices closed by the stream routes warm for a while
+    CAudioPcmPool* _pPcmPool;
+
+    // Recorder of the route manager inputs, to replay them offline
+    CAudioRoutingRecorder* _pRoutingRecorder;
+
+    // Time spent creating the ports and routes of the platform, description loading included
+    nsecs_t _platformCreationTime;
+
+    // Creation of the route manager, hence of the HAL
+    nsecs_t _creationTime;
+
+    // Background startup phases run on startup threads rather than in sequence
+    bool _bDeferredStartup;
+
+    // Parameter framework failed to start, set from a startup thread with the routing lock held
+    volatile bool _bStartupFailed;
+
+    // Parameter framework started: routing passes are queued until then, and the criteria are
+    // only written afterwards, with the routing lock held
+    bool _bRoutingReady;
+
+    /** Startup metrics, updated from startup and worker thread contexts. */
+    struct {
+
+        volatile int32_t iCriticalPhaseUs; /**< creation to the end of the critical phase. */
+        volatile int32_t aiPhaseUs[ENbStartupPhases]; /**< durations of the startup phases. */
+        volatile int32_t iQueuedRequests; /**< routing requests received before routing ready. */
+        volatile int32_t iFirstAudioMs; /**< creation to the first route enabled, 0 if none. */
+    } _stStartupMetrics;
+
+    android::sp<CStartupThread> _aStartupThreads[ENbStartupPhases];
+
     // Client wait semaphore list
     CSyncSemaphoreList _clientWaitSemaphoreList;
 
@@ -684,8 +1060,77 @@ private:
     // Routing timeout
     static const uint32_t _uiTimeoutSec;
 
-    // Routing lock protection
+    /*
+     * Locks of the route manager, to be taken in this order:
+     *   1. _lock, the routing lock: serializes the routing passes and protects the platform
+     *      state and the routes they read and update. Taken for writing by the entry points
+     *      changing the platform state or the streams, and by the worker thread. Released while
+     *      a synchronous routing request waits for its pass.
+     *   2. input stream locks: an input stream adding an AEC effect gets the echo reference
+     *      with its lock held.
+     *   3. _echoReferenceLock: protects the echo reference.
+     *   4. _streamsListLock: protects the streams lists, which are changed with both _lock and
+     *      _streamsListLock held, so that the echo reference management browses them without
+     *      waiting for a routing pass.
+     *   5. output stream locks, then the locks of the routes (capture fan out, playback mixer).
+     * The echo reference management thus never takes an input stream lock.
+     * _volumeLock serializes the voice volume accesses, which rely on the Parameter Framework
+     * own locking: it is taken alone. _parameterHandlesLock is a leaf lock.
+     * Platform state updates stay under the routing lock: the events they raise are consumed
+     * by the routing pass, which must evaluate and clear them at once.
+     */
     RWLock _lock;
+    Mutex _echoReferenceLock;
+    Mutex _streamsListLock;
+    Mutex _volumeLock;
+
+    /** Contention of a lock, updated with the lock held. */
+    struct SLockContention
+    {
+        volatile int32_t iAcquisitions;
+        volatile int32_t iContended; /**< acquisitions that had to wait. */
+        volatile int32_t iTotalWaitUs;
+        volatile int32_t iMaxWaitUs;
+    };
+    SLockContention _stRoutingLockContention;
+    SLockContention _stVolumeLockContention;
+
+    /**
+     * Accounts an acquisition of a lock. Must be called with the lock held.
+     *
+     * @param[in,out] stContention contention of the lock.
+     * @param[in] waitTime time spent waiting for the lock, 0 if not contended.
+     */
+    static void recordLockWait(SLockContention& stContention, nsecs_t waitTime);
+
+    static void dumpLockContention(String8& result, const char* pcName,
+                                   const SLockContention& stContention);
+
+    /**
+     * Takes the routing lock for writing, accounting the time spent waiting for it.
+     */
+    class AutoRoutingLock
+    {
+    public:
+        AutoRoutingLock(CAudioRouteManager* pRouteManager);
+        ~AutoRoutingLock();
+
+    private:
+        RWLock& _lock;
+    };
+
+    /**
+     * Takes the voice volume lock, accounting the time spent waiting for it.
+     */
+    class AutoVolumeLock
+    {
+    public:
+        AutoVolumeLock(CAudioRouteManager* pRouteManager);
+        ~AutoVolumeLock();
+
+    private:
+        Mutex& _lock;
+    };
 
     struct {
 
@@ -696,23 +1141,177 @@ private:
         uint32_t uiEnabled;
         // Bitfield of previously enabled route
         uint32_t uiPrevEnabled;
+        // Bitfield of route whose static rules match the devices and mode of the routing
+        uint32_t uiStaticallyApplicable;
     } _stRoutes[CUtils::ENbDirections];
 
+    /** Number of bits of the route and port identifiers. */
+    static const uint32_t NB_ID_BITS = 32;
+
+    /** Routes, by index of their identifier bit. */
+    CAudioRoute* _apRoutes[NB_ID_BITS];
+
+    /** Bitfield of the routes blocked by the use of each port, by index of its identifier bit. */
+    uint32_t _auiPortBlockedRoutes[NB_ID_BITS];
+
+    /** Bitfield of the ports used by the routing. */
+    uint32_t _uiUsedPorts;
+
+    /** Bitfield of the routes blocked by the ports used by the routing. */
+    uint32_t _uiBlockedRoutes;
+
+    /** Applicability rules of the routes compiled at startup. */
+    CAudioApplicabilityTables _applicabilityTables;
+
     /** Uevent message max length */
     static const int UEVENT_MSG_MAX_LEN;
 
     /** Socket buffer default size (64K) */
     static const int SOCKET_BUFFER_DEFAULT_SIZE;
 
+    /** Max time to wait for the sound cards upon SST recovery */
+    static const uint32_t SST_RECOVERY_TIMEOUT_MS;
+
+    /** Period of sound cards availability checks upon SST recovery */
+    static const uint32_t SST_RECOVERY_POLL_PERIOD_MS;
+
+    /** Delayed standby metrics, updated from stream contexts. */
+    struct {
+
+        volatile int32_t iDelayed; /**< standby requests delayed by a grace period. */
+        volatile int32_t iResumed; /**< restarts within the grace period: reroutings avoided. */
+        volatile int32_t iApplied; /**< grace periods elapsed: standby applied. */
+    } _stStandbyMetrics;
+
+    /**
+     * Incremental routing: a routing evaluation is skipped if it cannot change the routes.
+     */
+    bool _bIncrementalRouting;
+
+    /**
+     * Incremental routing check: routing evaluations that would be skipped are run anyway, and
+     * an error is logged if they change the routes.
+     */
+    bool _bIncrementalRoutingCheck;
+
+    /**
+     * Next routing evaluation must not be skipped: routes changed, were unrouted or were never
+     * evaluated.
+     */
+    bool _bRoutingEvaluationRequired;
+
+    /**
+     * For each platform state event, bitfield of the routes which read the state of the event
+     * at last evaluation.
+     */
+    uint32_t _auiEventRoutes[CAudioPlatformState::NbEvents];
+
+    /** Platform state events read by any route at last evaluation. */
+    uint32_t _uiRoutingDependencies;
+
+    /**
+     * Platform state events of the last routing evaluation, skipped or not. Their flag was set
+     * when read by the routes, and cleared since then.
+     */
+    uint32_t _uiLastRoutingEvents;
+
+    /** Stream state the routing depends on. */
+    struct SStreamSignature {
+
+        const ALSAStreamOps* pStream;
+        bool bStarted;
+        uint32_t uiApplicabilityMask;
+        uint32_t uiDevices;
+
+        bool operator==(const SStreamSignature &other) const
+        {
+            return (pStream == other.pStream) && (bStarted == other.bStarted) &&
+                    (uiApplicabilityMask == other.uiApplicabilityMask) &&
+                    (uiDevices == other.uiDevices);
+        }
+    };
+
+    /** Signature of the streams at last routing evaluation, and current one. */
+    vector<SStreamSignature> _streamSignature;
+    vector<SStreamSignature> _newStreamSignature;
+
+    /** Incremental routing metrics, updated from worker thread context. */
+    struct {
+
+        volatile int32_t iEvaluated; /**< routing evaluations run. */
+        volatile int32_t iSkipped; /**< routing evaluations skipped. */
+        volatile int32_t iMismatches; /**< skippable evaluations found to change the routes. */
+    } _stIncrementalRoutingMetrics;
+
+    /**
+     * A routing pass is requested and not run yet: further requests are served by this pass.
+     */
+    bool _bRoutingPending;
+
+    /**
+     * SST recovery in progress: routing passes are held until the sound cards are back.
+     */
+    bool _bSstRecoveryPending;
+
+    /** Start of the last SST recovery. */
+    nsecs_t _sstRecoveryStartTime;
+
+    /** Routes were in use upon the last SST recovery, and are not enabled again yet. */
+    bool _bSstAudioPending;
+
+    /** SST recovery metrics, updated from worker thread context. */
+    struct {
+
+        volatile int32_t iRecoveries;
+        volatile int32_t iCardsBackMs; /**< last recovery event to the sound cards back. */
+        volatile int32_t iAudioBackMs; /**< last recovery event to the routes enabled again. */
+    } _stSstRecoveryMetrics;
+
+    /** Stages of an executed routing pass, in order. */
+    enum RoutingStageIndex {
+
+        EMuteStageIndex,
+        EDisableStageIndex,
+        EConfigureStageIndex,
+        EEnableStageIndex,
+        EUnmuteStageIndex,
+
+        ENbRoutingStages
+    };
+
+    static const char* const ROUTING_STAGE_NAMES[ENbRoutingStages];
+
+    /** Routing metrics, updated from client and worker thread contexts. */
+    struct {
+
+        volatile int32_t iRequests; /**< routing requests. */
+        volatile int32_t iCoalesced; /**< requests served by an already requested pass. */
+        volatile int32_t iPasses; /**< routing passes run. */
+        volatile int32_t iExecuted; /**< routing passes which changed the routes. */
+        volatile int32_t aiStageTotalUs[ENbRoutingStages]; /**< wall time of the stages. */
+        volatile int32_t aiStageMaxUs[ENbRoutingStages]; /**< longest run of the stages. */
+    } _stRoutingMetrics;
+
+    /**
+     * Accounts the wall time of a routing stage. Must be called with the routing lock held.
+     *
+     * @param[in] eStage stage just run.
+     * @param[in] startTime time the stage started.
+     *
+     * @return current time, start of the next stage.
+     */
+    nsecs_t recordRoutingStageTime(RoutingStageIndex eStage, nsecs_t startTime);
+
 protected:
     friend class AudioHardwareALSA;
+    friend class CAudioRoutingReplayer;
 
     AudioHardwareALSA *     _pParent;
 
     // For backup and restore audio parameters
     CAudioParameterHandler* _pAudioParameterHandler;
 
-    struct echo_reference_itfe* _pEchoReference;
+    CAudioEchoReference* _pEchoReference;
 };
 };        // namespace android
 
@@ -0,0 +1,163 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/RoutingRecorder"
+
+#include "AudioRoutingRecorder.h"
+#include <utils/Log.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+
+using android::Mutex;
+using std::numeric_limits;
+using std::string;
+
+namespace android_audio_legacy
+{
+
+// "ARRC"
+const uint32_t CAudioRoutingRecorder::FILE_MAGIC = 0x43525241;
+
+const uint32_t CAudioRoutingRecorder::FILE_VERSION = 1;
+
+const char *const CAudioRoutingRecorder::EVENT_TYPE_NAMES[ENbEventTypes] = {
+
+    "set-parameters",
+    "add-stream",
+    "remove-stream",
+    "set-stream-parameters",
+    "start-stream",
+    "stop-stream",
+    "delay-standby",
+    "resume-stream",
+    "modem-status",
+    "sst-recovery"
+};
+
+CAudioRoutingRecorder::CAudioRoutingRecorder(const string &strPath)
+    : _pFile(NULL),
+      _iEnabled(0),
+      _lastEventTime(0),
+      _uiNextStreamId(1)
+{
+    if (strPath.empty()) {
+
+        return;
+    }
+    _pFile = fopen(strPath.c_str(), "wb");
+    if (_pFile == NULL) {
+
+        ALOGE("%s: could not open %s: %s", __FUNCTION__, strPath.c_str(), strerror(errno));
+        return;
+    }
+    SFileHeader stHeader;
+    stHeader.uiMagic = FILE_MAGIC;
+    stHeader.uiVersion = FILE_VERSION;
+    if (fwrite(&stHeader, sizeof(stHeader), 1, _pFile) != 1) {
+
+        ALOGE("%s: could not write to %s", __FUNCTION__, strPath.c_str());
+        fclose(_pFile);
+        _pFile = NULL;
+        return;
+    }
+    _iEnabled = 1;
+    ALOGI("%s: recording routing events into %s", __FUNCTION__, strPath.c_str());
+}
+
+CAudioRoutingRecorder::~CAudioRoutingRecorder()
+{
+    if (_pFile != NULL) {
+
+        fclose(_pFile);
+    }
+}
+
+void CAudioRoutingRecorder::record(EventType eType, const void *pStream, int32_t iArg0,
+                                   int32_t iArg1, const char *pcData)
+{
+    if (!isEnabled()) {
+
+        return;
+    }
+    Mutex::Autolock lock(_lock);
+
+    if (_pFile == NULL) {
+
+        // Stopped on a write error meanwhile
+        return;
+    }
+    nsecs_t now = systemTime();
+    nsecs_t delay = _lastEventTime ? now - _lastEventTime : 0;
+    _lastEventTime = now;
+
+    SEventHeader stHeader;
+    stHeader.uiType = eType;
+    stHeader.uiStreamId = getStreamIdL(eType, pStream);
+    stHeader.uiDelayUs = std::min<nsecs_t>(ns2us(delay), numeric_limits<uint32_t>::max());
+    stHeader.iArg0 = iArg0;
+    stHeader.iArg1 = iArg1;
+    stHeader.uiDataSize = pcData ? strlen(pcData) : 0;
+
+    if ((fwrite(&stHeader, sizeof(stHeader), 1, _pFile) != 1) ||
+            (stHeader.uiDataSize &&
+             (fwrite(pcData, stHeader.uiDataSize, 1, _pFile) != 1)) ||
+            (fflush(_pFile) != 0)) {
+
+        // Recording stops rather than leaving a truncated event in the middle of the file
+        ALOGE("%s: could not write event, recording stopped", __FUNCTION__);
+        android_atomic_release_store(0, &_iEnabled);
+        fclose(_pFile);
+        _pFile = NULL;
+    }
+}
+
+const char *CAudioRoutingRecorder::getEventTypeName(uint16_t uiType)
+{
+    return uiType < ENbEventTypes ? EVENT_TYPE_NAMES[uiType] : "unknown";
+}
+
+uint16_t CAudioRoutingRecorder::getStreamIdL(EventType eType, const void *pStream)
+{
+    if (pStream == NULL) {
+
+        return 0;
+    }
+    if (eType == EAddStream) {
+
+        uint16_t uiStreamId = _uiNextStreamId++;
+        if (_uiNextStreamId == 0) {
+
+            _uiNextStreamId = 1;
+        }
+        _streamIds[pStream] = uiStreamId;
+        return uiStreamId;
+    }
+    std::map<const void *, uint16_t>::iterator it = _streamIds.find(pStream);
+    if (it == _streamIds.end()) {
+
+        return 0;
+    }
+    uint16_t uiStreamId = it->second;
+    if (eType == ERemoveStream) {
+
+        _streamIds.erase(it);
+    }
+    return uiStreamId;
+}
+
+}       // namespace android
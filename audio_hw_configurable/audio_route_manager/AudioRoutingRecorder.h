@@ -0,0 +1,126 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <cutils/atomic.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Records the inputs of the route manager in a binary file, to reproduce a routing issue or to
+ * benchmark the routing engine offline with CAudioRoutingReplayer.
+ *
+ * The file starts with a SFileHeader, followed by the events, each made of a SEventHeader and
+ * of a string of uiDataSize bytes, not null terminated. Integers are in host byte order.
+ * Streams are identified by the order they were added in.
+ * Each event is flushed at once, so that the file survives a crash of the media server.
+ */
+class CAudioRoutingRecorder
+{
+public:
+    enum EventType {
+
+        ESetParameters,         /**< data: key value pairs. */
+        EAddStream,             /**< arg0: output flags, arg1: direction, data: sample spec. */
+        ERemoveStream,
+        ESetStreamParameters,   /**< arg0: android mode, data: key value pairs. */
+        EStartStream,
+        EStopStream,
+        EDelayStandby,
+        EResumeStream,
+        EModemStatus,           /**< arg0: route manager event, arg1: status read. */
+        ESstRecovery,
+
+        ENbEventTypes
+    };
+
+    struct SFileHeader
+    {
+        uint32_t uiMagic;
+        uint32_t uiVersion;
+    };
+
+    struct SEventHeader
+    {
+        uint16_t uiType;
+        uint16_t uiStreamId; /**< 0 if the event does not apply to a stream. */
+        uint32_t uiDelayUs; /**< time elapsed since previous event. */
+        int32_t iArg0;
+        int32_t iArg1;
+        uint32_t uiDataSize;
+    };
+
+    static const uint32_t FILE_MAGIC;
+    static const uint32_t FILE_VERSION;
+
+    /**
+     * @param[in] strPath file to record into, truncated, empty to disable the recording.
+     */
+    CAudioRoutingRecorder(const std::string &strPath);
+    ~CAudioRoutingRecorder();
+
+    bool isEnabled() const { return android_atomic_acquire_load(&_iEnabled) != 0; }
+
+    /**
+     * Records an event.
+     *
+     * @param[in] eType type of the event.
+     * @param[in] pStream stream the event applies to, NULL if none.
+     * @param[in] iArg0 first argument, meaning depends on the type.
+     * @param[in] iArg1 second argument, meaning depends on the type.
+     * @param[in] pcData string argument, NULL if none.
+     */
+    void record(EventType eType, const void *pStream = NULL, int32_t iArg0 = 0,
+                int32_t iArg1 = 0, const char *pcData = NULL);
+
+    static const char *getEventTypeName(uint16_t uiType);
+
+private:
+    CAudioRoutingRecorder(const CAudioRoutingRecorder &);
+    CAudioRoutingRecorder &operator=(const CAudioRoutingRecorder &);
+
+    /** Must be called with the lock held. */
+    uint16_t getStreamIdL(EventType eType, const void *pStream);
+
+    /** File recorded into, accessed with the lock held. */
+    FILE *_pFile;
+
+    /** Set while recording, read without the lock before each event. */
+    volatile int32_t _iEnabled;
+
+    /** Time of the last event recorded. */
+    nsecs_t _lastEventTime;
+
+    /** Identifiers of the streams added, by stream. */
+    std::map<const void *, uint16_t> _streamIds;
+    uint16_t _uiNextStreamId;
+
+    /** Serializes the events, recorded from clients, modem and worker thread contexts. */
+    android::Mutex _lock;
+
+    static const char *const EVENT_TYPE_NAMES[ENbEventTypes];
+};
+
+};        // namespace android
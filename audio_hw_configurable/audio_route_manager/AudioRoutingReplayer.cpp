@@ -0,0 +1,378 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/RoutingReplayer"
+
+#include "AudioRoutingReplayer.h"
+#include "AudioRoutingRecorder.h"
+#include "AudioRouteManager.h"
+#include "AudioRoute.h"
+#include <AudioHardwareALSA.h>
+#include <ALSAStreamOps.h>
+#include <AudioStreamInALSA.h>
+#include <AudioStreamOutALSA.h>
+#include <media/AudioParameter.h>
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+using android::AudioParameter;
+using android::String8;
+using android::status_t;
+using android::OK;
+using android::BAD_VALUE;
+using android::NAME_NOT_FOUND;
+
+namespace android_audio_legacy
+{
+
+const uint32_t CAudioRoutingReplayer::ROUTING_TIMEOUT_MS = 2000;
+
+const uint32_t CAudioRoutingReplayer::ROUTING_POLL_PERIOD_US = 1000;
+
+CAudioRoutingReplayer::CAudioRoutingReplayer(AudioHardwareALSA *pHardware)
+    : _pHardware(pHardware),
+      _pRouteManager(pHardware->mRouteMgr)
+{
+    memset(_auiReportedRoutes, 0, sizeof(_auiReportedRoutes));
+}
+
+CAudioRoutingReplayer::~CAudioRoutingReplayer()
+{
+    while (!_streams.empty()) {
+
+        closeStream(_streams.begin()->first);
+    }
+}
+
+status_t CAudioRoutingReplayer::replay(const char *pcPath, bool bRealTime, String8 &report)
+{
+    FILE *pFile = fopen(pcPath, "rb");
+    if (pFile == NULL) {
+
+        ALOGE("%s: could not open %s: %s", __FUNCTION__, pcPath, strerror(errno));
+        return NAME_NOT_FOUND;
+    }
+    CAudioRoutingRecorder::SFileHeader stFileHeader;
+    if ((fread(&stFileHeader, sizeof(stFileHeader), 1, pFile) != 1) ||
+            (stFileHeader.uiMagic != CAudioRoutingRecorder::FILE_MAGIC) ||
+            (stFileHeader.uiVersion != CAudioRoutingRecorder::FILE_VERSION)) {
+
+        ALOGE("%s: %s is not a routing record, or of another version", __FUNCTION__, pcPath);
+        fclose(pFile);
+        return BAD_VALUE;
+    }
+
+    int32_t iInitialPasses = android_atomic_acquire_load(
+                &_pRouteManager->_stRoutingMetrics.iPasses);
+    uint32_t uiNbEvents = 0;
+    uint32_t uiNbTimeouts = 0;
+    nsecs_t totalRoutingTime = 0;
+    nsecs_t maxRoutingTime = 0;
+    nsecs_t replayTime = 0;
+    status_t status = OK;
+
+    report.appendFormat("Replay of %s\n", pcPath);
+
+    CAudioRoutingRecorder::SEventHeader stHeader;
+    while (fread(&stHeader, sizeof(stHeader), 1, pFile) == 1) {
+
+        std::vector<char> buffer(stHeader.uiDataSize);
+        if (stHeader.uiDataSize &&
+                (fread(&buffer[0], stHeader.uiDataSize, 1, pFile) != 1)) {
+
+            // Truncated by a crash while recording
+            break;
+        }
+        String8 data(buffer.empty() ? "" : &buffer[0], stHeader.uiDataSize);
+        if (bRealTime) {
+
+            usleep(stHeader.uiDelayUs);
+        }
+        replayTime += us2ns(stHeader.uiDelayUs);
+        uiNbEvents++;
+
+        nsecs_t startTime = systemTime();
+        status = applyEvent(stHeader.uiType, stHeader.uiStreamId, stHeader.iArg0,
+                            stHeader.iArg1, data);
+        if (status != OK) {
+
+            report.appendFormat("  #%d %s: failed to apply (%d), replay stopped\n", uiNbEvents,
+                                CAudioRoutingRecorder::getEventTypeName(stHeader.uiType),
+                                status);
+            break;
+        }
+        if (!waitForRouting()) {
+
+            uiNbTimeouts++;
+        }
+        nsecs_t routingTime = systemTime() - startTime;
+        totalRoutingTime += routingTime;
+        if (routingTime > maxRoutingTime) {
+
+            maxRoutingTime = routingTime;
+        }
+
+        report.appendFormat("  %lld ms #%d %s", static_cast<long long>(ns2ms(replayTime)),
+                            uiNbEvents, CAudioRoutingRecorder::getEventTypeName(stHeader.uiType));
+        if (stHeader.uiStreamId) {
+
+            report.appendFormat(" stream %d", stHeader.uiStreamId);
+        }
+        if (!data.isEmpty()) {
+
+            report.appendFormat(" \"%s\"", data.string());
+        }
+        report.appendFormat(": %lld us\n", static_cast<long long>(ns2us(routingTime)));
+        reportRoutes(CUtils::EOutput, report);
+        reportRoutes(CUtils::EInput, report);
+    }
+    fclose(pFile);
+
+    while (!_streams.empty()) {
+
+        closeStream(_streams.begin()->first);
+    }
+
+    report.appendFormat("%d events, %d routing passes, %d timeouts\n", uiNbEvents,
+                        android_atomic_acquire_load(&_pRouteManager->_stRoutingMetrics.iPasses) -
+                        iInitialPasses,
+                        uiNbTimeouts);
+    report.appendFormat("routing time: total %lld us, avg %lld us, max %lld us\n",
+                        static_cast<long long>(ns2us(totalRoutingTime)),
+                        static_cast<long long>(uiNbEvents ?
+                                               ns2us(totalRoutingTime) / uiNbEvents : 0),
+                        static_cast<long long>(ns2us(maxRoutingTime)));
+    return status;
+}
+
+status_t CAudioRoutingReplayer::applyEvent(uint16_t uiType, uint16_t uiStreamId, int32_t iArg0,
+                                           int32_t iArg1, const String8 &data)
+{
+    if (uiType == CAudioRoutingRecorder::EAddStream) {
+
+        return openStream(uiStreamId, iArg1, iArg0, data);
+    }
+    if (uiType == CAudioRoutingRecorder::ESetParameters) {
+
+        return _pHardware->setParameters(data);
+    }
+    if (uiType == CAudioRoutingRecorder::EModemStatus) {
+
+        CAudioRouteManager::AutoRoutingLock lock(_pRouteManager);
+
+        _pRouteManager->applyModemStatus(iArg0, iArg1);
+        _pRouteManager->doReconsiderRouting();
+        return OK;
+    }
+    if (uiType == CAudioRoutingRecorder::ESstRecovery) {
+
+        _pRouteManager->recoverFromSstReset();
+        return OK;
+    }
+
+    // Stream events
+    ALSAStreamOps *pStream = findStream(uiStreamId);
+    if (pStream == NULL) {
+
+        ALOGE("%s: stream %d not opened", __FUNCTION__, uiStreamId);
+        return BAD_VALUE;
+    }
+    switch (uiType) {
+    case CAudioRoutingRecorder::ERemoveStream:
+        closeStream(uiStreamId);
+        return OK;
+
+    case CAudioRoutingRecorder::ESetStreamParameters:
+        return _pRouteManager->setStreamParameters(pStream, data, iArg0);
+
+    case CAudioRoutingRecorder::EStartStream:
+    case CAudioRoutingRecorder::EResumeStream:
+        // The stream finds out by itself if it is resumed within its standby grace period
+        return pStream->setStandby(false);
+
+    case CAudioRoutingRecorder::EStopStream:
+    case CAudioRoutingRecorder::EDelayStandby:
+        // The stream finds out by itself if its standby is delayed
+        return pStream->setStandby(true);
+
+    default:
+        ALOGE("%s: unknown event type %d", __FUNCTION__, uiType);
+        return BAD_VALUE;
+    }
+}
+
+status_t CAudioRoutingReplayer::openStream(uint16_t uiStreamId, bool bIsOut, uint32_t uiFlags,
+                                           const String8 &sampleSpec)
+{
+    AudioParameter param(sampleSpec);
+    int iFormat = 0;
+    int iChannels = 0;
+    int iSampleRate = 0;
+    param.getInt(String8(AudioParameter::keyFormat), iFormat);
+    param.getInt(String8(AudioParameter::keyChannels), iChannels);
+    param.getInt(String8(AudioParameter::keySamplingRate), iSampleRate);
+
+    uint32_t uiChannels = iChannels;
+    uint32_t uiSampleRate = iSampleRate;
+    ALSAStreamOps *pStream;
+
+    // Devices given at opening are only checked: streams are routed by their parameters
+    if (bIsOut) {
+
+        // Output flags are given through the status
+        status_t status = uiFlags;
+        AudioStreamOut *pStreamOut = _pHardware->openOutputStream(AudioSystem::DEVICE_OUT_SPEAKER,
+                                                                  &iFormat,
+                                                                  &uiChannels,
+                                                                  &uiSampleRate,
+                                                                  &status);
+        if (pStreamOut == NULL) {
+
+            return status;
+        }
+        pStream = static_cast<AudioStreamOutALSA *>(pStreamOut);
+    } else {
+
+        status_t status;
+        AudioStreamIn *pStreamIn = _pHardware->openInputStream(AudioSystem::DEVICE_IN_BUILTIN_MIC,
+                                                               &iFormat,
+                                                               &uiChannels,
+                                                               &uiSampleRate,
+                                                               &status,
+                                                               AudioSystem::AGC_DISABLE);
+        if (pStreamIn == NULL) {
+
+            return status;
+        }
+        pStream = static_cast<AudioStreamInALSA *>(pStreamIn);
+    }
+    _streams[uiStreamId] = pStream;
+    return OK;
+}
+
+void CAudioRoutingReplayer::closeStream(uint16_t uiStreamId)
+{
+    ALSAStreamOps *pStream = findStream(uiStreamId);
+    if (pStream == NULL) {
+
+        return;
+    }
+    _streams.erase(uiStreamId);
+
+    if (pStream->isOut()) {
+
+        _pHardware->closeOutputStream(static_cast<AudioStreamOutALSA *>(pStream));
+    } else {
+
+        _pHardware->closeInputStream(static_cast<AudioStreamInALSA *>(pStream));
+    }
+}
+
+ALSAStreamOps *CAudioRoutingReplayer::findStream(uint16_t uiStreamId) const
+{
+    std::map<uint16_t, ALSAStreamOps *>::const_iterator it = _streams.find(uiStreamId);
+
+    return it != _streams.end() ? it->second : NULL;
+}
+
+bool CAudioRoutingReplayer::waitForRouting() const
+{
+    uint32_t uiWaitedUs = 0;
+    while (true) {
+
+        {
+            CAudioRouteManager::AutoRoutingLock lock(_pRouteManager);
+
+            if (!_pRouteManager->_bRoutingPending) {
+
+                return true;
+            }
+        }
+        if (uiWaitedUs >= ROUTING_TIMEOUT_MS * 1000) {
+
+            ALOGE("%s: routing pass still pending after %d ms", __FUNCTION__,
+                  ROUTING_TIMEOUT_MS);
+            return false;
+        }
+        usleep(ROUTING_POLL_PERIOD_US);
+        uiWaitedUs += ROUTING_POLL_PERIOD_US;
+    }
+}
+
+void CAudioRoutingReplayer::setIncrementalRouting(bool bEnabled)
+{
+    CAudioRouteManager::AutoRoutingLock lock(_pRouteManager);
+
+    _pRouteManager->_bIncrementalRouting = bEnabled;
+}
+
+void CAudioRoutingReplayer::getRoutes(bool bIsOut, uint32_t &uiEnabled,
+                                      uint32_t &uiNeedReconfig) const
+{
+    CAudioRouteManager::AutoRoutingLock lock(_pRouteManager);
+
+    uiEnabled = _pRouteManager->_stRoutes[bIsOut].uiEnabled;
+    uiNeedReconfig = _pRouteManager->_stRoutes[bIsOut].uiNeedReconfig;
+}
+
+void CAudioRoutingReplayer::setAsyncStart(AudioStreamOut *pOut, bool bEnabled)
+{
+    AudioStreamOutALSA *pStream = static_cast<AudioStreamOutALSA *>(pOut);
+    AutoW lock(pStream->_streamLock);
+
+    pStream->mAsyncStart = bEnabled;
+}
+
+void CAudioRoutingReplayer::setStandbyDelay(AudioStreamOut *pOut, uint32_t uiDelayMs)
+{
+    ALSAStreamOps *pStream = static_cast<AudioStreamOutALSA *>(pOut);
+    AutoW lock(pStream->_streamLock);
+
+    pStream->mStandbyDelayMs = uiDelayMs;
+}
+
+void CAudioRoutingReplayer::reportRoutes(bool bIsOut, String8 &report)
+{
+    uint32_t uiRoutes;
+    {
+        CAudioRouteManager::AutoRoutingLock lock(_pRouteManager);
+
+        uiRoutes = _pRouteManager->_stRoutes[bIsOut].uiEnabled;
+    }
+    if (uiRoutes == _auiReportedRoutes[bIsOut]) {
+
+        return;
+    }
+    _auiReportedRoutes[bIsOut] = uiRoutes;
+
+    report.appendFormat("    %s routes:", bIsOut ? "output" : "input");
+    for (uint32_t uiBit = 0; uiBit < CAudioRouteManager::NB_ID_BITS; uiBit++) {
+
+        const CAudioRoute *pRoute = _pRouteManager->_apRoutes[uiBit];
+        if ((uiRoutes & (1 << uiBit)) && (pRoute != NULL)) {
+
+            report.appendFormat(" %s", pRoute->getName().c_str());
+        }
+    }
+    report.append("\n");
+}
+
+}       // namespace android
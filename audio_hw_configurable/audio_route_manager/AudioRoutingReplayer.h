@@ -0,0 +1,157 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <utils/Errors.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <map>
+#include <stdint.h>
+#include "Utils.h"
+
+namespace android_audio_legacy
+{
+
+class AudioHardwareALSA;
+class AudioStreamOut;
+class ALSAStreamOps;
+class CAudioRouteManager;
+
+/**
+ * Replays the route manager inputs recorded by CAudioRoutingRecorder, and reports the routing
+ * decisions and timings, to reproduce a routing issue or check a change of the routing engine
+ * against recorded sequences.
+ *
+ * Streams are opened, configured, started and put in standby through the audio hardware, as
+ * audio flinger does. Modem status changes and SST recoveries are applied to the route manager
+ * as its worker thread does, the modem audio manager and the SST driver being left out.
+ * Meant for host builds, against stub parameter-framework and tinyalsa backends: replaying on a
+ * target with running streams disturbs their routing.
+ */
+class CAudioRoutingReplayer
+{
+public:
+    /**
+     * @param[in] pHardware started audio hardware to drive.
+     */
+    CAudioRoutingReplayer(AudioHardwareALSA *pHardware);
+    ~CAudioRoutingReplayer();
+
+    /**
+     * Replays a recorded sequence of events.
+     * Streams still opened at the end of the sequence are closed.
+     *
+     * @param[in] pcPath file recorded.
+     * @param[in] bRealTime true to wait the recorded time between the events, false to replay
+     *                      them as fast as the routing allows.
+     * @param[out] report routing decisions and timings, appended.
+     *
+     * @return OK if the whole sequence was replayed, error code otherwise.
+     */
+    android::status_t replay(const char *pcPath, bool bRealTime, android::String8 &report);
+
+    /**
+     * Applies an event generated by a test rather than recorded, without waiting for the
+     * routing pass it requests.
+     *
+     * @return OK if applied, error code otherwise.
+     */
+    android::status_t apply(uint16_t uiType, uint16_t uiStreamId, int32_t iArg0, int32_t iArg1,
+                            const android::String8 &data)
+    {
+        return applyEvent(uiType, uiStreamId, iArg0, iArg1, data);
+    }
+
+    /**
+     * Waits for the routing pass requested by an event, if any.
+     *
+     * @return true if no routing pass is pending anymore, false on timeout.
+     */
+    bool waitForRouting() const;
+
+    /**
+     * Enables or disables the incremental routing, which skips the evaluation of the routing
+     * on events the routes do not depend on, as its property does at start.
+     */
+    void setIncrementalRouting(bool bEnabled);
+
+    /**
+     * Reads the routes of a direction as the last routing pass left them.
+     *
+     * @param[in] bIsOut direction of the routes.
+     * @param[out] uiEnabled routes enabled.
+     * @param[out] uiNeedReconfig routes enabled that the pass reconfigured.
+     */
+    void getRoutes(bool bIsOut, uint32_t &uiEnabled, uint32_t &uiNeedReconfig) const;
+
+    /**
+     * Enables or disables the asynchronous start of an output stream, as its property does
+     * upon opening. The stream must be in standby.
+     *
+     * @param[in] pOut output stream opened through the audio hardware.
+     * @param[in] bEnabled true for the first writes not to wait for the routing.
+     */
+    void setAsyncStart(AudioStreamOut *pOut, bool bEnabled);
+
+    /**
+     * Sets the standby grace period of an output stream, as its property does upon opening.
+     *
+     * @param[in] pOut output stream opened through the audio hardware.
+     * @param[in] uiDelayMs grace period of the standby, 0 to apply it immediately.
+     */
+    void setStandbyDelay(AudioStreamOut *pOut, uint32_t uiDelayMs);
+
+private:
+    CAudioRoutingReplayer(const CAudioRoutingReplayer &);
+    CAudioRoutingReplayer &operator=(const CAudioRoutingReplayer &);
+
+    /**
+     * Applies an event to the audio hardware or to the route manager.
+     *
+     * @return OK if applied, error code otherwise.
+     */
+    android::status_t applyEvent(uint16_t uiType, uint16_t uiStreamId, int32_t iArg0,
+                                 int32_t iArg1, const android::String8 &data);
+
+    android::status_t openStream(uint16_t uiStreamId, bool bIsOut, uint32_t uiFlags,
+                                 const android::String8 &sampleSpec);
+    void closeStream(uint16_t uiStreamId);
+
+    ALSAStreamOps *findStream(uint16_t uiStreamId) const;
+
+    /**
+     * Appends the routes enabled in a direction to the report if they changed.
+     */
+    void reportRoutes(bool bIsOut, android::String8 &report);
+
+    AudioHardwareALSA *_pHardware;
+    CAudioRouteManager *_pRouteManager;
+
+    /** Streams opened, by recorded identifier. */
+    std::map<uint16_t, ALSAStreamOps *> _streams;
+
+    /** Routes enabled at last report, by direction. */
+    uint32_t _auiReportedRoutes[CUtils::ENbDirections];
+
+    /** Max time to wait for a routing pass. */
+    static const uint32_t ROUTING_TIMEOUT_MS;
+
+    /** Period of the routing pass completion checks. */
+    static const uint32_t ROUTING_POLL_PERIOD_US;
+};
+
+};        // namespace android
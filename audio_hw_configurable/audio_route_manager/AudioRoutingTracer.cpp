@@ -0,0 +1,139 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/RoutingTracer"
+
+#include "AudioRoutingTracer.h"
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+#include <string.h>
+#include <unistd.h>
+
+using android::String8;
+
+namespace android_audio_legacy
+{
+
+CAudioRoutingTracer::CAudioRoutingTracer(uint32_t uiNbEvents)
+    : _pEvents(NULL),
+      _uiMask(0),
+      _iWriteIndex(0),
+      _pid(getpid())
+{
+    if (uiNbEvents == 0) {
+
+        return;
+    }
+    uint32_t uiSize = 1;
+    while (uiSize < uiNbEvents) {
+
+        uiSize <<= 1;
+    }
+    _pEvents = new SEvent[uiSize];
+    memset(_pEvents, 0, uiSize * sizeof(SEvent));
+    _uiMask = uiSize - 1;
+}
+
+CAudioRoutingTracer::~CAudioRoutingTracer()
+{
+    delete [] _pEvents;
+}
+
+void CAudioRoutingTracer::record(const char *pcCategory, const char *pcName, nsecs_t beginTime,
+                                 const char *pcRoute, int iDirection)
+{
+    if (!isEnabled()) {
+
+        return;
+    }
+    nsecs_t endTime = systemTime();
+    int32_t iIndex = android_atomic_inc(&_iWriteIndex);
+    SEvent &stEvent = _pEvents[iIndex & _uiMask];
+
+    android_atomic_release_store(0, &stEvent.iSequence);
+    // Readers see the event being recorded before any of its fields changes
+    android_memory_barrier();
+    stEvent.pcCategory = pcCategory;
+    stEvent.pcName = pcName;
+    stEvent.pcRoute = pcRoute;
+    stEvent.iDirection = iDirection;
+    stEvent.tid = gettid();
+    stEvent.beginTime = beginTime;
+    stEvent.endTime = endTime;
+    android_atomic_release_store(iIndex + 1, &stEvent.iSequence);
+}
+
+void CAudioRoutingTracer::exportJson(String8 &result) const
+{
+    result.append("{\"traceEvents\":[");
+
+    if (isEnabled()) {
+
+        int32_t iEndIndex = android_atomic_acquire_load(&_iWriteIndex);
+        int32_t iIndex = iEndIndex - static_cast<int32_t>(_uiMask + 1);
+        if (iIndex < 0) {
+
+            iIndex = 0;
+        }
+        bool bIsFirst = true;
+        for (; iIndex != iEndIndex; iIndex++) {
+
+            const SEvent &stRecorded = _pEvents[iIndex & _uiMask];
+
+            // Skip the events being recorded or already overwritten
+            if (android_atomic_acquire_load(&stRecorded.iSequence) != iIndex + 1) {
+
+                continue;
+            }
+            SEvent stEvent;
+            stEvent.pcCategory = stRecorded.pcCategory;
+            stEvent.pcName = stRecorded.pcName;
+            stEvent.pcRoute = stRecorded.pcRoute;
+            stEvent.iDirection = stRecorded.iDirection;
+            stEvent.tid = stRecorded.tid;
+            stEvent.beginTime = stRecorded.beginTime;
+            stEvent.endTime = stRecorded.endTime;
+
+            // Skip the events overwritten while copied
+            android_memory_barrier();
+            if (android_atomic_acquire_load(&stRecorded.iSequence) != iIndex + 1) {
+
+                continue;
+            }
+            result.appendFormat("%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                                "\"ts\":%lld.%03lld,\"dur\":%lld.%03lld,\"pid\":%d,\"tid\":%d",
+                                bIsFirst ? "" : ",",
+                                stEvent.pcName, stEvent.pcCategory,
+                                static_cast<long long>(stEvent.beginTime / 1000),
+                                static_cast<long long>(stEvent.beginTime % 1000),
+                                static_cast<long long>((stEvent.endTime - stEvent.beginTime) /
+                                                       1000),
+                                static_cast<long long>((stEvent.endTime - stEvent.beginTime) %
+                                                       1000),
+                                _pid, stEvent.tid);
+            if (stEvent.pcRoute != NULL) {
+
+                result.appendFormat(",\"args\":{\"route\":\"%s\",\"direction\":\"%s\"}",
+                                    stEvent.pcRoute, stEvent.iDirection ? "output" : "input");
+            }
+            result.append("}");
+            bIsFirst = false;
+        }
+    }
+    result.append("],\"displayTimeUnit\":\"ms\"}");
+}
+
+}       // namespace android
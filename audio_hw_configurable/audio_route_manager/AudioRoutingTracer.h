@@ -0,0 +1,135 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+namespace android_audio_legacy
+{
+
+/**
+ * Records the duration of the routing stages, of the actions on the routes and of the
+ * parameter-framework calls, to find out what a slow routing is spent on.
+ *
+ * Events are recorded in a ring allocated once, the oldest being overwritten. Recording takes
+ * two clock reads and an atomic increment, from any thread: the routing workers record the
+ * devices they open and close. Names must outlive the tracer, i.e. be literals or route names.
+ * The trace is exported in Chrome trace-event format (JSON), to be loaded in chrome://tracing.
+ */
+class CAudioRoutingTracer
+{
+public:
+    /**
+     * @param[in] uiNbEvents number of events kept, rounded up to a power of 2, 0 to disable.
+     */
+    CAudioRoutingTracer(uint32_t uiNbEvents);
+    ~CAudioRoutingTracer();
+
+    bool isEnabled() const { return _pEvents != NULL; }
+
+    /**
+     * Get the begin time of an event.
+     *
+     * @return current time, 0 if the tracer is disabled.
+     */
+    nsecs_t begin() const { return isEnabled() ? systemTime() : 0; }
+
+    /**
+     * Records an event ending now.
+     *
+     * @param[in] pcCategory category of the event: stage, route or pfw.
+     * @param[in] pcName name of the event.
+     * @param[in] beginTime time returned by begin() at the beginning of the event.
+     * @param[in] pcRoute name of the route the event applies to, NULL if none.
+     * @param[in] iDirection direction of the route, -1 if none.
+     */
+    void record(const char *pcCategory, const char *pcName, nsecs_t beginTime,
+                const char *pcRoute = NULL, int iDirection = -1);
+
+    /**
+     * Appends the events recorded to a string, in Chrome trace-event JSON format.
+     * Events recorded while exporting may be missing, events overwritten while exported are
+     * skipped.
+     *
+     * @param[out] result string to append to.
+     */
+    void exportJson(android::String8 &result) const;
+
+    /**
+     * Records an event for the duration of a scope.
+     */
+    class CScope
+    {
+    public:
+        CScope(CAudioRoutingTracer &tracer, const char *pcCategory, const char *pcName,
+               const char *pcRoute = NULL, int iDirection = -1)
+            : _tracer(tracer),
+              _pcCategory(pcCategory),
+              _pcName(pcName),
+              _pcRoute(pcRoute),
+              _iDirection(iDirection),
+              _beginTime(tracer.begin())
+        {
+        }
+
+        ~CScope()
+        {
+            _tracer.record(_pcCategory, _pcName, _beginTime, _pcRoute, _iDirection);
+        }
+
+    private:
+        CScope(const CScope &);
+        CScope &operator=(const CScope &);
+
+        CAudioRoutingTracer &_tracer;
+        const char *_pcCategory;
+        const char *_pcName;
+        const char *_pcRoute;
+        int _iDirection;
+        nsecs_t _beginTime;
+    };
+
+private:
+    CAudioRoutingTracer(const CAudioRoutingTracer &);
+    CAudioRoutingTracer &operator=(const CAudioRoutingTracer &);
+
+    struct SEvent
+    {
+        /** Index of the event + 1 once recorded, 0 while being recorded. */
+        volatile int32_t iSequence;
+        const char *pcCategory;
+        const char *pcName;
+        const char *pcRoute;
+        int iDirection;
+        pid_t tid;
+        nsecs_t beginTime;
+        nsecs_t endTime;
+    };
+
+    SEvent *_pEvents;
+    uint32_t _uiMask; /**< number of events - 1. */
+
+    /** Index of the next event to record, free running. */
+    volatile int32_t _iWriteIndex;
+
+    pid_t _pid;
+};
+
+};        // namespace android
@@ -0,0 +1,184 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "RouteManager/RoutingWorkers"
+
+#include "AudioRoutingWorkers.h"
+#include "AudioRoute.h"
+#include "AudioRoutingTracer.h"
+#include <utils/Log.h>
+
+using android::status_t;
+using android::Mutex;
+using android::sp;
+using android::OK;
+
+namespace android_audio_legacy
+{
+
+CAudioRoutingWorkers::CAudioRoutingWorkers(uint32_t uiNbWorkers, CAudioRoutingTracer *pTracer)
+    : _uiNbJobs(0),
+      _uiNextJob(0),
+      _uiPendingJobs(0),
+      _bExiting(false),
+      _pTracer(pTracer)
+{
+    for (uint32_t uiWorker = 0; uiWorker < uiNbWorkers; uiWorker++) {
+
+        sp<CWorker> worker = new CWorker(this);
+        if (worker->run("RoutingWorker", android::PRIORITY_AUDIO) != OK) {
+
+            ALOGE("%s: could not start worker %d", __FUNCTION__, uiWorker);
+            break;
+        }
+        _workers.push_back(worker);
+    }
+    ALOGD("%s: %zu workers", __FUNCTION__, _workers.size());
+}
+
+CAudioRoutingWorkers::~CAudioRoutingWorkers()
+{
+    {
+        Mutex::Autolock lock(_lock);
+
+        _bExiting = true;
+        _jobsQueued.broadcast();
+    }
+    for (uint32_t uiWorker = 0; uiWorker < _workers.size(); uiWorker++) {
+
+        _workers[uiWorker]->requestExitAndWait();
+    }
+}
+
+void CAudioRoutingWorkers::queueOpen(CAudioRoute *pRoute, bool bIsOut, bool bIsPreEnable)
+{
+    SJob stJob = { pRoute, bIsOut, true, bIsPreEnable };
+    _jobs.push_back(stJob);
+}
+
+void CAudioRoutingWorkers::queueClose(CAudioRoute *pRoute, bool bIsOut, bool bIsPostDisable)
+{
+    SJob stJob = { pRoute, bIsOut, false, bIsPostDisable };
+    _jobs.push_back(stJob);
+}
+
+uint32_t CAudioRoutingWorkers::run()
+{
+    uint32_t uiNbJobs = _jobs.size();
+
+    if (uiNbJobs == 0) {
+
+        return 0;
+    }
+    if (_workers.empty() || (uiNbJobs == 1)) {
+
+        // Nothing to share
+        for (uint32_t uiJob = 0; uiJob < uiNbJobs; uiJob++) {
+
+            runJob(_jobs[uiJob]);
+        }
+        _jobs.clear();
+        return uiNbJobs;
+    }
+
+    Mutex::Autolock lock(_lock);
+
+    _uiNbJobs = uiNbJobs;
+    _uiNextJob = 0;
+    _uiPendingJobs = uiNbJobs;
+    _jobsQueued.broadcast();
+
+    // Take part in the work, then wait for the jobs still run by the workers
+    SJob stJob;
+    while (takeJobL(stJob)) {
+
+        _lock.unlock();
+        runJob(stJob);
+        _lock.lock();
+        completeJobL();
+    }
+    while (_uiPendingJobs != 0) {
+
+        _jobsDone.wait(_lock);
+    }
+    _uiNbJobs = 0;
+    _uiNextJob = 0;
+    _jobs.clear();
+
+    return uiNbJobs;
+}
+
+bool CAudioRoutingWorkers::CWorker::threadLoop()
+{
+    return _pWorkers->waitAndRunJob();
+}
+
+bool CAudioRoutingWorkers::waitAndRunJob()
+{
+    Mutex::Autolock lock(_lock);
+
+    SJob stJob;
+    while (!takeJobL(stJob)) {
+
+        if (_bExiting) {
+
+            return false;
+        }
+        _jobsQueued.wait(_lock);
+    }
+    _lock.unlock();
+    runJob(stJob);
+    _lock.lock();
+    completeJobL();
+
+    return !_bExiting;
+}
+
+bool CAudioRoutingWorkers::takeJobL(SJob &stJob)
+{
+    if (_uiNextJob >= _uiNbJobs) {
+
+        return false;
+    }
+    stJob = _jobs[_uiNextJob++];
+    return true;
+}
+
+void CAudioRoutingWorkers::runJob(const SJob &stJob)
+{
+    CAudioRoutingTracer::CScope trace(*_pTracer, "route",
+                                      stJob.bIsOpen ? "openDevices" : "closeDevices",
+                                      stJob.pRoute->getName().c_str(), stJob.bIsOut);
+    if (stJob.bIsOpen) {
+
+        status_t err = stJob.pRoute->openDevices(stJob.bIsOut, stJob.bIsPrePhase);
+        ALOGE_IF(err != OK, "%s: could not open devices of route %s (err=%d)", __FUNCTION__,
+                 stJob.pRoute->getName().c_str(), err);
+    } else {
+
+        stJob.pRoute->closeDevices(stJob.bIsOut, stJob.bIsPrePhase);
+    }
+}
+
+void CAudioRoutingWorkers::completeJobL()
+{
+    if (--_uiPendingJobs == 0) {
+
+        _jobsDone.signal();
+    }
+}
+
+}       // namespace android
@@ -0,0 +1,151 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <utils/threads.h>
+#include <stdint.h>
+#include <vector>
+
+namespace android_audio_legacy
+{
+
+class CAudioRoute;
+class CAudioRoutingTracer;
+
+/**
+ * Opens and closes the devices of the routes concurrently during a routing stage.
+ *
+ * Opening or closing a pcm device blocks in the driver, mostly on DSP firmware messages, and
+ * the devices of distinct routes do not depend on each other. The route manager queues the
+ * devices to open or close in a stage, then runs the queue: the jobs are shared between the
+ * workers and the calling thread, which returns once all of them are done. Hence the next step
+ * of the routing still sees all the devices opened or closed, as it did when running in sequence.
+ * Without worker, the calling thread runs all the jobs.
+ * Queuing and running must be done from a single thread, the routing thread.
+ */
+class CAudioRoutingWorkers
+{
+public:
+    /**
+     * Starts the workers.
+     *
+     * @param[in] uiNbWorkers number of worker threads, 0 to run all jobs in the calling thread.
+     * @param[in] pTracer tracer recording the jobs.
+     */
+    CAudioRoutingWorkers(uint32_t uiNbWorkers, CAudioRoutingTracer *pTracer);
+    ~CAudioRoutingWorkers();
+
+    /**
+     * Queues the opening of the devices of a route.
+     *
+     * @param[in] pRoute route to open.
+     * @param[in] bIsOut direction of the route.
+     * @param[in] bIsPreEnable true if opening before the path is enabled.
+     */
+    void queueOpen(CAudioRoute *pRoute, bool bIsOut, bool bIsPreEnable);
+
+    /**
+     * Queues the closing of the devices of a route.
+     *
+     * @param[in] pRoute route to close.
+     * @param[in] bIsOut direction of the route.
+     * @param[in] bIsPostDisable true if closing after the path is disabled.
+     */
+    void queueClose(CAudioRoute *pRoute, bool bIsOut, bool bIsPostDisable);
+
+    /**
+     * Runs the queued jobs and empties the queue. Returns once all the jobs are done.
+     *
+     * @return number of jobs run.
+     */
+    uint32_t run();
+
+private:
+    CAudioRoutingWorkers(const CAudioRoutingWorkers &);
+    CAudioRoutingWorkers &operator=(const CAudioRoutingWorkers &);
+
+    /**
+     * Worker thread: runs jobs until asked to exit.
+     */
+    class CWorker : public android::Thread
+    {
+    public:
+        CWorker(CAudioRoutingWorkers *pWorkers)
+            : android::Thread(false),
+              _pWorkers(pWorkers)
+        {
+        }
+
+    private:
+        virtual bool threadLoop();
+
+        CAudioRoutingWorkers *_pWorkers;
+    };
+
+    struct SJob
+    {
+        CAudioRoute *pRoute;
+        bool bIsOut;
+        bool bIsOpen;
+        bool bIsPrePhase; /**< pre enable for opening, post disable for closing. */
+    };
+
+    /**
+     * Waits for a job and runs it. Called by the workers.
+     *
+     * @return false if the worker must exit.
+     */
+    bool waitAndRunJob();
+
+    /**
+     * Takes the next job of the queue. Must be called with the lock held.
+     *
+     * @param[out] stJob job taken.
+     *
+     * @return false if there is no job left.
+     */
+    bool takeJobL(SJob &stJob);
+
+    /**
+     * Runs a job, without the lock.
+     *
+     * @param[in] stJob job to run.
+     */
+    void runJob(const SJob &stJob);
+
+    /**
+     * Signals a job done. Must be called with the lock held.
+     */
+    void completeJobL();
+
+    /** Jobs queued, only read by the workers while running. */
+    std::vector<SJob> _jobs;
+    uint32_t _uiNbJobs; /**< jobs to run, 0 while not running. */
+    uint32_t _uiNextJob; /**< index of the next job to take. */
+    uint32_t _uiPendingJobs; /**< jobs not done yet. */
+    bool _bExiting;
+
+    CAudioRoutingTracer *_pTracer;
+
+    std::vector<android::sp<CWorker> > _workers;
+
+    android::Mutex _lock;
+    android::Condition _jobsQueued;
+    android::Condition _jobsDone;
+};
+
+};        // namespace android
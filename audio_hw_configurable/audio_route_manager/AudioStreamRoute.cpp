@@ -20,8 +20,10 @@
 #include "AudioStreamRoute.h"
 #include "AudioUtils.h"
 #include "ALSAStreamOps.h"
+#include "Property.h"
 #include <tinyalsa/asoundlib.h>
 #include <utils/Log.h>
+#include <utils/Timers.h>
 #include <algorithm>
 
 #define base    CAudioRoute
@@ -29,17 +31,27 @@
 namespace android_audio_legacy
 {
 
+const char* const CAudioStreamRoute::PLAYBACK_MIXING_PROP_NAME = "audiocomms.HAL.PlaybackMixing";
+
 CAudioStreamRoute::CAudioStreamRoute(uint32_t uiRouteIndex,
                                      CAudioPlatformState *platformState) :
     CAudioRoute(uiRouteIndex, platformState),
     _pEffectSupported(0),
-    _pcCardName(CAudioPlatformHardware::getRouteCardName(uiRouteIndex))
+    _pcCardName(CAudioPlatformHardware::getRouteCardName(uiRouteIndex)),
+    _bPlaybackMixingSupported(false),
+    _stPowerSavingPcmConfig(CAudioPlatformHardware::getDefaultPcmConfig(
+                                CUtils::EOutput, AUDIO_OUTPUT_FLAG_DEEP_BUFFER)),
+    _bPowerSavingConfigSupported(false),
+    _bPowerSavingConfigInUse(false),
+    _bPowerSavingConfigRequested(false),
+    _pPcmPool(NULL)
 {
     for (int iDir = 0; iDir < CUtils::ENbDirections; iDir++) {
 
        _stStreams[iDir].pCurrent = NULL;
        _stStreams[iDir].pNew = NULL;
        _astPcmDevice[iDir] = NULL;
+       _aiPcmCardIndex[iDir] = -1;
        _aiPcmDeviceId[iDir] = CAudioPlatformHardware::getRouteDeviceId(uiRouteIndex, iDir);
        _astPcmConfig[iDir] = CAudioPlatformHardware::getRoutePcmConfig(uiRouteIndex, iDir);
 
@@ -49,6 +61,17 @@ CAudioStreamRoute::CAudioStreamRoute(uint32_t uiRouteIndex,
        _routeSampleSpec[iDir].setChannelCount(_astPcmConfig[iDir].channels);
        _routeSampleSpec[iDir].setChannelsPolicy(CAudioPlatformHardware::getChannelsPolicy(uiRouteIndex, iDir));
     }
+
+    const pcm_config &stOutConfig = _astPcmConfig[CUtils::EOutput];
+    _bPowerSavingConfigSupported =
+            (_applicabilityRules[CUtils::EOutput].uiMask & AUDIO_OUTPUT_FLAG_PRIMARY) &&
+            (_stPowerSavingPcmConfig.period_size > stOutConfig.period_size) &&
+            (_stPowerSavingPcmConfig.rate == stOutConfig.rate) &&
+            (_stPowerSavingPcmConfig.channels == stOutConfig.channels) &&
+            (_stPowerSavingPcmConfig.format == stOutConfig.format);
+
+    _bPlaybackMixingSupported = TProperty<bool>(PLAYBACK_MIXING_PROP_NAME, false) &&
+            CAudioPlaybackMixer::isMixable(stOutConfig);
 }
 
 //
@@ -65,22 +88,48 @@ bool CAudioStreamRoute::needReconfiguration(bool bIsOut) const
     if (base::needReconfiguration(bIsOut) &&
              (needRerouting(bIsOut) ||
              (_stStreams[bIsOut].pCurrent != _stStreams[bIsOut].pNew) ||
+             (_sharedStreams[bIsOut].currentList != _sharedStreams[bIsOut].newList) ||
              (_stStreams[bIsOut].pCurrent->getCurrentDevices() != _stStreams[bIsOut].pNew->getNewDevices()))) {
         return true;
     }
     return false;
 }
 
-status_t CAudioStreamRoute::route(bool isOut, bool isPreEnable)
+void CAudioStreamRoute::checkAndSetNeedRerouting(bool bIsOut)
 {
-    if (isPreEnable == isPreEnableRequired()) {
+    // A new stream opens the device again with the configuration required at that time
+    if (!base::needReconfiguration(bIsOut) ||
+            (_stStreams[bIsOut].pCurrent != _stStreams[bIsOut].pNew)) {
 
-        status_t err = openPcmDevice(isOut);
-        if (err != NO_ERROR) {
+        return;
+    }
+    bool bRequested = isPowerSavingConfigRequired(bIsOut);
+    if (bRequested == _bPowerSavingConfigRequested) {
 
-            // Failed to open PCM device -> bailing out
-            return err;
-        }
+        return;
+    }
+    _bPowerSavingConfigRequested = bRequested;
+
+    // Period size is only set on open: the device keeps playing with the one in use rather than
+    // being drained and opened again, and is opened with the new one after standby or rerouting
+    const pcm_config &stNewConfig = bRequested ? _stPowerSavingPcmConfig : _astPcmConfig[bIsOut];
+    ALOGI("%s: %s, screen %s: period size %d -> %d frames, %d -> %d wakeups/s on next opening",
+          __FUNCTION__,
+          getName().c_str(),
+          bRequested ? "off" : "on",
+          getPcmConfig(bIsOut).period_size,
+          stNewConfig.period_size,
+          getWakeupsPerSec(getPcmConfig(bIsOut)),
+          getWakeupsPerSec(stNewConfig));
+}
+
+status_t CAudioStreamRoute::route(bool isOut, bool isPreEnable)
+{
+    if ((isPreEnable == isPreEnableRequired()) && (_astPcmDevice[isOut] == NULL)) {
+
+        // Failed to open PCM device -> bailing out
+        ALOGE("%s: audio device not opened, cannot route the stream", __FUNCTION__);
+        return NO_INIT;
     }
     if (!isPreEnable) {
 
@@ -100,6 +149,7 @@ status_t CAudioStreamRoute::route(bool isOut, bool isPreEnable)
             // Failed to attach the stream -> bailing out
             return err;
         }
+        attachSharedStreams(isOut, false);
     }
     CAudioRoute::route(isOut, isPreEnable);
     return OK;
@@ -115,16 +165,34 @@ void CAudioStreamRoute::unroute(bool isOut, bool isPostDisable)
          * need to garantee that the stream will not access to the device before unrouting.
          */
         detachCurrentStream(isOut);
+        detachSharedStreams(isOut, false);
+    }
+    CAudioRoute::unroute(isOut, isPostDisable);
+}
+
+status_t CAudioStreamRoute::openDevices(bool isOut, bool isPreEnable)
+{
+    if (isPreEnable != isPreEnableRequired()) {
+
+        return OK;
     }
+    return openPcmDevice(isOut);
+}
+
+void CAudioStreamRoute::closeDevices(bool isOut, bool isPostDisable)
+{
     if (isPostDisable == isPostDisableRequired()) {
 
         closePcmDevice(isOut);
     }
-    CAudioRoute::unroute(isOut, isPostDisable);
 }
 
 void CAudioStreamRoute::configure(bool bIsOut)
 {
+    // First release the shared streams leaving the route, one of them may become
+    // the main stream of the route.
+    detachSharedStreams(bIsOut, true);
+
     // Same stream is attached to this route, consumme the new device
     if (_stStreams[bIsOut].pCurrent == _stStreams[bIsOut].pNew) {
 
@@ -139,6 +207,8 @@ void CAudioStreamRoute::configure(bool bIsOut)
         // route new stream
         attachNewStream(bIsOut);
     }
+
+    attachSharedStreams(bIsOut, true);
 }
 
 void CAudioStreamRoute::resetAvailability()
@@ -151,6 +221,17 @@ void CAudioStreamRoute::resetAvailability()
             _stStreams[iDir].pNew = NULL;
         }
     }
+    for (int iDir = 0; iDir < CUtils::ENbDirections; iDir++) {
+
+        std::list<ALSAStreamOps*>::iterator it;
+        for (it = _sharedStreams[iDir].newList.begin(); it != _sharedStreams[iDir].newList.end();
+             ++it) {
+
+            (*it)->resetRoute();
+        }
+        _sharedStreams[iDir].newList.clear();
+    }
+
     base::resetAvailability();
 }
 
@@ -168,6 +249,59 @@ status_t CAudioStreamRoute::setStream(ALSAStreamOps* pStream)
     return NO_ERROR;
 }
 
+bool CAudioStreamRoute::isSharable(uint32_t uiMask, bool bIsOut) const
+{
+    return (!bIsOut || _bPlaybackMixingSupported) &&
+            (_stStreams[bIsOut].pNew != NULL) &&
+            (uiMask & _applicabilityRules[bIsOut].uiMask);
+}
+
+void CAudioStreamRoute::addSharedStream(ALSAStreamOps* pStream)
+{
+    bool bIsOut = pStream->isOut();
+    ALOGD("%s: %s stream %p shares %s route", __FUNCTION__, bIsOut ? "output" : "input", pStream,
+          getName().c_str());
+
+    _sharedStreams[bIsOut].newList.push_back(pStream);
+
+    pStream->setNewRoute(this);
+}
+
+int CAudioStreamRoute::readCapture(const ALSAStreamOps* pStream, void* pBuffer, uint32_t uiFrames,
+                                   uint32_t* puiFramesLost)
+{
+    return _captureFanOut.read(pStream, pBuffer, uiFrames, puiFramesLost);
+}
+
+int CAudioStreamRoute::writePlayback(const ALSAStreamOps* pStream, const void* pBuffer,
+                                     uint32_t uiFrames)
+{
+    if (!_bPlaybackMixingSupported) {
+
+        pcm* pPcmDevice = getPcmDevice(CUtils::EOutput);
+        return pcm_write(pPcmDevice, pBuffer, pcm_frames_to_bytes(pPcmDevice, uiFrames));
+    }
+    return _playbackMixer.write(pStream, pBuffer, uiFrames);
+}
+
+int CAudioStreamRoute::flushPlayback(const ALSAStreamOps* pStream)
+{
+    if (!_bPlaybackMixingSupported) {
+
+        return pcm_stop(getPcmDevice(CUtils::EOutput));
+    }
+    return _playbackMixer.flush(pStream);
+}
+
+void CAudioStreamRoute::setPlaybackGain(const ALSAStreamOps* pStream, float fLeftGain,
+                                        float fRightGain)
+{
+    if (_bPlaybackMixingSupported) {
+
+        _playbackMixer.setClientGain(pStream, fLeftGain, fRightGain);
+    }
+}
+
 bool CAudioStreamRoute::isApplicable(uint32_t uiDevices, int iMode, bool bIsOut, uint32_t uiMask) const
 {
     ALOGV("%s: is Route %s applicable? ",__FUNCTION__, getName().c_str());
@@ -207,7 +341,30 @@ pcm* CAudioStreamRoute::getPcmDevice(bool bIsOut) const
 
 const pcm_config& CAudioStreamRoute::getPcmConfig(bool bIsOut) const
 {
-    return _astPcmConfig[bIsOut];
+    return (bIsOut && _bPowerSavingConfigInUse) ? _stPowerSavingPcmConfig : _astPcmConfig[bIsOut];
+}
+
+bool CAudioStreamRoute::isPowerSavingConfigRequired(bool bIsOut) const
+{
+    return bIsOut && _bPowerSavingConfigSupported && !_pPlatformState->isScreenOn();
+}
+
+uint32_t CAudioStreamRoute::getMaxPeriodUs(bool bIsOut, uint32_t uiMask) const
+{
+    if ((uiMask & _applicabilityRules[bIsOut].uiMask) == 0) {
+
+        return 0;
+    }
+    // Power saving periods are the longest when supported
+    const pcm_config &config = (bIsOut && _bPowerSavingConfigSupported) ?
+                _stPowerSavingPcmConfig : _astPcmConfig[bIsOut];
+
+    return config.rate ? (static_cast<uint64_t>(config.period_size) * 1000000) / config.rate : 0;
+}
+
+uint32_t CAudioStreamRoute::getWakeupsPerSec(const pcm_config &config)
+{
+    return config.period_size ? config.rate / config.period_size : 0;
 }
 
 const char* CAudioStreamRoute::getCardName() const
@@ -215,11 +372,16 @@ const char* CAudioStreamRoute::getCardName() const
     return _pcCardName;
 }
 
+bool CAudioStreamRoute::isCardAvailable() const
+{
+    return AudioUtils::getCardIndexByName(getCardName()) >= 0;
+}
+
 status_t CAudioStreamRoute::attachNewStream(bool bIsOut)
 {
     LOG_ALWAYS_FATAL_IF(_stStreams[bIsOut].pNew == NULL);
 
-    status_t err = _stStreams[bIsOut].pNew->attachRoute();
+    status_t err = attachStream(_stStreams[bIsOut].pNew, false);
 
     if (err != NO_ERROR) {
 
@@ -235,10 +397,95 @@ void CAudioStreamRoute::detachCurrentStream(bool bIsOut)
 {
     LOG_ALWAYS_FATAL_IF(_stStreams[bIsOut].pCurrent == NULL);
 
-    _stStreams[bIsOut].pCurrent->detachRoute();
+    detachStream(_stStreams[bIsOut].pCurrent);
     _stStreams[bIsOut].pCurrent = NULL;
 }
 
+status_t CAudioStreamRoute::attachStream(ALSAStreamOps* pStream, bool bIsShared)
+{
+    // Stream must be known by the fan out / the mixer before its first read / write
+    if (!pStream->isOut()) {
+
+        _captureFanOut.addClient(pStream);
+    } else if (_bPlaybackMixingSupported) {
+
+        status_t err = _playbackMixer.addClient(pStream, !bIsShared);
+        if (err != NO_ERROR) {
+
+            return err;
+        }
+    }
+    status_t err = pStream->attachRoute();
+    if (err != NO_ERROR) {
+
+        if (!pStream->isOut()) {
+
+            _captureFanOut.removeClient(pStream);
+        } else if (_bPlaybackMixingSupported) {
+
+            _playbackMixer.removeClient(pStream);
+        }
+    }
+    return err;
+}
+
+void CAudioStreamRoute::detachStream(ALSAStreamOps* pStream)
+{
+    // Once detached, the stream does not read / write anymore
+    pStream->detachRoute();
+    if (!pStream->isOut()) {
+
+        _captureFanOut.removeClient(pStream);
+    } else if (_bPlaybackMixingSupported) {
+
+        _playbackMixer.removeClient(pStream);
+    }
+}
+
+void CAudioStreamRoute::detachSharedStreams(bool bIsOut, bool bRemovedOnly)
+{
+    std::list<ALSAStreamOps*> &currentList = _sharedStreams[bIsOut].currentList;
+    const std::list<ALSAStreamOps*> &newList = _sharedStreams[bIsOut].newList;
+
+    std::list<ALSAStreamOps*>::iterator it = currentList.begin();
+    while (it != currentList.end()) {
+
+        ALSAStreamOps* pStream = *it;
+        if (bRemovedOnly && (std::find(newList.begin(), newList.end(), pStream) != newList.end())) {
+
+            ++it;
+            continue;
+        }
+        detachStream(pStream);
+        it = currentList.erase(it);
+    }
+}
+
+void CAudioStreamRoute::attachSharedStreams(bool bIsOut, bool bAddedOnly)
+{
+    std::list<ALSAStreamOps*> &currentList = _sharedStreams[bIsOut].currentList;
+    const std::list<ALSAStreamOps*> &newList = _sharedStreams[bIsOut].newList;
+
+    std::list<ALSAStreamOps*>::const_iterator it;
+    for (it = newList.begin(); it != newList.end(); ++it) {
+
+        ALSAStreamOps* pStream = *it;
+        if (bAddedOnly && (std::find(currentList.begin(), currentList.end(),
+                                     pStream) != currentList.end())) {
+
+            // Already sharing the route, consume the new device(s)
+            pStream->setCurrentDevices(pStream->getNewDevices());
+            continue;
+        }
+        if (attachStream(pStream, true) != NO_ERROR) {
+
+            ALOGE("%s: could not attach shared stream %p", __FUNCTION__, pStream);
+            continue;
+        }
+        currentList.push_back(pStream);
+    }
+}
+
 bool CAudioStreamRoute::isEffectSupported(const effect_uuid_t* uuid) const
 {
     std::list<const effect_uuid_t*>::const_iterator it;
@@ -252,6 +499,11 @@ status_t CAudioStreamRoute::openPcmDevice(bool bIsOut)
 {
     LOG_ALWAYS_FATAL_IF(_astPcmDevice[bIsOut] != NULL);
 
+    if (bIsOut) {
+
+        _bPowerSavingConfigInUse = isPowerSavingConfigRequired(bIsOut);
+        _bPowerSavingConfigRequested = _bPowerSavingConfigInUse;
+    }
     pcm_config config = getPcmConfig(bIsOut);
     ALOGD("%s called for card (%s,%d)",
                                 __FUNCTION__,
@@ -262,25 +514,43 @@ status_t CAudioStreamRoute::openPcmDevice(bool bIsOut)
                                 config.rate,
                                 config.format,
                                 config.channels);
-    ALOGD("%s\t\t period_size=%d, period_count=%d",
+    ALOGD("%s\t\t period_size=%d, period_count=%d (%d wakeups/s%s)",
                                 __FUNCTION__,
                                 config.period_size,
-                                config.period_count);
+                                config.period_count,
+                                getWakeupsPerSec(config),
+                                _bPowerSavingConfigInUse ? ", power saving" : "");
     ALOGD("%s\t\t startTh=%d, stop Th=%d silence Th=%d",
                                 __FUNCTION__,
                                 config.start_threshold,
                                 config.stop_threshold,
                                 config.silence_threshold);
 
+    _aiPcmCardIndex[bIsOut] = AudioUtils::getCardIndexByName(getCardName());
+    nsecs_t startTime = systemTime();
+    bool bIsWarm = false;
+
+    // Device closed recently with the same configuration may still be opened
+    if (_pPcmPool != NULL) {
+
+        _astPcmDevice[bIsOut] = _pPcmPool->acquire(_aiPcmCardIndex[bIsOut],
+                                                   getPcmDeviceId(bIsOut), bIsOut, config);
+        bIsWarm = (_astPcmDevice[bIsOut] != NULL);
+        ALOGD_IF(bIsWarm, "%s\t\t warm handle reused", __FUNCTION__);
+    }
+
     //
     // Opens the device in BLOCKING mode (default)
     // No need to check for NULL handle, tiny alsa
     // guarantee to return a pcm structure, even when failing to open
     // it will return a reference on a "bad pcm" structure
     //
-    uint32_t uiFlags= (bIsOut ? PCM_OUT : PCM_IN);
-    _astPcmDevice[bIsOut] = pcm_open(AudioUtils::getCardIndexByName(getCardName()),
-                                     getPcmDeviceId(bIsOut), uiFlags, &config);
+    if (!bIsWarm) {
+
+        uint32_t uiFlags= (bIsOut ? PCM_OUT : PCM_IN);
+        _astPcmDevice[bIsOut] = pcm_open(_aiPcmCardIndex[bIsOut],
+                                         getPcmDeviceId(bIsOut), uiFlags, &config);
+    }
     if (_astPcmDevice[bIsOut] && !pcm_is_ready(_astPcmDevice[bIsOut])) {
 
         ALOGE("%s: Cannot open tinyalsa (%s,%d) device for %s stream (error=%s)", __FUNCTION__,
@@ -299,6 +569,24 @@ status_t CAudioStreamRoute::openPcmDevice(bool bIsOut)
         goto close_device;
     }
 
+    // Input device is read through the fan out, which may be shared by several streams
+    if (!bIsOut && (_captureFanOut.open(_astPcmDevice[bIsOut], config.period_size) != NO_ERROR)) {
+
+        goto close_device;
+    }
+
+    // Output device is written through the mixer, which may be shared by several streams
+    if (bIsOut && _bPlaybackMixingSupported &&
+            (_playbackMixer.open(_astPcmDevice[bIsOut], config) != NO_ERROR)) {
+
+        goto close_device;
+    }
+
+    if (_pPcmPool != NULL) {
+
+        _pPcmPool->recordOpenTime(bIsWarm, systemTime() - startTime);
+    }
+
     ALOGW_IF((getPcmConfig(bIsOut).period_count * getPcmConfig(bIsOut).period_size) !=
             (pcm_get_buffer_size(_astPcmDevice[bIsOut])),
              "%s, refine done by alsa, ALSA RingBuffer = %d (frames), "
@@ -323,7 +611,22 @@ void CAudioStreamRoute::closePcmDevice(bool bIsOut)
                                 __FUNCTION__,
                                 getCardName(),
                                 getPcmDeviceId(bIsOut));
-    pcm_close(_astPcmDevice[bIsOut]);
+    if (!bIsOut) {
+
+        _captureFanOut.close();
+    } else if (_bPlaybackMixingSupported) {
+
+        _playbackMixer.close();
+    }
+    // Route requiring rerouting must really close its device, otherwise keep it warm
+    if ((_pPcmPool != NULL) && !needRerouting(bIsOut)) {
+
+        _pPcmPool->release(_aiPcmCardIndex[bIsOut], getPcmDeviceId(bIsOut), bIsOut,
+                           getPcmConfig(bIsOut), _astPcmDevice[bIsOut]);
+    } else {
+
+        pcm_close(_astPcmDevice[bIsOut]);
+    }
     _astPcmDevice[bIsOut] = NULL;
 }
 
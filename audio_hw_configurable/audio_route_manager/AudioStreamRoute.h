@@ -19,6 +19,9 @@
 #include <tinyalsa/asoundlib.h>
 
 #include "AudioRoute.h"
+#include "AudioCaptureFanOut.h"
+#include "AudioPlaybackMixer.h"
+#include "AudioPcmPool.h"
 #include "SampleSpec.h"
 
 #include <list>
@@ -43,6 +46,78 @@ public:
     // Assign a new stream to this route
     status_t setStream(ALSAStreamOps* pStream);
 
+    /**
+     * Checks if a stream that did not find any route can share this route.
+     * The route must be used by another stream of the same direction and be applicable to the
+     * stream. Output routes can only be shared if they support mixing.
+     *
+     * @param[in] uiMask applicability mask of the stream, i.e. its input source or output flags.
+     * @param[in] bIsOut direction of the stream.
+     *
+     * @return true if the stream can be added as a shared stream.
+     */
+    bool isSharable(uint32_t uiMask, bool bIsOut) const;
+
+    /**
+     * Assigns an additional stream to this route.
+     * An input stream receives the frames read by the route for the stream set with setStream(),
+     * an output stream is mixed with the stream set with setStream().
+     *
+     * @param[in] pStream stream to share the route with.
+     */
+    void addSharedStream(ALSAStreamOps* pStream);
+
+    /**
+     * Checks if several streams are currently attached to the route.
+     *
+     * @param[in] bIsOut direction of the streams.
+     *
+     * @return true if the route is shared, false otherwise.
+     */
+    bool isShared(bool bIsOut) const { return !_sharedStreams[bIsOut].currentList.empty(); }
+
+    /**
+     * Reads captured frames on behalf of one of the input streams attached to this route.
+     *
+     * @param[in] pStream input stream reading.
+     * @param[out] pBuffer destination of the frames, in route sample specification.
+     * @param[in] uiFrames number of frames to read.
+     * @param[out] puiFramesLost frames lost by this stream since its previous read.
+     *
+     * @return 0 if success, pcm_read error code otherwise.
+     */
+    int readCapture(const ALSAStreamOps* pStream, void* pBuffer, uint32_t uiFrames,
+                    uint32_t* puiFramesLost);
+
+    /**
+     * Writes frames on behalf of one of the output streams attached to this route.
+     *
+     * @param[in] pStream output stream writing.
+     * @param[in] pBuffer frames to play, in route sample specification.
+     * @param[in] uiFrames number of frames to write.
+     *
+     * @return 0 if success, pcm_write error code otherwise.
+     */
+    int writePlayback(const ALSAStreamOps* pStream, const void* pBuffer, uint32_t uiFrames);
+
+    /**
+     * Drops the frames written by one of the output streams attached to this route.
+     *
+     * @param[in] pStream output stream flushing.
+     *
+     * @return 0 if success, pcm_stop error code otherwise.
+     */
+    int flushPlayback(const ALSAStreamOps* pStream);
+
+    /**
+     * Sets the gains applied by the mixer to one of the output streams attached to this route.
+     *
+     * @param[in] pStream output stream.
+     * @param[in] fLeftGain linear gain of the left channel, from 0 to 1.
+     * @param[in] fRightGain linear gain of the right channel, from 0 to 1.
+     */
+    void setPlaybackGain(const ALSAStreamOps* pStream, float fLeftGain, float fRightGain);
+
     /**
      * Route is called during enable routing stage.
      * It is called twice: before setting the audio path and after setting the audio path
@@ -69,9 +144,23 @@ public:
      */
     virtual void unroute(bool isOut, bool isPostDisable);
 
+    // Inherited from AudioRoute: opens the pcm device in the step it is required
+    virtual status_t openDevices(bool isOut, bool isPreEnable);
+
+    // Inherited from AudioRoute: closes the pcm device in the step it is required
+    virtual void closeDevices(bool isOut, bool isPostDisable);
+
     // Configure order
     virtual void configure(bool bIsOut);
 
+    /**
+     * Sets the pool keeping the devices closed by the route warm. Called by the route manager
+     * when creating the routes.
+     *
+     * @param[in] pPcmPool pool, NULL to close the devices at once.
+     */
+    void setPcmPool(CAudioPcmPool* pPcmPool) { _pPcmPool = pPcmPool; }
+
     // Inherited for AudioRoute - called from RouteManager
     virtual void resetAvailability();
 
@@ -84,11 +173,49 @@ public:
     // Filters the unroute/route
     virtual bool needReconfiguration(bool bIsOut) const;
 
+    /**
+     * Records the output pcm configuration matching the screen state (power saving periods are
+     * used while the screen is off). The route is not rerouted: the device opened keeps its
+     * period size, the one requested is applied on its next opening, after standby or rerouting.
+     *
+     * @param[in] bIsOut direction of the route.
+     */
+    virtual void checkAndSetNeedRerouting(bool bIsOut);
+
+    /**
+     * Get the pcm configuration of the device currently opened.
+     *
+     * @param[in] bIsOut direction of the route.
+     *
+     * @return power saving configuration if in use, configuration of the route otherwise.
+     */
+    const pcm_config& getPcmConfig(bool bIsOut) const;
+
+    bool isPowerSavingConfigInUse(bool bIsOut) const { return bIsOut && _bPowerSavingConfigInUse; }
+
     // Get amount of silence delay upon stream opening
     virtual uint32_t getOutputSilencePrologMs() const { return 0; }
 
     virtual bool isEffectSupported(const effect_uuid_t* uuid) const;
 
+    /**
+     * Checks if the sound card hosting the pcm devices of the route is registered.
+     *
+     * @return true if the card is available, false otherwise.
+     */
+    bool isCardAvailable() const;
+
+    /**
+     * Get the duration of the longest period the route may use for a stream.
+     *
+     * @param[in] bIsOut direction of the stream.
+     * @param[in] uiMask applicability mask of the stream (flags for output, input source
+     *                   for input).
+     *
+     * @return duration in microseconds, 0 if the route is not applicable to the stream.
+     */
+    uint32_t getMaxPeriodUs(bool bIsOut, uint32_t uiMask) const;
+
 protected:
     struct {
 
@@ -96,6 +223,15 @@ protected:
         ALSAStreamOps* pNew;
     } _stStreams[CUtils::ENbDirections];
 
+    /**
+     * Streams sharing the route with the stream attached to this route, per direction.
+     */
+    struct {
+
+        std::list<ALSAStreamOps*> currentList;
+        std::list<ALSAStreamOps*> newList;
+    } _sharedStreams[CUtils::ENbDirections];
+
     std::list<const effect_uuid_t*> _pEffectSupported;
 
 private:
@@ -112,7 +248,24 @@ private:
 
     int getPcmDeviceId(bool bIsOut) const;
 
-    const pcm_config& getPcmConfig(bool bIsOut) const;
+    /**
+     * Checks if the power saving pcm configuration must be used, i.e. if the route supports it
+     * and the screen is off.
+     *
+     * @param[in] bIsOut direction of the route.
+     *
+     * @return true if power saving configuration is required, false otherwise.
+     */
+    bool isPowerSavingConfigRequired(bool bIsOut) const;
+
+    /**
+     * Get the number of period elapsed interrupts per second for a given pcm configuration.
+     *
+     * @param[in] config pcm configuration.
+     *
+     * @return number of wakeups per second.
+     */
+    static uint32_t getWakeupsPerSec(const pcm_config &config);
 
     const char* getCardName() const;
 
@@ -124,14 +277,81 @@ private:
 
     void detachCurrentStream(bool bIsOut);
 
+    /**
+     * Attaches a stream to the route, registering it to the capture fan out for inputs, to the
+     * playback mixer for outputs.
+     *
+     * @param[in] pStream stream to attach.
+     * @param[in] bIsShared true if the stream shares the route, false for the stream owning it.
+     *
+     * @return OK if success, error code otherwise.
+     */
+    android::status_t attachStream(ALSAStreamOps* pStream, bool bIsShared);
+
+    /**
+     * Detaches a stream from the route, unregistering it from the capture fan out for inputs,
+     * from the playback mixer for outputs.
+     *
+     * @param[in] pStream stream to detach.
+     */
+    void detachStream(ALSAStreamOps* pStream);
+
+    /**
+     * Detaches the streams currently sharing the route.
+     *
+     * @param[in] bIsOut direction of the streams.
+     * @param[in] bRemovedOnly if true, only the streams that will not share the route anymore
+     *                         are detached.
+     */
+    void detachSharedStreams(bool bIsOut, bool bRemovedOnly);
+
+    /**
+     * Attaches the streams that will share the route.
+     *
+     * @param[in] bIsOut direction of the streams.
+     * @param[in] bAddedOnly if true, only the streams that newly share the route are attached,
+     *                       the streams already attached consume their new devices.
+     */
+    void attachSharedStreams(bool bIsOut, bool bAddedOnly);
+
     const char* _pcCardName;
     int _aiPcmDeviceId[CUtils::ENbDirections];
     pcm_config _astPcmConfig[CUtils::ENbDirections];
 
     pcm* _astPcmDevice[CUtils::ENbDirections];
+    int _aiPcmCardIndex[CUtils::ENbDirections]; /**< latched when the device is opened. */
+
+    /** Reads the input device on behalf of all input streams attached to the route. */
+    CAudioCaptureFanOut _captureFanOut;
+
+    /** Writes the output device on behalf of all output streams attached to the route. */
+    CAudioPlaybackMixer _playbackMixer;
+
+    /**
+     * Output streams may share the route only if mixing is enabled and the format of the route
+     * can be mixed. Otherwise, the stream owning the route writes the device directly.
+     */
+    bool _bPlaybackMixingSupported;
+
+    /**
+     * Playback configuration with longer periods, used while the screen is off.
+     * Only provided by primary output route, when the deep buffer configuration of the platform
+     * shares the same sample specification, so that the stream conversion chain is kept.
+     */
+    pcm_config _stPowerSavingPcmConfig;
+    bool _bPowerSavingConfigSupported;
+    bool _bPowerSavingConfigInUse; /**< latched when the output device is opened. */
+    /** Matching the screen state, applied on next opening of the output device. */
+    bool _bPowerSavingConfigRequested;
+
+    /** Keeps the devices closed by the route warm, NULL to close them at once. */
+    CAudioPcmPool* _pPcmPool;
 
     SampleSpec _routeSampleSpec[CUtils::ENbDirections];
 
+    /** Property enabling the mixing of several output streams on a stream route. */
+    static const char* const PLAYBACK_MIXING_PROP_NAME;
+
 };
 };        // namespace android
 
@@ -50,6 +50,8 @@ void AudioStreamRouteIaSspWorkaround::checkAndSetNeedRerouting(bool isOut)
     *
     * Outside these conditions, no rerouting can take place.
     */
+    CAudioStreamRoute::checkAndSetNeedRerouting(isOut);
+
     bool needRerouting = CAudioRoute::needReconfiguration(isOut) &&
         _pPlatformState->hasPlatformStateChanged(CAudioPlatformState::EOutputDevicesChange) &&
         (isOut ? (_pPlatformState->getDevices(CUtils::EOutput) &
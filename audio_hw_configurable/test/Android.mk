@@ -0,0 +1,160 @@
+#
+# INTEL CONFIDENTIAL
+# Copyright © 2013 Intel
+# Corporation All Rights Reserved.
+#
+# The source code contained or described herein and all documents related to
+# the source code ("Material") are owned by Intel Corporation or its suppliers
+# or licensors. Title to the Material remains with Intel Corporation or its
+# suppliers and licensors. The Material contains trade secrets and proprietary
+# and confidential information of Intel or its suppliers and licensors. The
+# Material is protected by worldwide copyright and trade secret laws and
+# treaty provisions. No part of the Material may be used, copied, reproduced,
+# modified, published, uploaded, posted, transmitted, distributed, or
+# disclosed in any way without Intel’s prior express written permission.
+#
+# No license under any patent, copyright, trade secret or other intellectual
+# property right is granted to or conferred upon you by disclosure or delivery
+# of the Materials, either expressly, by implication, inducement, estoppel or
+# otherwise. Any license under such intellectual property rights must be
+# express and approved by Intel in writing.
+#
+
+LOCAL_PATH := $(call my-dir)
+
+#######################################################################
+# Host unit tests of the HAL, run on the build server against the fake
+# tinyalsa backend
+
+ifeq ($(audiocomms_test_host),true)
+
+audio_hw_configurable_test_static_lib_host := \
+    libaudio_hw_configurable_static_host \
+    $(audio_hw_configurable_static_lib_host) \
+    $(filter-out libinterface-provider-lib_static_host, \
+        $(audio_hw_configurable_include_dirs_from_static_libraries_host)) \
+    libaudiohalutils_host \
+    libparameter_stub_host \
+    libinterface_provider_stub_host \
+    libutils \
+    libcutils \
+    liblog
+
+audio_hw_configurable_test_ldlibs_host := -lpthread -lrt -ldl
+
+#######################################################################
+# Parameter framework stub, linked instead of libparameter
+
+include $(CLEAR_VARS)
+
+LOCAL_C_INCLUDES := \
+    $(TARGET_OUT_HEADERS)/parameter
+
+LOCAL_SRC_FILES := stubs/ParameterMgrPlatformConnectorStub.cpp
+LOCAL_CFLAGS := $(audio_hw_configurable_cflags)
+
+LOCAL_MODULE := libparameter_stub_host
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+#######################################################################
+# Interface provider stub, linked instead of libinterface-provider-lib
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := stubs/InterfaceProviderStub.cpp
+LOCAL_CFLAGS := $(audio_hw_configurable_cflags)
+# Headers only
+LOCAL_STATIC_LIBRARIES := libinterface-provider-lib_static_host
+
+LOCAL_MODULE := libinterface_provider_stub_host
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+#######################################################################
+# Unit tests
+
+include $(CLEAR_VARS)
+
+LOCAL_C_INCLUDES := \
+    $(audio_hw_configurable_includes_dir_host) \
+    $(LOCAL_PATH)/..
+
+LOCAL_SRC_FILES := \
+    AudioApplicabilityTablesTest.cpp \
+    AudioAsyncStartTest.cpp \
+    AudioCaptureFanOutTest.cpp \
+    AudioDelayedStandbyTest.cpp \
+    AudioEchoReferenceTest.cpp \
+    AudioFastMediaLatencyTest.cpp \
+    AudioIncrementalRoutingTest.cpp \
+    AudioPcmPoolTest.cpp \
+    AudioPlatformDescriptionTest.cpp \
+    AudioPlaybackMixerTest.cpp \
+    AudioPowerSavingPeriodTest.cpp \
+    AudioRouteManagerLockTest.cpp \
+    AudioRouteManagerStartupTest.cpp \
+    AudioRoutingPassesTest.cpp \
+    AudioRoutingReplayTest.cpp \
+    AudioSstRecoveryTest.cpp \
+    AudioVirtualClockTest.cpp \
+    TinyAlsaFakeTest.cpp
+
+# Routing records replayed and platform descriptions, run from the top of the tree
+LOCAL_CFLAGS := $(audio_hw_configurable_cflags) \
+    -DAUDIO_ROUTING_TRACES_DIR=\"$(LOCAL_PATH)/traces\" \
+    -DAUDIO_PLATFORM_DESCRIPTIONS_DIR=\"$(LOCAL_PATH)/descriptions\"
+LOCAL_STATIC_LIBRARIES := \
+    $(audio_hw_configurable_test_static_lib_host) \
+    libgtest_host \
+    libgtest_main_host
+LOCAL_LDLIBS := $(audio_hw_configurable_test_ldlibs_host)
+
+LOCAL_MODULE := audio_hw_configurable_unit_test_host
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+#######################################################################
+# Routing records replay tool
+
+include $(CLEAR_VARS)
+
+LOCAL_C_INCLUDES := \
+    $(audio_hw_configurable_includes_dir_host) \
+    $(LOCAL_PATH)/..
+
+LOCAL_SRC_FILES := AudioRoutingReplay.cpp
+
+LOCAL_CFLAGS := $(audio_hw_configurable_cflags)
+LOCAL_STATIC_LIBRARIES := $(audio_hw_configurable_test_static_lib_host)
+LOCAL_LDLIBS := $(audio_hw_configurable_test_ldlibs_host)
+
+LOCAL_MODULE := audio_routing_replay_host
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+#######################################################################
+# Platform description converter, from the tables of the product platform file
+
+include $(CLEAR_VARS)
+
+LOCAL_C_INCLUDES := \
+    $(audio_hw_configurable_includes_dir_host) \
+    $(LOCAL_PATH)/..
+
+LOCAL_SRC_FILES := AudioPlatformDescriptionExport.cpp
+
+LOCAL_CFLAGS := $(audio_hw_configurable_cflags)
+LOCAL_STATIC_LIBRARIES := $(audio_hw_configurable_test_static_lib_host)
+LOCAL_LDLIBS := $(audio_hw_configurable_test_ldlibs_host)
+
+LOCAL_MODULE := audio_platform_description_host
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+endif #ifeq ($(audiocomms_test_host),true)
@@ -0,0 +1,268 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioApplicabilityTables.h"
+#include "AudioPlatformDescription.h"
+#include "AudioPlatformHardware.h"
+#include "AudioPlatformState.h"
+#include "AudioRoute.h"
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::CAudioApplicabilityTables;
+using android_audio_legacy::CAudioPlatformDescription;
+using android_audio_legacy::CAudioPlatformHardware;
+using android_audio_legacy::CAudioPlatformState;
+using android_audio_legacy::CAudioRoute;
+
+namespace
+{
+
+/** Hardware modes a routing may be requested in. */
+const int NB_MODES = 16;
+const unsigned int NB_BENCHMARK_ROUNDS = 2000;
+const unsigned int NB_BENCHMARK_MEASURES = 5;
+
+/**
+ * Descriptions exported from the tables of each platform file, by the platform description
+ * converter built for the product of the platform, in the descriptions directory of the tests.
+ */
+const char *const PLATFORM_NAMES[] = {
+
+    "baylake",
+    "byt_m_crb",
+    "byt_t_crv2",
+    "byt_t_ffrd8",
+    "ctp7160",
+    "redhookbay",
+    "saltbay"
+};
+
+int64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Route of the platform tables, with the base applicability rules only.
+ */
+class CTestRoute : public CAudioRoute
+{
+public:
+    CTestRoute(uint32_t uiRouteIndex, CAudioPlatformState *pPlatformState)
+        : CAudioRoute(uiRouteIndex, pPlatformState)
+    {
+        resetAvailability();
+    }
+
+    virtual RouteType getRouteType() const { return EExternalRoute; }
+
+    /** Takes the applicability rules of the route in the description of another platform. */
+    void setRules(const CAudioPlatformDescription::SRoute &stRoute)
+    {
+        for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+            _applicabilityRules[uiDir].uiDevices = stRoute.auiApplicableDevices[uiDir];
+            _applicabilityRules[uiDir].uiModes = stRoute.auiApplicableModes[uiDir];
+            _applicabilityRules[uiDir].uiMask = stRoute.auiApplicableMask[uiDir];
+        }
+    }
+};
+
+class AudioApplicabilityTablesTest : public ::testing::Test
+{
+protected:
+    AudioApplicabilityTablesTest() : _platformState(NULL) {}
+
+    virtual void SetUp()
+    {
+        for (uint32_t uiRoute = 0; uiRoute < CAudioPlatformHardware::getNbRoutes(); uiRoute++) {
+
+            _routes.push_back(new CTestRoute(uiRoute, &_platformState));
+            _tables.addRoute(_routes.back());
+        }
+    }
+
+    virtual void TearDown()
+    {
+        clearRoutes();
+    }
+
+    void clearRoutes()
+    {
+        for (size_t i = 0; i < _routes.size(); i++) {
+
+            delete _routes[i];
+        }
+        _routes.clear();
+        _tables = CAudioApplicabilityTables();
+    }
+
+    /** Replaces the routes of the compiled tables by the routes of a platform description. */
+    void setRoutes(const CAudioPlatformDescription::SImage &stImage)
+    {
+        clearRoutes();
+        for (uint32_t uiRoute = 0; uiRoute < stImage.uiNbRoutes; uiRoute++) {
+
+            CTestRoute *pRoute = new CTestRoute(uiRoute, &_platformState);
+            pRoute->setRules(stImage.astRoutes[uiRoute]);
+            _routes.push_back(pRoute);
+            _tables.addRoute(pRoute);
+        }
+    }
+
+    /** Devices a routing may be requested to: each device of the rules, then all of them. */
+    std::vector<uint32_t> getDeviceSets(bool bIsOut) const
+    {
+        std::vector<uint32_t> deviceSets;
+        uint32_t uiAllDevices = 0;
+
+        for (size_t i = 0; i < _routes.size(); i++) {
+
+            uiAllDevices |= _routes[i]->_applicabilityRules[bIsOut].uiDevices;
+        }
+        for (uint32_t uiDevices = uiAllDevices; uiDevices != 0; uiDevices &= uiDevices - 1) {
+
+            deviceSets.push_back(uiDevices & -uiDevices);
+        }
+        deviceSets.push_back(uiAllDevices);
+        return deviceSets;
+    }
+
+    /** Decision of the routes, one by one as the route manager did before the tables. */
+    uint32_t getRoutesOneByOne(bool bIsOut, uint32_t uiDevices, int iMode) const
+    {
+        uint32_t uiRoutes = 0;
+
+        for (size_t i = 0; i < _routes.size(); i++) {
+
+            if (_routes[i]->CAudioRoute::isApplicable(uiDevices, iMode, bIsOut)) {
+
+                uiRoutes |= _routes[i]->getRouteId();
+            }
+        }
+        return uiRoutes;
+    }
+
+    CAudioPlatformState _platformState;
+    std::vector<CAudioRoute *> _routes;
+    CAudioApplicabilityTables _tables;
+};
+
+}
+
+TEST_F(AudioApplicabilityTablesTest, tablesMatchTheRulesOfEachRoute)
+{
+    ASSERT_FALSE(_routes.empty());
+
+    for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+        bool bIsOut = uiDir == CUtils::EOutput;
+        std::vector<uint32_t> deviceSets = getDeviceSets(bIsOut);
+
+        for (size_t i = 0; i < deviceSets.size(); i++) {
+
+            for (int iMode = 0; iMode < NB_MODES; iMode++) {
+
+                ASSERT_EQ(getRoutesOneByOne(bIsOut, deviceSets[i], iMode),
+                          _tables.getRoutes(bIsOut, deviceSets[i], iMode))
+                        << (bIsOut ? "output" : "input") << " devices 0x" << std::hex
+                        << deviceSets[i] << " mode " << std::dec << iMode;
+            }
+        }
+    }
+}
+
+TEST_F(AudioApplicabilityTablesTest, outOfRangeModeMatchesNoRoute)
+{
+    EXPECT_EQ(0u, _tables.getRoutes(true, ~0u, -1));
+    EXPECT_EQ(0u, _tables.getRoutes(true, ~0u,
+                                    CAudioApplicabilityTables::NB_APPLICABILITY_BITS));
+}
+
+/**
+ * Time to find the routes matching the devices and mode of a routing, for every direction,
+ * device and mode, through the tables and asking the routes one by one, with the routes of
+ * each platform.
+ */
+TEST_F(AudioApplicabilityTablesTest, benchmarkDecisionTime)
+{
+    for (size_t uiPlatform = 0; uiPlatform < sizeof(PLATFORM_NAMES) / sizeof(PLATFORM_NAMES[0]);
+         uiPlatform++) {
+
+        std::string strPath = std::string(AUDIO_PLATFORM_DESCRIPTIONS_DIR "/") +
+                              PLATFORM_NAMES[uiPlatform] + ".desc";
+        CAudioPlatformDescription description;
+        ASSERT_EQ(android::OK, description.map(strPath)) << strPath;
+        setRoutes(description.getImage());
+
+        std::vector<uint32_t> deviceSets[CUtils::ENbDirections];
+        unsigned int uiNbDecisions = 0;
+
+        for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+            deviceSets[uiDir] = getDeviceSets(uiDir == CUtils::EOutput);
+            uiNbDecisions += deviceSets[uiDir].size() * NB_MODES;
+        }
+        uiNbDecisions *= NB_BENCHMARK_ROUNDS;
+
+        int64_t bestTablesNs = -1;
+        int64_t bestOneByOneNs = -1;
+        // Kept alive, not to have the decisions optimized out
+        volatile uint32_t uiRoutes = 0;
+
+        for (unsigned int uiMeasure = 0; uiMeasure < NB_BENCHMARK_MEASURES; uiMeasure++) {
+
+            for (int iMethod = 0; iMethod < 2; iMethod++) {
+
+                int64_t startNs = nowNs();
+                for (unsigned int uiRound = 0; uiRound < NB_BENCHMARK_ROUNDS; uiRound++) {
+
+                    for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+                        bool bIsOut = uiDir == CUtils::EOutput;
+                        for (size_t i = 0; i < deviceSets[uiDir].size(); i++) {
+
+                            for (int iMode = 0; iMode < NB_MODES; iMode++) {
+
+                                uiRoutes |= iMethod == 0 ?
+                                        _tables.getRoutes(bIsOut, deviceSets[uiDir][i], iMode) :
+                                        getRoutesOneByOne(bIsOut, deviceSets[uiDir][i], iMode);
+                            }
+                        }
+                    }
+                }
+                int64_t elapsedNs = nowNs() - startNs;
+                int64_t &bestNs = iMethod == 0 ? bestTablesNs : bestOneByOneNs;
+                if ((bestNs < 0) || (elapsedNs < bestNs)) {
+
+                    bestNs = elapsedNs;
+                }
+            }
+        }
+        printf("%s: routes decision of %u routes: tables %.1f ns, one by one %.1f ns\n",
+               PLATFORM_NAMES[uiPlatform], (unsigned int)_routes.size(),
+               (double)bestTablesNs / uiNbDecisions, (double)bestOneByOneNs / uiNbDecisions);
+
+        EXPECT_LE(bestTablesNs, bestOneByOneNs) << PLATFORM_NAMES[uiPlatform];
+    }
+}
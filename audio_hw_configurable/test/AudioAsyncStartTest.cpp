@@ -0,0 +1,303 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+
+#include "AudioHardwareALSA.h"
+#include "AudioPlatformHardware.h"
+#include "AudioRoutingReplayer.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <tinyalsa/asoundlib.h>
+#include <utils/String16.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::AudioStreamOut;
+using android_audio_legacy::AudioSystem;
+using android_audio_legacy::CAudioPlatformHardware;
+using android_audio_legacy::CAudioRoutingReplayer;
+using android::String16;
+using android::Vector;
+using android::status_t;
+using android::NO_ERROR;
+
+namespace
+{
+
+/** Devices scanned per card for the frames played. */
+const unsigned int MAX_DEVICES = 32;
+/** Opening time of each device, as a slow routing makes the start of a stream wait. */
+const unsigned int ROUTE_OPEN_TIME_US = 100000;
+/** Opening time long enough for the prebuffer to overflow before the stream is routed. */
+const unsigned int LONG_ROUTE_OPEN_TIME_US = 500000;
+const uint32_t NB_WRITES = 30;
+/** Step between the sample values of successive writes. */
+const int16_t SAMPLE_STEP = 256;
+/** Channels of the devices of the speaker route. */
+const size_t NB_CHANNELS = 2;
+/** Frames played before the samples of the conversion chain settle. */
+const size_t SETTLING_FRAMES = 64;
+
+/** Start metrics of the output stream, as dumped. */
+struct SStartMetrics
+{
+    long long llLastTimeToFirstSampleMs;
+    unsigned int uiDroppedFrames;
+};
+
+/**
+ * HAL run against the fake tinyalsa backend, with the sound cards of the platform, and the
+ * parameter framework stub. The primary output plays on the speaker, as audio flinger does,
+ * while opening the devices is slow.
+ */
+class AudioAsyncStartTest : public ::testing::Test
+{
+protected:
+    AudioAsyncStartTest() : _pHardware(NULL), _pOut(NULL), _pReplayer(NULL) {}
+
+    virtual void SetUp()
+    {
+        std::vector<std::string> cards;
+        char acDir[] = "/tmp/async_start.XXXXXX";
+
+        tinyalsa_fake_reset();
+        ASSERT_TRUE(mkdtemp(acDir) != NULL);
+        _strDataDir = acDir;
+        for (uint32_t uiRoute = 0; uiRoute < CAudioPlatformHardware::getNbRoutes(); uiRoute++) {
+
+            const char *pcCardName = CAudioPlatformHardware::getRouteCardName(uiRoute);
+            if ((pcCardName == NULL) || (pcCardName[0] == '\0') ||
+                    (std::find(cards.begin(), cards.end(), pcCardName) != cards.end())) {
+
+                continue;
+            }
+            ASSERT_EQ(0, tinyalsa_fake_add_card(pcCardName, cards.size()));
+            cards.push_back(pcCardName);
+        }
+        _uiNbCards = cards.size();
+        _pHardware = new AudioHardwareALSA();
+        ASSERT_EQ(NO_ERROR, _pHardware->initCheck());
+        _pReplayer = new CAudioRoutingReplayer(_pHardware);
+
+        int iFormat = AudioSystem::PCM_16_BIT;
+        uint32_t uiChannels = AudioSystem::CHANNEL_OUT_STEREO;
+        uint32_t uiSampleRate = 48000;
+        // Output flags are given through the status
+        status_t status = AUDIO_OUTPUT_FLAG_PRIMARY;
+        _pOut = _pHardware->openOutputStream(AudioSystem::DEVICE_OUT_SPEAKER, &iFormat,
+                                             &uiChannels, &uiSampleRate, &status);
+        ASSERT_TRUE(_pOut != NULL);
+    }
+
+    virtual void TearDown()
+    {
+        delete _pReplayer;
+        if (_pOut != NULL) {
+
+            _pHardware->closeOutputStream(_pOut);
+        }
+        delete _pHardware;
+        tinyalsa_fake_reset();
+
+        DIR *pDir = opendir(_strDataDir.c_str());
+        struct dirent *pEntry;
+        while ((pDir != NULL) && ((pEntry = readdir(pDir)) != NULL)) {
+
+            unlink((_strDataDir + "/" + pEntry->d_name).c_str());
+        }
+        if (pDir != NULL) {
+
+            closedir(pDir);
+        }
+        rmdir(_strDataDir.c_str());
+    }
+
+    /**
+     * Starts the stream from standby, with the first writes waiting for the routing or not.
+     */
+    void restart(bool bAsyncStart, unsigned int uiOpenTimeUs)
+    {
+        EXPECT_EQ(NO_ERROR, _pOut->standby());
+        EXPECT_TRUE(_pReplayer->waitForRouting());
+        _pReplayer->setAsyncStart(_pOut, bAsyncStart);
+        tinyalsa_fake_set_open_time(uiOpenTimeUs);
+    }
+
+    /**
+     * Writes as audio flinger does, with the buffer size of the stream, each buffer holding
+     * the index of the write in its samples.
+     *
+     * @return longest time spent in write().
+     */
+    nsecs_t writeBuffers(uint32_t uiNbWrites)
+    {
+        nsecs_t maxWriteTime = 0;
+
+        for (uint32_t uiWrite = 0; uiWrite < uiNbWrites; uiWrite++) {
+
+            std::vector<int16_t> buffer(_pOut->bufferSize() / sizeof(int16_t),
+                                        static_cast<int16_t>((uiWrite + 1) * SAMPLE_STEP));
+            nsecs_t startTime = systemTime();
+            EXPECT_EQ(static_cast<ssize_t>(_pOut->bufferSize()),
+                      _pOut->write(&buffer[0], _pOut->bufferSize()));
+            maxWriteTime = std::max(maxWriteTime, systemTime() - startTime);
+        }
+        return maxWriteTime;
+    }
+
+    SStartMetrics getStartMetrics() const
+    {
+        SStartMetrics stMetrics;
+        FILE *pFile = tmpfile();
+        char acLine[256];
+        long long llMaxMs;
+
+        memset(&stMetrics, 0, sizeof(stMetrics));
+        if (pFile == NULL) {
+
+            return stMetrics;
+        }
+        _pOut->dump(fileno(pFile), Vector<String16>());
+        rewind(pFile);
+        while (fgets(acLine, sizeof(acLine), pFile) != NULL) {
+
+            sscanf(acLine, "  time to first sample: last %lld ms, max %lld ms",
+                   &stMetrics.llLastTimeToFirstSampleMs, &llMaxMs);
+            sscanf(acLine, "  prebuffer: %u frames dropped", &stMetrics.uiDroppedFrames);
+        }
+        fclose(pFile);
+        return stMetrics;
+    }
+
+    /** @return samples of the playback device that played the most frames. */
+    std::vector<int16_t> readPlayedSamples() const
+    {
+        std::vector<int16_t> samples;
+
+        for (unsigned int uiCard = 0; uiCard < _uiNbCards; uiCard++) {
+
+            for (unsigned int uiDevice = 0; uiDevice < MAX_DEVICES; uiDevice++) {
+
+                char acPath[256];
+                snprintf(acPath, sizeof(acPath), "%s/pcmC%uD%up.raw", _strDataDir.c_str(),
+                         uiCard, uiDevice);
+                FILE *pFile = fopen(acPath, "rb");
+                if (pFile == NULL) {
+
+                    continue;
+                }
+                std::vector<int16_t> deviceSamples;
+                int16_t iSample;
+                while (fread(&iSample, sizeof(iSample), 1, pFile) == 1) {
+
+                    deviceSamples.push_back(iSample);
+                }
+                fclose(pFile);
+                if (deviceSamples.size() > samples.size()) {
+
+                    samples.swap(deviceSamples);
+                }
+            }
+        }
+        return samples;
+    }
+
+    AudioHardwareALSA *_pHardware;
+    AudioStreamOut *_pOut;
+    CAudioRoutingReplayer *_pReplayer;
+    unsigned int _uiNbCards;
+    std::string _strDataDir;
+};
+
+}
+
+/**
+ * Time from the first write of the stream to its first frames written to the audio device, and
+ * longest write, with the first writes waiting for the routing or prebuffered meanwhile.
+ */
+TEST_F(AudioAsyncStartTest, benchmarkTimeToFirstSampleAndWriteBlocking)
+{
+    static const bool abAsyncStart[] = { false, true };
+    nsecs_t aMaxWriteTime[2];
+
+    for (uint32_t i = 0; i < sizeof(abAsyncStart) / sizeof(abAsyncStart[0]); i++) {
+
+        restart(abAsyncStart[i], ROUTE_OPEN_TIME_US);
+        aMaxWriteTime[i] = writeBuffers(NB_WRITES);
+        SStartMetrics stMetrics = getStartMetrics();
+
+        printf("%s start, devices opened in %u ms: first sample after %lld ms, "
+               "write blocked %lld ms at most\n", abAsyncStart[i] ? "asynchronous" : "synchronous",
+               ROUTE_OPEN_TIME_US / 1000, stMetrics.llLastTimeToFirstSampleMs,
+               static_cast<long long>(ns2ms(aMaxWriteTime[i])));
+
+        // Slow opening delays the first sample, either way
+        EXPECT_GE(stMetrics.llLastTimeToFirstSampleMs, ROUTE_OPEN_TIME_US / 1000);
+    }
+    // Synchronous start blocks the first write for the routing
+    EXPECT_GE(ns2us(aMaxWriteTime[0]), ROUTE_OPEN_TIME_US);
+    EXPECT_LT(aMaxWriteTime[1], aMaxWriteTime[0]);
+}
+
+/**
+ * Routing lasting longer than the prebuffer: writes are paced meanwhile, and the oldest frames,
+ * too late to be played, are dropped so that the stream starts playing its newest frames.
+ */
+TEST_F(AudioAsyncStartTest, prebufferFullDropsTheOldestFrames)
+{
+    restart(true, LONG_ROUTE_OPEN_TIME_US);
+    tinyalsa_fake_set_data_dir(_strDataDir.c_str());
+
+    nsecs_t maxWriteTime = writeBuffers(NB_WRITES);
+    SStartMetrics stMetrics = getStartMetrics();
+    EXPECT_EQ(NO_ERROR, _pOut->standby());
+    EXPECT_TRUE(_pReplayer->waitForRouting());
+
+    std::vector<int16_t> samples = readPlayedSamples();
+    size_t szFirst = 0;
+    while ((szFirst < samples.size()) && (samples[szFirst] == 0)) {
+
+        szFirst++;
+    }
+    szFirst += SETTLING_FRAMES * NB_CHANNELS;
+    while (!samples.empty() && (samples.back() == 0)) {
+
+        samples.pop_back();
+    }
+    ASSERT_LT(szFirst, samples.size());
+    int16_t iLastSample = samples.back();
+
+    printf("Devices opened in %u ms: %u frames dropped, first write played %d, last one %d, "
+           "write blocked %lld ms at most\n", LONG_ROUTE_OPEN_TIME_US / 1000,
+           stMetrics.uiDroppedFrames, samples[szFirst] / SAMPLE_STEP - 1,
+           iLastSample / SAMPLE_STEP - 1, static_cast<long long>(ns2ms(maxWriteTime)));
+
+    // The first writes are dropped, not the last ones, and no write waits for the routing
+    EXPECT_GT(stMetrics.uiDroppedFrames, 0u);
+    EXPECT_GT(samples[szFirst], SAMPLE_STEP + SAMPLE_STEP / 2);
+    EXPECT_EQ(static_cast<int16_t>(NB_WRITES * SAMPLE_STEP), iLastSample);
+    EXPECT_LT(ns2us(maxWriteTime), LONG_ROUTE_OPEN_TIME_US);
+}
@@ -0,0 +1,228 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+
+#include "AudioCaptureFanOut.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <tinyalsa/asoundlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::CAudioCaptureFanOut;
+using android::OK;
+
+namespace
+{
+
+const unsigned int CARD = 0;
+const unsigned int DEVICE = 0;
+const unsigned int CHANNELS = 2;
+const unsigned int PERIOD_FRAMES = 240;
+/** Periods of the ring of the fan out. */
+const unsigned int RING_PERIODS = 4;
+/** Frames of the ramp captured in loop, more than any test reads. */
+const unsigned int RAMP_FRAMES = 32768;
+
+/**
+ * Input device of the fake backend shared by the clients of a fan out. The device captures a
+ * ramp, each frame holding its index from the start of the capture, so that the frames read by
+ * a client tell where in the capture they come from.
+ */
+class AudioCaptureFanOutTest : public ::testing::Test
+{
+protected:
+    AudioCaptureFanOutTest() : _pPcm(NULL) {}
+
+    virtual void SetUp()
+    {
+        char acDir[] = "/tmp/capture_fan_out.XXXXXX";
+
+        tinyalsa_fake_reset();
+        ASSERT_TRUE(mkdtemp(acDir) != NULL);
+        _strDataDir = acDir;
+
+        FILE *pFile = fopen(getCapturedFilePath().c_str(), "wb");
+        ASSERT_TRUE(pFile != NULL);
+        for (unsigned int i = 0; i < RAMP_FRAMES; i++) {
+
+            int16_t aiFrame[CHANNELS] = { static_cast<int16_t>(i), static_cast<int16_t>(i) };
+            ASSERT_EQ(1u, fwrite(aiFrame, sizeof(aiFrame), 1, pFile));
+        }
+        fclose(pFile);
+        tinyalsa_fake_set_data_dir(_strDataDir.c_str());
+
+        pcm_config config;
+        memset(&config, 0, sizeof(config));
+        config.channels = CHANNELS;
+        config.rate = 48000;
+        config.period_size = PERIOD_FRAMES;
+        config.period_count = 4;
+        config.format = PCM_FORMAT_S16_LE;
+        _pPcm = pcm_open(CARD, DEVICE, PCM_IN, &config);
+        ASSERT_TRUE(pcm_is_ready(_pPcm));
+        ASSERT_EQ(OK, _fanOut.open(_pPcm, PERIOD_FRAMES));
+    }
+
+    virtual void TearDown()
+    {
+        if (_pPcm != NULL) {
+
+            _fanOut.close();
+            pcm_close(_pPcm);
+        }
+        unlink(getCapturedFilePath().c_str());
+        rmdir(_strDataDir.c_str());
+        tinyalsa_fake_reset();
+    }
+
+    /**
+     * Reads frames for a client, and checks they follow the ramp from a given frame.
+     *
+     * @param[in] pClient client identifier.
+     * @param[in] uiFrames number of frames to read.
+     * @param[in] uiFirstFrame index of the frame expected first.
+     *
+     * @return frames lost by the client since its previous read.
+     */
+    uint32_t readRamp(const void *pClient, uint32_t uiFrames, uint32_t uiFirstFrame)
+    {
+        std::vector<int16_t> samples(uiFrames * CHANNELS);
+        uint32_t uiFramesLost = 0;
+
+        EXPECT_EQ(0, _fanOut.read(pClient, &samples[0], uiFrames, &uiFramesLost));
+        for (uint32_t i = 0; i < uiFrames; i++) {
+
+            int16_t iExpected = static_cast<int16_t>(uiFirstFrame + i);
+            EXPECT_EQ(iExpected, samples[i * CHANNELS]) << "frame " << i;
+            EXPECT_EQ(iExpected, samples[i * CHANNELS + 1]) << "frame " << i;
+            if (samples[i * CHANNELS] != iExpected) {
+
+                break;
+            }
+        }
+        return uiFramesLost;
+    }
+
+    uint64_t getDeviceFramesRead() const
+    {
+        tinyalsa_fake_stats stats;
+
+        tinyalsa_fake_get_stats(CARD, DEVICE, PCM_IN, &stats);
+        return stats.frames;
+    }
+
+    std::string getCapturedFilePath() const
+    {
+        char acPath[256];
+
+        snprintf(acPath, sizeof(acPath), "%s/pcmC%uD%uc.raw", _strDataDir.c_str(), CARD, DEVICE);
+        return acPath;
+    }
+
+    CAudioCaptureFanOut _fanOut;
+    pcm *_pPcm;
+    std::string _strDataDir;
+};
+
+}
+
+TEST_F(AudioCaptureFanOutTest, clientsReadingAtDifferentRatesGetTheSameFrames)
+{
+    int iFastClient = 0;
+    int iSlowClient = 0;
+    _fanOut.addClient(&iFastClient);
+    _fanOut.addClient(&iSlowClient);
+
+    // The slow client reads twice the frames half as often, half a period more or less at
+    // times, so that it is either behind or ahead of the other client
+    uint32_t uiFastFrame = 0;
+    uint32_t uiSlowFrame = 0;
+    for (unsigned int i = 0; i < 40; i++) {
+
+        EXPECT_EQ(0u, readRamp(&iFastClient, PERIOD_FRAMES, uiFastFrame));
+        uiFastFrame += PERIOD_FRAMES;
+        if ((i % 2) == 1) {
+
+            uint32_t uiFrames = ((i % 4) == 1) ? 2 * PERIOD_FRAMES + PERIOD_FRAMES / 2 :
+                                2 * PERIOD_FRAMES - PERIOD_FRAMES / 2;
+            EXPECT_EQ(0u, readRamp(&iSlowClient, uiFrames, uiSlowFrame));
+            uiSlowFrame += uiFrames;
+        }
+        ASSERT_FALSE(HasFailure());
+    }
+    _fanOut.removeClient(&iSlowClient);
+    _fanOut.removeClient(&iFastClient);
+
+    // The device was read once for both clients
+    EXPECT_EQ(uiFastFrame > uiSlowFrame ? uiFastFrame : uiSlowFrame, getDeviceFramesRead());
+}
+
+TEST_F(AudioCaptureFanOutTest, framesLostAreCountedToTheLaggingClientOnly)
+{
+    int iClient = 0;
+    int iLaggingClient = 0;
+    _fanOut.addClient(&iClient);
+    _fanOut.addClient(&iLaggingClient);
+
+    // Twice the ring read by the client while the other one does not read
+    const uint32_t uiReadFrames = 2 * RING_PERIODS * PERIOD_FRAMES;
+    for (uint32_t uiFrame = 0; uiFrame < uiReadFrames; uiFrame += PERIOD_FRAMES) {
+
+        EXPECT_EQ(0u, readRamp(&iClient, PERIOD_FRAMES, uiFrame));
+    }
+
+    // The lagging client gets the oldest frames still in the ring
+    const uint32_t uiLostFrames = uiReadFrames - RING_PERIODS * PERIOD_FRAMES;
+    EXPECT_EQ(uiLostFrames, readRamp(&iLaggingClient, PERIOD_FRAMES, uiLostFrames));
+    EXPECT_EQ(0u, readRamp(&iLaggingClient, PERIOD_FRAMES, uiLostFrames + PERIOD_FRAMES));
+
+    // Once caught up, none of the clients loses frames
+    EXPECT_EQ(0u, readRamp(&iClient, PERIOD_FRAMES, uiReadFrames));
+    EXPECT_EQ(0u, readRamp(&iLaggingClient, 2 * PERIOD_FRAMES, uiLostFrames + 2 * PERIOD_FRAMES));
+
+    _fanOut.removeClient(&iLaggingClient);
+    _fanOut.removeClient(&iClient);
+}
+
+TEST_F(AudioCaptureFanOutTest, singleClientSwitchesFromDeviceToRingOnSecondClient)
+{
+    // Less than a period, so that a read through the ring reads more of the device
+    const uint32_t uiFrames = PERIOD_FRAMES / 4;
+    int iClient = 0;
+    int iSecondClient = 0;
+    _fanOut.addClient(&iClient);
+
+    // Alone, the client reads the device directly
+    EXPECT_EQ(0u, readRamp(&iClient, uiFrames, 0));
+    EXPECT_EQ(0u, readRamp(&iClient, uiFrames, uiFrames));
+    EXPECT_EQ(2 * uiFrames, getDeviceFramesRead());
+
+    // With a second client, the device is read in the ring by periods, without any gap in the
+    // frames of the first client, and the second client gets the same frames
+    _fanOut.addClient(&iSecondClient);
+    EXPECT_EQ(0u, readRamp(&iClient, uiFrames, 2 * uiFrames));
+    EXPECT_EQ(2 * uiFrames + PERIOD_FRAMES, getDeviceFramesRead());
+    EXPECT_EQ(0u, readRamp(&iSecondClient, uiFrames, 2 * uiFrames));
+    EXPECT_EQ(0u, readRamp(&iClient, uiFrames, 3 * uiFrames));
+    EXPECT_EQ(2 * uiFrames + PERIOD_FRAMES, getDeviceFramesRead());
+
+    _fanOut.removeClient(&iSecondClient);
+    _fanOut.removeClient(&iClient);
+}
@@ -0,0 +1,198 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+
+#include "AudioHardwareALSA.h"
+#include "AudioPlatformHardware.h"
+#include "AudioRoutingReplayer.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::AudioStreamOut;
+using android_audio_legacy::AudioSystem;
+using android_audio_legacy::CAudioPlatformHardware;
+using android_audio_legacy::CAudioRoutingReplayer;
+using android::String16;
+using android::Vector;
+using android::status_t;
+using android::NO_ERROR;
+
+namespace
+{
+
+/** Grace period of the output standby. */
+const uint32_t STANDBY_DELAY_MS = 200;
+/** Time left to the route manager to apply an elapsed standby. */
+const uint32_t STANDBY_MARGIN_MS = 200;
+const uint32_t NB_RESTARTS = 5;
+
+/** Standby and routing metrics of the route manager, as reported by the dump of the HAL. */
+struct SStandbyMetrics
+{
+    int iDelayed;
+    int iResumed;
+    int iApplied;
+    int iPasses;
+};
+
+/**
+ * HAL run against the fake tinyalsa backend, with the sound cards of the platform, and the
+ * parameter framework stub. The primary output plays on the speaker, and its standby is
+ * delayed by a grace period.
+ */
+class AudioDelayedStandbyTest : public ::testing::Test
+{
+protected:
+    AudioDelayedStandbyTest() : _pHardware(NULL), _pOut(NULL), _pReplayer(NULL) {}
+
+    virtual void SetUp()
+    {
+        std::vector<std::string> cards;
+
+        tinyalsa_fake_reset();
+        for (uint32_t uiRoute = 0; uiRoute < CAudioPlatformHardware::getNbRoutes(); uiRoute++) {
+
+            const char *pcCardName = CAudioPlatformHardware::getRouteCardName(uiRoute);
+            if ((pcCardName == NULL) || (pcCardName[0] == '\0') ||
+                    (std::find(cards.begin(), cards.end(), pcCardName) != cards.end())) {
+
+                continue;
+            }
+            ASSERT_EQ(0, tinyalsa_fake_add_card(pcCardName, cards.size()));
+            cards.push_back(pcCardName);
+        }
+        _pHardware = new AudioHardwareALSA();
+        ASSERT_EQ(NO_ERROR, _pHardware->initCheck());
+        _pReplayer = new CAudioRoutingReplayer(_pHardware);
+
+        int iFormat = AudioSystem::PCM_16_BIT;
+        uint32_t uiChannels = AudioSystem::CHANNEL_OUT_STEREO;
+        uint32_t uiSampleRate = 48000;
+        // Output flags are given through the status
+        status_t status = AUDIO_OUTPUT_FLAG_PRIMARY;
+        _pOut = _pHardware->openOutputStream(AudioSystem::DEVICE_OUT_SPEAKER, &iFormat,
+                                             &uiChannels, &uiSampleRate, &status);
+        ASSERT_TRUE(_pOut != NULL);
+        _pReplayer->setStandbyDelay(_pOut, STANDBY_DELAY_MS);
+
+        // Routed to the speaker, as once audio flinger has started playing
+        write();
+        ASSERT_TRUE(_pReplayer->waitForRouting());
+    }
+
+    virtual void TearDown()
+    {
+        delete _pReplayer;
+        if (_pOut != NULL) {
+
+            _pHardware->closeOutputStream(_pOut);
+        }
+        delete _pHardware;
+        tinyalsa_fake_reset();
+    }
+
+    /** Writes a buffer of silence, as audio flinger does, starting the stream if in standby. */
+    void write()
+    {
+        std::vector<char> buffer(_pOut->bufferSize(), 0);
+
+        EXPECT_EQ(static_cast<ssize_t>(buffer.size()), _pOut->write(&buffer[0], buffer.size()));
+    }
+
+    SStandbyMetrics getStandbyMetrics() const
+    {
+        SStandbyMetrics stMetrics;
+        FILE *pFile = tmpfile();
+        char acLine[256];
+        int iRequests;
+        int iCoalesced;
+        int iExecuted;
+
+        memset(&stMetrics, 0, sizeof(stMetrics));
+        if (pFile == NULL) {
+
+            return stMetrics;
+        }
+        _pHardware->dumpState(fileno(pFile), Vector<String16>());
+        rewind(pFile);
+        while (fgets(acLine, sizeof(acLine), pFile) != NULL) {
+
+            sscanf(acLine, "  delayed standby: %d delayed, %d resumed (reroutings avoided), "
+                   "%d applied", &stMetrics.iDelayed, &stMetrics.iResumed, &stMetrics.iApplied);
+            sscanf(acLine, "  routing: %d requests, %d coalesced, %d passes, %d executed",
+                   &iRequests, &iCoalesced, &stMetrics.iPasses, &iExecuted);
+        }
+        fclose(pFile);
+        return stMetrics;
+    }
+
+    AudioHardwareALSA *_pHardware;
+    AudioStreamOut *_pOut;
+    CAudioRoutingReplayer *_pReplayer;
+};
+
+}
+
+/**
+ * Stream restarted within the grace period of its standby, as between two sounds of the user
+ * interface: the route and the device are kept, and no routing pass is run.
+ */
+TEST_F(AudioDelayedStandbyTest, restartWithinGracePeriodAvoidsRerouting)
+{
+    SStandbyMetrics stStart = getStandbyMetrics();
+
+    for (uint32_t uiRestart = 0; uiRestart < NB_RESTARTS; uiRestart++) {
+
+        EXPECT_EQ(NO_ERROR, _pOut->standby());
+        write();
+    }
+    EXPECT_TRUE(_pReplayer->waitForRouting());
+    SStandbyMetrics stEnd = getStandbyMetrics();
+
+    EXPECT_EQ(static_cast<int>(NB_RESTARTS), stEnd.iDelayed - stStart.iDelayed);
+    EXPECT_EQ(static_cast<int>(NB_RESTARTS), stEnd.iResumed - stStart.iResumed);
+    EXPECT_EQ(0, stEnd.iApplied - stStart.iApplied);
+    EXPECT_EQ(0, stEnd.iPasses - stStart.iPasses);
+}
+
+/**
+ * Stream left in standby beyond the grace period: the standby is applied once the period
+ * elapses, with a single routing pass to release the route.
+ */
+TEST_F(AudioDelayedStandbyTest, expiredGracePeriodRunsOneRoutingPass)
+{
+    SStandbyMetrics stStart = getStandbyMetrics();
+
+    EXPECT_EQ(NO_ERROR, _pOut->standby());
+    usleep((STANDBY_DELAY_MS + STANDBY_MARGIN_MS) * 1000);
+    EXPECT_TRUE(_pReplayer->waitForRouting());
+    SStandbyMetrics stEnd = getStandbyMetrics();
+
+    EXPECT_EQ(1, stEnd.iDelayed - stStart.iDelayed);
+    EXPECT_EQ(0, stEnd.iResumed - stStart.iResumed);
+    EXPECT_EQ(1, stEnd.iApplied - stStart.iApplied);
+    EXPECT_EQ(1, stEnd.iPasses - stStart.iPasses);
+}
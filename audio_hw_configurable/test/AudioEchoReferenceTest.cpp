@@ -0,0 +1,323 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioEchoReference.h"
+#include <audio_utils/echo_reference.h>
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <SampleSpec.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+using android_audio_legacy::CAudioEchoReference;
+using android_audio_legacy::SampleSpec;
+using android::OK;
+
+namespace
+{
+
+const uint32_t CAPTURE_RATE = 16000;
+const uint32_t PLAYBACK_RATE = 48000;
+/** 10 ms, as the effects library processes. */
+const uint32_t PERIOD_FRAMES = 160;
+/** Power of 2 holding the 500 ms of reference kept at the capture rate. */
+const uint32_t RING_FRAMES = 8192;
+/** Echo delay above which the reference is realigned on the capture time. */
+const int64_t MAX_ECHO_DELAY_NS = 250000000LL;
+const int64_t NSEC_PER_SEC = 1000000000LL;
+/** Render time of the first frame written by the tests. */
+const int64_t START_TIME_NS = 100 * NSEC_PER_SEC;
+
+/** Frames of a ramp, each frame holding its index in the reference, so that order is checked. */
+std::vector<int16_t> getRamp(uint32_t uiFirstFrame, uint32_t uiFrames, uint32_t uiChannels)
+{
+    std::vector<int16_t> ramp(uiFrames * uiChannels);
+
+    for (uint32_t uiFrame = 0; uiFrame < uiFrames; uiFrame++) {
+
+        for (uint32_t uiChannel = 0; uiChannel < uiChannels; uiChannel++) {
+
+            ramp[uiFrame * uiChannels + uiChannel] =
+                    static_cast<int16_t>((uiFirstFrame + uiFrame) & 0x7FFF);
+        }
+    }
+    return ramp;
+}
+
+struct echo_reference_buffer getDelay(int64_t llTimeNs, int32_t iDelayNs)
+{
+    struct echo_reference_buffer delay;
+
+    memset(&delay, 0, sizeof(delay));
+    delay.time_stamp.tv_sec = llTimeNs / NSEC_PER_SEC;
+    delay.time_stamp.tv_nsec = llTimeNs % NSEC_PER_SEC;
+    delay.delay_ns = iDelayNs;
+    return delay;
+}
+
+/**
+ * Echo reference between a playback and a capture of 16 bits frames, the playback being
+ * rendered as soon as written.
+ */
+class AudioEchoReferenceTest : public ::testing::Test
+{
+protected:
+    AudioEchoReferenceTest() : _pReference(NULL), _uiWrittenFrames(0) {}
+
+    virtual void TearDown()
+    {
+        delete _pReference;
+    }
+
+    void createReference(uint32_t uiPlaybackChannels, uint32_t uiPlaybackRate)
+    {
+        _pReference = new CAudioEchoReference(SampleSpec(1, AUDIO_FORMAT_PCM_16_BIT,
+                                                         CAPTURE_RATE),
+                                              SampleSpec(uiPlaybackChannels,
+                                                         AUDIO_FORMAT_PCM_16_BIT,
+                                                         uiPlaybackRate));
+        ASSERT_EQ(OK, _pReference->init());
+    }
+
+    /** Writes the next frames of the ramp, the last one rendered at the time of its index. */
+    void write(uint32_t uiFrames)
+    {
+        std::vector<int16_t> ramp = getRamp(_uiWrittenFrames, uiFrames, 1);
+        _uiWrittenFrames += uiFrames;
+        struct echo_reference_buffer delay =
+                getDelay(getRenderTimeNs(_uiWrittenFrames - 1), 0);
+
+        _pReference->write(&ramp[0], uiFrames, &delay);
+    }
+
+    static int64_t getRenderTimeNs(uint32_t uiFrame)
+    {
+        return START_TIME_NS + uiFrame * NSEC_PER_SEC / CAPTURE_RATE;
+    }
+
+    /**
+     * Reads and consumes up to a number of frames, region by region.
+     *
+     * @param[out] frames values read, appended.
+     *
+     * @return number of regions read.
+     */
+    uint32_t read(int32_t iReader, uint32_t uiFrames, std::vector<int16_t> &frames)
+    {
+        uint32_t uiRegions = 0;
+
+        while (uiFrames != 0) {
+
+            uint32_t uiRegionFrames;
+            const int16_t *pRegion = static_cast<const int16_t *>(
+                        _pReference->getReadRegion(iReader, &uiRegionFrames));
+            if (uiRegionFrames == 0) {
+
+                break;
+            }
+            if (uiRegionFrames > uiFrames) {
+
+                uiRegionFrames = uiFrames;
+            }
+            frames.insert(frames.end(), pRegion, pRegion + uiRegionFrames);
+            _pReference->commitRead(iReader, uiRegionFrames);
+            uiFrames -= uiRegionFrames;
+            uiRegions++;
+        }
+        return uiRegions;
+    }
+
+    CAudioEchoReference *_pReference;
+    uint32_t _uiWrittenFrames;
+};
+
+}
+
+/** Frames written across the end of the ring are read in two regions, in order. */
+TEST_F(AudioEchoReferenceTest, readRegionWrapsAround)
+{
+    createReference(1, CAPTURE_RATE);
+    int32_t iReader = _pReference->addReader();
+    ASSERT_GE(iReader, 0);
+
+    std::vector<int16_t> frames;
+    write(6000);
+    EXPECT_EQ(1u, read(iReader, 6000, frames));
+
+    // 2192 frames up to the end of the ring, 1808 from its beginning
+    frames.clear();
+    write(4000);
+    uint32_t uiRegionFrames;
+    _pReference->getReadRegion(iReader, &uiRegionFrames);
+    EXPECT_EQ(RING_FRAMES - 6000, uiRegionFrames);
+    EXPECT_EQ(2u, read(iReader, 4000, frames));
+    EXPECT_EQ(getRamp(6000, 4000, 1), frames);
+
+    _pReference->getReadRegion(iReader, &uiRegionFrames);
+    EXPECT_EQ(0u, uiRegionFrames);
+}
+
+/** Each reader reads the whole reference at its own pace, the fastest one is not held back. */
+TEST_F(AudioEchoReferenceTest, readersAtDifferentSpeeds)
+{
+    createReference(1, CAPTURE_RATE);
+    int32_t iFastReader = _pReference->addReader();
+    int32_t iSlowReader = _pReference->addReader();
+    ASSERT_GE(iFastReader, 0);
+    ASSERT_GE(iSlowReader, 0);
+    EXPECT_NE(iFastReader, iSlowReader);
+    EXPECT_EQ(2u, _pReference->getNbReaders());
+
+    const uint32_t NB_PERIODS = 100;
+    std::vector<int16_t> fastFrames;
+    std::vector<int16_t> slowFrames;
+    for (uint32_t uiPeriod = 0; uiPeriod < NB_PERIODS; uiPeriod++) {
+
+        write(PERIOD_FRAMES);
+        read(iFastReader, PERIOD_FRAMES, fastFrames);
+        if (uiPeriod % 2) {
+
+            // Late by a period every other period
+            read(iSlowReader, 2 * PERIOD_FRAMES, slowFrames);
+        }
+    }
+    EXPECT_EQ(getRamp(0, NB_PERIODS * PERIOD_FRAMES, 1), fastFrames);
+    EXPECT_EQ(fastFrames, slowFrames);
+
+    _pReference->removeReader(iSlowReader);
+    EXPECT_EQ(1u, _pReference->getNbReaders());
+}
+
+/**
+ * Playback frames are dropped once the slowest reader has a full ring pending, whatever the
+ * other readers consumed. Frames written once it caught up are stored again.
+ */
+TEST_F(AudioEchoReferenceTest, framesDroppedWhenSlowestReaderIsFull)
+{
+    createReference(1, CAPTURE_RATE);
+    int32_t iFastReader = _pReference->addReader();
+    int32_t iSlowReader = _pReference->addReader();
+    ASSERT_GE(iFastReader, 0);
+    ASSERT_GE(iSlowReader, 0);
+
+    // 51 periods fit in the ring, the 52nd does not
+    const uint32_t NB_STORED_PERIODS = RING_FRAMES / PERIOD_FRAMES;
+    std::vector<int16_t> fastFrames;
+    for (uint32_t uiPeriod = 0; uiPeriod < NB_STORED_PERIODS; uiPeriod++) {
+
+        write(PERIOD_FRAMES);
+        read(iFastReader, PERIOD_FRAMES, fastFrames);
+    }
+    write(PERIOD_FRAMES);
+    EXPECT_EQ(0u, read(iFastReader, PERIOD_FRAMES, fastFrames));
+
+    // Slowest reader gets the frames stored, the period dropped is missing for all readers
+    std::vector<int16_t> slowFrames;
+    read(iSlowReader, RING_FRAMES, slowFrames);
+    EXPECT_EQ(getRamp(0, NB_STORED_PERIODS * PERIOD_FRAMES, 1), slowFrames);
+    EXPECT_EQ(fastFrames, slowFrames);
+
+    fastFrames.clear();
+    slowFrames.clear();
+    write(PERIOD_FRAMES);
+    read(iFastReader, PERIOD_FRAMES, fastFrames);
+    read(iSlowReader, PERIOD_FRAMES, slowFrames);
+    EXPECT_EQ(getRamp((NB_STORED_PERIODS + 1) * PERIOD_FRAMES, PERIOD_FRAMES, 1), fastFrames);
+    EXPECT_EQ(fastFrames, slowFrames);
+}
+
+/**
+ * Reference rendered more than MAX_ECHO_DELAY_NS before the capture time is skipped, so that
+ * the echo delay reported is within the AEC range. Below, the reference is kept.
+ */
+TEST_F(AudioEchoReferenceTest, syncSkipsFramesWhenDelayExceedsMax)
+{
+    createReference(1, CAPTURE_RATE);
+    int32_t iReader = _pReference->addReader();
+    ASSERT_GE(iReader, 0);
+
+    // Nothing rendered yet
+    struct echo_reference_buffer captureDelay = getDelay(START_TIME_NS, 0);
+    EXPECT_EQ(0, _pReference->sync(iReader, &captureDelay));
+
+    // 400 ms of reference, the first frame rendered at START_TIME_NS
+    const uint32_t NB_FRAMES = 6400;
+    write(NB_FRAMES);
+
+    // Captured 100 ms after the render of the first frame: in range, nothing skipped
+    captureDelay = getDelay(getRenderTimeNs(1600), 0);
+    int32_t iEchoDelayNs = _pReference->sync(iReader, &captureDelay);
+    EXPECT_NEAR(100000000, iEchoDelayNs, 1000000);
+    std::vector<int16_t> frames;
+    read(iReader, 1, frames);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_EQ(0, frames[0]);
+
+    // Captured 300 ms after the render of the next frame: realigned on the capture time
+    captureDelay = getDelay(getRenderTimeNs(4801), 0);
+    iEchoDelayNs = _pReference->sync(iReader, &captureDelay);
+    EXPECT_LT(iEchoDelayNs, MAX_ECHO_DELAY_NS);
+    EXPECT_LT(iEchoDelayNs, 1000000);
+    frames.clear();
+    read(iReader, 1, frames);
+    ASSERT_EQ(1u, frames.size());
+    EXPECT_NEAR(4801, frames[0], 16);
+
+    // Capture delay counts as well: the first frame to process was captured earlier
+    captureDelay = getDelay(getRenderTimeNs(NB_FRAMES - 1), 50000000);
+    iEchoDelayNs = _pReference->sync(iReader, &captureDelay);
+    EXPECT_LT(iEchoDelayNs, MAX_ECHO_DELAY_NS);
+}
+
+/** Same sample specifications: frames are stored as written, without conversion. */
+TEST_F(AudioEchoReferenceTest, noConversionForSameSampleSpec)
+{
+    createReference(1, CAPTURE_RATE);
+    int32_t iReader = _pReference->addReader();
+    ASSERT_GE(iReader, 0);
+
+    write(PERIOD_FRAMES);
+    std::vector<int16_t> frames;
+    read(iReader, RING_FRAMES, frames);
+    EXPECT_EQ(getRamp(0, PERIOD_FRAMES, 1), frames);
+}
+
+/**
+ * Playback in another sample specification is converted to the capture one before being
+ * stored: 48 kHz stereo periods are read back as 16 kHz mono periods.
+ */
+TEST_F(AudioEchoReferenceTest, conversionForOtherSampleSpec)
+{
+    createReference(2, PLAYBACK_RATE);
+    int32_t iReader = _pReference->addReader();
+    ASSERT_GE(iReader, 0);
+
+    const uint32_t NB_PERIODS = 10;
+    const uint32_t PLAYBACK_PERIOD_FRAMES = PERIOD_FRAMES * PLAYBACK_RATE / CAPTURE_RATE;
+    std::vector<int16_t> silence(PLAYBACK_PERIOD_FRAMES * 2, 0);
+    for (uint32_t uiPeriod = 0; uiPeriod < NB_PERIODS; uiPeriod++) {
+
+        struct echo_reference_buffer delay = getDelay(START_TIME_NS, 0);
+        _pReference->write(&silence[0], PLAYBACK_PERIOD_FRAMES, &delay);
+    }
+    std::vector<int16_t> frames;
+    read(iReader, RING_FRAMES, frames);
+
+    // Resampler may keep a few frames of history
+    EXPECT_NEAR(NB_PERIODS * PERIOD_FRAMES, frames.size(), PERIOD_FRAMES);
+    EXPECT_EQ(std::vector<int16_t>(frames.size(), 0), frames);
+}
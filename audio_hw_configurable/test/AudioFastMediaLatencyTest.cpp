@@ -0,0 +1,208 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioPlatformHardware.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <tinyalsa/asoundlib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+using android_audio_legacy::CAudioPlatformHardware;
+
+namespace
+{
+
+const unsigned int LOOPBACK_CARD = 0;
+const unsigned int PLAYBACK_DEVICE = 0;
+const unsigned int CAPTURE_DEVICE = 1;
+/** Periods written before the pulse, so that the playback runs at its steady state. */
+const unsigned int NB_WARMUP_PERIODS = 16;
+const unsigned int NB_MEASURES = 5;
+/** Scheduling latency tolerated on a loaded build server. */
+const int64_t TOLERANCE_US = 4000;
+
+int64_t nowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+int64_t framesToUs(const pcm_config& config, uint64_t frames)
+{
+    return frames * 1000000LL / config.rate;
+}
+
+/**
+ * Plays periods of silence, with a pulse in one of them, as a stream writing to its route does.
+ */
+struct SPlayback
+{
+    pcm* pPcm;
+    const pcm_config* pConfig;
+    volatile bool bStop;
+    int64_t pulseWriteTimeUs;
+};
+
+void* playbackThread(void* pArg)
+{
+    SPlayback* pPlayback = static_cast<SPlayback*>(pArg);
+    unsigned int uiBytes = pcm_frames_to_bytes(pPlayback->pPcm, pPlayback->pConfig->period_size);
+    std::vector<char> silence(uiBytes, 0);
+    std::vector<char> pulse(uiBytes, 0);
+
+    // Full scale first frame
+    memset(&pulse[0], 0x7F, pcm_frames_to_bytes(pPlayback->pPcm, 1));
+
+    for (unsigned int uiPeriod = 0; !pPlayback->bStop; uiPeriod++) {
+
+        bool bPulse = uiPeriod == NB_WARMUP_PERIODS;
+        if (pcm_write(pPlayback->pPcm, bPulse ? &pulse[0] : &silence[0], uiBytes) != 0) {
+
+            break;
+        }
+        // Latency starts once the client handed the frames over, not while it waits for room
+        if (bPulse) {
+
+            pPlayback->pulseWriteTimeUs = nowUs();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Measures the time from the write of a frame by the client to its capture on the loopback:
+ * the playback buffering, then up to a period for the DMA to play it and one capture period.
+ *
+ * @return round trip latency in microseconds, negative if the pulse was not captured.
+ */
+int64_t measureRoundTripUs(const pcm_config& playbackConfig)
+{
+    pcm_config playbackPcmConfig = playbackConfig;
+    // Short capture periods not to hide the playback latency
+    pcm_config capturePcmConfig = playbackConfig;
+    capturePcmConfig.start_threshold = 1;
+    capturePcmConfig.stop_threshold = 0;
+
+    tinyalsa_fake_reset();
+    tinyalsa_fake_set_loopback(LOOPBACK_CARD, PLAYBACK_DEVICE, CAPTURE_DEVICE);
+
+    pcm* pPlaybackPcm = pcm_open(LOOPBACK_CARD, PLAYBACK_DEVICE, PCM_OUT, &playbackPcmConfig);
+    pcm* pCapturePcm = pcm_open(LOOPBACK_CARD, CAPTURE_DEVICE, PCM_IN, &capturePcmConfig);
+    if (!pcm_is_ready(pPlaybackPcm) || !pcm_is_ready(pCapturePcm)) {
+
+        pcm_close(pPlaybackPcm);
+        pcm_close(pCapturePcm);
+        return -1;
+    }
+    SPlayback playback = { pPlaybackPcm, &playbackConfig, false, 0 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, playbackThread, &playback);
+
+    unsigned int uiBytes = pcm_frames_to_bytes(pCapturePcm, capturePcmConfig.period_size);
+    std::vector<char> buffer(uiBytes);
+    int64_t pulseCaptureTimeUs = -1;
+    uint64_t uiMaxPeriods = 4 * (NB_WARMUP_PERIODS + playbackConfig.period_count);
+
+    for (uint64_t uiPeriod = 0; uiPeriod < uiMaxPeriods; uiPeriod++) {
+
+        if (pcm_read(pCapturePcm, &buffer[0], uiBytes) != 0) {
+
+            break;
+        }
+        int64_t readTimeUs = nowUs();
+        for (unsigned int i = 0; i < uiBytes; i++) {
+
+            if (buffer[i] != 0) {
+
+                pulseCaptureTimeUs = readTimeUs;
+                break;
+            }
+        }
+        if (pulseCaptureTimeUs >= 0) {
+
+            break;
+        }
+    }
+    playback.bStop = true;
+    pthread_join(thread, NULL);
+    pcm_close(pPlaybackPcm);
+    pcm_close(pCapturePcm);
+    tinyalsa_fake_reset();
+
+    return pulseCaptureTimeUs < 0 ? -1 : pulseCaptureTimeUs - playback.pulseWriteTimeUs;
+}
+
+/** Best of several measures, the first ones on a build server being often the worst. */
+int64_t measureBestRoundTripUs(const pcm_config& playbackConfig)
+{
+    int64_t bestUs = -1;
+
+    for (unsigned int i = 0; i < NB_MEASURES; i++) {
+
+        int64_t roundTripUs = measureRoundTripUs(playbackConfig);
+        if ((roundTripUs >= 0) && ((bestUs < 0) || (roundTripUs < bestUs))) {
+
+            bestUs = roundTripUs;
+        }
+    }
+    return bestUs;
+}
+
+}
+
+TEST(AudioFastMedia, primaryOutputKeepsThePrimaryConfiguration)
+{
+    const pcm_config& primaryConfig =
+            CAudioPlatformHardware::getDefaultPcmConfig(true, AUDIO_OUTPUT_FLAG_PRIMARY);
+
+    const pcm_config& config = CAudioPlatformHardware::getDefaultPcmConfig(
+                true, AUDIO_OUTPUT_FLAG_PRIMARY | AUDIO_OUTPUT_FLAG_FAST);
+    EXPECT_EQ(&primaryConfig, &config);
+}
+
+TEST(AudioFastMedia, roundTripLatencyIsBelowTheMediaOne)
+{
+    const pcm_config& mediaConfig =
+            CAudioPlatformHardware::getDefaultPcmConfig(true, AUDIO_OUTPUT_FLAG_PRIMARY);
+    const pcm_config& fastConfig =
+            CAudioPlatformHardware::getDefaultPcmConfig(true, AUDIO_OUTPUT_FLAG_FAST);
+
+    if (&fastConfig == &mediaConfig) {
+
+        printf("No low latency configuration on this platform\n");
+        return;
+    }
+    int64_t mediaRoundTripUs = measureBestRoundTripUs(mediaConfig);
+    int64_t fastRoundTripUs = measureBestRoundTripUs(fastConfig);
+
+    printf("Round trip latency: media %lld us, fast %lld us\n",
+           (long long)mediaRoundTripUs, (long long)fastRoundTripUs);
+
+    ASSERT_GE(mediaRoundTripUs, 0);
+    ASSERT_GE(fastRoundTripUs, 0);
+    EXPECT_LT(fastRoundTripUs, mediaRoundTripUs);
+
+    // Full playback buffer, DMA period and capture period of the fast configuration
+    EXPECT_LT(fastRoundTripUs,
+              framesToUs(fastConfig, fastConfig.period_size * (fastConfig.period_count + 2)) +
+              TOLERANCE_US);
+}
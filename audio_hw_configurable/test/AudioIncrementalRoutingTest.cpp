@@ -0,0 +1,357 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioHardwareALSA.h"
+#include "AudioPlatformHardware.h"
+#include "AudioRoutingRecorder.h"
+#include "AudioRoutingReplayer.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <media/AudioParameter.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::AudioSystem;
+using android_audio_legacy::CAudioPlatformHardware;
+using android_audio_legacy::CAudioRoutingRecorder;
+using android_audio_legacy::CAudioRoutingReplayer;
+using android::AudioParameter;
+using android::String16;
+using android::String8;
+using android::Vector;
+using android::NO_ERROR;
+using android::OK;
+
+namespace
+{
+
+const unsigned int NB_SEQUENCES = 20;
+const unsigned int NB_STEPS = 100;
+
+/** Streams of the sequences, by identifier given to the replayer. */
+enum StreamId
+{
+    EPrimaryOut = 1,
+    EDeepBufferOut,
+    EIn,
+    ENbStreamIds
+};
+
+const uint32_t OUTPUT_DEVICES[] = {
+    AudioSystem::DEVICE_OUT_SPEAKER,
+    AudioSystem::DEVICE_OUT_EARPIECE,
+    AudioSystem::DEVICE_OUT_WIRED_HEADSET,
+    AudioSystem::DEVICE_OUT_WIRED_HEADPHONE,
+    AudioSystem::DEVICE_OUT_BLUETOOTH_SCO
+};
+const uint32_t NB_OUTPUT_DEVICES = sizeof(OUTPUT_DEVICES) / sizeof(OUTPUT_DEVICES[0]);
+
+const uint32_t INPUT_DEVICES[] = {
+    0,
+    AudioSystem::DEVICE_IN_BUILTIN_MIC,
+    AudioSystem::DEVICE_IN_WIRED_HEADSET,
+    AudioSystem::DEVICE_IN_BLUETOOTH_SCO_HEADSET
+};
+const uint32_t NB_INPUT_DEVICES = sizeof(INPUT_DEVICES) / sizeof(INPUT_DEVICES[0]);
+
+const int MODES[] = {
+    AudioSystem::MODE_NORMAL,
+    AudioSystem::MODE_IN_COMMUNICATION,
+    AudioSystem::MODE_IN_CALL
+};
+const uint32_t NB_MODES = sizeof(MODES) / sizeof(MODES[0]);
+
+/** Event of a sequence, as the routing recorder stores it. */
+struct SEvent
+{
+    uint16_t uiType;
+    uint16_t uiStreamId;
+    int32_t iArg0;
+    int32_t iArg1;
+    String8 data;
+};
+
+/** Routes left by the routing pass of an event. */
+struct SRoutes
+{
+    uint32_t auiEnabled[CUtils::ENbDirections];
+    uint32_t auiNeedReconfig[CUtils::ENbDirections];
+};
+
+/**
+ * HAL run against the fake tinyalsa backend, with the cards of the platform registered, and the
+ * parameter framework stub. Each sequence is run on a new HAL.
+ */
+class AudioIncrementalRoutingTest : public ::testing::Test
+{
+protected:
+    AudioIncrementalRoutingTest() : _iSkipped(0) {}
+
+    virtual void SetUp()
+    {
+        std::vector<std::string> cards;
+
+        tinyalsa_fake_reset();
+        for (uint32_t uiRoute = 0; uiRoute < CAudioPlatformHardware::getNbRoutes(); uiRoute++) {
+
+            const char *pcCardName = CAudioPlatformHardware::getRouteCardName(uiRoute);
+            if ((pcCardName == NULL) || (pcCardName[0] == '\0') ||
+                    (std::find(cards.begin(), cards.end(), pcCardName) != cards.end())) {
+
+                continue;
+            }
+            ASSERT_EQ(0, tinyalsa_fake_add_card(pcCardName, cards.size()));
+            cards.push_back(pcCardName);
+        }
+    }
+
+    virtual void TearDown()
+    {
+        tinyalsa_fake_reset();
+    }
+
+    static String8 getParameter(const char *pcKey, const char *pcValue)
+    {
+        AudioParameter param;
+
+        param.add(String8(pcKey), String8(pcValue));
+        return param.toString();
+    }
+
+    static String8 getSampleSpec(uint32_t uiChannels, uint32_t uiSampleRate)
+    {
+        AudioParameter param;
+
+        param.addInt(String8(AudioParameter::keyFormat), AudioSystem::PCM_16_BIT);
+        param.addInt(String8(AudioParameter::keyChannels), uiChannels);
+        param.addInt(String8(AudioParameter::keySamplingRate), uiSampleRate);
+        return param.toString();
+    }
+
+    static SEvent getEvent(uint16_t uiType, uint16_t uiStreamId, int32_t iArg0, int32_t iArg1,
+                           const String8 &data)
+    {
+        SEvent stEvent;
+
+        stEvent.uiType = uiType;
+        stEvent.uiStreamId = uiStreamId;
+        stEvent.iArg0 = iArg0;
+        stEvent.iArg1 = iArg1;
+        stEvent.data = data;
+        return stEvent;
+    }
+
+    /**
+     * Sequence of hardware parameters, stream routings and mode changes, starts and stops, the
+     * streams being opened first.
+     */
+    static std::vector<SEvent> generateSequence(unsigned int uiSeed)
+    {
+        std::vector<SEvent> sequence;
+        int iMode = AudioSystem::MODE_NORMAL;
+
+        sequence.push_back(getEvent(CAudioRoutingRecorder::EAddStream, EPrimaryOut,
+                                    AUDIO_OUTPUT_FLAG_PRIMARY, true,
+                                    getSampleSpec(AudioSystem::CHANNEL_OUT_STEREO, 48000)));
+        sequence.push_back(getEvent(CAudioRoutingRecorder::EAddStream, EDeepBufferOut,
+                                    AUDIO_OUTPUT_FLAG_DEEP_BUFFER, true,
+                                    getSampleSpec(AudioSystem::CHANNEL_OUT_STEREO, 48000)));
+        sequence.push_back(getEvent(CAudioRoutingRecorder::EAddStream, EIn, 0, false,
+                                    getSampleSpec(AudioSystem::CHANNEL_IN_MONO, 16000)));
+
+        for (unsigned int uiStep = 0; uiStep < NB_STEPS; uiStep++) {
+
+            bool bOn = rand_r(&uiSeed) & 1;
+            uint16_t uiStreamId = EPrimaryOut + rand_r(&uiSeed) % (ENbStreamIds - EPrimaryOut);
+            AudioParameter routing;
+
+            switch (rand_r(&uiSeed) % 7) {
+            case 0:
+                sequence.push_back(getEvent(CAudioRoutingRecorder::ESetParameters, 0, 0, 0,
+                                            getParameter(AUDIO_PARAMETER_KEY_SCREEN_STATE,
+                                                         bOn ? AUDIO_PARAMETER_VALUE_ON :
+                                                               AUDIO_PARAMETER_VALUE_OFF)));
+                break;
+            case 1:
+                sequence.push_back(getEvent(CAudioRoutingRecorder::ESetParameters, 0, 0, 0,
+                                            getParameter(AUDIO_PARAMETER_KEY_BT_NREC,
+                                                         bOn ? AUDIO_PARAMETER_VALUE_ON :
+                                                               AUDIO_PARAMETER_VALUE_OFF)));
+                break;
+            case 2:
+                // Any value but the on one disables bluetooth
+                sequence.push_back(getEvent(CAudioRoutingRecorder::ESetParameters, 0, 0, 0,
+                                            getParameter(AUDIO_PARAMETER_KEY_BLUETOOTH_STATE,
+                                                         bOn ?
+                                                         AUDIO_PARAMETER_VALUE_BLUETOOTH_STATE_ON :
+                                                         AUDIO_PARAMETER_VALUE_OFF)));
+                break;
+            case 3:
+                // Device plugged or selected, along with a mode change or not
+                if (bOn) {
+
+                    iMode = MODES[rand_r(&uiSeed) % NB_MODES];
+                }
+                uiStreamId = EPrimaryOut + rand_r(&uiSeed) % (EIn - EPrimaryOut);
+                routing.addInt(String8(AudioParameter::keyRouting),
+                               OUTPUT_DEVICES[rand_r(&uiSeed) % NB_OUTPUT_DEVICES]);
+                sequence.push_back(getEvent(CAudioRoutingRecorder::ESetStreamParameters,
+                                            uiStreamId, iMode, 0, routing.toString()));
+                break;
+            case 4:
+                routing.addInt(String8(AudioParameter::keyRouting),
+                               INPUT_DEVICES[rand_r(&uiSeed) % NB_INPUT_DEVICES]);
+                sequence.push_back(getEvent(CAudioRoutingRecorder::ESetStreamParameters, EIn,
+                                            iMode, 0, routing.toString()));
+                break;
+            case 5:
+                sequence.push_back(getEvent(CAudioRoutingRecorder::EStartStream, uiStreamId, 0,
+                                            0, String8()));
+                break;
+            default:
+                sequence.push_back(getEvent(CAudioRoutingRecorder::EStopStream, uiStreamId, 0,
+                                            0, String8()));
+                break;
+            }
+        }
+        return sequence;
+    }
+
+    /**
+     * Runs a sequence on a new HAL.
+     *
+     * @param[out] routes routes left by each event, once its routing pass run.
+     */
+    void runSequence(const std::vector<SEvent> &sequence, bool bIncrementalRouting,
+                     std::vector<SRoutes> &routes)
+    {
+        AudioHardwareALSA *pHardware = new AudioHardwareALSA();
+        ASSERT_EQ(NO_ERROR, pHardware->initCheck());
+        {
+            CAudioRoutingReplayer replayer(pHardware);
+
+            replayer.setIncrementalRouting(bIncrementalRouting);
+            for (size_t i = 0; i < sequence.size(); i++) {
+
+                const SEvent &stEvent = sequence[i];
+                SRoutes stRoutes;
+
+                EXPECT_EQ(OK, replayer.apply(stEvent.uiType, stEvent.uiStreamId, stEvent.iArg0,
+                                             stEvent.iArg1, stEvent.data));
+                EXPECT_TRUE(replayer.waitForRouting());
+                for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+                    replayer.getRoutes(uiDir, stRoutes.auiEnabled[uiDir],
+                                       stRoutes.auiNeedReconfig[uiDir]);
+                }
+                routes.push_back(stRoutes);
+            }
+        }
+        if (bIncrementalRouting) {
+
+            _iSkipped += getSkippedEvaluations(pHardware);
+        }
+        delete pHardware;
+    }
+
+    /** Routing evaluations skipped, as reported by the dump of the HAL. */
+    static int getSkippedEvaluations(AudioHardwareALSA *pHardware)
+    {
+        FILE *pFile = tmpfile();
+        char acLine[256];
+        int iEvaluated = 0;
+        int iSkipped = 0;
+
+        if (pFile == NULL) {
+
+            return 0;
+        }
+        pHardware->dumpState(fileno(pFile), Vector<String16>());
+        rewind(pFile);
+        while (fgets(acLine, sizeof(acLine), pFile) != NULL) {
+
+            const char *pcMetrics = strstr(acLine, "incremental routing");
+            if ((pcMetrics != NULL) && ((pcMetrics = strchr(pcMetrics, ':')) != NULL) &&
+                    (sscanf(pcMetrics, ": %d evaluations, %d skipped",
+                            &iEvaluated, &iSkipped) == 2)) {
+
+                break;
+            }
+        }
+        fclose(pFile);
+        return iSkipped;
+    }
+
+    /** Evaluations skipped by the incremental routing over all the sequences run. */
+    int _iSkipped;
+};
+
+}
+
+/**
+ * Incremental routing only skips the evaluations that would find the routes unchanged: after
+ * every event of random sequences, the routes enabled and reconfigured are the same with and
+ * without it.
+ */
+TEST_F(AudioIncrementalRoutingTest, randomSequencesRouteAsFullEvaluation)
+{
+    for (unsigned int uiSeed = 1; uiSeed <= NB_SEQUENCES; uiSeed++) {
+
+        std::vector<SEvent> sequence = generateSequence(uiSeed);
+        std::vector<SRoutes> fullRoutes;
+        std::vector<SRoutes> incrementalRoutes;
+
+        runSequence(sequence, false, fullRoutes);
+        runSequence(sequence, true, incrementalRoutes);
+        ASSERT_EQ(sequence.size(), fullRoutes.size());
+        ASSERT_EQ(sequence.size(), incrementalRoutes.size());
+
+        for (size_t i = 0; i < sequence.size(); i++) {
+
+            const SEvent &stEvent = sequence[i];
+            for (uint32_t uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+                ASSERT_EQ(fullRoutes[i].auiEnabled[uiDir], incrementalRoutes[i].auiEnabled[uiDir])
+                        << "seed " << uiSeed << " event #" << i << " "
+                        << CAudioRoutingRecorder::getEventTypeName(stEvent.uiType)
+                        << " stream " << stEvent.uiStreamId << " \"" << stEvent.data.string()
+                        << "\", " << (uiDir == CUtils::EOutput ? "output" : "input")
+                        << " routes enabled";
+                ASSERT_EQ(fullRoutes[i].auiNeedReconfig[uiDir],
+                          incrementalRoutes[i].auiNeedReconfig[uiDir])
+                        << "seed " << uiSeed << " event #" << i << " "
+                        << CAudioRoutingRecorder::getEventTypeName(stEvent.uiType)
+                        << " stream " << stEvent.uiStreamId << " \"" << stEvent.data.string()
+                        << "\", " << (uiDir == CUtils::EOutput ? "output" : "input")
+                        << " routes reconfigured";
+            }
+        }
+    }
+    printf("Incremental routing: %d evaluations skipped over %d sequences of %d events\n",
+           _iSkipped, NB_SEQUENCES, NB_STEPS);
+
+    // Otherwise the sequences only compared full evaluations
+    EXPECT_GT(_iSkipped, 0);
+}
@@ -0,0 +1,264 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+
+#include "AudioPcmPool.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <tinyalsa/asoundlib.h>
+#include <utils/String8.h>
+#include <stdio.h>
+#include <string.h>
+
+using android_audio_legacy::CAudioPcmPool;
+using android::String8;
+
+namespace
+{
+
+const int CARD = 0;
+const int DEVICE = 0;
+const uint32_t NB_TOGGLES = 50;
+/** Time the fake takes to open a device, of the order of a real device. */
+const unsigned int OPEN_TIME_US = 2000;
+const uint32_t RETENTION_MS = 2000;
+
+/** Metrics of the pool, as dumped. */
+struct SPoolMetrics
+{
+    int iWarmOpens;
+    long long llWarmOpenUs;
+    int iColdOpens;
+    long long llColdOpenUs;
+    int iEvicted;
+    int iExpired;
+};
+
+pcm_config getConfig(unsigned int uiPeriodSize)
+{
+    pcm_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.channels = 2;
+    config.rate = 48000;
+    config.period_size = uiPeriodSize;
+    config.period_count = 4;
+    config.format = PCM_FORMAT_S16_LE;
+    return config;
+}
+
+/**
+ * Devices of the fake backend opened and closed through a pool, as the stream routes do.
+ */
+class AudioPcmPoolTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        tinyalsa_fake_reset();
+        tinyalsa_fake_set_open_time(OPEN_TIME_US);
+    }
+
+    virtual void TearDown()
+    {
+        tinyalsa_fake_reset();
+    }
+
+    /**
+     * Opens a device as a route enabled does: from a warm handle if any, prepare included.
+     *
+     * @param[in] pool pool of the warm handles.
+     * @param[in] iDevice pcm device identifier.
+     * @param[in] config configuration of the device.
+     * @param[out] pbIsWarm true if a warm handle was used.
+     *
+     * @return device opened.
+     */
+    pcm *open(CAudioPcmPool &pool, int iDevice, pcm_config config, bool *pbIsWarm = NULL)
+    {
+        nsecs_t startTime = systemTime();
+        pcm *pPcm = pool.acquire(CARD, iDevice, true, config);
+        bool bIsWarm = (pPcm != NULL);
+
+        if (!bIsWarm) {
+
+            pPcm = pcm_open(CARD, iDevice, PCM_OUT, &config);
+        }
+        EXPECT_TRUE(pcm_is_ready(pPcm));
+        EXPECT_EQ(0, pcm_prepare(pPcm));
+        pool.recordOpenTime(bIsWarm, systemTime() - startTime);
+        if (pbIsWarm != NULL) {
+
+            *pbIsWarm = bIsWarm;
+        }
+        return pPcm;
+    }
+
+    /**
+     * Closes a device as a route disabled does.
+     */
+    void close(CAudioPcmPool &pool, int iDevice, const pcm_config &config, pcm *pPcm)
+    {
+        pool.release(CARD, iDevice, true, config, pPcm);
+    }
+
+    SPoolMetrics getMetrics(const CAudioPcmPool &pool)
+    {
+        SPoolMetrics stMetrics;
+        String8 result;
+
+        memset(&stMetrics, 0, sizeof(stMetrics));
+        pool.dump(result);
+        const char *pcLine = strstr(result.string(), "warm opens");
+        EXPECT_TRUE(pcLine != NULL);
+        while ((pcLine != NULL) && (pcLine > result.string()) && (pcLine[-1] != '\n')) {
+
+            pcLine--;
+        }
+        EXPECT_EQ(6, sscanf(pcLine != NULL ? pcLine : "",
+                            " %d warm opens (avg %lld us), %d cold opens (avg %lld us), "
+                            "%d evicted, %d expired",
+                            &stMetrics.iWarmOpens, &stMetrics.llWarmOpenUs,
+                            &stMetrics.iColdOpens, &stMetrics.llColdOpenUs,
+                            &stMetrics.iEvicted, &stMetrics.iExpired));
+        return stMetrics;
+    }
+
+    unsigned int getDeviceOpens(int iDevice)
+    {
+        tinyalsa_fake_stats stats;
+
+        tinyalsa_fake_get_stats(CARD, iDevice, PCM_OUT, &stats);
+        return stats.opens;
+    }
+};
+
+}
+
+/**
+ * Time to enable a route toggled on and off, without and with warm handles.
+ */
+TEST_F(AudioPcmPoolTest, benchmarkRouteToggle)
+{
+    static const uint32_t auiMaxHandles[] = { 0, 2 };
+    pcm_config config = getConfig(240);
+    long long allAvgOpenUs[2];
+
+    for (uint32_t i = 0; i < sizeof(auiMaxHandles) / sizeof(auiMaxHandles[0]); i++) {
+
+        tinyalsa_fake_reset();
+        tinyalsa_fake_set_open_time(OPEN_TIME_US);
+        CAudioPcmPool pool(auiMaxHandles[i], RETENTION_MS);
+        nsecs_t maxOpenTime = 0;
+
+        for (uint32_t uiToggle = 0; uiToggle < NB_TOGGLES; uiToggle++) {
+
+            nsecs_t startTime = systemTime();
+            pcm *pPcm = open(pool, DEVICE, config);
+            nsecs_t openTime = systemTime() - startTime;
+            if (openTime > maxOpenTime) {
+
+                maxOpenTime = openTime;
+            }
+            close(pool, DEVICE, config, pPcm);
+        }
+        SPoolMetrics stMetrics = getMetrics(pool);
+        allAvgOpenUs[i] = (stMetrics.iWarmOpens * stMetrics.llWarmOpenUs +
+                           stMetrics.iColdOpens * stMetrics.llColdOpenUs) / NB_TOGGLES;
+
+        printf("pool of %u handles: %u toggles, %u device opens, avg %lld us, max %lld us to "
+               "enable the route\n", auiMaxHandles[i], NB_TOGGLES, getDeviceOpens(DEVICE),
+               allAvgOpenUs[i], static_cast<long long>(ns2us(maxOpenTime)));
+
+        // Only the first toggle opens the device once the pool keeps it
+        EXPECT_EQ(auiMaxHandles[i] ? 1u : NB_TOGGLES, getDeviceOpens(DEVICE));
+        EXPECT_EQ(auiMaxHandles[i] ? NB_TOGGLES - 1 : 0, (uint32_t)stMetrics.iWarmOpens);
+    }
+    EXPECT_LT(allAvgOpenUs[1], allAvgOpenUs[0]);
+}
+
+TEST_F(AudioPcmPoolTest, oldestHandleIsEvictedWhenThePoolIsFull)
+{
+    pcm_config config = getConfig(240);
+    CAudioPcmPool pool(2, RETENTION_MS);
+    bool bIsWarm;
+
+    for (int iDevice = 0; iDevice < 3; iDevice++) {
+
+        close(pool, iDevice, config, open(pool, iDevice, config));
+    }
+    EXPECT_EQ(1, getMetrics(pool).iEvicted);
+
+    // The first device released made room for the last one
+    pcm *pPcm = open(pool, 0, config, &bIsWarm);
+    EXPECT_FALSE(bIsWarm);
+    close(pool, 0, config, pPcm);
+    EXPECT_EQ(2u, getDeviceOpens(0));
+
+    // Device 1 was then the oldest one
+    pPcm = open(pool, 2, config, &bIsWarm);
+    EXPECT_TRUE(bIsWarm);
+    close(pool, 2, config, pPcm);
+    pPcm = open(pool, 1, config, &bIsWarm);
+    EXPECT_FALSE(bIsWarm);
+    close(pool, 1, config, pPcm);
+    EXPECT_EQ(1u, getDeviceOpens(2));
+    EXPECT_EQ(3, getMetrics(pool).iEvicted);
+}
+
+TEST_F(AudioPcmPoolTest, warmHandleOfAnotherConfigIsClosed)
+{
+    pcm_config config = getConfig(240);
+    pcm_config otherConfig = getConfig(960);
+    CAudioPcmPool pool(2, RETENTION_MS);
+    bool bIsWarm;
+
+    close(pool, DEVICE, config, open(pool, DEVICE, config));
+    pcm *pPcm = open(pool, DEVICE, otherConfig, &bIsWarm);
+    EXPECT_FALSE(bIsWarm);
+    EXPECT_EQ(2u, getDeviceOpens(DEVICE));
+    EXPECT_EQ(1, getMetrics(pool).iEvicted);
+    close(pool, DEVICE, otherConfig, pPcm);
+}
+
+TEST_F(AudioPcmPoolTest, warmHandlesExpireAfterTheRetentionTime)
+{
+    pcm_config config = getConfig(240);
+    const uint32_t uiRetentionMs = 50;
+    CAudioPcmPool pool(4, uiRetentionMs);
+    bool bIsWarm;
+
+    nsecs_t releaseTime = systemTime();
+    close(pool, 0, config, open(pool, 0, config));
+    close(pool, 1, config, open(pool, 1, config));
+
+    // Kept until the retention time of the oldest handle
+    nsecs_t deadline = pool.closeExpired(systemTime());
+    EXPECT_GE(deadline, releaseTime + ms2ns(uiRetentionMs));
+    EXPECT_LE(deadline, systemTime() + ms2ns(uiRetentionMs));
+    EXPECT_FALSE(pool.isEmpty());
+    EXPECT_EQ(0, getMetrics(pool).iExpired);
+
+    // Both handles expired a retention time later
+    EXPECT_EQ(0, pool.closeExpired(systemTime() + ms2ns(uiRetentionMs)));
+    EXPECT_TRUE(pool.isEmpty());
+    EXPECT_EQ(2, getMetrics(pool).iExpired);
+
+    pcm *pPcm = open(pool, 0, config, &bIsWarm);
+    EXPECT_FALSE(bIsWarm);
+    EXPECT_EQ(2u, getDeviceOpens(0));
+    close(pool, 0, config, pPcm);
+}
@@ -0,0 +1,61 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/*
+ * Host tool converting the tables compiled in the platform file of the product into the
+ * platform description file the HAL maps at startup, given by the platform description
+ * property. A new board thus gets its description without running a HAL on target.
+ * The description has the layout of the x86 targets, the same on the 32 and 64 bits hosts.
+ *
+ * usage: audio_platform_description_host <description file>
+ */
+
+#include "AudioPlatformDescription.h"
+#include "AudioPlatformHardware.h"
+#include <stdio.h>
+#include <string>
+
+using android_audio_legacy::CAudioPlatformDescription;
+using android_audio_legacy::CAudioPlatformHardware;
+using android::OK;
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+
+        fprintf(stderr, "usage: %s <description file>\n", argv[0]);
+        return 1;
+    }
+    std::string strPath(argv[1]);
+
+    if (CAudioPlatformHardware::exportDescription(strPath) != OK) {
+
+        fprintf(stderr, "%s: could not convert the platform tables into %s\n", argv[0],
+                strPath.c_str());
+        return 1;
+    }
+    // Checked as the HAL does when loading it
+    CAudioPlatformDescription description;
+    if (description.map(strPath) != OK) {
+
+        fprintf(stderr, "%s: %s does not load back\n", argv[0], strPath.c_str());
+        return 1;
+    }
+    const CAudioPlatformDescription::SImage &stImage = description.getImage();
+    printf("%s: %u ports, %u port groups, %u routes\n", strPath.c_str(), stImage.uiNbPorts,
+           stImage.uiNbPortGroups, stImage.uiNbRoutes);
+    return 0;
+}
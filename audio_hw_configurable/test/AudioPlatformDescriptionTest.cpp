@@ -0,0 +1,170 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioPlatformDescription.h"
+#include "AudioPlatformHardware.h"
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+using android_audio_legacy::CAudioPlatformDescription;
+using android_audio_legacy::CAudioPlatformHardware;
+using android::OK;
+using android::BAD_VALUE;
+
+namespace
+{
+
+/**
+ * Description exported from the tables of the platform, corrupted then mapped back as the HAL
+ * loads it at startup.
+ */
+class AudioPlatformDescriptionTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        char acPath[] = "/tmp/audio_platform_descriptionXXXXXX";
+        int iFd = mkstemp(acPath);
+        ASSERT_GE(iFd, 0);
+        close(iFd);
+        _strPath = acPath;
+
+        ASSERT_EQ(OK, CAudioPlatformHardware::exportDescription(_strPath));
+        ASSERT_TRUE(read(_stImage));
+    }
+
+    virtual void TearDown()
+    {
+        unlink(_strPath.c_str());
+    }
+
+    bool read(CAudioPlatformDescription::SImage &stImage) const
+    {
+        FILE *pFile = fopen(_strPath.c_str(), "rb");
+        if (pFile == NULL) {
+
+            return false;
+        }
+        bool bRead = fread(&stImage, sizeof(stImage), 1, pFile) == 1;
+        fclose(pFile);
+        return bRead;
+    }
+
+    /** Writes an image, mapped back through the checks of the description. */
+    android::status_t map(const CAudioPlatformDescription::SImage &stImage) const
+    {
+        FILE *pFile = fopen(_strPath.c_str(), "wb");
+        if (pFile == NULL) {
+
+            return BAD_VALUE;
+        }
+        bool bWritten = fwrite(&stImage, sizeof(stImage), 1, pFile) == 1;
+        fclose(pFile);
+        if (!bWritten) {
+
+            return BAD_VALUE;
+        }
+        CAudioPlatformDescription description;
+        return description.map(_strPath);
+    }
+
+    /** Index of the first route playing or capturing, -1 if none. */
+    int32_t getRouteWithPcmConfig(uint32_t &uiDir) const
+    {
+        for (uint32_t uiRoute = 0; uiRoute < _stImage.uiNbRoutes; uiRoute++) {
+
+            for (uiDir = 0; uiDir < CUtils::ENbDirections; uiDir++) {
+
+                if (_stImage.astRoutes[uiRoute].astPcmConfig[uiDir].rate != 0) {
+
+                    return uiRoute;
+                }
+            }
+        }
+        return -1;
+    }
+
+    std::string _strPath;
+    CAudioPlatformDescription::SImage _stImage;
+};
+
+}
+
+TEST_F(AudioPlatformDescriptionTest, exportedDescriptionIsMapped)
+{
+    EXPECT_EQ(OK, map(_stImage));
+}
+
+TEST_F(AudioPlatformDescriptionTest, routePcmConfigWithoutRateOrPeriodsIsRejected)
+{
+    uint32_t uiDir;
+    int32_t iRoute = getRouteWithPcmConfig(uiDir);
+    ASSERT_GE(iRoute, 0);
+    const pcm_config &stConfig = _stImage.astRoutes[iRoute].astPcmConfig[uiDir];
+
+    CAudioPlatformDescription::SImage stImage = _stImage;
+    stImage.astRoutes[iRoute].astPcmConfig[uiDir].rate = 0;
+    EXPECT_EQ(BAD_VALUE, map(stImage));
+
+    stImage.astRoutes[iRoute].astPcmConfig[uiDir] = stConfig;
+    stImage.astRoutes[iRoute].astPcmConfig[uiDir].period_size = 0;
+    EXPECT_EQ(BAD_VALUE, map(stImage));
+
+    stImage.astRoutes[iRoute].astPcmConfig[uiDir] = stConfig;
+    stImage.astRoutes[iRoute].astPcmConfig[uiDir].period_count = 0;
+    EXPECT_EQ(BAD_VALUE, map(stImage));
+
+    stImage.astRoutes[iRoute].astPcmConfig[uiDir] = stConfig;
+    stImage.astRoutes[iRoute].astPcmConfig[uiDir].channels =
+            CAudioPlatformDescription::MAX_CHANNELS + 1;
+    EXPECT_EQ(BAD_VALUE, map(stImage));
+}
+
+TEST_F(AudioPlatformDescriptionTest, channelsPolicyOutOfRangeIsRejected)
+{
+    ASSERT_GT(_stImage.uiNbRoutes, 0u);
+
+    CAudioPlatformDescription::SImage stImage = _stImage;
+    stImage.astRoutes[0].aiChannelsPolicy[0][0] = -1;
+    EXPECT_EQ(BAD_VALUE, map(stImage));
+
+    stImage.astRoutes[0].aiChannelsPolicy[0][0] = 0x7fffffff;
+    EXPECT_EQ(BAD_VALUE, map(stImage));
+}
+
+TEST_F(AudioPlatformDescriptionTest, defaultPcmConfigs)
+{
+    CAudioPlatformDescription::SImage stImage = _stImage;
+
+    // Media configurations are mandatory
+    stImage.astDefaultPcmConfigs[CAudioPlatformDescription::EMediaPlayback].period_count = 0;
+    EXPECT_EQ(BAD_VALUE, map(stImage));
+
+    // Deep buffer and fast configurations may be left empty, not partially filled
+    stImage = _stImage;
+    memset(&stImage.astDefaultPcmConfigs[CAudioPlatformDescription::EDeepMediaPlayback], 0,
+           sizeof(pcm_config));
+    memset(&stImage.astDefaultPcmConfigs[CAudioPlatformDescription::EFastMediaPlayback], 0,
+           sizeof(pcm_config));
+    EXPECT_EQ(OK, map(stImage));
+
+    stImage.astDefaultPcmConfigs[CAudioPlatformDescription::EFastMediaPlayback].rate = 48000;
+    EXPECT_EQ(BAD_VALUE, map(stImage));
+}
@@ -0,0 +1,275 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioPlaybackMixer.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <tinyalsa/asoundlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::CAudioPlaybackMixer;
+using android::OK;
+
+namespace
+{
+
+const unsigned int CARD = 0;
+const unsigned int DEVICE = 0;
+const unsigned int NB_BENCHMARK_PERIODS = 100;
+const int16_t SAMPLE = 16384;
+
+pcm_config getConfig(pcm_format eFormat)
+{
+    pcm_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.channels = 2;
+    config.rate = 48000;
+    config.period_size = 240;
+    config.period_count = 4;
+    config.format = eFormat;
+    return config;
+}
+
+int64_t threadCpuTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Output device of the fake backend mixed into, the frames played being kept in a data file.
+ */
+class AudioPlaybackMixerTest : public ::testing::Test
+{
+protected:
+    AudioPlaybackMixerTest() : _pPcm(NULL) {}
+
+    virtual void SetUp()
+    {
+        char acDir[] = "/tmp/playback_mixer.XXXXXX";
+
+        tinyalsa_fake_reset();
+        ASSERT_TRUE(mkdtemp(acDir) != NULL);
+        _strDataDir = acDir;
+    }
+
+    virtual void TearDown()
+    {
+        if (_pPcm != NULL) {
+
+            _mixer.close();
+            pcm_close(_pPcm);
+        }
+        unlink(getPlayedFilePath().c_str());
+        rmdir(_strDataDir.c_str());
+        tinyalsa_fake_reset();
+    }
+
+    void open(pcm_config config, bool bKeepFrames)
+    {
+        tinyalsa_fake_set_data_dir(bKeepFrames ? _strDataDir.c_str() : NULL);
+        _config = config;
+        _pPcm = pcm_open(CARD, DEVICE, PCM_OUT, &config);
+        ASSERT_TRUE(pcm_is_ready(_pPcm));
+        ASSERT_EQ(OK, _mixer.open(_pPcm, _config));
+    }
+
+    std::vector<int16_t> getPeriod(int16_t iSample) const
+    {
+        return std::vector<int16_t>(_config.period_size * _config.channels, iSample);
+    }
+
+    std::vector<int16_t> readPlayedFrames() const
+    {
+        std::vector<int16_t> samples;
+        FILE *pFile = fopen(getPlayedFilePath().c_str(), "rb");
+        int16_t iSample;
+
+        while ((pFile != NULL) && (fread(&iSample, sizeof(iSample), 1, pFile) == 1)) {
+
+            samples.push_back(iSample);
+        }
+        if (pFile != NULL) {
+
+            fclose(pFile);
+        }
+        return samples;
+    }
+
+    std::string getPlayedFilePath() const
+    {
+        char acPath[256];
+
+        snprintf(acPath, sizeof(acPath), "%s/pcmC%uD%up.raw", _strDataDir.c_str(), CARD, DEVICE);
+        return acPath;
+    }
+
+    CAudioPlaybackMixer _mixer;
+    pcm *_pPcm;
+    pcm_config _config;
+    std::string _strDataDir;
+};
+
+}
+
+TEST_F(AudioPlaybackMixerTest, leftAndRightGainsApplyToTheirChannels)
+{
+    open(getConfig(PCM_FORMAT_S16_LE), true);
+    int iWriter;
+    ASSERT_EQ(OK, _mixer.addClient(&iWriter, true));
+    _mixer.setClientGain(&iWriter, 0.5f, 1.0f);
+
+    std::vector<int16_t> period = getPeriod(SAMPLE);
+    ASSERT_EQ(0, _mixer.write(&iWriter, &period[0], _config.period_size));
+    _mixer.removeClient(&iWriter);
+    _mixer.close();
+    pcm_close(_pPcm);
+    _pPcm = NULL;
+
+    std::vector<int16_t> played = readPlayedFrames();
+    ASSERT_EQ(period.size(), played.size());
+    for (size_t i = 0; i < played.size(); i += 2) {
+
+        ASSERT_EQ(SAMPLE / 2, played[i]);
+        ASSERT_EQ(SAMPLE, played[i + 1]);
+    }
+}
+
+TEST_F(AudioPlaybackMixerTest, clientDrainsTheRingsOfAPausedWriter)
+{
+    open(getConfig(PCM_FORMAT_S16_LE), true);
+    int iWriter;
+    int iClient;
+    ASSERT_EQ(OK, _mixer.addClient(&iWriter, true));
+    ASSERT_EQ(OK, _mixer.addClient(&iClient, false));
+
+    // Twice the ring of the client, without the writer ever writing
+    const unsigned int uiNbPeriods = 8;
+    for (unsigned int i = 0; i < uiNbPeriods; i++) {
+
+        std::vector<int16_t> period = getPeriod(SAMPLE);
+        ASSERT_EQ(0, _mixer.write(&iClient, &period[0], _config.period_size));
+    }
+    _mixer.removeClient(&iClient);
+    _mixer.removeClient(&iWriter);
+    _mixer.close();
+    pcm_close(_pPcm);
+    _pPcm = NULL;
+
+    // Frames still queued when the client left are dropped, none of the frames drained is
+    std::vector<int16_t> played = readPlayedFrames();
+    ASSERT_GE(played.size(), (uiNbPeriods / 2) * getPeriod(0).size());
+    for (size_t i = 0; i < played.size(); i++) {
+
+        ASSERT_EQ(SAMPLE, played[i]);
+    }
+}
+
+TEST_F(AudioPlaybackMixerTest, writerFlushKeepsTheOtherClientsPlaying)
+{
+    open(getConfig(PCM_FORMAT_S16_LE), false);
+    int iWriter;
+    int iClient;
+    unsigned int uiAvail;
+    struct timespec ts;
+    ASSERT_EQ(OK, _mixer.addClient(&iWriter, true));
+    ASSERT_EQ(OK, _mixer.addClient(&iClient, false));
+
+    // Half of the buffer written starts the device
+    std::vector<int16_t> period = getPeriod(SAMPLE);
+    for (unsigned int i = 0; i < _config.period_count / 2; i++) {
+
+        ASSERT_EQ(0, _mixer.write(&iClient, &period[0], _config.period_size));
+        ASSERT_EQ(0, _mixer.write(&iWriter, &period[0], _config.period_size));
+    }
+    ASSERT_EQ(0, pcm_get_htimestamp(_pPcm, &uiAvail, &ts));
+
+    EXPECT_EQ(0, _mixer.flush(&iWriter));
+    EXPECT_EQ(0, pcm_get_htimestamp(_pPcm, &uiAvail, &ts));
+
+    // Alone, the writer stops the device
+    _mixer.removeClient(&iClient);
+    EXPECT_EQ(0, _mixer.flush(&iWriter));
+    EXPECT_NE(0, pcm_get_htimestamp(_pPcm, &uiAvail, &ts));
+    _mixer.removeClient(&iWriter);
+}
+
+/**
+ * Processing time of the writer and of the clients per period, the device waits excluded, as
+ * streams are added to the route.
+ */
+TEST_F(AudioPlaybackMixerTest, benchmarkMixCostPerPeriod)
+{
+    static const unsigned int auiNbStreams[] = { 2, 4, 8 };
+    static const pcm_format aeFormats[] = { PCM_FORMAT_S16_LE, PCM_FORMAT_S32_LE };
+
+    for (size_t uiFormat = 0; uiFormat < sizeof(aeFormats) / sizeof(aeFormats[0]); uiFormat++) {
+
+        for (size_t uiCase = 0; uiCase < sizeof(auiNbStreams) / sizeof(auiNbStreams[0]);
+             uiCase++) {
+
+            unsigned int uiNbStreams = auiNbStreams[uiCase];
+            pcm_config config = getConfig(aeFormats[uiFormat]);
+            CAudioPlaybackMixer mixer;
+            pcm *pPcm = pcm_open(CARD, DEVICE, PCM_OUT, &config);
+            ASSERT_TRUE(pcm_is_ready(pPcm));
+            ASSERT_EQ(OK, mixer.open(pPcm, config));
+
+            // Streams are identified by their index, the first one owning the route
+            std::vector<char> streams(uiNbStreams);
+            for (unsigned int uiStream = 0; uiStream < uiNbStreams; uiStream++) {
+
+                ASSERT_EQ(OK, mixer.addClient(&streams[uiStream], uiStream == 0));
+                mixer.setClientGain(&streams[uiStream], 0.5f, 0.25f);
+            }
+            std::vector<char> period(pcm_frames_to_bytes(pPcm, config.period_size), 0x11);
+
+            int64_t startNs = threadCpuTimeNs();
+            for (unsigned int i = 0; i < NB_BENCHMARK_PERIODS; i++) {
+
+                // Clients queue their period before the writer mixes it, none of them waits
+                for (unsigned int uiStream = 1; uiStream < uiNbStreams; uiStream++) {
+
+                    ASSERT_EQ(0, mixer.write(&streams[uiStream], &period[0], config.period_size));
+                }
+                ASSERT_EQ(0, mixer.write(&streams[0], &period[0], config.period_size));
+            }
+            int64_t costNs = (threadCpuTimeNs() - startNs) / NB_BENCHMARK_PERIODS;
+
+            printf("Mix of %u %s streams: %lld ns per period of %u frames\n", uiNbStreams,
+                   config.format == PCM_FORMAT_S16_LE ? "S16" : "S24 over 32",
+                   (long long)costNs, config.period_size);
+
+            // Far below the period duration, or the streams cannot be mixed in real time
+            EXPECT_LT(costNs, (int64_t)config.period_size * 1000000000LL / config.rate / 10);
+
+            for (unsigned int uiStream = 0; uiStream < uiNbStreams; uiStream++) {
+
+                mixer.removeClient(&streams[uiStream]);
+            }
+            mixer.close();
+            pcm_close(pPcm);
+        }
+    }
+}
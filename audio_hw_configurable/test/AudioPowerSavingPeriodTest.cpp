@@ -0,0 +1,228 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioHardwareALSA.h"
+#include "AudioPlatformHardware.h"
+#include "AudioRoutingReplayer.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <media/AudioParameter.h>
+#include <tinyalsa/asoundlib.h>
+#include <utils/String8.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::AudioStreamOut;
+using android_audio_legacy::AudioSystem;
+using android_audio_legacy::CAudioPlatformHardware;
+using android_audio_legacy::CAudioRoutingReplayer;
+using android::AudioParameter;
+using android::String8;
+using android::status_t;
+using android::NO_ERROR;
+
+namespace
+{
+
+/** Devices scanned per card for the metrics of the playback. */
+const unsigned int MAX_DEVICES = 32;
+const unsigned int NB_TOGGLES = 5;
+/** Playback time after each screen state change, several periods of either size. */
+const uint32_t TOGGLE_PERIOD_MS = 200;
+const uint32_t POLL_PERIOD_US = 1000;
+const uint32_t AUDIO_TIMEOUT_MS = 2000;
+
+/** Metrics of all the playback devices of the platform. */
+struct SPlaybackStats
+{
+    unsigned int uiOpens;
+    unsigned int uiXruns;
+    uint64_t ulFrames;
+};
+
+/**
+ * HAL run against the fake tinyalsa backend, with the sound cards of the platform, and the
+ * parameter framework stub. The primary output plays on the speaker, as audio flinger does.
+ */
+class AudioPowerSavingPeriodTest : public ::testing::Test
+{
+protected:
+    AudioPowerSavingPeriodTest()
+        : _pHardware(NULL), _pOut(NULL), _pReplayer(NULL), _bStop(false) {}
+
+    virtual void SetUp()
+    {
+        std::vector<std::string> cards;
+
+        tinyalsa_fake_reset();
+        for (uint32_t uiRoute = 0; uiRoute < CAudioPlatformHardware::getNbRoutes(); uiRoute++) {
+
+            const char *pcCardName = CAudioPlatformHardware::getRouteCardName(uiRoute);
+            if ((pcCardName == NULL) || (pcCardName[0] == '\0') ||
+                    (std::find(cards.begin(), cards.end(), pcCardName) != cards.end())) {
+
+                continue;
+            }
+            ASSERT_EQ(0, tinyalsa_fake_add_card(pcCardName, cards.size()));
+            cards.push_back(pcCardName);
+        }
+        _uiNbCards = cards.size();
+        _pHardware = new AudioHardwareALSA();
+        ASSERT_EQ(NO_ERROR, _pHardware->initCheck());
+        _pReplayer = new CAudioRoutingReplayer(_pHardware);
+
+        int iFormat = AudioSystem::PCM_16_BIT;
+        uint32_t uiChannels = AudioSystem::CHANNEL_OUT_STEREO;
+        uint32_t uiSampleRate = 48000;
+        // Output flags are given through the status
+        status_t status = AUDIO_OUTPUT_FLAG_PRIMARY;
+        _pOut = _pHardware->openOutputStream(AudioSystem::DEVICE_OUT_SPEAKER, &iFormat,
+                                             &uiChannels, &uiSampleRate, &status);
+        ASSERT_TRUE(_pOut != NULL);
+    }
+
+    virtual void TearDown()
+    {
+        delete _pReplayer;
+        if (_pOut != NULL) {
+
+            _pHardware->closeOutputStream(_pOut);
+        }
+        delete _pHardware;
+        tinyalsa_fake_reset();
+    }
+
+    SPlaybackStats getPlaybackStats() const
+    {
+        SPlaybackStats stStats = { 0, 0, 0 };
+
+        for (unsigned int uiCard = 0; uiCard < _uiNbCards; uiCard++) {
+
+            for (unsigned int uiDevice = 0; uiDevice < MAX_DEVICES; uiDevice++) {
+
+                tinyalsa_fake_stats stats;
+                tinyalsa_fake_get_stats(uiCard, uiDevice, PCM_OUT, &stats);
+                stStats.uiOpens += stats.opens;
+                stStats.uiXruns += stats.xruns;
+                stStats.ulFrames += stats.frames;
+            }
+        }
+        return stStats;
+    }
+
+    /** @return true once frames are played after the given ones, false on timeout. */
+    bool waitForAudio(uint64_t ulFrames) const
+    {
+        for (uint32_t uiWaitedUs = 0; uiWaitedUs < AUDIO_TIMEOUT_MS * 1000;
+             uiWaitedUs += POLL_PERIOD_US) {
+
+            if (getPlaybackStats().ulFrames > ulFrames) {
+
+                return true;
+            }
+            usleep(POLL_PERIOD_US);
+        }
+        return false;
+    }
+
+    /** Plays as audio flinger does, with the buffer size of the stream, until stopped. */
+    static void *writeThread(void *pArg)
+    {
+        AudioPowerSavingPeriodTest *pTest = static_cast<AudioPowerSavingPeriodTest *>(pArg);
+
+        while (!pTest->_bStop) {
+
+            std::vector<char> buffer(pTest->_pOut->bufferSize(), 0);
+            pTest->_pOut->write(&buffer[0], buffer.size());
+        }
+        return NULL;
+    }
+
+    void setScreenState(bool bScreenOn)
+    {
+        AudioParameter param;
+
+        param.add(String8(AUDIO_PARAMETER_KEY_SCREEN_STATE),
+                  String8(bScreenOn ? AUDIO_PARAMETER_VALUE_ON : AUDIO_PARAMETER_VALUE_OFF));
+        EXPECT_EQ(NO_ERROR, _pHardware->setParameters(param.toString()));
+        EXPECT_TRUE(_pReplayer->waitForRouting());
+    }
+
+    AudioHardwareALSA *_pHardware;
+    AudioStreamOut *_pOut;
+    CAudioRoutingReplayer *_pReplayer;
+    unsigned int _uiNbCards;
+    volatile bool _bStop;
+};
+
+}
+
+/**
+ * Screen state changes while playing keep the device opened with its period size: no frame
+ * queued is lost, nor does the write thread stall, hence no underrun. The period size matching
+ * the screen state is used once the stream leaves standby.
+ */
+TEST_F(AudioPowerSavingPeriodTest, screenToggleWhilePlayingHasNoXrun)
+{
+    pthread_t thread;
+
+    ASSERT_EQ(0, pthread_create(&thread, NULL, writeThread, this));
+    EXPECT_TRUE(waitForAudio(0));
+    usleep(TOGGLE_PERIOD_MS * 1000);
+
+    SPlaybackStats stBefore = getPlaybackStats();
+    size_t szBufferSizeScreenOn = _pOut->bufferSize();
+    for (unsigned int uiToggle = 0; uiToggle < NB_TOGGLES; uiToggle++) {
+
+        setScreenState(false);
+        usleep(TOGGLE_PERIOD_MS * 1000);
+        setScreenState(true);
+        usleep(TOGGLE_PERIOD_MS * 1000);
+    }
+    SPlaybackStats stAfter = getPlaybackStats();
+
+    // Screen off, then out of standby
+    setScreenState(false);
+    _bStop = true;
+    pthread_join(thread, NULL);
+    EXPECT_EQ(NO_ERROR, _pOut->standby());
+    EXPECT_TRUE(_pReplayer->waitForRouting());
+
+    _bStop = false;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, writeThread, this));
+    EXPECT_TRUE(waitForAudio(getPlaybackStats().ulFrames));
+    size_t szBufferSizeScreenOff = _pOut->bufferSize();
+    _bStop = true;
+    pthread_join(thread, NULL);
+
+    printf("Screen toggled %d times while playing: %d xruns, %d device openings, "
+           "%llu frames played\n", NB_TOGGLES, stAfter.uiXruns - stBefore.uiXruns,
+           stAfter.uiOpens - stBefore.uiOpens,
+           static_cast<unsigned long long>(stAfter.ulFrames - stBefore.ulFrames));
+    printf("Primary output buffer: %zu bytes screen on, %zu bytes screen off after standby\n",
+           szBufferSizeScreenOn, szBufferSizeScreenOff);
+
+    EXPECT_EQ(stBefore.uiXruns, stAfter.uiXruns);
+    EXPECT_EQ(stBefore.uiOpens, stAfter.uiOpens);
+    EXPECT_GT(stAfter.ulFrames, stBefore.ulFrames);
+    EXPECT_GE(szBufferSizeScreenOff, szBufferSizeScreenOn);
+}
@@ -0,0 +1,279 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioHardwareALSA.h"
+#include "TinyAlsaFake.h"
+#include "stubs/InterfaceProviderStub.h"
+#include "stubs/ParameterMgrStub.h"
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <media/AudioParameter.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::AudioStreamOut;
+using android_audio_legacy::AudioSystem;
+using android::AudioParameter;
+using android::String16;
+using android::String8;
+using android::Vector;
+using android::status_t;
+using android::NO_ERROR;
+
+namespace
+{
+
+const unsigned int NB_ROUTING_REQUESTS = 10;
+/** Each application of the configurations, several per routing pass changing the routes. */
+const uint32_t APPLY_DELAY_MS = 20;
+const uint32_t STARTUP_TIMEOUT_MS = 2000;
+const uint32_t POLL_PERIOD_MS = 10;
+const uint32_t VOICE_VOLUME_PERIOD_US = 1000;
+
+/** Parameter giving the path of the voice volume of the platform, and that path. */
+const char *const VOICE_VOLUME_CTRL_PARAMETER = "/Audio/CONFIGURATION/VOICE_VOLUME_CTRL_PARAMETER";
+const char *const VOICE_VOLUME_PARAMETER = "/Audio/MODEM/VOICE_VOLUME";
+
+/** Contention of a lock of the route manager, as reported by the dump of the HAL. */
+struct SLockContention
+{
+    int iAcquisitions;
+    int iContended;
+    int iTotalWaitUs;
+    int iMaxWaitUs;
+};
+
+int64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * HAL of a platform embedding a modem, run against the fake tinyalsa backend and the parameter
+ * framework stub, whose configurations are slow to apply. A thread reroutes a playing stream
+ * while another one sets the voice volume, through the parameter framework.
+ */
+class AudioRouteManagerLockTest : public ::testing::Test
+{
+protected:
+    AudioRouteManagerLockTest() : _pHardware(NULL), _pOut(NULL), _bStop(false) {}
+
+    virtual void SetUp()
+    {
+        tinyalsa_fake_reset();
+        interface_provider_stub_set_modem_embedded(true);
+        parameter_mgr_stub_add_parameter(VOICE_VOLUME_CTRL_PARAMETER, VOICE_VOLUME_PARAMETER);
+        parameter_mgr_stub_add_parameter(VOICE_VOLUME_PARAMETER, "0");
+        parameter_mgr_stub_set_apply_delay(APPLY_DELAY_MS);
+
+        _pHardware = new AudioHardwareALSA();
+        ASSERT_EQ(NO_ERROR, _pHardware->initCheck());
+
+        int iFormat = AudioSystem::PCM_16_BIT;
+        uint32_t uiChannels = AudioSystem::CHANNEL_OUT_STEREO;
+        uint32_t uiSampleRate = 48000;
+        // Output flags are given through the status
+        status_t status = AUDIO_OUTPUT_FLAG_PRIMARY;
+        _pOut = _pHardware->openOutputStream(AudioSystem::DEVICE_OUT_SPEAKER, &iFormat,
+                                             &uiChannels, &uiSampleRate, &status);
+        ASSERT_TRUE(_pOut != NULL);
+    }
+
+    virtual void TearDown()
+    {
+        if (_pOut != NULL) {
+
+            _pHardware->closeOutputStream(_pOut);
+        }
+        delete _pHardware;
+        parameter_mgr_stub_reset();
+        interface_provider_stub_set_modem_embedded(false);
+        tinyalsa_fake_reset();
+    }
+
+    static String8 getRouting(uint32_t uiDevices)
+    {
+        AudioParameter param;
+
+        param.addInt(String8(AudioParameter::keyRouting), uiDevices);
+        return param.toString();
+    }
+
+    /** Started stream moved between the speaker and the headset, each move changing routes. */
+    static void *routingThread(void *pArg)
+    {
+        AudioRouteManagerLockTest *pTest = static_cast<AudioRouteManagerLockTest *>(pArg);
+        std::vector<char> buffer(pTest->_pOut->bufferSize(), 0);
+
+        pTest->_pOut->write(&buffer[0], buffer.size());
+        for (unsigned int i = 0; i < NB_ROUTING_REQUESTS; i++) {
+
+            pTest->_pOut->setParameters(getRouting((i & 1) == 0 ?
+                                                   AudioSystem::DEVICE_OUT_WIRED_HEADSET :
+                                                   AudioSystem::DEVICE_OUT_SPEAKER));
+            pTest->_pOut->write(&buffer[0], buffer.size());
+        }
+        pTest->_bStop = true;
+        return NULL;
+    }
+
+    /** @return true once the parameter framework is started and takes the voice volume. */
+    bool waitForVoiceVolume()
+    {
+        for (uint32_t uiWaitMs = 0; uiWaitMs < STARTUP_TIMEOUT_MS; uiWaitMs += POLL_PERIOD_MS) {
+
+            if (_pHardware->setVoiceVolume(0.0f) == NO_ERROR) {
+
+                return true;
+            }
+            usleep(POLL_PERIOD_MS * 1000);
+        }
+        return false;
+    }
+
+    int getExecutedPasses() const
+    {
+        FILE *pFile = tmpfile();
+        char acLine[256];
+        int iRequests;
+        int iCoalesced;
+        int iPasses;
+        int iExecuted = 0;
+
+        if (pFile == NULL) {
+
+            return 0;
+        }
+        _pHardware->dumpState(fileno(pFile), Vector<String16>());
+        rewind(pFile);
+        while (fgets(acLine, sizeof(acLine), pFile) != NULL) {
+
+            if (sscanf(acLine, "  routing: %d requests, %d coalesced, %d passes, %d executed",
+                       &iRequests, &iCoalesced, &iPasses, &iExecuted) == 4) {
+
+                break;
+            }
+        }
+        fclose(pFile);
+        return iExecuted;
+    }
+
+    void getLockContention(SLockContention &stRouting, SLockContention &stVolume) const
+    {
+        FILE *pFile = tmpfile();
+        char acLine[256];
+
+        memset(&stRouting, 0, sizeof(stRouting));
+        memset(&stVolume, 0, sizeof(stVolume));
+        if (pFile == NULL) {
+
+            return;
+        }
+        _pHardware->dumpState(fileno(pFile), Vector<String16>());
+        rewind(pFile);
+        while (fgets(acLine, sizeof(acLine), pFile) != NULL) {
+
+            sscanf(acLine, "  routing lock: %d acquisitions, %d contended, waited %d us (max %d us)",
+                   &stRouting.iAcquisitions, &stRouting.iContended, &stRouting.iTotalWaitUs,
+                   &stRouting.iMaxWaitUs);
+            sscanf(acLine,
+                   "  voice volume lock: %d acquisitions, %d contended, waited %d us (max %d us)",
+                   &stVolume.iAcquisitions, &stVolume.iContended, &stVolume.iTotalWaitUs,
+                   &stVolume.iMaxWaitUs);
+        }
+        fclose(pFile);
+    }
+
+    AudioHardwareALSA *_pHardware;
+    AudioStreamOut *_pOut;
+    volatile bool _bStop;
+};
+
+}
+
+/**
+ * Time to set the voice volume while routing passes, slowed down by the application of the
+ * configurations, hold the routing lock. The voice volume reaches the parameter framework
+ * without waiting for the passes.
+ */
+TEST_F(AudioRouteManagerLockTest, benchmarkVoiceVolumeDuringRouting)
+{
+    ASSERT_TRUE(waitForVoiceVolume());
+    int iExecutedBefore = getExecutedPasses();
+
+    pthread_t thread;
+    unsigned int uiNbRequests = 0;
+    int64_t totalNs = 0;
+    int64_t maxNs = 0;
+    float fLastGain = 0;
+
+    ASSERT_EQ(0, pthread_create(&thread, NULL, routingThread, this));
+    while (!_bStop) {
+
+        fLastGain = (float)(uiNbRequests % 11) / 10;
+        int64_t startNs = nowNs();
+        EXPECT_EQ(NO_ERROR, _pHardware->setVoiceVolume(fLastGain));
+        int64_t elapsedNs = nowNs() - startNs;
+
+        uiNbRequests++;
+        totalNs += elapsedNs;
+        if (elapsedNs > maxNs) {
+
+            maxNs = elapsedNs;
+        }
+        usleep(VOICE_VOLUME_PERIOD_US);
+    }
+    pthread_join(thread, NULL);
+
+    SLockContention stRouting;
+    SLockContention stVolume;
+    getLockContention(stRouting, stVolume);
+    int iExecuted = getExecutedPasses() - iExecutedBefore;
+
+    printf("Voice volume during %d routing passes applying configurations in %u ms: "
+           "%.1f us per call (max %.1f us) over %u calls\n",
+           iExecuted, APPLY_DELAY_MS, (double)totalNs / uiNbRequests / 1000,
+           (double)maxNs / 1000, uiNbRequests);
+    printf("Routing lock: %d acquisitions, %d contended, waited %d us (max %d us)\n",
+           stRouting.iAcquisitions, stRouting.iContended, stRouting.iTotalWaitUs,
+           stRouting.iMaxWaitUs);
+    printf("Voice volume lock: %d acquisitions, %d contended, waited %d us (max %d us)\n",
+           stVolume.iAcquisitions, stVolume.iContended, stVolume.iTotalWaitUs,
+           stVolume.iMaxWaitUs);
+
+    // Passes holding the routing lock for at least one application of the configurations
+    ASSERT_GT(iExecuted, 0);
+    ASSERT_GT(uiNbRequests, 0u);
+    EXPECT_LT(maxNs, (int64_t)APPLY_DELAY_MS * 1000000LL / 2);
+
+    // Set through the parameter framework
+    std::string strValue;
+    ASSERT_TRUE(parameter_mgr_stub_get_parameter(VOICE_VOLUME_PARAMETER, strValue));
+    EXPECT_NEAR(fLastGain, atof(strValue.c_str()), 0.001);
+}
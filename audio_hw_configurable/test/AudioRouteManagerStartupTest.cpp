@@ -0,0 +1,136 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioHardwareALSA.h"
+#include "TinyAlsaFake.h"
+#include "stubs/ParameterMgrStub.h"
+#include <gtest/gtest.h>
+#include <cutils/atomic.h>
+#include <hardware/audio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::AudioStreamOut;
+using android_audio_legacy::AudioSystem;
+using android::status_t;
+
+namespace
+{
+
+/** Parameter framework start, in the background, failing after the streams are started. */
+const uint32_t START_DELAY_MS = 100;
+/** Time for a stream start to give up once the startup failed. */
+const uint32_t START_TIMEOUT_MS = 2000;
+const uint32_t POLL_PERIOD_MS = 10;
+
+/**
+ * HAL run against the fake tinyalsa backend and the parameter framework stub, whose start
+ * fails as with a broken configuration on target.
+ */
+class AudioRouteManagerStartupTest : public ::testing::Test
+{
+protected:
+    AudioRouteManagerStartupTest() : _pHardware(NULL), _pOut(NULL), _iWritesDone(0) {}
+
+    virtual void SetUp()
+    {
+        tinyalsa_fake_reset();
+        parameter_mgr_stub_set_start_error("broken configuration", START_DELAY_MS);
+        _pHardware = new AudioHardwareALSA();
+
+        int iFormat = AudioSystem::PCM_16_BIT;
+        uint32_t uiChannels = AudioSystem::CHANNEL_OUT_STEREO;
+        uint32_t uiSampleRate = 48000;
+        // Output flags are given through the status
+        status_t status = AUDIO_OUTPUT_FLAG_PRIMARY;
+        _pOut = _pHardware->openOutputStream(AudioSystem::DEVICE_OUT_SPEAKER, &iFormat,
+                                             &uiChannels, &uiSampleRate, &status);
+        ASSERT_TRUE(_pOut != NULL);
+    }
+
+    virtual void TearDown()
+    {
+        if (_pOut != NULL) {
+
+            _pHardware->closeOutputStream(_pOut);
+        }
+        delete _pHardware;
+        parameter_mgr_stub_reset();
+        tinyalsa_fake_reset();
+    }
+
+    /** First write starts the stream, waiting for its routing. */
+    static void *writeThread(void *pArg)
+    {
+        AudioRouteManagerStartupTest *pTest = static_cast<AudioRouteManagerStartupTest *>(pArg);
+        std::vector<char> buffer(pTest->_pOut->bufferSize(), 0);
+
+        pTest->_pOut->write(&buffer[0], buffer.size());
+        android_atomic_inc(&pTest->_iWritesDone);
+        return NULL;
+    }
+
+    /** @return true if the write returned within the timeout. */
+    bool writeWithTimeout()
+    {
+        int32_t iWritesDone = android_atomic_acquire_load(&_iWritesDone);
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, writeThread, this) != 0) {
+
+            return false;
+        }
+        for (uint32_t uiWaitMs = 0; uiWaitMs < START_TIMEOUT_MS; uiWaitMs += POLL_PERIOD_MS) {
+
+            if (android_atomic_acquire_load(&_iWritesDone) != iWritesDone) {
+
+                pthread_join(thread, NULL);
+                return true;
+            }
+            usleep(POLL_PERIOD_MS * 1000);
+        }
+        // Left blocked, the HAL cannot be deleted
+        pthread_detach(thread);
+        _pOut = NULL;
+        _pHardware = NULL;
+        return false;
+    }
+
+    AudioHardwareALSA *_pHardware;
+    AudioStreamOut *_pOut;
+    volatile int32_t _iWritesDone;
+};
+
+}
+
+TEST_F(AudioRouteManagerStartupTest, streamStartedDuringFailedStartupIsReleased)
+{
+    // Started before the parameter framework fails, waiting for the routing queued meanwhile
+    EXPECT_TRUE(writeWithTimeout());
+}
+
+TEST_F(AudioRouteManagerStartupTest, streamStartedAfterFailedStartupDoesNotWait)
+{
+    usleep(START_DELAY_MS * 2 * 1000);
+    EXPECT_TRUE(writeWithTimeout());
+
+    // Restarted from standby
+    ASSERT_TRUE(_pOut != NULL);
+    _pOut->standby();
+    EXPECT_TRUE(writeWithTimeout());
+}
@@ -0,0 +1,210 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioHardwareALSA.h"
+#include "AudioStreamInALSA.h"
+#include "AudioStreamOutALSA.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <media/AudioParameter.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+#include <stdio.h>
+#include <string.h>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::AudioStreamIn;
+using android_audio_legacy::AudioStreamInALSA;
+using android_audio_legacy::AudioStreamOut;
+using android_audio_legacy::AudioStreamOutALSA;
+using android_audio_legacy::AudioSystem;
+using android::AudioParameter;
+using android::String16;
+using android::String8;
+using android::Vector;
+using android::status_t;
+using android::NO_ERROR;
+
+namespace
+{
+
+const unsigned int NB_CALLS = 10;
+
+/** Routing metrics of the route manager, as reported by the dump of the HAL. */
+struct SRoutingMetrics
+{
+    int iRequests;
+    int iCoalesced;
+    int iPasses;
+    int iExecuted;
+};
+
+/**
+ * HAL run against the fake tinyalsa backend and the parameter framework stub, driven as audio
+ * flinger does.
+ */
+class AudioRoutingPassesTest : public ::testing::Test
+{
+protected:
+    AudioRoutingPassesTest() : _pHardware(NULL), _pOut(NULL), _pIn(NULL) {}
+
+    virtual void SetUp()
+    {
+        tinyalsa_fake_reset();
+        _pHardware = new AudioHardwareALSA();
+        ASSERT_EQ(NO_ERROR, _pHardware->initCheck());
+
+        int iFormat = AudioSystem::PCM_16_BIT;
+        uint32_t uiChannels = AudioSystem::CHANNEL_OUT_STEREO;
+        uint32_t uiSampleRate = 48000;
+        // Output flags are given through the status
+        status_t status = AUDIO_OUTPUT_FLAG_PRIMARY;
+        _pOut = _pHardware->openOutputStream(AudioSystem::DEVICE_OUT_SPEAKER, &iFormat,
+                                             &uiChannels, &uiSampleRate, &status);
+        ASSERT_TRUE(_pOut != NULL);
+
+        iFormat = AudioSystem::PCM_16_BIT;
+        uiChannels = AudioSystem::CHANNEL_IN_MONO;
+        uiSampleRate = 16000;
+        _pIn = _pHardware->openInputStream(AudioSystem::DEVICE_IN_BUILTIN_MIC, &iFormat,
+                                           &uiChannels, &uiSampleRate, &status,
+                                           AudioSystem::AGC_DISABLE);
+        ASSERT_TRUE(_pIn != NULL);
+    }
+
+    virtual void TearDown()
+    {
+        if (_pIn != NULL) {
+
+            _pHardware->closeInputStream(_pIn);
+        }
+        if (_pOut != NULL) {
+
+            _pHardware->closeOutputStream(_pOut);
+        }
+        delete _pHardware;
+        tinyalsa_fake_reset();
+    }
+
+    static String8 getRouting(uint32_t uiDevices)
+    {
+        AudioParameter param;
+
+        param.addInt(String8(AudioParameter::keyRouting), uiDevices);
+        return param.toString();
+    }
+
+    static String8 getParameter(const char *pcKey, const char *pcValue)
+    {
+        AudioParameter param;
+
+        param.add(String8(pcKey), String8(pcValue));
+        return param.toString();
+    }
+
+    /**
+     * Requests of a VoIP call setup, or of its end, in the order audio flinger and the
+     * telephony send them. The hardware parameters are applied asynchronously, the stream
+     * routings and starts synchronously.
+     */
+    void runCallTransition(bool bIsCallStarting)
+    {
+        _pHardware->setMode(bIsCallStarting ?
+                            AudioSystem::MODE_IN_COMMUNICATION : AudioSystem::MODE_NORMAL);
+        _pHardware->setParameters(getParameter(AUDIO_PARAMETER_KEY_SCREEN_STATE,
+                                               bIsCallStarting ?
+                                               AUDIO_PARAMETER_VALUE_OFF :
+                                               AUDIO_PARAMETER_VALUE_ON));
+        _pHardware->setParameters(getParameter(AUDIO_PARAMETER_KEY_BT_NREC,
+                                               AUDIO_PARAMETER_VALUE_ON));
+        _pOut->setParameters(getRouting(bIsCallStarting ?
+                                        AudioSystem::DEVICE_OUT_EARPIECE :
+                                        AudioSystem::DEVICE_OUT_SPEAKER));
+        _pIn->setParameters(getRouting(bIsCallStarting ?
+                                       AudioSystem::DEVICE_IN_BUILTIN_MIC : 0));
+        // Route status not checked: the fake backend has no card of the platform
+        static_cast<AudioStreamOutALSA *>(_pOut)->setStandby(!bIsCallStarting);
+        static_cast<AudioStreamInALSA *>(_pIn)->setStandby(!bIsCallStarting);
+    }
+
+    SRoutingMetrics getRoutingMetrics() const
+    {
+        SRoutingMetrics stMetrics;
+        FILE *pFile = tmpfile();
+        char acLine[256];
+
+        memset(&stMetrics, 0, sizeof(stMetrics));
+        if (pFile == NULL) {
+
+            return stMetrics;
+        }
+        _pHardware->dumpState(fileno(pFile), Vector<String16>());
+        rewind(pFile);
+        while (fgets(acLine, sizeof(acLine), pFile) != NULL) {
+
+            if (sscanf(acLine, "  routing: %d requests, %d coalesced, %d passes, %d executed",
+                       &stMetrics.iRequests, &stMetrics.iCoalesced, &stMetrics.iPasses,
+                       &stMetrics.iExecuted) == 4) {
+
+                break;
+            }
+        }
+        fclose(pFile);
+        return stMetrics;
+    }
+
+    AudioHardwareALSA *_pHardware;
+    AudioStreamOut *_pOut;
+    AudioStreamIn *_pIn;
+};
+
+}
+
+/**
+ * Routing passes run per call setup and end. Each request ran its own pass before the
+ * requests were coalesced: the requests received are the passes run without coalescing.
+ * Passes also include the standbys applied once their grace period elapsed.
+ */
+TEST_F(AudioRoutingPassesTest, benchmarkPassesPerCallSetup)
+{
+    SRoutingMetrics stStart = getRoutingMetrics();
+
+    for (unsigned int uiCall = 0; uiCall < NB_CALLS; uiCall++) {
+
+        runCallTransition(true);
+        runCallTransition(false);
+    }
+    SRoutingMetrics stEnd = getRoutingMetrics();
+
+    int iRequests = stEnd.iRequests - stStart.iRequests;
+    int iCoalesced = stEnd.iCoalesced - stStart.iCoalesced;
+    int iPasses = stEnd.iPasses - stStart.iPasses;
+    int iExecuted = stEnd.iExecuted - stStart.iExecuted;
+
+    printf("Call setup and end: %.1f routing passes, %.1f without coalescing, "
+           "%.1f changing the routes\n",
+           (double)iPasses / NB_CALLS, (double)iRequests / NB_CALLS,
+           (double)iExecuted / NB_CALLS);
+
+    EXPECT_GT(iRequests, 0);
+    EXPECT_GT(iPasses, 0);
+    // Hardware parameters sent back to back ride on the pass of the first of them
+    EXPECT_LT(iPasses, iRequests);
+    // Each pass serves at least one request not coalesced
+    EXPECT_LE(iPasses, iRequests - iCoalesced);
+}
@@ -0,0 +1,102 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/*
+ * Host tool replaying the routing records of the HAL, made by setting the routing record file
+ * property on target, against the fake tinyalsa backend and the parameter framework stub.
+ *
+ * usage: audio_routing_replay_host [-r] <record file>...
+ *   -r: wait the recorded time between the events, instead of replaying them at once.
+ */
+
+#include "AudioHardwareALSA.h"
+#include "AudioPlatformHardware.h"
+#include "AudioRoutingReplayer.h"
+#include "TinyAlsaFake.h"
+#include <utils/String8.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::CAudioPlatformHardware;
+using android_audio_legacy::CAudioRoutingReplayer;
+using android::String8;
+using android::status_t;
+using android::OK;
+
+/**
+ * Registers the cards of the platform routes in the fake backend, so that the stream routes
+ * open their devices as on target.
+ */
+static void registerPlatformCards()
+{
+    std::vector<std::string> cards;
+
+    for (uint32_t uiRoute = 0; uiRoute < CAudioPlatformHardware::getNbRoutes(); uiRoute++) {
+
+        const char *pcCardName = CAudioPlatformHardware::getRouteCardName(uiRoute);
+        if ((pcCardName == NULL) || (pcCardName[0] == '\0') ||
+                (std::find(cards.begin(), cards.end(), pcCardName) != cards.end())) {
+
+            continue;
+        }
+        tinyalsa_fake_add_card(pcCardName, cards.size());
+        cards.push_back(pcCardName);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool bRealTime = false;
+    int iArg = 1;
+
+    if ((iArg < argc) && (strcmp(argv[iArg], "-r") == 0)) {
+
+        bRealTime = true;
+        iArg++;
+    }
+    if (iArg >= argc) {
+
+        fprintf(stderr, "usage: %s [-r] <record file>...\n", argv[0]);
+        return 1;
+    }
+    registerPlatformCards();
+
+    AudioHardwareALSA hardware;
+    if (hardware.initCheck() != OK) {
+
+        fprintf(stderr, "%s: could not start the audio hardware\n", argv[0]);
+        return 1;
+    }
+    int iFailures = 0;
+    for (; iArg < argc; iArg++) {
+
+        CAudioRoutingReplayer replayer(&hardware);
+        String8 report;
+        status_t status = replayer.replay(argv[iArg], bRealTime, report);
+
+        fputs(report.string(), stdout);
+        if (status != OK) {
+
+            fprintf(stderr, "%s: replay of %s failed (%d)\n", argv[0], argv[iArg], status);
+            iFailures++;
+        }
+    }
+    return iFailures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioHardwareALSA.h"
+#include "AudioPlatformHardware.h"
+#include "AudioRoutingReplayer.h"
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <utils/String8.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::CAudioPlatformHardware;
+using android_audio_legacy::CAudioRoutingReplayer;
+using android::String8;
+using android::NO_ERROR;
+using android::OK;
+
+namespace
+{
+
+/** Records of the routing, made on target, in the traces directory of the tests. */
+const char *const VOIP_CALL_RECORD = AUDIO_ROUTING_TRACES_DIR "/voip_call.rec";
+
+/**
+ * HAL run against the fake tinyalsa backend, with the cards of the platform registered, and the
+ * parameter framework stub.
+ */
+class AudioRoutingReplayTest : public ::testing::Test
+{
+protected:
+    AudioRoutingReplayTest() : _pHardware(NULL) {}
+
+    virtual void SetUp()
+    {
+        std::vector<std::string> cards;
+
+        tinyalsa_fake_reset();
+        for (uint32_t uiRoute = 0; uiRoute < CAudioPlatformHardware::getNbRoutes(); uiRoute++) {
+
+            const char *pcCardName = CAudioPlatformHardware::getRouteCardName(uiRoute);
+            if ((pcCardName == NULL) || (pcCardName[0] == '\0') ||
+                    (std::find(cards.begin(), cards.end(), pcCardName) != cards.end())) {
+
+                continue;
+            }
+            ASSERT_EQ(0, tinyalsa_fake_add_card(pcCardName, cards.size()));
+            cards.push_back(pcCardName);
+        }
+        _pHardware = new AudioHardwareALSA();
+        ASSERT_EQ(NO_ERROR, _pHardware->initCheck());
+    }
+
+    virtual void TearDown()
+    {
+        delete _pHardware;
+        tinyalsa_fake_reset();
+    }
+
+    AudioHardwareALSA *_pHardware;
+};
+
+}
+
+/**
+ * VoIP call recorded on target: the primary output is rerouted to the earpiece, a capture
+ * stream is opened for the call, then both are closed. Every event is applied and routed.
+ */
+TEST_F(AudioRoutingReplayTest, voipCallRecordIsReplayed)
+{
+    CAudioRoutingReplayer replayer(_pHardware);
+    String8 report;
+
+    EXPECT_EQ(OK, replayer.replay(VOIP_CALL_RECORD, false, report));
+    printf("%s", report.string());
+
+    unsigned int uiNbEvents = 0;
+    unsigned int uiNbPasses = 0;
+    unsigned int uiNbTimeouts = 0;
+    const char *pcSummary = strstr(report.string(), " events, ");
+    ASSERT_TRUE(pcSummary != NULL);
+    while ((pcSummary > report.string()) && (pcSummary[-1] != '\n')) {
+
+        pcSummary--;
+    }
+    ASSERT_EQ(3, sscanf(pcSummary, "%u events, %u routing passes, %u timeouts",
+                        &uiNbEvents, &uiNbPasses, &uiNbTimeouts));
+    EXPECT_EQ(15u, uiNbEvents);
+    EXPECT_GT(uiNbPasses, 0u);
+    EXPECT_EQ(0u, uiNbTimeouts);
+}
@@ -0,0 +1,276 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioHardwareALSA.h"
+#include "AudioPlatformHardware.h"
+#include "AudioRoutingRecorder.h"
+#include "AudioRoutingReplayer.h"
+#include "TinyAlsaFake.h"
+#include <cutils/atomic.h>
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <tinyalsa/asoundlib.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using android_audio_legacy::AudioHardwareALSA;
+using android_audio_legacy::AudioStreamOut;
+using android_audio_legacy::AudioSystem;
+using android_audio_legacy::CAudioPlatformHardware;
+using android_audio_legacy::CAudioRoutingRecorder;
+using android_audio_legacy::CAudioRoutingReplayer;
+using android::String16;
+using android::String8;
+using android::Vector;
+using android::status_t;
+using android::NO_ERROR;
+
+namespace
+{
+
+/** Devices scanned per card for the frames played. */
+const unsigned int MAX_DEVICES = 32;
+/** Firmware reset: time the sound cards take to be registered again. */
+const uint32_t CARDS_BACK_MS = 50;
+const uint32_t AUDIO_TIMEOUT_MS = 2000;
+/** Far below the SST recovery timeout, which the streams started meanwhile used to wait. */
+const uint32_t START_TIMEOUT_MS = 500;
+const uint32_t POLL_PERIOD_US = 1000;
+
+int64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * HAL run against the fake tinyalsa backend, with the sound cards of the platform, and the
+ * parameter framework stub. The SST recovery is injected as its uevent does, the sound cards
+ * being unregistered until the firmware is back.
+ */
+class AudioSstRecoveryTest : public ::testing::Test
+{
+protected:
+    AudioSstRecoveryTest()
+        : _pHardware(NULL), _pOut(NULL), _pReplayer(NULL), _bStop(false), _iWrites(0) {}
+
+    virtual void SetUp()
+    {
+        tinyalsa_fake_reset();
+        addCards();
+        _pHardware = new AudioHardwareALSA();
+        ASSERT_EQ(NO_ERROR, _pHardware->initCheck());
+        _pReplayer = new CAudioRoutingReplayer(_pHardware);
+
+        int iFormat = AudioSystem::PCM_16_BIT;
+        uint32_t uiChannels = AudioSystem::CHANNEL_OUT_STEREO;
+        uint32_t uiSampleRate = 48000;
+        // Output flags are given through the status
+        status_t status = AUDIO_OUTPUT_FLAG_PRIMARY;
+        _pOut = _pHardware->openOutputStream(AudioSystem::DEVICE_OUT_SPEAKER, &iFormat,
+                                             &uiChannels, &uiSampleRate, &status);
+        ASSERT_TRUE(_pOut != NULL);
+    }
+
+    virtual void TearDown()
+    {
+        delete _pReplayer;
+        if (_pOut != NULL) {
+
+            _pHardware->closeOutputStream(_pOut);
+        }
+        delete _pHardware;
+        tinyalsa_fake_reset();
+    }
+
+    /** Registers the sound cards of the platform, as the driver does once the firmware runs. */
+    void addCards()
+    {
+        _cards.clear();
+        for (uint32_t uiRoute = 0; uiRoute < CAudioPlatformHardware::getNbRoutes(); uiRoute++) {
+
+            const char *pcCardName = CAudioPlatformHardware::getRouteCardName(uiRoute);
+            if ((pcCardName == NULL) || (pcCardName[0] == '\0') ||
+                    (std::find(_cards.begin(), _cards.end(), pcCardName) != _cards.end())) {
+
+                continue;
+            }
+            tinyalsa_fake_add_card(pcCardName, _cards.size());
+            _cards.push_back(pcCardName);
+        }
+    }
+
+    void removeCards()
+    {
+        for (uint32_t uiCard = 0; uiCard < _cards.size(); uiCard++) {
+
+            tinyalsa_fake_remove_card(_cards[uiCard].c_str());
+        }
+    }
+
+    /** Frames played and openings of all the playback devices of the platform. */
+    void getPlaybackStats(uint64_t &ulFrames, unsigned int &uiOpens) const
+    {
+        ulFrames = 0;
+        uiOpens = 0;
+        for (uint32_t uiCard = 0; uiCard < _cards.size(); uiCard++) {
+
+            for (unsigned int uiDevice = 0; uiDevice < MAX_DEVICES; uiDevice++) {
+
+                tinyalsa_fake_stats stats;
+                tinyalsa_fake_get_stats(uiCard, uiDevice, PCM_OUT, &stats);
+                ulFrames += stats.frames;
+                uiOpens += stats.opens;
+            }
+        }
+    }
+
+    /** Plays as audio flinger does, until stopped. */
+    static void *writeThread(void *pArg)
+    {
+        AudioSstRecoveryTest *pTest = static_cast<AudioSstRecoveryTest *>(pArg);
+        std::vector<char> buffer(pTest->_pOut->bufferSize(), 0);
+
+        while (!pTest->_bStop) {
+
+            pTest->_pOut->write(&buffer[0], buffer.size());
+            android_atomic_inc(&pTest->_iWrites);
+        }
+        return NULL;
+    }
+
+    /** @return true once the frames written reach a playback device, false on timeout. */
+    bool waitForAudio(uint64_t ulFramesBefore, unsigned int uiOpensBefore) const
+    {
+        for (uint32_t uiWaitedUs = 0; uiWaitedUs < AUDIO_TIMEOUT_MS * 1000;
+             uiWaitedUs += POLL_PERIOD_US) {
+
+            uint64_t ulFrames;
+            unsigned int uiOpens;
+            getPlaybackStats(ulFrames, uiOpens);
+            if ((ulFrames > ulFramesBefore) && (uiOpens > uiOpensBefore)) {
+
+                return true;
+            }
+            usleep(POLL_PERIOD_US);
+        }
+        return false;
+    }
+
+    /** SST recovery metrics, as reported by the dump of the HAL. */
+    void getRecoveryMetrics(int &iRecoveries, int &iCardsBackMs, int &iAudioBackMs) const
+    {
+        FILE *pFile = tmpfile();
+        char acLine[256];
+
+        iRecoveries = iCardsBackMs = iAudioBackMs = 0;
+        if (pFile == NULL) {
+
+            return;
+        }
+        _pHardware->dumpState(fileno(pFile), Vector<String16>());
+        rewind(pFile);
+        while (fgets(acLine, sizeof(acLine), pFile) != NULL) {
+
+            if (sscanf(acLine, "  sst recovery: %d recoveries, last one cards back in %d ms, "
+                       "audio back in %d ms", &iRecoveries, &iCardsBackMs, &iAudioBackMs) == 3) {
+
+                break;
+            }
+        }
+        fclose(pFile);
+    }
+
+    AudioHardwareALSA *_pHardware;
+    AudioStreamOut *_pOut;
+    CAudioRoutingReplayer *_pReplayer;
+    std::vector<std::string> _cards;
+    volatile bool _bStop;
+    volatile int32_t _iWrites;
+};
+
+}
+
+/**
+ * Time from the SST recovery event to the first frames written to a device routed again, the
+ * firmware taking CARDS_BACK_MS to register its sound cards.
+ */
+TEST_F(AudioSstRecoveryTest, benchmarkTimeToAudio)
+{
+    pthread_t thread;
+    uint64_t ulFrames;
+    unsigned int uiOpens;
+
+    ASSERT_EQ(0, pthread_create(&thread, NULL, writeThread, this));
+    EXPECT_TRUE(waitForAudio(0, 0));
+
+    removeCards();
+    getPlaybackStats(ulFrames, uiOpens);
+    int64_t startNs = nowNs();
+    ASSERT_EQ(NO_ERROR, _pReplayer->apply(CAudioRoutingRecorder::ESstRecovery, 0, 0, 0,
+                                          String8()));
+    usleep(CARDS_BACK_MS * 1000);
+    addCards();
+
+    // Reopened once the cards are back, the stream having generated silence meanwhile
+    bool bAudioBack = waitForAudio(ulFrames, uiOpens);
+    int64_t audioBackNs = nowNs() - startNs;
+    int32_t iWrites = android_atomic_acquire_load(&_iWrites);
+    _bStop = true;
+    pthread_join(thread, NULL);
+
+    int iRecoveries;
+    int iCardsBackMs;
+    int iAudioBackMs;
+    getRecoveryMetrics(iRecoveries, iCardsBackMs, iAudioBackMs);
+    printf("SST recovery: cards back in %d ms, routes back in %d ms, first frames written "
+           "%.1f ms after the event, %d writes\n", iCardsBackMs, iAudioBackMs,
+           (double)audioBackNs / 1000000, iWrites);
+
+    ASSERT_TRUE(bAudioBack);
+    EXPECT_EQ(1, iRecoveries);
+    EXPECT_GE(iCardsBackMs, (int)CARDS_BACK_MS);
+    EXPECT_GE(iAudioBackMs, iCardsBackMs);
+    EXPECT_GE(audioBackNs, (int64_t)CARDS_BACK_MS * 1000000LL);
+}
+
+/** A stream started while the sound cards are away generates silence, without waiting. */
+TEST_F(AudioSstRecoveryTest, streamStartedDuringRecoveryDoesNotWait)
+{
+    removeCards();
+    ASSERT_EQ(NO_ERROR, _pReplayer->apply(CAudioRoutingRecorder::ESstRecovery, 0, 0, 0,
+                                          String8()));
+
+    std::vector<char> buffer(_pOut->bufferSize(), 0);
+    int64_t startNs = nowNs();
+    EXPECT_EQ((ssize_t)buffer.size(), _pOut->write(&buffer[0], buffer.size()));
+    int64_t writeNs = nowNs() - startNs;
+    printf("First write during SST recovery: %.1f ms\n", (double)writeNs / 1000000);
+    EXPECT_LT(writeNs, (int64_t)START_TIMEOUT_MS * 1000000LL);
+
+    addCards();
+    EXPECT_TRUE(_pReplayer->waitForRouting());
+}
@@ -0,0 +1,110 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "AudioVirtualClock.h"
+#include <gtest/gtest.h>
+#include <time.h>
+#include <unistd.h>
+
+using android_audio_legacy::AudioVirtualClock;
+
+namespace
+{
+
+const uint32_t BUFFER_DURATION_US = 5000;
+const uint32_t NB_BUFFERS = 20;
+/** Scheduling latency tolerated on a loaded build server. */
+const int64_t TOLERANCE_US = 4000;
+
+int64_t nowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+}
+
+TEST(AudioVirtualClock, pacesBuffersOnTheirDuration)
+{
+    AudioVirtualClock clock;
+    int64_t startUs = nowUs();
+
+    for (uint32_t i = 0; i < NB_BUFFERS; i++) {
+
+        clock.wait(BUFFER_DURATION_US);
+    }
+    int64_t elapsedUs = nowUs() - startUs;
+
+    EXPECT_GE(elapsedUs, NB_BUFFERS * BUFFER_DURATION_US);
+    EXPECT_LT(elapsedUs, NB_BUFFERS * BUFFER_DURATION_US + TOLERANCE_US);
+}
+
+TEST(AudioVirtualClock, doesNotAccumulateProcessingTime)
+{
+    AudioVirtualClock clock;
+    int64_t startUs = nowUs();
+
+    // The client spends part of each buffer duration processing, as a stream does
+    for (uint32_t i = 0; i < NB_BUFFERS; i++) {
+
+        clock.wait(BUFFER_DURATION_US);
+        usleep(BUFFER_DURATION_US / 2);
+    }
+    int64_t elapsedUs = nowUs() - startUs;
+
+    // A relative sleep would have lasted NB_BUFFERS * 1.5 buffers
+    EXPECT_LT(elapsedUs, NB_BUFFERS * BUFFER_DURATION_US + BUFFER_DURATION_US / 2 + TOLERANCE_US);
+}
+
+TEST(AudioVirtualClock, resyncsInsteadOfBurstingAfterAStall)
+{
+    AudioVirtualClock clock;
+
+    clock.wait(BUFFER_DURATION_US);
+    usleep(4 * BUFFER_DURATION_US);
+
+    // Deadline already missed: returns at once, then paces from now
+    int64_t startUs = nowUs();
+    clock.wait(BUFFER_DURATION_US);
+    EXPECT_LT(nowUs() - startUs, TOLERANCE_US);
+
+    startUs = nowUs();
+    clock.wait(BUFFER_DURATION_US);
+    clock.wait(BUFFER_DURATION_US);
+    int64_t elapsedUs = nowUs() - startUs;
+
+    EXPECT_GE(elapsedUs, 2 * BUFFER_DURATION_US - TOLERANCE_US);
+    EXPECT_LT(elapsedUs, 2 * BUFFER_DURATION_US + TOLERANCE_US);
+}
+
+TEST(AudioVirtualClock, reanchorsAfterReset)
+{
+    AudioVirtualClock clock;
+
+    clock.wait(BUFFER_DURATION_US);
+    clock.reset();
+    usleep(4 * BUFFER_DURATION_US);
+
+    // The timeline starts again from now: a full buffer duration, no catch up
+    int64_t startUs = nowUs();
+    clock.wait(BUFFER_DURATION_US);
+    int64_t elapsedUs = nowUs() - startUs;
+
+    EXPECT_GE(elapsedUs, BUFFER_DURATION_US);
+    EXPECT_LT(elapsedUs, BUFFER_DURATION_US + TOLERANCE_US);
+}
@@ -0,0 +1,202 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "TinyAlsaFake.h"
+#include <gtest/gtest.h>
+#include <tinyalsa/asoundlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+namespace
+{
+
+const unsigned int CARD = 0;
+const unsigned int DEVICE = 0;
+const unsigned int NB_BENCHMARK_PERIODS = 50;
+
+pcm_config getConfig(unsigned int uiPeriodSize, unsigned int uiPeriodCount)
+{
+    pcm_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.channels = 2;
+    config.rate = 48000;
+    config.period_size = uiPeriodSize;
+    config.period_count = uiPeriodCount;
+    config.format = PCM_FORMAT_S16_LE;
+    return config;
+}
+
+int64_t getTimeNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t getPeriodNs(const pcm_config &config)
+{
+    return (int64_t)config.period_size * 1000000000LL / config.rate;
+}
+
+class TinyAlsaFakeTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        tinyalsa_fake_reset();
+    }
+
+    virtual void TearDown()
+    {
+        tinyalsa_fake_reset();
+    }
+};
+
+}
+
+TEST_F(TinyAlsaFakeTest, pcmWaitHonorsItsTimeout)
+{
+    // Periods far longer than the timeout
+    pcm_config config = getConfig(4800, 2);
+    pcm *pPcm = pcm_open(CARD, DEVICE, PCM_OUT, &config);
+    ASSERT_TRUE(pcm_is_ready(pPcm));
+
+    // Full buffer: the device starts, no room is left before the first period is played
+    std::vector<char> buffer(pcm_frames_to_bytes(pPcm, pcm_get_buffer_size(pPcm)), 0);
+    ASSERT_EQ(0, pcm_write(pPcm, &buffer[0], buffer.size()));
+
+    int64_t startNs = getTimeNs(CLOCK_MONOTONIC);
+    EXPECT_EQ(0, pcm_wait(pPcm, 10));
+    int64_t elapsedNs = getTimeNs(CLOCK_MONOTONIC) - startNs;
+    EXPECT_GE(elapsedNs, 10000000LL);
+    EXPECT_LT(elapsedNs, getPeriodNs(config) / 2);
+
+    // Room is made once the DMA played a period
+    EXPECT_EQ(1, pcm_wait(pPcm, -1));
+    EXPECT_EQ(1, pcm_wait(pPcm, 0));
+
+    pcm_close(pPcm);
+}
+
+TEST_F(TinyAlsaFakeTest, removedCardCannotBeOpened)
+{
+    pcm_config config = getConfig(240, 4);
+
+    ASSERT_EQ(0, tinyalsa_fake_add_card("fake", CARD));
+    ASSERT_EQ(0, tinyalsa_fake_remove_card("fake"));
+    pcm *pPcm = pcm_open(CARD, DEVICE, PCM_OUT, &config);
+    EXPECT_FALSE(pcm_is_ready(pPcm));
+    pcm_close(pPcm);
+
+    // Back once registered again
+    ASSERT_EQ(0, tinyalsa_fake_add_card("fake", CARD));
+    pPcm = pcm_open(CARD, DEVICE, PCM_OUT, &config);
+    EXPECT_TRUE(pcm_is_ready(pPcm));
+    pcm_close(pPcm);
+}
+
+TEST_F(TinyAlsaFakeTest, openingTakesTheOpenTime)
+{
+    pcm_config config = getConfig(240, 4);
+    const unsigned int uiOpenTimeUs = 20000;
+
+    tinyalsa_fake_set_open_time(uiOpenTimeUs);
+    int64_t startTime = getTimeNs(CLOCK_MONOTONIC);
+    pcm *pPcm = pcm_open(CARD, DEVICE, PCM_OUT, &config);
+    EXPECT_GE(getTimeNs(CLOCK_MONOTONIC) - startTime, uiOpenTimeUs * 1000LL);
+    EXPECT_TRUE(pcm_is_ready(pPcm));
+    pcm_close(pPcm);
+
+    // Failed openings do not wait
+    tinyalsa_fake_add_card("fake", CARD);
+    startTime = getTimeNs(CLOCK_MONOTONIC);
+    pPcm = pcm_open(CARD + 1, DEVICE, PCM_OUT, &config);
+    EXPECT_LT(getTimeNs(CLOCK_MONOTONIC) - startTime, uiOpenTimeUs * 1000LL);
+    EXPECT_FALSE(pcm_is_ready(pPcm));
+    pcm_close(pPcm);
+}
+
+/**
+ * Frames written and read per second once the device runs, CPU time of the client per period,
+ * and time the client resumes after the period interrupt it waited for, as the fake paces the
+ * HAL on a build server.
+ */
+TEST_F(TinyAlsaFakeTest, benchmarkThroughputAndLatency)
+{
+    static const unsigned int auiFlags[] = { PCM_OUT, PCM_IN };
+    pcm_config config = getConfig(240, 4);
+
+    for (size_t uiDir = 0; uiDir < sizeof(auiFlags) / sizeof(auiFlags[0]); uiDir++) {
+
+        bool bIsOut = auiFlags[uiDir] == PCM_OUT;
+        pcm *pPcm = pcm_open(CARD, DEVICE, auiFlags[uiDir], &config);
+        ASSERT_TRUE(pcm_is_ready(pPcm));
+        std::vector<char> period(pcm_frames_to_bytes(pPcm, config.period_size), 0);
+
+        // Output buffer primed first, not to measure its filling
+        for (unsigned int i = 0; bIsOut && (i < config.period_count); i++) {
+
+            ASSERT_EQ(0, pcm_write(pPcm, &period[0], period.size()));
+        }
+        int64_t totalWakeUpNs = 0;
+        int64_t maxWakeUpNs = 0;
+        int64_t startNs = getTimeNs(CLOCK_MONOTONIC);
+        int64_t startCpuNs = getTimeNs(CLOCK_THREAD_CPUTIME_ID);
+
+        for (unsigned int i = 0; i < NB_BENCHMARK_PERIODS; i++) {
+
+            ASSERT_EQ(0, bIsOut ? pcm_write(pPcm, &period[0], period.size()) :
+                                  pcm_read(pPcm, &period[0], period.size()));
+
+            unsigned int uiAvail;
+            struct timespec ts;
+            if (pcm_get_htimestamp(pPcm, &uiAvail, &ts) == 0) {
+
+                int64_t wakeUpNs = getTimeNs(CLOCK_MONOTONIC) -
+                        (ts.tv_sec * 1000000000LL + ts.tv_nsec);
+                totalWakeUpNs += wakeUpNs;
+                if (wakeUpNs > maxWakeUpNs) {
+
+                    maxWakeUpNs = wakeUpNs;
+                }
+            }
+        }
+        int64_t elapsedNs = getTimeNs(CLOCK_MONOTONIC) - startNs;
+        int64_t cpuNs = getTimeNs(CLOCK_THREAD_CPUTIME_ID) - startCpuNs;
+
+        tinyalsa_fake_stats stats;
+        tinyalsa_fake_get_stats(CARD, DEVICE, auiFlags[uiDir], &stats);
+        pcm_close(pPcm);
+
+        double rate = (double)NB_BENCHMARK_PERIODS * config.period_size * 1000000000LL /
+                      elapsedNs;
+        int64_t meanWakeUpNs = totalWakeUpNs / NB_BENCHMARK_PERIODS;
+        printf("%s: %.0f frames/s for %u, %.1f us CPU per period, wake up %.1f us after the "
+               "period (max %.1f us), %u xruns\n",
+               bIsOut ? "Playback" : "Capture", rate, config.rate,
+               (double)cpuNs / NB_BENCHMARK_PERIODS / 1000, (double)meanWakeUpNs / 1000,
+               (double)maxWakeUpNs / 1000, stats.xruns);
+
+        // Paced by the simulated DMA, within the scheduling jitter of the build server
+        EXPECT_NEAR(config.rate, rate, config.rate / 10);
+        EXPECT_LT(meanWakeUpNs, getPeriodNs(config) / 2);
+        EXPECT_EQ(0u, stats.xruns);
+    }
+}
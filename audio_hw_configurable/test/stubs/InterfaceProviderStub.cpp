@@ -0,0 +1,65 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "InterfaceProviderStub"
+
+#include "InterfaceProviderStub.h"
+#include "InterfaceProviderLib.h"
+#include <utils/Log.h>
+#include <string>
+
+using NInterfaceProvider::IInterface;
+using NInterfaceProvider::IInterfaceProvider;
+using std::string;
+
+/*
+ * Interface provider stub, linked instead of libinterface-provider-lib by the host tests of
+ * the HAL, no plugin library being loadable on the build server.
+ */
+
+namespace
+{
+
+class CInterfaceProviderStub : public IInterfaceProvider
+{
+public:
+    virtual IInterface* queryInterface(const string& strInterfaceName) const
+    {
+        ALOGD("%s: %s not provided by the stub", __FUNCTION__, strInterfaceName.c_str());
+        return NULL;
+    }
+
+    virtual string getInterfaceList() const
+    {
+        return "";
+    }
+};
+
+CInterfaceProviderStub gModemInterfaceProvider;
+volatile bool gbModemEmbedded = false;
+
+}
+
+void interface_provider_stub_set_modem_embedded(bool bIsEmbedded)
+{
+    gbModemEmbedded = bIsEmbedded;
+}
+
+IInterfaceProvider* getInterfaceProvider(const char* pcLibraryName)
+{
+    ALOGD("%s: %s %s", __FUNCTION__, pcLibraryName, gbModemEmbedded ? "found" : "not found");
+    return gbModemEmbedded ? &gModemInterfaceProvider : NULL;
+}
@@ -0,0 +1,26 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+/**
+ * Control of the interface provider stub, given to the test harness.
+ *
+ * Makes the platform embed a modem from the next creation of the HAL: its library is found,
+ * without providing the modem audio manager, so that the HAL takes the modem paths with no
+ * modem status to wait for.
+ */
+void interface_provider_stub_set_modem_embedded(bool bIsEmbedded);
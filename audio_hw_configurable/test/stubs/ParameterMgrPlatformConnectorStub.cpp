@@ -0,0 +1,448 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "ParameterMgrStub"
+
+#include "ParameterMgrStub.h"
+#include "ParameterMgrPlatformConnector.h"
+#include "ParameterHandle.h"
+#include "SelectionCriterionInterface.h"
+#include "SelectionCriterionTypeInterface.h"
+#include <utils/Log.h>
+#include <utils/threads.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using android::Mutex;
+using std::map;
+using std::string;
+using std::vector;
+
+/*
+ * Parameter framework stub, linked instead of libparameter by the host tests of the HAL.
+ *
+ * Criteria and their types are kept in memory, so that the route manager runs its routing
+ * passes as on target. No configuration is applied: parameters are values kept as strings,
+ * added by the tests, which also delay the application of the configurations and make the
+ * starts fail through ParameterMgrStub.h.
+ */
+
+namespace
+{
+
+class CSelectionCriterionTypeStub : public ISelectionCriterionTypeInterface
+{
+public:
+    CSelectionCriterionTypeStub(bool bIsInclusive) : _bIsInclusive(bIsInclusive) {}
+    virtual ~CSelectionCriterionTypeStub() {}
+
+    virtual bool addValuePair(int iValue, const string& strValue)
+    {
+        if (_numericalValues.find(strValue) != _numericalValues.end()) {
+
+            return false;
+        }
+        _numericalValues[strValue] = iValue;
+        _literalValues[iValue] = strValue;
+        return true;
+    }
+
+    virtual bool getNumericalValue(const string& strValue, int& iValue) const
+    {
+        map<string, int>::const_iterator it = _numericalValues.find(strValue);
+        if (it == _numericalValues.end()) {
+
+            return false;
+        }
+        iValue = it->second;
+        return true;
+    }
+
+    virtual bool getLiteralValue(int iValue, string& strValue) const
+    {
+        map<int, string>::const_iterator it = _literalValues.find(iValue);
+        if (it == _literalValues.end()) {
+
+            return false;
+        }
+        strValue = it->second;
+        return true;
+    }
+
+    virtual bool isTypeInclusive() const { return _bIsInclusive; }
+
+    virtual string getFormattedState(int iValue) const
+    {
+        if (!_bIsInclusive) {
+
+            string strValue;
+            return getLiteralValue(iValue, strValue) ? strValue : "<none>";
+        }
+        // Inclusive states are the list of the values of their bits
+        string strState;
+        map<int, string>::const_iterator it;
+        for (it = _literalValues.begin(); it != _literalValues.end(); ++it) {
+
+            if ((it->first != 0) && ((iValue & it->first) == it->first)) {
+
+                strState += (strState.empty() ? "" : "|") + it->second;
+            }
+        }
+        return strState.empty() ? "<none>" : strState;
+    }
+
+private:
+    bool _bIsInclusive;
+    map<string, int> _numericalValues;
+    map<int, string> _literalValues;
+};
+
+class CSelectionCriterionStub : public ISelectionCriterionInterface
+{
+public:
+    CSelectionCriterionStub(const string& strName,
+                            const ISelectionCriterionTypeInterface* pType)
+        : _strName(strName), _pType(pType), _iState(0) {}
+    virtual ~CSelectionCriterionStub() {}
+
+    virtual void setCriterionState(int iState) { _iState = iState; }
+    virtual int getCriterionState() const { return _iState; }
+    virtual string getCriterionName() const { return _strName; }
+    virtual const ISelectionCriterionTypeInterface* getCriterionType() const { return _pType; }
+
+private:
+    string _strName;
+    const ISelectionCriterionTypeInterface* _pType;
+    int _iState;
+};
+
+/** State of a connector, out of the connector not to depend on the layout of the real one. */
+struct SConnectorStub
+{
+    SConnectorStub() : bStarted(false), pLogger(NULL) {}
+
+    bool bStarted;
+    CParameterMgrPlatformConnector::ILogger* pLogger;
+    vector<CSelectionCriterionTypeStub*> apCriterionTypes;
+    map<string, CSelectionCriterionStub*> criteria;
+};
+
+Mutex gConnectorsLock;
+map<const CParameterMgrPlatformConnector*, SConnectorStub*> gConnectors;
+string gStartError;
+uint32_t gStartDelayMs = 0;
+uint32_t gApplyDelayMs = 0;
+
+/** Parameters, shared by the connectors, and the handles opened on them. */
+Mutex gParametersLock;
+map<string, string> gParameters;
+map<const CParameterHandle*, string> gHandles;
+
+bool getParameter(const CParameterHandle* pHandle, string& strValue)
+{
+    Mutex::Autolock lock(gParametersLock);
+
+    map<const CParameterHandle*, string>::const_iterator it = gHandles.find(pHandle);
+    if ((it == gHandles.end()) || (gParameters.find(it->second) == gParameters.end())) {
+
+        return false;
+    }
+    strValue = gParameters[it->second];
+    return true;
+}
+
+bool setParameter(const CParameterHandle* pHandle, const string& strValue)
+{
+    Mutex::Autolock lock(gParametersLock);
+
+    map<const CParameterHandle*, string>::const_iterator it = gHandles.find(pHandle);
+    if (it == gHandles.end()) {
+
+        return false;
+    }
+    gParameters[it->second] = strValue;
+    return true;
+}
+
+SConnectorStub& getStub(const CParameterMgrPlatformConnector* pConnector)
+{
+    Mutex::Autolock lock(gConnectorsLock);
+
+    return *gConnectors[pConnector];
+}
+
+}
+
+void parameter_mgr_stub_set_start_error(const string& strError, uint32_t uiDelayMs)
+{
+    Mutex::Autolock lock(gConnectorsLock);
+
+    gStartError = strError;
+    gStartDelayMs = uiDelayMs;
+}
+
+void parameter_mgr_stub_set_apply_delay(uint32_t uiDelayMs)
+{
+    Mutex::Autolock lock(gConnectorsLock);
+
+    gApplyDelayMs = uiDelayMs;
+}
+
+void parameter_mgr_stub_add_parameter(const string& strPath, const string& strValue)
+{
+    Mutex::Autolock lock(gParametersLock);
+
+    gParameters[strPath] = strValue;
+}
+
+bool parameter_mgr_stub_get_parameter(const string& strPath, string& strValue)
+{
+    Mutex::Autolock lock(gParametersLock);
+
+    map<string, string>::const_iterator it = gParameters.find(strPath);
+    if (it == gParameters.end()) {
+
+        return false;
+    }
+    strValue = it->second;
+    return true;
+}
+
+void parameter_mgr_stub_reset()
+{
+    {
+        Mutex::Autolock lock(gConnectorsLock);
+
+        gStartError.clear();
+        gStartDelayMs = 0;
+        gApplyDelayMs = 0;
+    }
+    Mutex::Autolock lock(gParametersLock);
+
+    gParameters.clear();
+}
+
+CParameterMgrPlatformConnector::CParameterMgrPlatformConnector(const string& strConfigurationFilePath)
+{
+    ALOGD("%s: %s ignored by the stub", __FUNCTION__, strConfigurationFilePath.c_str());
+    Mutex::Autolock lock(gConnectorsLock);
+
+    gConnectors[this] = new SConnectorStub;
+}
+
+CParameterMgrPlatformConnector::~CParameterMgrPlatformConnector()
+{
+    SConnectorStub* pStub = &getStub(this);
+
+    for (uint32_t i = 0; i < pStub->apCriterionTypes.size(); i++) {
+
+        delete pStub->apCriterionTypes[i];
+    }
+    map<string, CSelectionCriterionStub*>::iterator it;
+    for (it = pStub->criteria.begin(); it != pStub->criteria.end(); ++it) {
+
+        delete it->second;
+    }
+    delete pStub;
+    Mutex::Autolock lock(gConnectorsLock);
+
+    gConnectors.erase(this);
+}
+
+ISelectionCriterionTypeInterface* CParameterMgrPlatformConnector::createSelectionCriterionType(
+        bool bIsInclusive)
+{
+    CSelectionCriterionTypeStub* pType = new CSelectionCriterionTypeStub(bIsInclusive);
+
+    getStub(this).apCriterionTypes.push_back(pType);
+    return pType;
+}
+
+ISelectionCriterionInterface* CParameterMgrPlatformConnector::createSelectionCriterion(
+        const string& strName, const ISelectionCriterionTypeInterface* pSelectionCriterionType)
+{
+    SConnectorStub& stub = getStub(this);
+
+    if (stub.criteria.find(strName) != stub.criteria.end()) {
+
+        return NULL;
+    }
+    CSelectionCriterionStub* pCriterion = new CSelectionCriterionStub(strName,
+                                                                      pSelectionCriterionType);
+    stub.criteria[strName] = pCriterion;
+    return pCriterion;
+}
+
+ISelectionCriterionInterface* CParameterMgrPlatformConnector::getSelectionCriterion(
+        const string& strName)
+{
+    SConnectorStub& stub = getStub(this);
+    map<string, CSelectionCriterionStub*>::const_iterator it = stub.criteria.find(strName);
+
+    return it == stub.criteria.end() ? NULL : it->second;
+}
+
+void CParameterMgrPlatformConnector::setLogger(ILogger* pLogger)
+{
+    getStub(this).pLogger = pLogger;
+}
+
+bool CParameterMgrPlatformConnector::start(string& strError)
+{
+    uint32_t uiDelayMs;
+    {
+        Mutex::Autolock lock(gConnectorsLock);
+
+        strError = gStartError;
+        uiDelayMs = gStartDelayMs;
+    }
+    usleep(uiDelayMs * 1000);
+    if (!strError.empty()) {
+
+        return false;
+    }
+    getStub(this).bStarted = true;
+    return true;
+}
+
+bool CParameterMgrPlatformConnector::isStarted() const
+{
+    return getStub(this).bStarted;
+}
+
+void CParameterMgrPlatformConnector::applyConfigurations()
+{
+    uint32_t uiDelayMs;
+    {
+        Mutex::Autolock lock(gConnectorsLock);
+
+        uiDelayMs = gApplyDelayMs;
+    }
+    // As the accesses to the hardware of the configurations, out of the parameters lock
+    usleep(uiDelayMs * 1000);
+}
+
+CParameterHandle* CParameterMgrPlatformConnector::createParameterHandle(const string& strPath,
+                                                                        string& strError) const
+{
+    {
+        Mutex::Autolock lock(gParametersLock);
+
+        if (gParameters.find(strPath) == gParameters.end()) {
+
+            strError = "no parameter in the stub: " + strPath;
+            return NULL;
+        }
+    }
+    // Handles are known by their address, not to depend on the layout of the real ones
+    CParameterHandle* pHandle = new CParameterHandle(NULL, NULL);
+    Mutex::Autolock lock(gParametersLock);
+
+    gHandles[pHandle] = strPath;
+    return pHandle;
+}
+
+CParameterHandle::CParameterHandle(const CBaseParameter* pParameter,
+                                   CParameterMgr* pParameterMgr)
+{
+    (void)pParameter;
+    (void)pParameterMgr;
+}
+
+CParameterHandle::~CParameterHandle()
+{
+    Mutex::Autolock lock(gParametersLock);
+
+    gHandles.erase(this);
+}
+
+string CParameterHandle::getPath() const
+{
+    Mutex::Autolock lock(gParametersLock);
+
+    map<const CParameterHandle*, string>::const_iterator it = gHandles.find(this);
+    return it == gHandles.end() ? "" : it->second;
+}
+
+bool CParameterHandle::getAsInteger(uint32_t& uiValue, string& strError) const
+{
+    string strValue;
+    if (!getParameter(this, strValue)) {
+
+        strError = "no parameter in the stub";
+        return false;
+    }
+    uiValue = strtoul(strValue.c_str(), NULL, 0);
+    return true;
+}
+
+bool CParameterHandle::setAsInteger(uint32_t uiValue, string& strError)
+{
+    char acValue[16];
+
+    snprintf(acValue, sizeof(acValue), "%u", uiValue);
+    if (!setParameter(this, acValue)) {
+
+        strError = "no parameter in the stub";
+        return false;
+    }
+    return true;
+}
+
+bool CParameterHandle::setAsIntegerArray(const vector<uint32_t>& auiValues, string& strError)
+{
+    string strValues;
+
+    for (uint32_t i = 0; i < auiValues.size(); i++) {
+
+        char acValue[16];
+        snprintf(acValue, sizeof(acValue), "%s%u", i == 0 ? "" : " ", auiValues[i]);
+        strValues += acValue;
+    }
+    if (!setParameter(this, strValues)) {
+
+        strError = "no parameter in the stub";
+        return false;
+    }
+    return true;
+}
+
+bool CParameterHandle::setAsDouble(double dValue, string& strError)
+{
+    char acValue[32];
+
+    snprintf(acValue, sizeof(acValue), "%f", dValue);
+    if (!setParameter(this, acValue)) {
+
+        strError = "no parameter in the stub";
+        return false;
+    }
+    return true;
+}
+
+bool CParameterHandle::getAsString(string& strValue, string& strError) const
+{
+    if (!getParameter(this, strValue)) {
+
+        strError = "no parameter in the stub";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+/*
+ * Control of the parameter framework stub, given to the test harness.
+ */
+
+/**
+ * Makes the connectors started from now on fail with the given error once the delay elapsed,
+ * as a broken configuration does on target. An empty error restores successful starts.
+ */
+void parameter_mgr_stub_set_start_error(const std::string& strError, uint32_t uiDelayMs);
+
+/** Delays each application of the configurations, as slow hardware accesses do. */
+void parameter_mgr_stub_set_apply_delay(uint32_t uiDelayMs);
+
+/** Adds a parameter, or sets its value, for the HAL to open a handle on it. */
+void parameter_mgr_stub_add_parameter(const std::string& strPath, const std::string& strValue);
+
+/**
+ * Reads the value of a parameter, as the HAL last set it.
+ *
+ * @return false if the parameter does not exist.
+ */
+bool parameter_mgr_stub_get_parameter(const std::string& strPath, std::string& strValue);
+
+/** Removes the parameters and restores immediate and successful starts and applications. */
+void parameter_mgr_stub_reset();
@@ -113,7 +113,16 @@ int AudioUtils::getCardIndexByName(const char *name)
 
     ssize_t written;
 
-    snprintf(id_filepath, sizeof(id_filepath), "/proc/asound/%s", name);
+    const char *soundCardsDir = "/proc/asound";
+#ifndef HAVE_ANDROID_OS
+    // Host builds run against a fake tinyalsa backend, which gives its own sound cards
+    const char *fakeSoundCardsDir = getenv("AUDIOCOMMS_ASOUND_DIR");
+    if (fakeSoundCardsDir != NULL) {
+
+        soundCardsDir = fakeSoundCardsDir;
+    }
+#endif
+    snprintf(id_filepath, sizeof(id_filepath), "%s/%s", soundCardsDir, name);
 
     written = readlink(id_filepath, number_filepath, sizeof(number_filepath));
     if (written < 0) {
@@ -0,0 +1,51 @@
+#
+# INTEL CONFIDENTIAL
+# Copyright © 2013 Intel
+# Corporation All Rights Reserved.
+#
+# The source code contained or described herein and all documents related to
+# the source code ("Material") are owned by Intel Corporation or its suppliers
+# or licensors. Title to the Material remains with Intel Corporation or its
+# suppliers and licensors. The Material contains trade secrets and proprietary
+# and confidential information of Intel or its suppliers and licensors. The
+# Material is protected by worldwide copyright and trade secret laws and
+# treaty provisions. No part of the Material may be used, copied, reproduced,
+# modified, published, uploaded, posted, transmitted, distributed, or
+# disclosed in any way without Intel’s prior express written permission.
+#
+# No license under any patent, copyright, trade secret or other intellectual
+# property right is granted to or conferred upon you by disclosure or delivery
+# of the Materials, either expressly, by implication, inducement, estoppel or
+# otherwise. Any license under such intellectual property rights must be
+# express and approved by Intel in writing.
+#
+
+ifeq ($(BOARD_USES_ALSA_AUDIO),true)
+
+LOCAL_PATH := $(call my-dir)
+
+#######################################################################
+# Fake tinyalsa backend, linked instead of libtinyalsa by the host tests
+
+ifneq ($(filter true, $(audiocomms_test_host) $(audiocomms_test_gcov_host)),)
+
+include $(CLEAR_VARS)
+
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/include
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/include \
+    external/tinyalsa/include \
+    bionic/libc/kernel/common
+
+LOCAL_SRC_FILES := TinyAlsaFake.cpp
+LOCAL_CFLAGS := -Wall -Werror
+
+LOCAL_MODULE := libtinyalsa_fake_host
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+endif
+
+endif #ifeq ($(BOARD_USES_ALSA_AUDIO),true)
@@ -0,0 +1,890 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#define LOG_TAG "TinyAlsaFake"
+
+#include "TinyAlsaFake.h"
+#include <tinyalsa/asoundlib.h>
+#include <utils/Log.h>
+#include <utils/threads.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using android::Mutex;
+using std::deque;
+using std::map;
+using std::min;
+using std::set;
+using std::string;
+using std::vector;
+
+/** Environment variable giving AudioUtils the directory of the sound cards on host. */
+static const char *const ASOUND_DIR_ENV_NAME = "AUDIOCOMMS_ASOUND_DIR";
+
+static const uint64_t NSECS_PER_SEC = 1000000000;
+static const uint64_t NSECS_PER_MSEC = 1000000;
+
+/** Deadline of the waits without timeout. */
+static const uint64_t NO_DEADLINE = ~static_cast<uint64_t>(0);
+
+static const size_t PCM_ERROR_MAX = 128;
+
+struct pcm {
+
+    unsigned int card;
+    unsigned int device;
+    unsigned int flags;
+    struct pcm_config config;
+    unsigned int buffer_size;           /**< in frames. */
+    bool ready;
+    bool running;
+    bool xrun;
+    uint64_t hw_ptr;                    /**< frames transferred by the DMA. */
+    uint64_t appl_ptr;                  /**< frames written or read by the client. */
+    uint64_t start_time;                /**< time the DMA started. */
+    uint64_t start_hw_ptr;              /**< position the DMA started from. */
+    FILE *file;
+    bool looped;                        /**< played to, or captured from, a loopback. */
+    vector<char> dma_buffer;            /**< frames written, kept until played to a loopback. */
+    struct tinyalsa_fake_stats *stats;
+    Mutex lock;
+    char error[PCM_ERROR_MAX];
+};
+
+namespace android_audio_legacy
+{
+
+/**
+ * State shared by the pcm devices: cards registered, data directory and metrics.
+ */
+class CTinyAlsaFake
+{
+public:
+    static CTinyAlsaFake &getInstance()
+    {
+        static CTinyAlsaFake instance;
+        return instance;
+    }
+
+    int addCard(const char *pcName, unsigned int uiCard)
+    {
+        Mutex::Autolock lock(_lock);
+
+        if (_strAsoundDir.empty()) {
+
+            char acDir[] = "/tmp/tinyalsa_fake.XXXXXX";
+            if (mkdtemp(acDir) == NULL) {
+
+                return -errno;
+            }
+            _strAsoundDir = acDir;
+            setenv(ASOUND_DIR_ENV_NAME, acDir, 1);
+        }
+        // Same layout as /proc/asound: <name> -> card<index>
+        char acLinkPath[PATH_MAX];
+        char acTarget[16];
+        snprintf(acLinkPath, sizeof(acLinkPath), "%s/%s", _strAsoundDir.c_str(), pcName);
+        snprintf(acTarget, sizeof(acTarget), "card%u", uiCard);
+        unlink(acLinkPath);
+        if (symlink(acTarget, acLinkPath) != 0) {
+
+            return -errno;
+        }
+        _cards.insert(uiCard);
+        _bCardsRegistered = true;
+        return 0;
+    }
+
+    int removeCard(const char *pcName)
+    {
+        Mutex::Autolock lock(_lock);
+
+        char acLinkPath[PATH_MAX];
+        char acTarget[16];
+        snprintf(acLinkPath, sizeof(acLinkPath), "%s/%s", _strAsoundDir.c_str(), pcName);
+        ssize_t iTargetLength = readlink(acLinkPath, acTarget, sizeof(acTarget) - 1);
+        unsigned int uiCard;
+        if (iTargetLength < 0) {
+
+            return -errno;
+        }
+        acTarget[iTargetLength] = '\0';
+        if ((sscanf(acTarget, "card%u", &uiCard) != 1) || (unlink(acLinkPath) != 0)) {
+
+            return -EINVAL;
+        }
+        _cards.erase(uiCard);
+        return 0;
+    }
+
+    bool hasCard(unsigned int uiCard)
+    {
+        Mutex::Autolock lock(_lock);
+
+        return !_bCardsRegistered || (_cards.find(uiCard) != _cards.end());
+    }
+
+    void setDataDir(const char *pcDir)
+    {
+        Mutex::Autolock lock(_lock);
+
+        _strDataDir = pcDir ? pcDir : "";
+    }
+
+    int setLoopback(unsigned int uiCard, unsigned int uiPlaybackDevice,
+                    unsigned int uiCaptureDevice)
+    {
+        Mutex::Autolock lock(_lock);
+
+        _loopbacks[getDeviceKey(uiCard, uiPlaybackDevice, false)] =
+                getDeviceKey(uiCard, uiCaptureDevice, true);
+        return 0;
+    }
+
+    /** Whether frames played by, or captured by, a device go through a loopback. */
+    bool isLooped(unsigned int uiCard, unsigned int uiDevice, bool bIsIn)
+    {
+        Mutex::Autolock lock(_lock);
+
+        uint64_t key = getDeviceKey(uiCard, uiDevice, bIsIn);
+        if (!bIsIn) {
+
+            return _loopbacks.find(key) != _loopbacks.end();
+        }
+        map<uint64_t, uint64_t>::const_iterator it;
+        for (it = _loopbacks.begin(); it != _loopbacks.end(); ++it) {
+
+            if (it->second == key) {
+
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Frames played while the capture device of the loopback is closed are lost, as they would
+     * be on a wire.
+     */
+    void openLoopbackCapture(unsigned int uiCard, unsigned int uiDevice)
+    {
+        Mutex::Autolock lock(_lock);
+
+        _loopbackFrames[getDeviceKey(uiCard, uiDevice, true)].clear();
+    }
+
+    void closeLoopbackCapture(unsigned int uiCard, unsigned int uiDevice)
+    {
+        Mutex::Autolock lock(_lock);
+
+        _loopbackFrames.erase(getDeviceKey(uiCard, uiDevice, true));
+    }
+
+    void playToLoopback(unsigned int uiCard, unsigned int uiDevice, const char *pcData,
+                        size_t bytes)
+    {
+        Mutex::Autolock lock(_lock);
+
+        map<uint64_t, uint64_t>::const_iterator it =
+                _loopbacks.find(getDeviceKey(uiCard, uiDevice, false));
+        if (it == _loopbacks.end()) {
+
+            return;
+        }
+        map<uint64_t, deque<char> >::iterator itFrames = _loopbackFrames.find(it->second);
+        if (itFrames == _loopbackFrames.end()) {
+
+            return;
+        }
+        if (pcData == NULL) {
+
+            itFrames->second.insert(itFrames->second.end(), bytes, 0);
+            return;
+        }
+        itFrames->second.insert(itFrames->second.end(), pcData, pcData + bytes);
+    }
+
+    /** @return bytes captured, the frames played so far. */
+    size_t captureFromLoopback(unsigned int uiCard, unsigned int uiDevice, char *pcData,
+                               size_t bytes)
+    {
+        Mutex::Autolock lock(_lock);
+
+        map<uint64_t, deque<char> >::iterator itFrames =
+                _loopbackFrames.find(getDeviceKey(uiCard, uiDevice, true));
+        if (itFrames == _loopbackFrames.end()) {
+
+            return 0;
+        }
+        bytes = min(bytes, itFrames->second.size());
+        std::copy(itFrames->second.begin(), itFrames->second.begin() + bytes, pcData);
+        itFrames->second.erase(itFrames->second.begin(), itFrames->second.begin() + bytes);
+        return bytes;
+    }
+
+    FILE *openDataFile(unsigned int uiCard, unsigned int uiDevice, bool bIsIn)
+    {
+        Mutex::Autolock lock(_lock);
+
+        if (_strDataDir.empty()) {
+
+            return NULL;
+        }
+        char acPath[PATH_MAX];
+        snprintf(acPath, sizeof(acPath), "%s/pcmC%uD%u%c.raw", _strDataDir.c_str(), uiCard,
+                 uiDevice, bIsIn ? 'c' : 'p');
+
+        // Frames played by successive openings are kept
+        return fopen(acPath, bIsIn ? "rb" : "ab");
+    }
+
+    void setOpenTime(unsigned int uiOpenTimeUs)
+    {
+        Mutex::Autolock lock(_lock);
+
+        _uiOpenTimeUs = uiOpenTimeUs;
+    }
+
+    unsigned int getOpenTime()
+    {
+        Mutex::Autolock lock(_lock);
+
+        return _uiOpenTimeUs;
+    }
+
+    /** Metrics are kept after the device is closed, never freed until reset. */
+    struct tinyalsa_fake_stats *getStats(unsigned int uiCard, unsigned int uiDevice, bool bIsIn)
+    {
+        Mutex::Autolock lock(_lock);
+
+        return &_stats[getDeviceKey(uiCard, uiDevice, bIsIn)];
+    }
+
+    void copyStats(unsigned int uiCard, unsigned int uiDevice, bool bIsIn,
+                   struct tinyalsa_fake_stats *pStats)
+    {
+        Mutex::Autolock lock(_lock);
+
+        map<uint64_t, struct tinyalsa_fake_stats>::const_iterator it =
+                _stats.find(getDeviceKey(uiCard, uiDevice, bIsIn));
+        if (it == _stats.end()) {
+
+            memset(pStats, 0, sizeof(*pStats));
+            return;
+        }
+        *pStats = it->second;
+    }
+
+    void reset()
+    {
+        Mutex::Autolock lock(_lock);
+
+        _cards.clear();
+        _bCardsRegistered = false;
+        _strDataDir.clear();
+        _loopbacks.clear();
+        _uiOpenTimeUs = 0;
+        map<uint64_t, struct tinyalsa_fake_stats>::iterator it;
+        for (it = _stats.begin(); it != _stats.end(); ++it) {
+
+            // Opened devices keep on pointing to their metrics
+            memset(&it->second, 0, sizeof(it->second));
+        }
+    }
+
+private:
+    CTinyAlsaFake() : _bCardsRegistered(false), _uiOpenTimeUs(0) {}
+
+    static uint64_t getDeviceKey(unsigned int uiCard, unsigned int uiDevice, bool bIsIn)
+    {
+        return (static_cast<uint64_t>(uiCard) << 32) | (uiDevice << 1) | bIsIn;
+    }
+
+    set<unsigned int> _cards;
+    bool _bCardsRegistered;                         /**< only registered cards are opened. */
+    string _strAsoundDir;
+    string _strDataDir;
+    map<uint64_t, struct tinyalsa_fake_stats> _stats;
+    map<uint64_t, uint64_t> _loopbacks;             /**< capture device of playback devices. */
+    map<uint64_t, deque<char> > _loopbackFrames;    /**< frames played, per capture device. */
+    unsigned int _uiOpenTimeUs;                     /**< time a successful opening takes. */
+    Mutex _lock;
+};
+
+}       // namespace android
+
+using android_audio_legacy::CTinyAlsaFake;
+
+static uint64_t getTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * NSECS_PER_SEC + ts.tv_nsec;
+}
+
+static uint64_t framesToNs(const struct pcm *pcm, uint64_t frames)
+{
+    return frames * NSECS_PER_SEC / pcm->config.rate;
+}
+
+static int oops(struct pcm *pcm, int e, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(pcm->error, PCM_ERROR_MAX, fmt, ap);
+    va_end(ap);
+    if (e) {
+
+        size_t sz = strlen(pcm->error);
+        snprintf(pcm->error + sz, PCM_ERROR_MAX - sz, ": %s", strerror(e));
+    }
+    return -1;
+}
+
+static bool isIn(const struct pcm *pcm)
+{
+    return pcm->flags & PCM_IN;
+}
+
+/**
+ * Frames the client can write (playback) or read (capture) without blocking.
+ */
+static uint64_t getAvail(const struct pcm *pcm)
+{
+    return isIn(pcm) ? pcm->hw_ptr - pcm->appl_ptr :
+                       pcm->buffer_size - (pcm->appl_ptr - pcm->hw_ptr);
+}
+
+static void startDma(struct pcm *pcm)
+{
+    pcm->running = true;
+    pcm->start_time = getTimeNs();
+    pcm->start_hw_ptr = pcm->hw_ptr;
+}
+
+/**
+ * Sends the frames the DMA played to the loopback, silence for the frames never written.
+ * Must be called with the pcm lock held.
+ */
+static void playToLoopback(struct pcm *pcm, uint64_t from, uint64_t to)
+{
+    for (uint64_t frame = from; frame < to; ) {
+
+        unsigned int offset = frame % pcm->buffer_size;
+        unsigned int frames = min<uint64_t>(to - frame, pcm->buffer_size - offset);
+
+        // Frames beyond the client position, or overwritten since, were not played
+        bool written = (frame < pcm->appl_ptr) && (frame + pcm->buffer_size >= pcm->appl_ptr);
+        if (written) {
+
+            frames = min<uint64_t>(frames, pcm->appl_ptr - frame);
+        } else if (frame < pcm->appl_ptr) {
+
+            frames = min<uint64_t>(frames, pcm->appl_ptr - pcm->buffer_size - frame);
+        }
+        CTinyAlsaFake::getInstance().playToLoopback(
+                    pcm->card, pcm->device,
+                    written ? &pcm->dma_buffer[pcm_frames_to_bytes(pcm, offset)] : NULL,
+                    pcm_frames_to_bytes(pcm, frames));
+        frame += frames;
+    }
+}
+
+/**
+ * Moves the DMA position to the last period transferred, and detects the xruns.
+ * Must be called with the pcm lock held.
+ */
+static void updateDma(struct pcm *pcm)
+{
+    if (!pcm->running) {
+
+        return;
+    }
+    uint64_t elapsedFrames = (getTimeNs() - pcm->start_time) * pcm->config.rate / NSECS_PER_SEC;
+
+    // DMA interrupts once per period
+    elapsedFrames -= elapsedFrames % pcm->config.period_size;
+    if (pcm->looped && !isIn(pcm)) {
+
+        playToLoopback(pcm, pcm->hw_ptr, pcm->start_hw_ptr + elapsedFrames);
+    }
+    pcm->hw_ptr = pcm->start_hw_ptr + elapsedFrames;
+
+    // Avail may exceed the buffer size, frames being then lost or silence played
+    uint64_t avail = isIn(pcm) ? pcm->hw_ptr - pcm->appl_ptr :
+                                 pcm->buffer_size + pcm->hw_ptr - pcm->appl_ptr;
+    if (avail >= pcm->config.stop_threshold) {
+
+        ALOGV("%s: %s on (%u,%u)", __FUNCTION__, isIn(pcm) ? "overrun" : "underrun", pcm->card,
+              pcm->device);
+        pcm->stats->xruns++;
+        pcm->running = false;
+        pcm->xrun = true;
+        return;
+    }
+    if (avail <= pcm->buffer_size) {
+
+        return;
+    }
+    pcm->stats->xruns++;
+
+    // Device does not stop: client resumes from the current DMA position
+    pcm->appl_ptr = isIn(pcm) ? pcm->hw_ptr - pcm->buffer_size : pcm->hw_ptr;
+}
+
+/**
+ * Sleeps until the DMA transferred some frames, or until the deadline.
+ * Must be called with the pcm lock held, released while sleeping.
+ */
+static void waitDma(struct pcm *pcm, uint64_t frames, uint64_t deadline = NO_DEADLINE)
+{
+    uint64_t now = getTimeNs();
+    uint64_t nextPeriodTime = pcm->start_time +
+            framesToNs(pcm, pcm->hw_ptr - pcm->start_hw_ptr +
+                       min<uint64_t>(frames, pcm->config.period_size));
+    nextPeriodTime = min(nextPeriodTime, deadline);
+    if (nextPeriodTime > now) {
+
+        struct timespec ts;
+        ts.tv_sec = (nextPeriodTime - now) / NSECS_PER_SEC;
+        ts.tv_nsec = (nextPeriodTime - now) % NSECS_PER_SEC;
+
+        pcm->lock.unlock();
+        nanosleep(&ts, NULL);
+        pcm->lock.lock();
+    }
+    pcm->stats->wait_time_ns += getTimeNs() - now;
+}
+
+/**
+ * Recovers from an xrun as tinyalsa does, unless asked not to.
+ * Must be called with the pcm lock held.
+ *
+ * @return 0 if recovered, -1 otherwise.
+ */
+static int recoverXrun(struct pcm *pcm)
+{
+    pcm->xrun = false;
+    if (pcm->flags & PCM_NORESTART) {
+
+        return oops(pcm, EPIPE, "cannot %s stream data", isIn(pcm) ? "read" : "write");
+    }
+    pcm->hw_ptr = pcm->appl_ptr = 0;
+    return 0;
+}
+
+static void playData(struct pcm *pcm, const char *data, unsigned int frames)
+{
+    if (pcm->looped) {
+
+        // Played by the DMA later on, from the position of the client in the buffer
+        unsigned int offset = pcm->appl_ptr % pcm->buffer_size;
+        unsigned int first = min(frames, pcm->buffer_size - offset);
+
+        memcpy(&pcm->dma_buffer[pcm_frames_to_bytes(pcm, offset)], data,
+               pcm_frames_to_bytes(pcm, first));
+        memcpy(&pcm->dma_buffer[0], data + pcm_frames_to_bytes(pcm, first),
+               pcm_frames_to_bytes(pcm, frames - first));
+    }
+    if (pcm->file != NULL) {
+
+        fwrite(data, 1, pcm_frames_to_bytes(pcm, frames), pcm->file);
+    }
+}
+
+static void captureData(struct pcm *pcm, char *data, unsigned int frames)
+{
+    unsigned int bytes = pcm_frames_to_bytes(pcm, frames);
+    size_t read = 0;
+    if (pcm->looped) {
+
+        // Frames not played yet are silent
+        read = CTinyAlsaFake::getInstance().captureFromLoopback(pcm->card, pcm->device, data,
+                                                                 bytes);
+    } else if (pcm->file != NULL) {
+
+        read = fread(data, 1, bytes, pcm->file);
+        if (read < bytes) {
+
+            // Capture loops on the file
+            rewind(pcm->file);
+            read += fread(data + read, 1, bytes - read, pcm->file);
+        }
+    }
+    memset(data + read, 0, bytes - read);
+}
+
+struct pcm *pcm_open(unsigned int card, unsigned int device, unsigned int flags,
+                     struct pcm_config *config)
+{
+    struct pcm *pcm = new struct pcm;
+
+    pcm->card = card;
+    pcm->device = device;
+    pcm->flags = flags;
+    pcm->ready = false;
+    pcm->running = false;
+    pcm->xrun = false;
+    pcm->hw_ptr = 0;
+    pcm->appl_ptr = 0;
+    pcm->start_time = 0;
+    pcm->start_hw_ptr = 0;
+    pcm->file = NULL;
+    pcm->looped = false;
+    pcm->error[0] = '\0';
+    pcm->stats = CTinyAlsaFake::getInstance().getStats(card, device, flags & PCM_IN);
+
+    if (config == NULL) {
+
+        oops(pcm, EINVAL, "no config");
+        return pcm;
+    }
+    pcm->config = *config;
+    pcm->buffer_size = config->period_size * config->period_count;
+
+    if (!CTinyAlsaFake::getInstance().hasCard(card)) {
+
+        oops(pcm, ENODEV, "cannot open device (%u,%u)", card, device);
+        return pcm;
+    }
+    if ((config->rate == 0) || (config->channels == 0) || (pcm->buffer_size == 0)) {
+
+        oops(pcm, EINVAL, "cannot set hw params");
+        return pcm;
+    }
+
+    // Same default thresholds as tinyalsa
+    if (!config->start_threshold) {
+
+        pcm->config.start_threshold = (flags & PCM_IN) ? 1 : pcm->buffer_size / 2;
+    }
+    if (!config->stop_threshold) {
+
+        pcm->config.stop_threshold = (flags & PCM_IN) ? pcm->buffer_size * 10 :
+                                                        pcm->buffer_size;
+    }
+
+    // Setting the hardware parameters is what makes the opening of a real device slow
+    unsigned int openTimeUs = CTinyAlsaFake::getInstance().getOpenTime();
+    if (openTimeUs != 0) {
+
+        usleep(openTimeUs);
+    }
+
+    pcm->file = CTinyAlsaFake::getInstance().openDataFile(card, device, flags & PCM_IN);
+    pcm->looped = CTinyAlsaFake::getInstance().isLooped(card, device, flags & PCM_IN);
+    if (pcm->looped) {
+
+        if (flags & PCM_IN) {
+
+            CTinyAlsaFake::getInstance().openLoopbackCapture(card, device);
+        } else {
+
+            pcm->dma_buffer.resize(pcm_frames_to_bytes(pcm, pcm->buffer_size));
+        }
+    }
+    pcm->stats->opens++;
+    pcm->ready = true;
+    return pcm;
+}
+
+int pcm_close(struct pcm *pcm)
+{
+    if (pcm->file != NULL) {
+
+        fclose(pcm->file);
+    }
+    if (pcm->looped && isIn(pcm)) {
+
+        CTinyAlsaFake::getInstance().closeLoopbackCapture(pcm->card, pcm->device);
+    }
+    delete pcm;
+    return 0;
+}
+
+int pcm_is_ready(struct pcm *pcm)
+{
+    return pcm->ready;
+}
+
+const char *pcm_get_error(struct pcm *pcm)
+{
+    return pcm->error;
+}
+
+unsigned int pcm_get_buffer_size(struct pcm *pcm)
+{
+    return pcm->buffer_size;
+}
+
+unsigned int pcm_format_to_bits(enum pcm_format format)
+{
+    switch (format) {
+    case PCM_FORMAT_S32_LE:
+    case PCM_FORMAT_S24_LE:
+        return 32;
+    case PCM_FORMAT_S8:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+unsigned int pcm_frames_to_bytes(struct pcm *pcm, unsigned int frames)
+{
+    return frames * pcm->config.channels * (pcm_format_to_bits(pcm->config.format) >> 3);
+}
+
+unsigned int pcm_bytes_to_frames(struct pcm *pcm, unsigned int bytes)
+{
+    return bytes / (pcm->config.channels * (pcm_format_to_bits(pcm->config.format) >> 3));
+}
+
+int pcm_prepare(struct pcm *pcm)
+{
+    if (!pcm->ready) {
+
+        return oops(pcm, EBADFD, "cannot prepare channel");
+    }
+    Mutex::Autolock lock(pcm->lock);
+
+    pcm->running = false;
+    pcm->xrun = false;
+    pcm->hw_ptr = pcm->appl_ptr = 0;
+    return 0;
+}
+
+int pcm_start(struct pcm *pcm)
+{
+    if (!pcm->ready) {
+
+        return oops(pcm, EBADFD, "cannot start channel");
+    }
+    Mutex::Autolock lock(pcm->lock);
+
+    if (!pcm->running) {
+
+        startDma(pcm);
+    }
+    return 0;
+}
+
+int pcm_stop(struct pcm *pcm)
+{
+    if (!pcm->ready) {
+
+        return oops(pcm, EBADFD, "cannot stop channel");
+    }
+    Mutex::Autolock lock(pcm->lock);
+
+    // Frames pending are dropped
+    pcm->running = false;
+    pcm->xrun = false;
+    pcm->hw_ptr = pcm->appl_ptr = 0;
+    return 0;
+}
+
+int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail, struct timespec *tstamp)
+{
+    if (!pcm->ready) {
+
+        return -1;
+    }
+    Mutex::Autolock lock(pcm->lock);
+
+    updateDma(pcm);
+    if (!pcm->running) {
+
+        return -1;
+    }
+    *avail = getAvail(pcm);
+
+    // Time of the interrupt of the last period transferred
+    uint64_t periodTime = pcm->start_time + framesToNs(pcm, pcm->hw_ptr - pcm->start_hw_ptr);
+    tstamp->tv_sec = periodTime / NSECS_PER_SEC;
+    tstamp->tv_nsec = periodTime % NSECS_PER_SEC;
+    return 0;
+}
+
+int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
+{
+    if (isIn(pcm)) {
+
+        return -EINVAL;
+    }
+    if (!pcm->ready) {
+
+        return oops(pcm, EBADFD, "cannot write stream data");
+    }
+    Mutex::Autolock lock(pcm->lock);
+
+    const char *pcData = static_cast<const char *>(data);
+    unsigned int frames = pcm_bytes_to_frames(pcm, count);
+    pcm->stats->frames += frames;
+
+    while (frames) {
+
+        updateDma(pcm);
+        if (pcm->xrun && (recoverXrun(pcm) != 0)) {
+
+            return -EPIPE;
+        }
+        uint64_t avail = getAvail(pcm);
+        if (avail == 0) {
+
+            if (!pcm->running) {
+
+                // Buffer full below the start threshold
+                startDma(pcm);
+            }
+            waitDma(pcm, frames);
+            continue;
+        }
+        unsigned int chunk = min<uint64_t>(frames, avail);
+        playData(pcm, pcData, chunk);
+        pcm->appl_ptr += chunk;
+        pcData += pcm_frames_to_bytes(pcm, chunk);
+        frames -= chunk;
+
+        if (!pcm->running && (pcm->appl_ptr - pcm->hw_ptr >= pcm->config.start_threshold)) {
+
+            startDma(pcm);
+        }
+    }
+    return 0;
+}
+
+int pcm_read(struct pcm *pcm, void *data, unsigned int count)
+{
+    if (!isIn(pcm)) {
+
+        return -EINVAL;
+    }
+    if (!pcm->ready) {
+
+        return oops(pcm, EBADFD, "cannot read stream data");
+    }
+    Mutex::Autolock lock(pcm->lock);
+
+    char *pcData = static_cast<char *>(data);
+    unsigned int frames = pcm_bytes_to_frames(pcm, count);
+    pcm->stats->frames += frames;
+
+    while (frames) {
+
+        if (!pcm->running) {
+
+            startDma(pcm);
+        }
+        updateDma(pcm);
+        if (pcm->xrun) {
+
+            if (recoverXrun(pcm) != 0) {
+
+                return -EPIPE;
+            }
+            continue;
+        }
+        uint64_t avail = getAvail(pcm);
+        if (avail == 0) {
+
+            waitDma(pcm, frames);
+            continue;
+        }
+        unsigned int chunk = min<uint64_t>(frames, avail);
+        captureData(pcm, pcData, chunk);
+        pcm->appl_ptr += chunk;
+        pcData += pcm_frames_to_bytes(pcm, chunk);
+        frames -= chunk;
+    }
+    return 0;
+}
+
+int pcm_wait(struct pcm *pcm, int timeout)
+{
+    if (!pcm->ready) {
+
+        return -1;
+    }
+    Mutex::Autolock lock(pcm->lock);
+
+    uint64_t availMin = pcm->config.avail_min > 0 ? pcm->config.avail_min : 1;
+    // Negative timeout waits forever, as poll does
+    uint64_t deadline = timeout >= 0 ? getTimeNs() + timeout * NSECS_PER_MSEC : NO_DEADLINE;
+
+    while (true) {
+
+        updateDma(pcm);
+        if (!pcm->running || (getAvail(pcm) >= availMin)) {
+
+            return 1;
+        }
+        if (getTimeNs() >= deadline) {
+
+            return 0;
+        }
+        waitDma(pcm, availMin, deadline);
+    }
+}
+
+int tinyalsa_fake_add_card(const char *name, unsigned int card)
+{
+    return CTinyAlsaFake::getInstance().addCard(name, card);
+}
+
+int tinyalsa_fake_remove_card(const char *name)
+{
+    return CTinyAlsaFake::getInstance().removeCard(name);
+}
+
+int tinyalsa_fake_set_loopback(unsigned int card, unsigned int playback_device,
+                               unsigned int capture_device)
+{
+    return CTinyAlsaFake::getInstance().setLoopback(card, playback_device, capture_device);
+}
+
+void tinyalsa_fake_set_data_dir(const char *dir)
+{
+    CTinyAlsaFake::getInstance().setDataDir(dir);
+}
+
+void tinyalsa_fake_set_open_time(unsigned int us)
+{
+    CTinyAlsaFake::getInstance().setOpenTime(us);
+}
+
+void tinyalsa_fake_get_stats(unsigned int card, unsigned int device, unsigned int flags,
+                             struct tinyalsa_fake_stats *stats)
+{
+    CTinyAlsaFake::getInstance().copyStats(card, device, flags & PCM_IN, stats);
+}
+
+void tinyalsa_fake_reset(void)
+{
+    CTinyAlsaFake::getInstance().reset();
+}
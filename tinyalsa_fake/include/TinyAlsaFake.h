@@ -0,0 +1,119 @@
+/*
+ ** Copyright 2013 Intel Corporation
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **      http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#pragma once
+
+/**
+ * Fake tinyalsa backend, linked instead of libtinyalsa by the host builds of the HAL, to run it
+ * end to end on a build server.
+ *
+ * It implements the pcm API of tinyalsa on top of a simulated DMA: once started, a device
+ * transfers a period of frames each period time of its configuration, from the monotonic clock.
+ * Writes and reads block as the real devices do, underruns and overruns happen when the client
+ * does not keep up, and pcm_get_htimestamp reports the position and time of the last period
+ * transferred. Frames played are appended to, and frames captured are read in loop from, the
+ * files of a data directory, or discarded and silent if none is set.
+ *
+ * This header gives control of the backend to the test harness.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Metrics of a pcm device, since its first opening or the last reset. */
+struct tinyalsa_fake_stats {
+
+    unsigned int opens;
+    unsigned int xruns;         /**< underruns or overruns. */
+    uint64_t frames;            /**< frames written or read. */
+    uint64_t wait_time_ns;      /**< time writes and reads blocked, waiting for the DMA. */
+};
+
+/**
+ * Registers a sound card, so that AudioUtils::getCardIndexByName finds it.
+ * Once a card is registered, only the devices of the registered cards can be opened.
+ *
+ * @param[in] name name of the card.
+ * @param[in] card index of the card.
+ *
+ * @return 0 if successful, negative errno otherwise.
+ */
+int tinyalsa_fake_add_card(const char *name, unsigned int card);
+
+/**
+ * Unregisters a sound card, as a reset of the audio firmware does until the card is registered
+ * again: AudioUtils::getCardIndexByName no longer finds it and its devices cannot be opened.
+ *
+ * @param[in] name name of the card.
+ *
+ * @return 0 if successful, negative errno otherwise.
+ */
+int tinyalsa_fake_remove_card(const char *name);
+
+/**
+ * Loops a playback device back on a capture device of the same card, to measure round trip
+ * latencies: frames are captured once the DMA of the playback device played them, and silence
+ * is captured in between. The devices must use the same frame size. Applies to the devices
+ * opened afterwards, instead of their data files.
+ *
+ * @param[in] card index of the card.
+ * @param[in] playback_device index of the playback device.
+ * @param[in] capture_device index of the capture device.
+ *
+ * @return 0 if successful, negative errno otherwise.
+ */
+int tinyalsa_fake_set_loopback(unsigned int card, unsigned int playback_device,
+                               unsigned int capture_device);
+
+/**
+ * Sets the directory of the data files: pcmC<card>D<device>p.raw for the frames played,
+ * pcmC<card>D<device>c.raw for the frames captured. Applies to the devices opened afterwards.
+ *
+ * @param[in] dir directory, NULL to discard the frames played and capture silence.
+ */
+void tinyalsa_fake_set_data_dir(const char *dir);
+
+/**
+ * Sets the time a successful opening of a device takes, as the setting of the hardware
+ * parameters of a real device does. Applies to the devices opened afterwards.
+ *
+ * @param[in] us time of an opening, in microseconds, 0 for none.
+ */
+void tinyalsa_fake_set_open_time(unsigned int us);
+
+/**
+ * Gets the metrics of a pcm device.
+ *
+ * @param[in] card index of the card.
+ * @param[in] device index of the device.
+ * @param[in] flags PCM_IN for a capture device, PCM_OUT otherwise.
+ * @param[out] stats metrics, zeroed if the device was never opened.
+ */
+void tinyalsa_fake_get_stats(unsigned int card, unsigned int device, unsigned int flags,
+                             struct tinyalsa_fake_stats *stats);
+
+/**
+ * Forgets the cards registered, the data directory, the loopbacks, the open time and the
+ * metrics.
+ */
+void tinyalsa_fake_reset(void);
+
+#ifdef __cplusplus
+}
+#endif